@@ -0,0 +1,39 @@
+#include <iostream>
+
+#include "argparser.h"
+#include "utils.h"
+#include "nsdf_file.h"
+
+
+
+int main(int argc, const char** argv)
+{
+    ArgParser parser(argc, argv);
+
+    const std::string kind = parser.getOptionValue<std::string>("--kind");
+    const std::string input = parser.getOptionValue<std::string>("--input");
+    const std::string output = parser.getOptionValue<std::string>("--output");
+
+    if (kind == "samples") {
+        const auto [points, sdfs] = load_points(input);
+        const uint64_t n = sdfs.size();
+        if (points.size() != 3 * n)
+            throw std::runtime_error(input + " has " + std::to_string(points.size()) + \
+                " coordinates for " + std::to_string(n) + " sdf values");
+
+        std::vector<float> points_soa = transpose(points, n, 3);
+        save_nsdf_samples(output, points_soa.data(), sdfs.data(), n);
+        std::cout << "Converted " << n << " samples: " << input << " -> " << output << std::endl;
+    } else if (kind == "weights") {
+        const int n_hidden = parser.getOptionValue<int>("--n_hidden");
+        const int hidden_size = parser.getOptionValue<int>("--hidden_size");
+        const auto weights = load_weights(input, n_hidden, hidden_size);
+        save_nsdf_weights(output, weights, n_hidden, hidden_size);
+        std::cout << "Converted " << weights.size() << " weights: " << input << " -> " << \
+            output << std::endl;
+    } else {
+        throw std::runtime_error("Unknown --kind " + kind + ", expected samples or weights");
+    }
+
+    return 0;
+}
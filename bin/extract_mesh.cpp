@@ -0,0 +1,54 @@
+#include <iostream>
+
+#include "backend.h"
+#include "thread_pool.h"
+#include "argparser.h"
+#include "nsdf_file.h"
+#include "mesh_extractor.h"
+
+
+
+int main(int argc, const char** argv)
+{
+    ArgParser parser(argc, argv);
+
+    set_nn_backend(parser.getOptionValue<std::string>("--backend", "auto"));
+    std::cout << "NN backend: " << nn_backend().name << std::endl;
+
+    set_nn_threads(parser.getOptionValue<int>("--threads", 0));
+    std::cout << "NN threads: " << nn_threads() << std::endl;
+
+    const auto [n_hidden_layers, hidden_size, batch_size] = parser.get_network_setup();
+    const auto weights = load_weights(
+        parser.getOptionValue<std::string>("--weights"), n_hidden_layers, hidden_size);
+    const SirenModel model(n_hidden_layers, hidden_size, weights, batch_size);
+
+    MeshExtractionCfg cfg;
+    cfg.resolution = parser.getOptionValue<int>("--resolution", cfg.resolution);
+    cfg.adaptive = parser.getOptionValue<int>("--adaptive", cfg.adaptive) != 0;
+    cfg.block_size = parser.getOptionValue<int>("--block_size", cfg.block_size);
+    cfg.bounded = parser.getOptionValue<int>("--bounded", cfg.bounded) != 0;
+    cfg.batch_size = batch_size;
+
+    const std::string save_to = parser.getOptionValue<std::string>("--save_to");
+    auto writer = make_mesh_writer(save_to);
+
+    std::cout << "Extracting mesh with resolution: " << cfg.resolution << "^3, " << \
+        (cfg.adaptive ? "adaptive, block_size: " + std::to_string(cfg.block_size) + \
+            (cfg.bounded ? ", bounded" : "") : std::string("dense")) << \
+        ", batch_size: " << batch_size << std::endl;
+    const MeshStats stats = extract_mesh(model, cfg, *writer);
+
+    if (cfg.adaptive)
+        std::cout << "Blocks refined: " << stats.n_active_blocks << " of " << stats.n_blocks << \
+            ", max gradient at block corners " << stats.lipschitz << std::endl;
+    std::cout << "Network evaluated at " << stats.n_evaluated << " of " << stats.n_grid_points << \
+        " grid points in " << stats.eval_seconds << " sec, " << \
+        stats.n_evaluated / std::max(stats.eval_seconds, 1e-6f) << " points/sec" << std::endl;
+    std::cout << "Mesh: " << stats.n_vertices << " vertices, " << stats.n_triangles << " triangles, " << \
+        "elapsed = " << stats.total_seconds << " sec, " << \
+        stats.n_grid_points / std::max(stats.total_seconds, 1e-6f) << " grid points/sec" << std::endl;
+    std::cout << "Saved to: " << save_to << std::endl;
+
+    return 0;
+}
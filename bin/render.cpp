@@ -1,20 +1,95 @@
 #include <iostream>
 #include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
 
-#include "Image2d.h"
-
+#include "backend.h"
+#include "thread_pool.h"
 #include "argparser.h"
 #include "ray_marcher.h"
+#include "nsdf_file.h"
+#include "sdf_cache.h"
+#include "sdf_octree.h"
+#include "render_sink.h"
 
-#ifdef USE_VULKAN
-static const bool onGPU = true;
-#else
-static const bool onGPU = false;
-#endif
+static const int DEFAULT_RES = 512;
 
 
-static const int DEFAULT_RES = 512;
+// max and mean abs difference of two models' sdf over points stored as [N x 3]
+static void report_sdf_error(const SirenModel &model, const SirenModel &ref, const std::vector<float> &points)
+{
+    const uint32_t n = points.size() / 3;
+    const std::vector<float> batch = transpose(points, n, 3);
+    std::vector<float> sdf(n), ref_sdf(n);
+    model.forward(sdf.data(), batch.data(), n);
+    ref.forward(ref_sdf.data(), batch.data(), n);
+    double max_err = 0.0, sum_err = 0.0;
+    for (uint32_t i = 0; i < n; ++i) {
+        const double err = std::fabs(double(sdf[i]) - ref_sdf[i]);
+        max_err = std::max(max_err, err);
+        sum_err += err;
+    }
+    std::cout << "SDF error vs fp32 on " << n << " points: max = " << max_err << \
+        ", mean = " << sum_err / std::max(n, 1u) << std::endl;
+}
+
+
+// pixels that differ and mean abs difference of color channels, 0..255
+static void report_image_difference(const std::vector<uint> &image, const std::vector<uint> &ref)
+{
+    uint32_t n_different = 0;
+    double sum_diff = 0.0;
+    for (size_t i = 0; i < image.size(); ++i) {
+        n_different += image[i] != ref[i];
+        for (int shift = 0; shift < 24; shift += 8)
+            sum_diff += std::abs(int((image[i] >> shift) & 0xFF) - int((ref[i] >> shift) & 0xFF));
+    }
+    std::cout << "Image difference vs fp32: " << n_different << " of " << image.size() << \
+        " pixels differ, mean abs channel difference = " << sum_diff / (3.0 * image.size()) << std::endl;
+}
+
+
+
+static void report_march_stats(const MarchStats &stats)
+{
+    std::cout << "Steps per ray: mean " << float(stats.n_steps) / std::max<uint64_t>(stats.n_rays, 1) << \
+        ", octree skips " << stats.n_node_skips << ", histogram";
+    for (uint32_t bin = 0; bin < MarchStats::N_BINS; ++bin) {
+        const uint32_t from = bin == 0 ? 0 : 1u << (bin - 1);
+        std::cout << " [" << from << (bin == 0 ? "" : bin + 1 < MarchStats::N_BINS ? \
+            "-" + std::to_string((1u << bin) - 1) : "+") << "]: " << stats.step_histogram[bin];
+    }
+    std::cout << std::endl;
+}
+
+
+// all views in one batched render, view i is saved next to save_to with suffix _i
+static void render_views(const RayMarcher &ray_marcher, const std::vector<Camera> &cams, int resolution,
+    int chunk_rays, const std::string &save_to)
+{
+    std::cout << "Rendering " << cams.size() << " views with resolution: " << resolution << \
+        ", rays per chunk: " << chunk_rays << std::endl;
+    auto start = std::chrono::high_resolution_clock::now();
+    const auto images = ray_marcher.renderViews(cams, resolution, resolution, chunk_rays);
+    float renderTime = float(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::high_resolution_clock::now() - start).count()) / 1e6f;
+    std::cout << "Render done, elapsed = " << renderTime << " sec, " << cams.size() / renderTime << \
+        " frames/sec" << std::endl;
+    report_march_stats(ray_marcher.getMarchStats());
 
+    auto view_path = [&](size_t v) {
+        const size_t dot = save_to.find_last_of('.');
+        char suffix[16];
+        std::snprintf(suffix, sizeof(suffix), "_%03zu", v);
+        return dot == std::string::npos ? save_to + suffix : save_to.substr(0, dot) + suffix + save_to.substr(dot);
+    };
+    for (size_t v = 0; v < images.size(); ++v)
+        make_bmp_sink(view_path(v), resolution, resolution)->writeTile(
+            0, 0, resolution, resolution, images[v].data(), true);
+    std::cout << "Saved to: " << view_path(0) << " .. " << view_path(images.size() - 1) << std::endl;
+}
 
 
 int main(int argc, const char** argv)
@@ -23,29 +98,180 @@ int main(int argc, const char** argv)
 
     const int resolution = parser.getOptionValue<int>("--resolution", DEFAULT_RES);
 
-    Camera cam = load_cam(parser.getOptionValue<std::string>("--camera"));
+    // --cameras takes a comma separated list of camera files, --orbit turns the first camera
+    // into that many views around its target
+    std::vector<Camera> cams;
+    if (parser.hasOption("--cameras")) {
+        std::stringstream list(parser.getOptionValue<std::string>("--cameras"));
+        std::string path;
+        while (std::getline(list, path, ','))
+            if (!path.empty())
+                cams.push_back(load_cam(path));
+    } else {
+        cams.push_back(load_cam(parser.getOptionValue<std::string>("--camera")));
+    }
+    if (cams.empty())
+        throw std::runtime_error("--cameras doesn't list any camera");
+    if (parser.hasOption("--orbit")) {
+        const int n_views = parser.getOptionValue<int>("--orbit");
+        if (n_views < 1)
+            throw std::runtime_error("--orbit needs at least 1 view, got " + std::to_string(n_views));
+        cams = orbit_cameras(cams.at(0), n_views);
+    }
+    const Camera cam = cams.at(0);
     Light light = load_light(parser.getOptionValue<std::string>("--light"));
 
+    set_nn_backend(parser.getOptionValue<std::string>("--backend", "auto"));
+    std::cout << "NN backend: " << nn_backend().name << std::endl;
+
+    set_nn_threads(parser.getOptionValue<int>("--threads", 0));
+    std::cout << "NN threads: " << nn_threads() << std::endl;
+
     const auto [n_hidden_layers, hidden_size, batch_size] = parser.get_network_setup();
-    const auto weights = load_floats(parser.getOptionValue<std::string>("--weights"));
+    const auto weights = load_weights(
+        parser.getOptionValue<std::string>("--weights"), n_hidden_layers, hidden_size);
 
     const std::string save_to = parser.getOptionValue<std::string>("--save_to");
+    const RenderMode mode = render_mode_from_string(
+        parser.getOptionValue<std::string>("--render_mode", "tiled"));
+    const int tile_size = parser.getOptionValue<int>("--tile_size", 32);
+
+    auto model = std::make_shared<SirenModel>(n_hidden_layers, hidden_size, weights, batch_size);
+    const Precision precision = precision_from_string(
+        parser.getOptionValue<std::string>("--precision", "fp32"));
+    // the reference marches the fp32 model with the same settings; a baked cache
+    // holds one model's SDF, so it can't serve both
+    const bool compare_fp32 = parser.getOptionValue<int>("--compare_fp32", 0) != 0;
+    if (compare_fp32 && parser.hasOption("--sdf_cache"))
+        throw std::runtime_error("--compare_fp32 can't be used with --sdf_cache");
+    std::shared_ptr<const SirenModel> ref_model;
+    if (precision != Precision::FP32) {
+        ref_model = std::make_shared<const SirenModel>(n_hidden_layers, hidden_size, weights, batch_size);
+        // int8 activation scales are calibrated on these points, e.g. a test sample
+        std::vector<float> calibration;
+        if (parser.hasOption("--calibration"))
+            calibration = load_points(parser.getOptionValue<std::string>("--calibration")).first;
+        const uint32_t n_calibration = calibration.size() / 3;
+        const std::vector<float> calibration_batch = transpose(calibration, n_calibration, 3);
+        model->quantize(precision, calibration_batch.data(), n_calibration);
+        if (precision == Precision::INT8)
+            std::cout << "Precision: int8, weights " << model->getWeightsBytes() << \
+                " bytes instead of " << ref_model->getWeightsBytes() << std::endl;
+        else
+            std::cout << "Precision: " << precision_name(precision) << \
+                " rounding emulated in fp32, memory and speed are those of fp32" << std::endl;
+        if (n_calibration > 0)
+            report_sdf_error(*model, *ref_model, calibration);
+    }
+    if (model->isSpecialized() && precision == Precision::FP32)
+        std::cout << "Small batches use kernels specialized for " << n_hidden_layers << "x" << \
+            hidden_size << std::endl;
+
+    auto ray_marcher = RayMarcher(cam, light, model, mode, tile_size);
 
-    auto net = getSirenNetwork(n_hidden_layers, hidden_size, batch_size);
-    net->setWeights(weights);
-    net->CommitDeviceData();
+    // baked once and reused from the file afterwards
+    if (parser.hasOption("--sdf_cache")) {
+        const std::string cache_path = parser.getOptionValue<std::string>("--sdf_cache");
+        std::shared_ptr<const SdfCache> cache;
+        auto start = std::chrono::high_resolution_clock::now();
+        if (is_nsdf_file(cache_path)) {
+            cache = std::make_shared<const SdfCache>(cache_path, parser.hasOption("--verify"));
+            std::cout << "Sdf cache mapped from " << cache_path;
+        } else {
+            cache = std::make_shared<const SdfCache>(*model,
+                parser.getOptionValue<int>("--cache_bricks", 16), parser.getOptionValue<int>("--cache_brick_res", 8));
+            cache->save(cache_path);
+            std::cout << "Sdf cache baked and saved to " << cache_path;
+        }
+        float cacheTime = float(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::high_resolution_clock::now() - start).count()) / 1e6f;
+        const SdfCacheHeader &h = cache->getHeader();
+        std::cout << " in " << cacheTime << " sec: " << h.bricks_per_axis << "^3 bricks, " << \
+            h.n_fine << " of them with " << h.brick_res << "^3 cells, " << cache->getMemoryBytes() << \
+            " bytes, lipschitz bound " << cache->getLipschitz() << std::endl;
+        ray_marcher.setSdfCache(cache, parser.getOptionValue<float>("--cache_band", 0.02f));
+    }
 
-    auto ray_marcher = RayMarcher(cam, light, net);
+    MarchCfg march_cfg;
+    march_cfg.max_iterations = parser.getOptionValue<int>("--max_iterations", march_cfg.max_iterations);
+    march_cfg.min_dist = parser.getOptionValue<float>("--min_dist", march_cfg.min_dist);
+    march_cfg.max_dist = parser.getOptionValue<float>("--max_dist", march_cfg.max_dist);
+    march_cfg.hit_pixels = parser.getOptionValue<float>("--hit_pixels", march_cfg.hit_pixels);
+    march_cfg.relaxation = parser.getOptionValue<float>("--relaxation", march_cfg.relaxation);
+    march_cfg.refine_steps = parser.getOptionValue<int>("--refine_steps", march_cfg.refine_steps);
+    march_cfg.lipschitz = parser.getOptionValue<float>("--lipschitz", march_cfg.lipschitz);
+    ray_marcher.setMarchCfg(march_cfg);
+    std::cout << "Marching: relaxation " << march_cfg.relaxation << ", lipschitz " << march_cfg.lipschitz << \
+        ", hit at " << march_cfg.min_dist << " or " << march_cfg.hit_pixels << " pixels, " << \
+        march_cfg.refine_steps << " refinement steps" << std::endl;
+
+    const uint32_t octree_depth = parser.getOptionValue<int>("--octree_depth", 0);
+    if (octree_depth > 0) {
+        auto start = std::chrono::high_resolution_clock::now();
+        auto octree = std::make_shared<const SdfOctree>(*model, octree_depth);
+        float octreeTime = float(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::high_resolution_clock::now() - start).count()) / 1e6f;
+        std::cout << "Octree built in " << octreeTime << " sec: " << octree->getNodes().size() << \
+            " nodes, " << octree->getEmptyLeaves() << " empty leaves, " << \
+            100.0f * octree->getEmptyVolume() << "% of the cube empty" << std::endl;
+        ray_marcher.setOctree(octree);
+    }
+
+    ProgressiveCfg progressive_cfg;
+    progressive_cfg.coarse_step = parser.getOptionValue<int>("--coarse_step", progressive_cfg.coarse_step);
+    progressive_cfg.tolerance = parser.getOptionValue<int>("--progressive_tolerance", progressive_cfg.tolerance);
+    ray_marcher.setProgressiveCfg(progressive_cfg);
+    if (cams.size() > 1) {
+        render_views(ray_marcher, cams, resolution, parser.getOptionValue<int>("--view_chunk", 1024), save_to);
+        return 0;
+    }
+
+    // the image is written into the file tile by tile while rendering
+    ray_marcher.setRenderSink(make_bmp_sink(save_to, resolution, resolution));
 
     std::cout << "Rendering with resolution: " << resolution << \
-        ", on GPU: " << onGPU << std::endl;
+        ", batch_size: " << batch_size << std::endl;
     auto start = std::chrono::high_resolution_clock::now();
     std::vector<uint> pixelData = ray_marcher.render(resolution, resolution);
     float renderTime = float(std::chrono::duration_cast<std::chrono::microseconds>(
         std::chrono::high_resolution_clock::now() - start).count()) / 1e6f;
     std::cout << "Render done, elapsed = " << renderTime << " sec" << std::endl;
 
-    LiteImage::SaveBMP(save_to.c_str(), pixelData.data(), resolution, resolution);
+    if (mode == RenderMode::Tiled) {
+        const TileStats &stats = ray_marcher.getTileStats();
+        std::cout << "Tiles: " << stats.n_tiles << " on " << stats.n_workers << \
+            " workers, steals = " << stats.n_steals << ", tile time min / mean / max = " << \
+            stats.min_tile_ms << " / " << stats.mean_tile_ms << " / " << stats.max_tile_ms << \
+            " ms" << std::endl;
+        std::cout << "Worker busy time, ms:";
+        for (float ms: stats.worker_busy_ms)
+            std::cout << " " << ms;
+        std::cout << std::endl;
+    }
+
+    if (mode == RenderMode::Progressive) {
+        const ProgressiveStats &stats = ray_marcher.getProgressiveStats();
+        uint32_t n_marched = 0;
+        std::cout << "Progressive: first pass in " << stats.first_pass_ms << " ms, marched pixels by pass:";
+        for (uint32_t n: stats.marched) {
+            std::cout << " " << n;
+            n_marched += n;
+        }
+        std::cout << ", " << n_marched << " marched and " << stats.n_interpolated << \
+            " interpolated of " << resolution * resolution << std::endl;
+    }
+
+    report_march_stats(ray_marcher.getMarchStats());
+
+    if (ref_model && compare_fp32) {
+        auto ref_marcher = RayMarcher(cam, light, ref_model, mode, tile_size);
+        ref_marcher.setMarchCfg(march_cfg);
+        ref_marcher.setProgressiveCfg(progressive_cfg);
+        if (octree_depth > 0)
+            ref_marcher.setOctree(std::make_shared<const SdfOctree>(*ref_model, octree_depth));
+        report_image_difference(pixelData, ref_marcher.render(resolution, resolution));
+    }
+
     std::cout << "Saved to: " << save_to << std::endl;
 
     return 0;
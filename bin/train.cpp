@@ -1,10 +1,23 @@
 #include <iostream>
 #include <chrono>
+#include <memory>
+#include <thread>
+#include <tuple>
+#include <algorithm>
+#include <stdexcept>
 
 #include "siren.h"
+#include "data_parallel.h"
+#include "backend.h"
+#include "thread_pool.h"
 #include "argparser.h"
 #include "utils.h"
 #include "configs.h"
+#include "dataset.h"
+#include "nsdf_file.h"
+#include "streaming_loader.h"
+#include "train_pipeline.h"
+#include "process_group.h"
 
 
 
@@ -12,65 +25,214 @@ int main(int argc, const char** argv)
 {
     ArgParser parser(argc, argv);
 
+    // Several processes train on their shards of the data and average gradients every step.
+    // Without --rank the other ranks are forked from this one, before any thread is started;
+    // the socket path is picked before forking, so all of them agree on it
+    const int world_size = parser.getOptionValue<int>("--world_size", 1);
+    if (parser.hasOption("--rank") && !parser.hasOption("--dist_socket"))
+        throw std::runtime_error("--rank needs --dist_socket shared by all ranks");
+    const std::string dist_socket = parser.getOptionValue<std::string>("--dist_socket",
+        "/tmp/neural_sdf_train_" + std::to_string(std::random_device{}()) + ".sock");
+    const int rank = parser.hasOption("--rank") ?
+        parser.getOptionValue<int>("--rank") : spawn_local_ranks(world_size);
+    ProcessGroup group(rank, world_size, dist_socket);
+    // only rank 0 reports, the others' numbers are gathered at the end
+    if (rank > 0)
+        std::cout.setstate(std::ios::failbit);
+    if (world_size > 1)
+        std::cout << "Processes: " << world_size << std::endl;
+
+    set_nn_backend(parser.getOptionValue<std::string>("--backend", "auto"));
+    std::cout << "NN backend: " << nn_backend().name << std::endl;
+
+    // by default the hardware threads are split between processes
+    const int default_threads = world_size > 1 ?
+        std::max(1, int(std::thread::hardware_concurrency()) / world_size) : 0;
+    set_nn_threads(parser.getOptionValue<int>("--threads", default_threads));
+    std::cout << "NN threads: " << nn_threads() << std::endl;
+
     const auto [n_hidden_layers, hidden_size, batch_size] = parser.get_network_setup();
     std::cout << "Network setup: n_hidden = " << n_hidden_layers << \
         ", hidden_size = " << hidden_size << ", batch_size = " << batch_size << std::endl;
 
-    const auto [points, sdfs] = load_points(
-        parser.getOptionValue<std::string>("--train_sample"));
+    const std::string train_sample = parser.getOptionValue<std::string>("--train_sample");
+    // every rank gets an equal contiguous shard, so all of them make the same number
+    // of steps and meet in every allreduce; the n % world_size samples left over are dropped
+    auto shard = [&](uint64_t n) {
+        if (world_size > 1 && n < uint64_t(world_size))
+            throw std::runtime_error(train_sample + " has " + std::to_string(n) + \
+                " samples, fewer than the " + std::to_string(world_size) + " processes");
+        const uint64_t shard_size = n / world_size;
+        if (n % world_size != 0)
+            std::cout << "Sharding drops the last " << n % world_size << " of " << n << \
+                " samples" << std::endl;
+        return std::pair<uint64_t, uint64_t>{rank * shard_size, shard_size};
+    };
+    std::unique_ptr<PointDataset> dataset;
+    std::unique_ptr<StreamingLoader> loader;
+    if (parser.hasOption("--stream")) {
+        // samples are read in chunks while training, memory doesn't grow with the dataset
+        StreamingLoaderConfig loader_cfg;
+        loader_cfg.batch_size = batch_size;
+        loader_cfg.chunk_size = parser.getOptionValue<int>("--chunk_size", loader_cfg.chunk_size);
+        loader_cfg.shuffle_buffer_size = parser.getOptionValue<int>("--shuffle_buffer",
+            loader_cfg.shuffle_buffer_size);
+        loader_cfg.seed = std::random_device{}();
+        std::tie(loader_cfg.first_sample, loader_cfg.n_samples) = shard(SampleReader(train_sample).size());
+        loader = std::make_unique<StreamingLoader>(train_sample, loader_cfg);
+        std::cout << "Streaming " << loader->size() << " samples, chunk_size = " << \
+            loader_cfg.chunk_size << ", shuffle_buffer = " << loader_cfg.shuffle_buffer_size << std::endl;
+    } else if (is_nsdf_file(train_sample)) {
+        // already in network layout, copied once from the mapping
+        NsdfFile file(train_sample, NsdfKind::Samples, parser.hasOption("--verify"));
+        const auto [begin, count] = shard(file.header().count);
+        dataset = std::make_unique<PointDataset>(
+            file.points() + begin, file.sdfs() + begin, count, file.header().count);
+    } else {
+        const auto [points, sdfs] = load_points(train_sample);
+        dataset = std::make_unique<PointDataset>(points, sdfs);
+        if (world_size > 1) {
+            PointBatch all = dataset->batch(0, dataset->size());
+            const auto [begin, count] = shard(all.size);
+            dataset = std::make_unique<PointDataset>(all.points + begin, all.sdf + begin, count, all.stride);
+        }
+    }
 
     const auto train_cfg = load_train_cfg(parser.getOptionValue<std::string>("--train_cfg"));
 
     const std::string save_to = parser.getOptionValue<std::string>("--save_to");
 
-    auto net = getSirenNetwork(n_hidden_layers, hidden_size, batch_size);
-    net->CommitDeviceData();
-    net->UpdateMembersPlainData();
+    // with several replicas every batch is split between them, one per thread
+    const int n_replicas = parser.getOptionValue<int>("--replicas", 1);
+    // large batches can be split into micro-batches that accumulate gradients before a step
+    const int micro_batch_size = std::min(parser.getOptionValue<int>("--micro_batch", 0), batch_size);
+    if (micro_batch_size > 0 && n_replicas != 1)
+        throw std::runtime_error("--micro_batch can't be combined with --replicas");
+    std::shared_ptr<SirenNetwork> net;
+    std::unique_ptr<DataParallelSiren> replicas;
+    if (n_replicas != 1) {
+        replicas = std::make_unique<DataParallelSiren>(n_hidden_layers, hidden_size, batch_size, n_replicas);
+        std::cout << "Data-parallel replicas: " << replicas->getNumReplicas() << std::endl;
+    } else {
+        // with micro-batches the network only needs room for one of them
+        net = getSirenNetwork(n_hidden_layers, hidden_size, micro_batch_size > 0 ? micro_batch_size : batch_size);
+        net->CommitDeviceData();
+        net->UpdateMembersPlainData();
+    }
+
+#ifndef USE_VULKAN
+    OptimizerConfig optimizer_cfg;
+    const std::string optimizer_name = parser.getOptionValue<std::string>("--optimizer", "adam");
+    optimizer_cfg.type = optimizer_type_from_string(optimizer_name);
+    optimizer_cfg.weight_decay = parser.getOptionValue<float>("--weight_decay", optimizer_cfg.weight_decay);
+    optimizer_cfg.momentum = parser.getOptionValue<float>("--momentum", optimizer_cfg.momentum);
+    if (replicas)
+        replicas->setOptimizer(optimizer_cfg);
+    else
+        net->setOptimizer(optimizer_cfg);
+    std::cout << "Optimizer: " << optimizer_name << ", weight_decay = " << optimizer_cfg.weight_decay << std::endl;
+#endif
+
+    // all ranks start from rank 0's initialization
+    if (world_size > 1) {
+        auto init = replicas ? replicas->getWeights() : net->getWeights();
+        group.broadcast(init.data(), init.size());
+        if (replicas)
+            replicas->setWeights(init);
+        else
+            net->setWeights(init);
+    }
 
-    int n_batches = (sdfs.size() + batch_size - 1) / batch_size;
-    std::vector<std::vector<float>> x_batches = batchify(points, batch_size, n_batches, INPUT_DIM);
-    std::vector<std::vector<float>> y_batches = batchify(sdfs, batch_size, n_batches, OUTPUT_DIM);
+    // batches are prepared and losses reduced on helper threads while the network trains
+    BatchSource source = loader ?
+        BatchSource([&](BatchWorkspace &batch) { return loader->nextBatch(batch); }) :
+        dataset_batches(*dataset, batch_size, std::random_device{}());
+    TrainPipelineConfig pipeline_cfg;
+    pipeline_cfg.lr = train_cfg.lr;
+    pipeline_cfg.queue_depth = parser.getOptionValue<int>("--pipeline_depth", pipeline_cfg.queue_depth);
+    pipeline_cfg.fused_step = parser.getOptionValue<int>("--fused_step", 1) != 0;
+    pipeline_cfg.micro_batch_size = micro_batch_size;
+    if (micro_batch_size > 0)
+        std::cout << "Micro-batches: " << micro_batch_size << " points" << std::endl;
+    if (world_size > 1) {
+        // shards are equal, so the batch mean is the plain mean over ranks
+        pipeline_cfg.gradient_hook = [&](float *grads, uint32_t n_weights) {
+            group.allreduceSum(grads, n_weights);
+            for (uint32_t i = 0; i < n_weights; ++i)
+                grads[i] /= world_size;
+        };
+    }
+    std::unique_ptr<TrainPipeline> pipeline = replicas ?
+        std::make_unique<TrainPipeline>(*replicas, source, pipeline_cfg) :
+        std::make_unique<TrainPipeline>(*net, source, pipeline_cfg);
 
     std::cout << "Running train with lr: " << train_cfg.lr << ", n_epochs: " << \
         train_cfg.n_epochs << std::endl;
 
     auto start = std::chrono::high_resolution_clock::now();
     for (int epoch = 0; epoch < train_cfg.n_epochs; ++epoch) {
-        auto batch_idxs = shuffle_batch_idxs(n_batches);
-
-        std::vector<float> epoch_losses(n_batches);
-        for (auto batch_idx: batch_idxs) {
-            auto y_batch = y_batches[batch_idx];
-            auto x_batch = transpose(x_batches[batch_idx], y_batch.size(), INPUT_DIM);
-            std::vector<float> preds(y_batch.size());
+        float mean_epoch_loss = pipeline->runEpoch();
+        group.allreduceSum(&mean_epoch_loss, 1);
+        mean_epoch_loss /= world_size;
 
-            net->forward(preds.data(), x_batch.data(), y_batch.size());
-
-            float loss = mse_loss(preds, y_batch);
-            epoch_losses[batch_idx] = loss;
-            net->backward(y_batch.data());
-            net->step(train_cfg.lr);
-        }
-
-        float mean_epoch_loss = 0.0f;
-        for (auto loss: epoch_losses)
-            mean_epoch_loss += loss;
-        mean_epoch_loss /= n_batches;
-
-        if (epoch % train_cfg.log_every_n_epochs == 0)
+        if (epoch % train_cfg.log_every_n_epochs == 0) {
             std::cout << "Epoch: " << epoch << ", loss: " << mean_epoch_loss << std::endl;
+            PipelineStats stats = pipeline->stats();
+            std::cout << "Pipeline: queue depth " << stats.meanQueueDepth() << " (max " << \
+                stats.max_queue_depth << "), " << stats.batch_stall_ms << " ms waiting for batches, " << \
+                stats.loss_stall_ms << " ms waiting for loss" << std::endl;
+            if (loader) {
+                LoaderStats loader_stats = loader->stats();
+                std::cout << "Loader: " << loader_stats.n_stalls << " stalls, " << loader_stats.stall_ms << \
+                    " ms waiting, " << loader_stats.n_chunks << " chunks, " << \
+                    loader_stats.bytes_read / (1 << 20) << " MiB read" << std::endl;
+            }
+        }
     }
 
     auto elapsed = float(std::chrono::duration_cast<std::chrono::microseconds>(
         std::chrono::high_resolution_clock::now() - start).count()) / 1e6f;
     std::cout << "Training finished, elapsed = " << elapsed << " sec" << std::endl;
 
-    auto weights = net->getWeights();
-    std::ofstream fout(save_to, std::ios::out | std::ios::binary);
-    fout.write((char*)&weights[0], weights.size() * sizeof(float));
-    fout.close();
-    std::cout << "Saved weights to: " << save_to << std::endl;
+    if (world_size > 1) {
+        // every rank fills its row, the sum gathers them on rank 0. Efficiency is the part
+        // of the time a rank computes rather than exchanges gradients or waits for others
+        const uint64_t n_samples = uint64_t(loader ? loader->size() : dataset->size()) * train_cfg.n_epochs;
+        const float comm_sec = group.stats().comm_ms / 1e3f;
+        std::vector<float> rank_stats(3 * world_size, 0.0f);
+        rank_stats[3 * rank] = n_samples / elapsed;
+        rank_stats[3 * rank + 1] = comm_sec;
+        rank_stats[3 * rank + 2] = 1.0f - comm_sec / elapsed;
+        group.allreduceSum(rank_stats.data(), rank_stats.size());
+
+        float total_throughput = 0.0f;
+        for (int r = 0; r < world_size; ++r) {
+            std::cout << "Rank " << r << ": " << rank_stats[3 * r] << " samples/sec, " << \
+                rank_stats[3 * r + 1] << " sec exchanging gradients, efficiency " << \
+                100.0f * rank_stats[3 * r + 2] << "%" << std::endl;
+            total_throughput += rank_stats[3 * r];
+        }
+        std::cout << "Total: " << total_throughput << " samples/sec" << std::endl;
+    }
 
+    // weights are the same on all ranks, rank 0 saves them
+    if (rank == 0) {
+        auto weights = replicas ? replicas->getWeights() : net->getWeights();
+        if (save_to.size() >= 5 && save_to.compare(save_to.size() - 5, 5, ".nsdf") == 0) {
+            save_nsdf_weights(save_to, weights, n_hidden_layers, hidden_size);
+        } else {
+            std::ofstream fout(save_to, std::ios::out | std::ios::binary);
+            fout.write((char*)&weights[0], weights.size() * sizeof(float));
+            fout.close();
+        }
+        std::cout << "Saved weights to: " << save_to << std::endl;
+    }
+
+    pipeline = nullptr;
     net = nullptr;
+    if (rank == 0 && !wait_local_ranks()) {
+        std::cerr << "Some of the ranks failed" << std::endl;
+        return 1;
+    }
     return 0;
 }
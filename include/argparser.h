@@ -29,7 +29,15 @@ public:
             throw std::runtime_error(ss.str());
         }
 
-        return from_string<T>(*itr);
+        // numbers must take the whole value, anything else is a usage error
+        try {
+            size_t n_parsed = itr->size();
+            T value = from_string<T>(*itr, n_parsed);
+            if (n_parsed == itr->size())
+                return value;
+        } catch (const std::logic_error &) {
+        }
+        throw std::runtime_error("Option " + option + " has an invalid value " + *itr);
     }
 
     bool hasOption(const std::string &option) const;
@@ -39,12 +47,12 @@ private:
     std::vector<std::string> _tokens;
 
     template <typename T>
-    T from_string(const std::string &str) const
+    T from_string(const std::string &str, size_t &n_parsed) const
     {
         if constexpr(std::is_same_v<T, int>) {
-            return std::stoi(str);
+            return std::stoi(str, &n_parsed);
         } else if constexpr(std::is_same_v<T, float>) {
-            return std::stof(str);
+            return std::stof(str, &n_parsed);
         } else
             return str;
     }
@@ -1,6 +1,9 @@
 #pragma once
 
 
+#include <string>
+#include <vector>
+
 #include "LiteMath.h"
 using namespace LiteMath;
 
@@ -27,5 +30,8 @@ struct TrainCfg
 
 
 Camera load_cam(const std::string &path);
+// n_views cameras evenly spaced on a full turn of cam's position around the axis
+// through look_at along up, the first one is cam
+std::vector<Camera> orbit_cameras(const Camera &cam, uint32_t n_views);
 Light load_light(const std::string &path);
 TrainCfg load_train_cfg(const std::string &path);
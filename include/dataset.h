@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <random>
+#include <cstdint>
+
+
+// Batch of samples that points into the dataset storage: coordinate dim of
+// sample i is points[dim * stride + i], its sdf is sdf[i]
+struct PointBatch
+{
+    const float *points;
+    const float *sdf;
+    uint32_t size, stride;
+};
+
+
+// Contiguous copy of a batch, [3 x size] points and size sdfs.
+// Buffers grow on first use and are reused afterwards. A source that hands out
+// samples in place sets view instead and leaves the buffers alone.
+struct BatchWorkspace
+{
+    std::vector<float> points, sdf;
+    uint32_t size = 0;
+    PointBatch view{};
+
+    // view if it is set, else the buffers
+    PointBatch batch() const;
+};
+
+
+// Training samples stored once, in the [3 x N] layout the network consumes
+class PointDataset
+{
+public:
+    // points are [N x 3] as in the sample files, sdfs are [N]
+    PointDataset(const std::vector<float> &points, const std::vector<float> &sdfs);
+    // points are already [3 x n], e.g. straight from a mapped NSDF file; with a
+    // stride, coordinate dim of sample i is points[dim * stride + i], so a range
+    // of a bigger dataset can be copied
+    PointDataset(const float *points, const float *sdfs, uint32_t n, uint32_t stride = 0);
+
+    uint32_t size() const;
+    uint32_t numBatches(uint32_t batch_size) const;
+
+    // samples [batch_idx * batch_size, ...) as a view, valid until the next shuffle
+    PointBatch batch(uint32_t batch_idx, uint32_t batch_size) const;
+
+    // permutes samples in place, once per epoch; allocates nothing
+    void shuffle(std::mt19937 &gen);
+
+    // copies samples idxs[0..count) into workspace, for sampling by an index permutation
+    void gather(const uint32_t *idxs, uint32_t count, BatchWorkspace &workspace) const;
+
+private:
+    // [3 x N]: all xs, then all ys, then all zs
+    std::vector<float> m_points;
+    std::vector<float> m_sdfs;
+};
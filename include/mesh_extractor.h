@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "siren_model.h"
+
+
+// Receives an extracted mesh piece by piece: vertices are numbered from 0 in the
+// order they arrive, triangles only refer to vertices that already arrived
+class MeshWriter
+{
+public:
+    virtual ~MeshWriter() = default;
+    // xyz of n vertices, interleaved
+    virtual void addVertices(const float *xyz, uint32_t n) = 0;
+    // 3 vertex indices per triangle, counterclockwise seen from outside
+    virtual void addTriangles(const uint32_t *indices, uint32_t n) = 0;
+    // completes the file, nothing can be added afterwards
+    virtual void finish() = 0;
+};
+
+// Writes binary little endian PLY for ".ply" paths and OBJ for ".obj" ones.
+// OBJ is written straight through; PLY needs the counts in its header, so its vertices
+// and faces are spooled to two files next to path and joined by finish.
+std::unique_ptr<MeshWriter> make_mesh_writer(const std::string &path);
+
+
+struct MeshExtractionCfg
+{
+    // cells per axis of the grid over [-1, 1]^3
+    uint32_t resolution = 256;
+    // adaptive: the grid is split into blocks of block_size^3 cells, the network is
+    // first evaluated at block corners and only blocks the surface may cross are refined.
+    // Which blocks those are is estimated from the gradients at the corners, so thin
+    // parts of the surface inside a skipped block can be lost
+    bool adaptive = true;
+    uint32_t block_size = 16;
+    // adaptive only: a block is skipped only if siren_bounds proves its sign, then the
+    // mesh is the same as the dense one, at the cost of refining more blocks
+    bool bounded = false;
+    // points per network call
+    uint32_t batch_size = 4096;
+};
+
+struct MeshStats
+{
+    uint64_t n_vertices = 0, n_triangles = 0;
+    // network evaluations and points of the full grid
+    uint64_t n_evaluated = 0, n_grid_points = 0;
+    uint32_t n_blocks = 0, n_active_blocks = 0;
+    // largest gradient norm at block corners
+    float lipschitz = 0.0f;
+    float eval_seconds = 0.0f, total_seconds = 0.0f;
+};
+
+
+// Zero level set of the model over [-1, 1]^3 by dual contouring (surface nets): a vertex
+// in every cell with a sign change, at the mean of its edges' crossings, and a quad of
+// two triangles around every crossed edge. The grid is processed slice by slice along z,
+// so memory stays O(resolution^2) and the mesh is streamed to writer as it's built.
+// Slices are evaluated in batches spread over nn_thread_pool(), cells by rows.
+// The adaptive grid skips blocks whose corners are farther from the surface than
+// L times half the block diagonal, L being the largest gradient norm at block corners.
+// That is an estimate, not a bound: the mesh equals the dense one only where the network
+// is L-Lipschitz, unless cfg.bounded checks the skipped blocks with siren_bounds.
+MeshStats extract_mesh(const SirenModel &model, const MeshExtractionCfg &cfg, MeshWriter &writer);
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Container for point samples and network weights ("NSDF" files).
+// A fixed-size header is followed by the payload, which starts at an aligned
+// offset so it can be used straight from a memory mapping:
+// - samples: [3 x count] points (all xs, then ys, then zs), then count sdfs;
+// - weights: count floats, every layer's matrix followed by its bias;
+// - sdf cache: count 4-byte words of a baked SdfCache, laid out by sdf_cache.h.
+// The older headerless .bin files are still read, see load_points and load_floats.
+
+static const char NSDF_MAGIC[4] = {'N', 'S', 'D', 'F'};
+static const uint32_t NSDF_VERSION = 1;
+static const uint32_t NSDF_ALIGNMENT = 64;
+
+enum class NsdfKind : uint32_t
+{
+    Samples = 1,
+    Weights = 2,
+    SdfCache = 3
+};
+
+enum class NsdfDtype : uint32_t
+{
+    Float32 = 1
+};
+
+enum class NsdfLayout : uint32_t
+{
+    SoA = 1,        // samples: [3 x count] points, then sdfs
+    LayerMajor = 2, // weights: matrix then bias of every layer
+    Bricks = 3      // sdf cache: see SdfCache
+};
+
+struct NsdfHeader
+{
+    char magic[4];
+    uint32_t version;
+    NsdfKind kind;
+    NsdfDtype dtype;
+    NsdfLayout layout;
+    uint32_t alignment;
+    // network architecture, zeros for samples
+    uint32_t n_hidden, hidden_size;
+    // number of samples, of weights or of sdf cache words
+    uint64_t count;
+    uint64_t payload_offset, payload_size;
+    // FNV-1a over the payload bytes
+    uint64_t checksum;
+};
+static_assert(sizeof(NsdfHeader) == 64, "NSDF header layout is part of the file format");
+
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const uint8_t *data() const;
+    size_t size() const;
+
+private:
+    const uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+    // used instead of a mapping where mmap isn't available
+    std::vector<uint8_t> m_buffer;
+};
+
+
+// Opened NSDF file, the payload is accessed in place
+class NsdfFile
+{
+public:
+    // throws if the file isn't a valid NSDF file of the given kind;
+    // the checksum pass reads the whole payload, so it can be skipped for big sample sets
+    NsdfFile(const std::string &path, NsdfKind kind, bool verify_checksum = true);
+
+    const NsdfHeader &header() const;
+    const float *payload() const;
+
+    // samples only
+    const float *points() const;
+    const float *sdfs() const;
+
+private:
+    MappedFile m_file;
+    NsdfHeader m_header;
+};
+
+
+// throws if the header doesn't describe a valid payload of the given kind
+// within a file of file_size bytes; path is only used in messages
+void check_nsdf_header(const NsdfHeader &header, NsdfKind kind, uint64_t file_size,
+    const std::string &path);
+
+// true if the file starts with NSDF_MAGIC
+bool is_nsdf_file(const std::string &path);
+
+// FNV-1a, pass the previous result as hash to continue over several buffers
+uint64_t nsdf_checksum(const uint8_t *data, size_t size,
+    uint64_t hash = 14695981039346656037ull);
+
+// writes header (magic, version, dtype, alignment, payload offset, size and checksum
+// are filled in) followed by the concatenated parts, given as pointers and sizes in bytes
+void save_nsdf(const std::string &path, NsdfHeader header,
+    const std::vector<std::pair<const void *, uint64_t>> &parts);
+
+// points are [3 x n] SoA
+void save_nsdf_samples(const std::string &path, const float *points, const float *sdfs, uint64_t n);
+void save_nsdf_weights(const std::string &path, const std::vector<float> &weights,
+    int n_hidden, int hidden_size);
+
+// Loads weights from an NSDF or a headerless .bin file and checks that their
+// architecture (or, for .bin files, their number) matches the given one
+std::vector<float> load_weights(const std::string &path, int n_hidden, int hidden_size);
+
+// number of weights of a SIREN with 3 inputs and 1 output
+uint64_t siren_n_params(int n_hidden, int hidden_size);
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+struct CommStats
+{
+    // time spent inside collective calls, including waiting for other ranks
+    double comm_ms = 0.0;
+    uint64_t bytes_sent = 0, bytes_received = 0;
+    uint64_t n_calls = 0;
+};
+
+
+// Group of processes on one machine connected by Unix domain sockets. Rank 0
+// listens on socket_path and is connected to every other rank; collectives go
+// through it, so results are the same on all ranks and don't depend on timing.
+// A group of one process does no communication.
+class ProcessGroup
+{
+public:
+    // blocks until all ranks are connected, throws after timeout_sec
+    ProcessGroup(int rank, int world_size, const std::string &socket_path, double timeout_sec = 30.0);
+    ~ProcessGroup();
+
+    ProcessGroup(const ProcessGroup &) = delete;
+    ProcessGroup &operator=(const ProcessGroup &) = delete;
+
+    int rank() const;
+    int worldSize() const;
+
+    // data = sum of data over ranks, added in rank order
+    void allreduceSum(float *data, size_t n);
+    // data = data of rank 0
+    void broadcast(float *data, size_t n);
+    void barrier();
+
+    CommStats stats() const;
+
+private:
+    void send_all(int fd, const void *data, size_t size);
+    void recv_all(int fd, void *data, size_t size);
+
+    int m_rank, m_world_size;
+    // rank 0: socket of every other rank by rank, others: the socket to rank 0
+    std::vector<int> m_peers;
+    std::vector<float> m_recv_buffer;
+    CommStats m_stats;
+};
+
+
+// Forks world_size - 1 copies of the calling process and returns the rank of each
+// of them, 0 for the caller. Must be called before any thread is started.
+int spawn_local_ranks(int world_size);
+// for rank 0: waits for the spawned ranks, false if any of them failed
+bool wait_local_ranks();
@@ -1,26 +1,189 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
 
-#include "siren.h"
+#include "siren_model.h"
+#include "sdf_cache.h"
+#include "sdf_octree.h"
+#include "render_sink.h"
 #include "configs.h"
 #include "utils.h"
 
 
+enum class RenderMode
+{
+    PerPixel,   // one network call per ray step, batch of a single point
+    Wavefront,  // all active rays are evaluated together, batch_size points per call
+    Tiled,      // wavefront per image tile, tiles are spread over threads with work stealing
+    Progressive // coarse pass, then passes that march only where the coarser pixels disagree
+};
+
+
+// Progressive render: pass 0 marches every coarse_step-th pixel in x and y, every next
+// pass halves the step. A new pixel is marched if the corners of the previous pass's cell
+// around it differ by more than tolerance in some 8 bit channel, else it's interpolated
+// from them. Thin details between agreeing corners can be missed.
+struct ProgressiveCfg
+{
+    uint32_t coarse_step = 8;
+    uint32_t tolerance = 0;
+};
+
+
+// Work of the last progressive render
+struct ProgressiveStats
+{
+    // marched pixels per pass
+    std::vector<uint32_t> marched;
+    uint32_t n_interpolated = 0;
+    // time until the first pass was done and its preview sent to the sink
+    float first_pass_ms = 0.0f;
+};
+
+
+// Timings of the last tiled render
+struct TileStats
+{
+    uint32_t n_tiles = 0, n_workers = 0, n_steals = 0;
+    float min_tile_ms = 0.0f, mean_tile_ms = 0.0f, max_tile_ms = 0.0f;
+    // time each worker spent rendering its tiles
+    std::vector<float> worker_busy_ms;
+};
+
+
+// How rays are marched, the defaults are plain sphere tracing
+struct MarchCfg
+{
+    uint32_t max_iterations = 100;
+    // a hit when the step is below min_dist, or below hit_pixels pixel footprints at the
+    // ray's distance if that is larger (cone tracing), a miss when it is above max_dist
+    float min_dist = 1e-4f;
+    float hit_pixels = 0.0f;
+    float max_dist = 100.0f;
+    // steps are relaxation * sdf / lipschitz. A relaxed step whose sphere doesn't overlap
+    // the previous one may have skipped the surface: it is taken back and replaced by
+    // a plain step. Networks that aren't exact sdfs need lipschitz above 1.
+    float relaxation = 1.0f;
+    float lipschitz = 1.0f;
+    // secant steps on the hit, regula falsi once the surface is bracketed
+    uint32_t refine_steps = 0;
+};
+
+
+// Marching steps of the last render, a step is one sdf lookup of a ray, refinement included
+struct MarchStats
+{
+    // rays by step count: bin 0 holds rays without steps, bin b > 0 rays with
+    // [2^(b-1), 2^b) steps, the last bin everything up to the iteration limit
+    static const uint32_t N_BINS = 8;
+    std::vector<uint64_t> step_histogram = std::vector<uint64_t>(N_BINS, 0);
+    uint64_t n_rays = 0, n_steps = 0;
+    // empty octree leaves jumped over without a lookup
+    uint64_t n_node_skips = 0;
+
+    void addRay(uint32_t steps);
+    void merge(const MarchStats &other);
+};
+
+
 class RayMarcher
 {
 public:
-    RayMarcher(Camera cam, Light light, std::shared_ptr<SirenNetwork> net);
+    RayMarcher(Camera cam, Light light, std::shared_ptr<const SirenModel> model,
+        RenderMode mode = RenderMode::Wavefront, uint32_t tile_size = 32);
+    // Threads of one render share the marcher, but render and renderViews reset its
+    // statistics and pixel footprint, so one RayMarcher must not run two of them at once
     std::vector<uint> render(uint32_t width, uint32_t height) const;
+    // Renders a frame from every camera with the same model, caches and settings. Rays of
+    // all views are marched as one wavefront split into chunks of chunk_rays spread over
+    // threads, so a chunk can take rays from several views into the same network batches.
+    // The render mode and the sink aren't used.
+    std::vector<std::vector<uint>> renderViews(const std::vector<Camera> &cams, uint32_t width,
+        uint32_t height, uint32_t chunk_rays = 1024) const;
+    void setCamera(const Camera &cam);
+    const TileStats &getTileStats() const;
+    const MarchStats &getMarchStats() const;
+    const ProgressiveStats &getProgressiveStats() const;
+    // Marching steps take the cache's lower bound of the sdf while it is above band,
+    // the network is only evaluated closer to the surface. Throws if the cache
+    // was baked from another model. Pass null to march on the network alone.
+    void setSdfCache(std::shared_ptr<const SdfCache> cache, float band = 0.02f);
+    // Rays are clipped to the cube [-1, 1]^3 and jump over the octree's empty leaves
+    // without looking up the sdf. Pass null to turn it off.
+    void setOctree(std::shared_ptr<const SdfOctree> octree);
+    // throws on a relaxation outside [1, 2) or a non-positive lipschitz
+    void setMarchCfg(const MarchCfg &cfg);
+    const MarchCfg &getMarchCfg() const;
+    // throws unless coarse_step is a power of two
+    void setProgressiveCfg(const ProgressiveCfg &cfg);
+    // Finished tiles are sent to the sink as soon as they are done (tiled and progressive
+    // modes, which also send a preview of the frame after every pass but the last),
+    // other modes send the whole frame at the end. Pass null for no sink.
+    // An exception thrown by the sink stops the render and leaves render.
+    void setRenderSink(std::shared_ptr<RenderSink> sink);
 
     uint32_t MarchOneRay(float3 rayPos, float3 rayDir) const;
+    // same, the ray's steps are added to stats
+    uint32_t MarchOneRay(float3 rayPos, float3 rayDir, MarchStats &stats) const;
     float3 EstimateNormal(float3 p) const;
     float sdf(float3 p) const;
+
+    // wavefront path: marches n_rays rays at once and writes their colors to out_color
+    void MarchRays(const float3 *rayPos, const float3 *rayDir, uint32_t n_rays,
+        uint *out_color) const;
+    // evaluates sdf for n points stored as [3 x n] (xs, then ys, then zs)
+    void sdfBatch(float *dist, const float *points, uint32_t n) const;
+    // same plus the sdf gradient, also stored as [3 x n]
+    void sdfGradBatch(float *dist, float *grad, const float *points, uint32_t n) const;
 protected:
+    std::vector<uint> renderPerPixel(uint32_t width, uint32_t height) const;
+    std::vector<uint> renderWavefront(uint32_t width, uint32_t height) const;
+    std::vector<uint> renderTiled(uint32_t width, uint32_t height) const;
+    std::vector<uint> renderProgressive(uint32_t width, uint32_t height) const;
+    void sendToSink(uint32_t x0, uint32_t y0, uint32_t w, uint32_t h, const uint *pixels,
+        bool final) const;
+
+    // same as the public ones, but network scratch memory is given by the caller
+    void MarchRays(SirenWorkspace &workspace, const float3 *rayPos, const float3 *rayDir,
+        uint32_t n_rays, uint *out_color) const;
+    void sdfBatch(SirenWorkspace &workspace, float *dist, const float *points, uint32_t n) const;
+    void sdfGradBatch(SirenWorkspace &workspace, float *dist, float *grad, const float *points,
+        uint32_t n) const;
+    // distances to step by: sdf, or its lower bound from the cache away from the surface
+    float marchDistance(float3 p) const;
+    void marchDistanceBatch(SirenWorkspace &workspace, float *dist, const float *points,
+        uint32_t n) const;
+    // primary ray through the center of pixel (x, y)
+    void EyeRay(uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+        float3 &rayPos, float3 &rayDir) const;
+
     float4x4 m_worldViewProjInv;
     float4x4 m_worldViewInv;
     float    copyTime;
     float    rayMarchTime;
-    std::shared_ptr<SirenNetwork> m_nn;
+    std::shared_ptr<const SirenModel> m_model;
     Light m_light;
+    RenderMode m_mode;
+    uint32_t m_tile_size;
+    std::shared_ptr<const SdfCache> m_cache;
+    float m_cache_band = 0.0f;
+    std::shared_ptr<const SdfOctree> m_octree;
+    MarchCfg m_march_cfg;
+    // view angle of a pixel, set by render for cone tracing
+    mutable float m_pixel_footprint = 0.0f;
+    // filled by render in tiled mode
+    mutable TileStats m_tile_stats;
+    ProgressiveCfg m_progressive_cfg;
+    mutable ProgressiveStats m_progressive_stats;
+    std::shared_ptr<RenderSink> m_sink;
+    mutable std::mutex m_sink_mutex;
+    // reset by render, marching threads add their totals to it once per chunk or tile
+    mutable MarchStats m_march_stats;
+    mutable std::mutex m_march_stats_mutex;
 };
+
+
+RenderMode render_mode_from_string(const std::string &mode);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+
+// Receives a frame piece by piece while it renders. Calls are never concurrent.
+class RenderSink
+{
+public:
+    virtual ~RenderSink() = default;
+    // pixels of the rectangle [x0, x0 + w) x [y0, y0 + h), w per row. A preview
+    // (final = false) is overwritten by later calls, final pixels are not; this is
+    // a promise of the renderer, sinks don't have to check it.
+    virtual void writeTile(uint32_t x0, uint32_t y0, uint32_t w, uint32_t h,
+        const uint32_t *pixels, bool final) = 0;
+};
+
+// 24 bit BMP of width x height: the file is created with a black image right away
+// and every tile is written into it in place, so it can be viewed while rendering.
+// An existing file at path is truncated at once, and a render that fails leaves
+// the image incomplete with black in place of the missing tiles.
+std::shared_ptr<RenderSink> make_bmp_sink(const std::string &path, uint32_t width, uint32_t height);
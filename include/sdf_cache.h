@@ -0,0 +1,80 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "siren_model.h"
+#include "nsdf_file.h"
+#include "utils.h"
+
+
+// Parameters of a cache, the first 64 bytes of its NSDF payload. They are followed by
+// - coarse values: (bricks_per_axis + 1)^3 floats at brick corners, x fastest;
+// - brick table: bricks_per_axis^3 int32, index of the brick's fine values or -1;
+// - fine values: n_fine blocks of (brick_res + 1)^3 floats, x fastest.
+struct SdfCacheHeader
+{
+    uint32_t bricks_per_axis, brick_res, n_fine;
+    // Precision the model was evaluated in
+    uint32_t precision;
+    // FNV-1a of the model's weights, a cache only fits the model it was baked from
+    uint64_t weights_checksum;
+    // bound of the network's gradient norm used for lower bounds, at least 1
+    float lipschitz;
+    uint32_t reserved[9];
+};
+static_assert(sizeof(SdfCacheHeader) == 64, "sdf cache header layout is part of the file format");
+
+
+// Network sdf baked on a sparse two-level grid over the cube [-1, 1]^3 that the
+// ray marcher clips the scene to. The cube is split into bricks: a brick the surface
+// may come close to stores brick_res^3 cells of samples, any other brick is a single
+// cell interpolated from its corners. Lookups are trilinear. A baked cache owns its
+// values, a loaded one reads them in place from a memory mapping.
+class SdfCache
+{
+public:
+    // evaluates model on the grid
+    SdfCache(const SirenModel &model, uint32_t bricks_per_axis = 16, uint32_t brick_res = 8);
+    // maps a cache written by save, throws if the file isn't one
+    explicit SdfCache(const std::string &path, bool verify_checksum = true);
+
+    SdfCache(const SdfCache &) = delete;
+    SdfCache &operator=(const SdfCache &) = delete;
+
+    void save(const std::string &path) const;
+    // true if the cache was baked from a model with the same weights and precision
+    bool matches(const SirenModel &model) const;
+
+    // trilinear interpolation of the baked sdf, p must be inside the cube
+    float value(float3 p) const;
+    // value minus the interpolation error bound: not above the network sdf as long as
+    // its gradient norm stays within getLipschitz(); -infinity outside the cube
+    float lowerBound(float3 p) const;
+
+    const SdfCacheHeader &getHeader() const;
+    float getLipschitz() const;
+    // bytes of the grid values and the brick table
+    size_t getMemoryBytes() const;
+
+private:
+    void bind(const uint8_t *payload);
+    // trilinear interpolation in the brick of p, slack is the error bound of its cells
+    float interpolate(float3 p, float &slack) const;
+
+    SdfCacheHeader m_header;
+    const float *m_coarse = nullptr;
+    const int32_t *m_bricks = nullptr;
+    const float *m_fine = nullptr;
+    // error bounds of trilinear interpolation over coarse and fine cells
+    float m_coarse_slack = 0.0f, m_fine_slack = 0.0f;
+
+    // payload of a baked cache, laid out as in the file
+    std::vector<uint8_t> m_data;
+    std::unique_ptr<NsdfFile> m_file;
+};
+
+
+// FNV-1a of the model's weights as stored in SdfCacheHeader
+uint64_t sdf_cache_weights_checksum(const SirenModel &model);
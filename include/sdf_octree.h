@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "siren_model.h"
+#include "utils.h"
+
+
+// Octree node over part of the cube [-1, 1]^3
+struct SdfOctreeNode
+{
+    // lower bound of the network sdf over the node's box
+    float lower;
+    // index of the first of 8 children, stored one after another (x fastest), 0 for a leaf
+    uint32_t children;
+};
+
+
+// Conservative bounds of the network sdf over the cube [-1, 1]^3 the ray marcher clips
+// the scene to. Every node holds a lower bound of the network over its box from
+// siren_bounds, which uses only the weights, no samples. Nodes whose bound is not safely
+// above zero are split up to max_depth, so the leaves either have no surface or are
+// small boxes near it. Built once, read-only afterwards.
+class SdfOctree
+{
+public:
+    explicit SdfOctree(const SirenModel &model, uint32_t max_depth = 6);
+
+    // If p is in a leaf the surface can't be in, returns the distance along dir (unit)
+    // to that leaf's exit, else 0. Outside the cube returns 0 too.
+    float emptyDistance(float3 p, float3 dir) const;
+
+    const std::vector<SdfOctreeNode> &getNodes() const;
+    uint32_t getMaxDepth() const;
+    // leaves the ray marcher skips and their share of the cube's volume
+    uint32_t getEmptyLeaves() const;
+    float getEmptyVolume() const;
+
+private:
+    std::vector<SdfOctreeNode> m_nodes;
+    uint32_t m_max_depth;
+    uint32_t m_empty_leaves = 0;
+    float m_empty_volume = 0.0f;
+};
+
+
+// Bounds of the network output over the box center +- half by a first order Taylor
+// model: every neuron is an affine function of the point plus a bounded remainder,
+// which keeps the correlations plain interval arithmetic loses. A neuron whose
+// exact sin range over its pre-activation interval is narrower becomes that constant
+// interval instead, which is what happens for wide boxes.
+void siren_bounds(const SirenModel &model, float3 center, float3 half, float &lower, float &upper);
+
+// Lipschitz constant of the network over all of space from the weight norms: the product
+// of the layers' spectral norm bounds, times 30 for every sin layer. Guaranteed, but for
+// trained SIRENs far above the gradient norms that actually occur.
+float siren_lipschitz_bound(const SirenModel &model);
+
+// [t_near, t_far] of the ray inside the box, false if it misses
+bool ray_box_intersection(float3 origin, float3 dir, float3 box_min, float3 box_max,
+    float &t_near, float &t_far);
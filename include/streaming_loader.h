@@ -0,0 +1,126 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <cstdint>
+
+#include "dataset.h"
+
+
+struct StreamingLoaderConfig
+{
+    uint32_t batch_size = 512;
+    // samples read from disk at once, two chunks are kept in memory
+    uint32_t chunk_size = 1 << 16;
+    // samples a batch is drawn from, bigger means better randomization
+    uint32_t shuffle_buffer_size = 1 << 18;
+    uint32_t seed = 0;
+    // samples [first_sample, first_sample + n_samples) of the file are streamed,
+    // n_samples = 0 means up to the end; e.g. the shard of one process
+    uint64_t first_sample = 0, n_samples = 0;
+};
+
+
+struct LoaderStats
+{
+    // time nextBatch spent waiting for the prefetch thread
+    double stall_ms = 0.0;
+    uint64_t n_stalls = 0;
+    uint64_t n_chunks = 0;
+    uint64_t bytes_read = 0;
+};
+
+
+// Reads chunk [start, start + count) of a sample file (NSDF or headerless .bin)
+// into [3 x count] points and count sdfs
+class SampleReader
+{
+public:
+    explicit SampleReader(const std::string &path);
+
+    uint64_t size() const;
+    void read(uint64_t start, uint32_t count, float *points, float *sdfs);
+
+private:
+    std::ifstream m_file;
+    uint64_t m_size;
+    bool m_soa;
+    uint64_t m_points_offset, m_sdfs_offset;
+    // AoS chunk of a .bin file before it's transposed
+    std::vector<float> m_aos;
+};
+
+
+// Streams training samples from disk with bounded memory. A background thread
+// reads chunks in shuffled order into two buffers, batches are drawn at random
+// from a shuffle buffer filled from those chunks.
+class StreamingLoader
+{
+public:
+    StreamingLoader(const std::string &path, const StreamingLoaderConfig &config);
+    ~StreamingLoader();
+
+    StreamingLoader(const StreamingLoader &) = delete;
+    StreamingLoader &operator=(const StreamingLoader &) = delete;
+
+    // number of streamed samples
+    uint64_t size() const;
+
+    // Writes the next batch of the current epoch into workspace, which the network
+    // reads directly. Returns false once the epoch is over, the next call starts
+    // a new one. The last batch of an epoch may be smaller than batch_size.
+    bool nextBatch(BatchWorkspace &workspace);
+
+    // counters since construction
+    LoaderStats stats() const;
+
+private:
+    struct Chunk
+    {
+        std::vector<float> points, sdfs;
+        uint32_t size = 0;
+        // marks the end of an epoch instead of holding samples
+        bool end_of_epoch = false;
+    };
+
+    void prefetch_loop();
+    // takes the next filled chunk from the prefetch thread
+    void acquire_chunk();
+    void release_chunk();
+    // tops up the shuffle buffer, returns false once it's empty at the end of epoch
+    bool fill_shuffle_buffer();
+
+    StreamingLoaderConfig m_config;
+    SampleReader m_reader;
+    uint64_t m_first, m_size;
+
+    // double buffering: the consumer reads one chunk while the other is being filled
+    Chunk m_chunks[2];
+    std::vector<int> m_free;
+    std::deque<int> m_ready;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop = false;
+    std::exception_ptr m_error;
+    std::thread m_thread;
+
+    // chunk being consumed and the position in it
+    int m_current = -1;
+    uint32_t m_chunk_pos = 0;
+    bool m_epoch_input_done = false;
+
+    // shuffle buffer, [3 x capacity] points and capacity sdfs
+    std::vector<float> m_buffer_points, m_buffer_sdfs;
+    uint32_t m_buffer_size = 0;
+    std::mt19937 m_gen;
+
+    mutable std::mutex m_stats_mutex;
+    LoaderStats m_stats;
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstdint>
+
+#include "siren.h"
+#include "data_parallel.h"
+#include "dataset.h"
+
+
+// Writes the next batch into the workspace, returns false at the end of an epoch;
+// the call after that starts the next epoch. Called from a helper thread.
+using BatchSource = std::function<bool(BatchWorkspace &)>;
+
+// gathers batches of a fixed dataset in a new random order every epoch
+BatchSource shuffled_batches(const PointDataset &dataset, uint32_t batch_size, uint32_t seed);
+
+// batches are views of the dataset, which is reshuffled in place at the start of
+// every epoch: nothing is copied, but nothing else may read the dataset meanwhile
+BatchSource dataset_batches(PointDataset &dataset, uint32_t batch_size, uint32_t seed);
+
+
+// Called with the gradients of every step between backward and step, e.g. to
+// average them between processes; runs on the training thread
+using GradientHook = std::function<void(float *grads, uint32_t n_weights)>;
+
+
+struct TrainPipelineConfig
+{
+    float lr = 1e-4f;
+    // batches prepared ahead of the one being trained on
+    uint32_t queue_depth = 2;
+    GradientHook gradient_hook;
+    // single network without a gradient hook: layers are updated during backward
+    // (SirenNetwork::backwardStep). CPU builds only, elsewhere it's ignored
+    bool fused_step = false;
+    // single network only: every batch is processed as micro-batches of this size
+    // whose gradients add up before one step, so the network's buffers only have
+    // to hold a micro-batch and can stay in cache. 0 means the whole batch at once.
+    // CPU builds only
+    uint32_t micro_batch_size = 0;
+};
+
+
+struct PipelineStats
+{
+    uint64_t n_steps = 0;
+    // time the training thread waited for a prepared batch
+    double batch_stall_ms = 0.0;
+    // time it waited for the previous loss reduction before overwriting predictions
+    double loss_stall_ms = 0.0;
+    // prepared batches in the queue at the start of a step, summed over steps
+    uint64_t queue_depth_sum = 0;
+    uint32_t max_queue_depth = 0;
+
+    double meanQueueDepth() const;
+};
+
+
+// Training loop with two helper threads: one prepares the next batches while the
+// network trains on the current one, the other reduces the loss of a step from
+// the predictions kept in the network while backward and step run.
+// The source's next epoch is started only once every batch of the previous one is
+// done, so batches may be views of storage the source rearranges between epochs.
+// Gives the same weights as the serial forward/backward/step loop.
+class TrainPipeline
+{
+public:
+    TrainPipeline(SirenNetwork &net, BatchSource source, const TrainPipelineConfig &config);
+    // data-parallel training, every step is spread over the replicas
+    TrainPipeline(DataParallelSiren &net, BatchSource source, const TrainPipelineConfig &config);
+    ~TrainPipeline();
+
+    TrainPipeline(const TrainPipeline &) = delete;
+    TrainPipeline &operator=(const TrainPipeline &) = delete;
+
+    // trains on one epoch of the source, returns the mean batch loss
+    float runEpoch();
+
+    // counters since construction
+    PipelineStats stats() const;
+
+private:
+    struct Slot
+    {
+        BatchWorkspace batch;
+        bool end_of_epoch = false;
+    };
+
+    TrainPipeline(SirenNetwork *net, DataParallelSiren *replicas, BatchSource source,
+        const TrainPipelineConfig &config);
+
+    // forward, and in micro-batch mode backward too, as the network keeps
+    // the activations of one micro-batch only
+    void forward(const PointBatch &batch);
+    void backward_step(const PointBatch &batch);
+    const float *predictions() const;
+
+    void prepare_loop();
+    void loss_loop();
+    int take_batch();
+    void wait_loss();
+
+    // exactly one of them is set
+    SirenNetwork *m_net;
+    DataParallelSiren *m_replicas;
+    BatchSource m_source;
+    TrainPipelineConfig m_config;
+    std::vector<float> m_preds;
+    uint32_t m_n_weights;
+
+    // ready batches in order and free slots; the slot in training and the one
+    // of the previous step are in neither
+    std::vector<Slot> m_slots;
+    std::deque<int> m_ready;
+    std::vector<int> m_free;
+    // slot whose loss is being reduced, -1 if none
+    int m_loss_slot = -1;
+    float m_loss_sum = 0.0f;
+    uint32_t m_loss_count = 0;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop = false;
+    std::exception_ptr m_error;
+    PipelineStats m_stats;
+
+    std::thread m_prepare_thread, m_loss_thread;
+};
@@ -22,6 +22,7 @@ std::vector<std::vector<float>> batchify(const std::vector<float> &matrix,
 std::vector<float> transpose(const std::vector<float> &m, int n_rows, int n_cols);
 
 float mse_loss(const std::vector<float> &y_pred, const std::vector<float> &y_gt);
+float mse_loss(const float *y_pred, const float *y_gt, uint32_t n);
 
 float3 EyeRayDir(float x, float y, float4x4 a_mViewProjInv);
 void transform_ray3f(float4x4 a_mWorldViewInv, float3* ray_pos, float3* ray_dir);
@@ -1,5 +1,7 @@
 #include "configs.h"
 
+#include <cmath>
+
 
 Camera load_cam(const std::string &path)
 {
@@ -28,6 +30,21 @@ Camera load_cam(const std::string &path)
 }
 
 
+std::vector<Camera> orbit_cameras(const Camera &cam, uint32_t n_views)
+{
+    const float3 axis = normalize(cam.up);
+    const float3 offset = cam.pos - cam.look_at;
+    std::vector<Camera> cams(n_views, cam);
+    for (uint32_t i = 0; i < n_views; ++i) {
+        // Rodrigues' rotation of the offset around the axis
+        const float angle = 2.0f * float(M_PI) * i / n_views;
+        const float c = std::cos(angle), s = std::sin(angle);
+        cams[i].pos = cam.look_at + offset * c + cross(axis, offset) * s + axis * dot(axis, offset) * (1.0f - c);
+    }
+    return cams;
+}
+
+
 Light load_light(const std::string &path)
 {
     float3 direction;
@@ -0,0 +1,97 @@
+#include "dataset.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+
+
+static const uint32_t N_DIMS = 3;
+
+
+PointBatch BatchWorkspace::batch() const
+{
+    if (view.points)
+        return view;
+    return PointBatch{points.data(), sdf.data(), size, size};
+}
+
+
+PointDataset::PointDataset(const std::vector<float> &points, const std::vector<float> &sdfs)
+{
+    if (points.size() != N_DIMS * sdfs.size())
+        throw std::runtime_error("Dataset needs 3 coordinates per sdf value");
+
+    const uint32_t n = sdfs.size();
+    m_points.resize(N_DIMS * n);
+    for (uint32_t i = 0; i < n; ++i) {
+        for (uint32_t dim = 0; dim < N_DIMS; ++dim)
+            m_points[dim * n + i] = points[i * N_DIMS + dim];
+    }
+    m_sdfs = sdfs;
+}
+
+
+PointDataset::PointDataset(const float *points, const float *sdfs, uint32_t n, uint32_t stride)
+    : m_sdfs(sdfs, sdfs + n)
+{
+    if (stride == 0)
+        stride = n;
+    m_points.resize(N_DIMS * n);
+    for (uint32_t dim = 0; dim < N_DIMS; ++dim)
+        std::copy(points + dim * stride, points + dim * stride + n, m_points.begin() + dim * n);
+}
+
+
+uint32_t PointDataset::size() const
+{
+    return m_sdfs.size();
+}
+
+
+uint32_t PointDataset::numBatches(uint32_t batch_size) const
+{
+    return (size() + batch_size - 1) / batch_size;
+}
+
+
+PointBatch PointDataset::batch(uint32_t batch_idx, uint32_t batch_size) const
+{
+    const uint32_t start = std::min(size(), batch_idx * batch_size);
+    const uint32_t count = std::min(batch_size, size() - start);
+    return PointBatch{m_points.data() + start, m_sdfs.data() + start, count, size()};
+}
+
+
+void PointDataset::shuffle(std::mt19937 &gen)
+{
+    // Fisher-Yates over columns of the SoA storage
+    const uint32_t n = size();
+    float *xs = m_points.data(), *ys = xs + n, *zs = ys + n;
+    for (uint32_t i = n; i > 1; --i) {
+        uint32_t j = std::uniform_int_distribution<uint32_t>(0, i - 1)(gen);
+        std::swap(xs[i - 1], xs[j]);
+        std::swap(ys[i - 1], ys[j]);
+        std::swap(zs[i - 1], zs[j]);
+        std::swap(m_sdfs[i - 1], m_sdfs[j]);
+    }
+}
+
+
+void PointDataset::gather(const uint32_t *idxs, uint32_t count, BatchWorkspace &workspace) const
+{
+    if (workspace.points.size() < N_DIMS * count)
+        workspace.points.resize(N_DIMS * count);
+    if (workspace.sdf.size() < count)
+        workspace.sdf.resize(count);
+    workspace.size = count;
+
+    const uint32_t n = size();
+    for (uint32_t dim = 0; dim < N_DIMS; ++dim) {
+        const float *src = m_points.data() + dim * n;
+        float *dst = workspace.points.data() + dim * count;
+        for (uint32_t i = 0; i < count; ++i)
+            dst[i] = src[idxs[i]];
+    }
+    for (uint32_t i = 0; i < count; ++i)
+        workspace.sdf[i] = m_sdfs[idxs[i]];
+}
@@ -0,0 +1,421 @@
+#include "mesh_extractor.h"
+#include "sdf_octree.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+
+static const uint32_t NO_VERTEX = std::numeric_limits<uint32_t>::max();
+
+
+// Text OBJ, streamed straight to the file
+class ObjWriter : public MeshWriter
+{
+public:
+    explicit ObjWriter(const std::string &path)
+        : m_out(path)
+    {
+        if (!m_out)
+            throw std::runtime_error("Can't write " + path);
+    }
+
+    void addVertices(const float *xyz, uint32_t n) override
+    {
+        char line[96];
+        for (uint32_t i = 0; i < n; ++i) {
+            int len = std::snprintf(line, sizeof(line), "v %.7g %.7g %.7g\n", xyz[3 * i], xyz[3 * i + 1], xyz[3 * i + 2]);
+            m_out.write(line, len);
+        }
+    }
+
+    void addTriangles(const uint32_t *indices, uint32_t n) override
+    {
+        // OBJ indices start from 1
+        char line[64];
+        for (uint32_t i = 0; i < n; ++i) {
+            int len = std::snprintf(line, sizeof(line), "f %u %u %u\n",
+                indices[3 * i] + 1, indices[3 * i + 1] + 1, indices[3 * i + 2] + 1);
+            m_out.write(line, len);
+        }
+    }
+
+    void finish() override
+    {
+        m_out.close();
+        if (m_out.fail())
+            throw std::runtime_error("Failed writing mesh");
+    }
+
+private:
+    std::ofstream m_out;
+};
+
+
+// Binary PLY: vertices and faces go to their own spool files until the counts are known
+class PlyWriter : public MeshWriter
+{
+public:
+    explicit PlyWriter(const std::string &path)
+        : m_path(path), m_vertices_path(path + ".vertices"), m_faces_path(path + ".faces"),
+          m_vertices(m_vertices_path, std::ios::binary), m_faces(m_faces_path, std::ios::binary)
+    {
+        if (!m_vertices || !m_faces)
+            throw std::runtime_error("Can't write " + path);
+    }
+
+    ~PlyWriter() override
+    {
+        std::remove(m_vertices_path.c_str());
+        std::remove(m_faces_path.c_str());
+    }
+
+    void addVertices(const float *xyz, uint32_t n) override
+    {
+        m_vertices.write(reinterpret_cast<const char *>(xyz), 3 * sizeof(float) * n);
+        m_n_vertices += n;
+    }
+
+    void addTriangles(const uint32_t *indices, uint32_t n) override
+    {
+        // every face is a vertex count followed by int32 indices
+        char face[1 + 3 * sizeof(uint32_t)] = {3};
+        for (uint32_t i = 0; i < n; ++i) {
+            std::copy_n(reinterpret_cast<const char *>(indices + 3 * i), 3 * sizeof(uint32_t), face + 1);
+            m_faces.write(face, sizeof(face));
+        }
+        m_n_faces += n;
+    }
+
+    void finish() override
+    {
+        m_vertices.close();
+        m_faces.close();
+        std::ofstream out(m_path, std::ios::binary);
+        if (!out || m_vertices.fail() || m_faces.fail())
+            throw std::runtime_error("Failed writing " + m_path);
+        out << "ply\nformat binary_little_endian 1.0\n" << \
+            "element vertex " << m_n_vertices << "\n" << \
+            "property float x\nproperty float y\nproperty float z\n" << \
+            "element face " << m_n_faces << "\n" << \
+            "property list uchar int vertex_indices\nend_header\n";
+        // copying an empty stream buffer would fail the output stream
+        for (auto [part, count]: {std::make_pair(m_vertices_path, m_n_vertices), std::make_pair(m_faces_path, m_n_faces)}) {
+            std::ifstream in(part, std::ios::binary);
+            if (count > 0)
+                out << in.rdbuf();
+        }
+        if (!out)
+            throw std::runtime_error("Failed writing " + m_path);
+    }
+
+private:
+    std::string m_path, m_vertices_path, m_faces_path;
+    std::ofstream m_vertices, m_faces;
+    uint64_t m_n_vertices = 0, m_n_faces = 0;
+};
+
+
+std::unique_ptr<MeshWriter> make_mesh_writer(const std::string &path)
+{
+    auto ends_with = [&](const std::string &suffix) {
+        return path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    if (ends_with(".ply"))
+        return std::make_unique<PlyWriter>(path);
+    if (ends_with(".obj"))
+        return std::make_unique<ObjWriter>(path);
+    throw std::runtime_error("Unknown mesh format of " + path + ", expected .ply or .obj");
+}
+
+
+// Evaluates the model at grid points, batches are spread over the thread pool
+class GridEvaluator
+{
+public:
+    GridEvaluator(const SirenModel &model, uint32_t resolution, uint32_t batch_size)
+        : m_model(model), m_res(resolution), m_batch(std::max(batch_size, 1u)) {}
+
+    float coord(uint32_t i) const
+    {
+        return -1.0f + 2.0f * float(i) / float(m_res);
+    }
+
+    // values[j] = model(grid point (xs[j], ys[j], z)) for the n points in ids, given
+    // as y * row + x
+    void evaluate(float *values, const uint32_t *ids, uint32_t n, uint32_t row, float z) const
+    {
+        const uint32_t n_batches = (n + m_batch - 1) / m_batch;
+        parallel_for(n_batches, 1, 1, [&](uint32_t begin, uint32_t end) {
+            std::vector<float> batch(INPUT_DIM * m_batch), res(m_batch);
+            for (uint32_t b = begin; b < end; ++b) {
+                const uint32_t first = b * m_batch, count = std::min(m_batch, n - first);
+                for (uint32_t j = 0; j < count; ++j) {
+                    batch[j] = coord(ids[first + j] % row);
+                    batch[count + j] = coord(ids[first + j] / row);
+                    batch[2 * count + j] = z;
+                }
+                // nested calls from the pool run serially, every batch stays on its thread
+                m_model.forward(res.data(), batch.data(), count);
+                for (uint32_t j = 0; j < count; ++j)
+                    values[ids[first + j]] = res[j];
+            }
+        });
+    }
+
+private:
+    const SirenModel &m_model;
+    uint32_t m_res, m_batch;
+};
+
+
+MeshStats extract_mesh(const SirenModel &model, const MeshExtractionCfg &cfg, MeshWriter &writer)
+{
+    using clock = std::chrono::high_resolution_clock;
+    auto seconds_since = [](clock::time_point start) {
+        return float(std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start).count()) / 1e6f;
+    };
+    const auto start = clock::now();
+
+    const uint32_t res = cfg.resolution, row = res + 1;
+    if (res == 0 || cfg.block_size == 0)
+        throw std::runtime_error("Mesh extraction needs a positive resolution and block size");
+    const uint32_t block = cfg.adaptive ? cfg.block_size : res;
+    const uint32_t n_blocks = (res + block - 1) / block, corner_row = n_blocks + 1;
+    const float step = 2.0f / res;
+    GridEvaluator grid(model, res, cfg.batch_size);
+
+    MeshStats stats;
+    stats.n_grid_points = uint64_t(row) * row * row;
+    stats.n_blocks = n_blocks * n_blocks * n_blocks;
+
+    // coarse pass: values and gradients at block corners decide which blocks are refined
+    std::vector<float> corner_values;
+    std::vector<uint8_t> active(stats.n_blocks, 1);
+    if (cfg.adaptive) {
+        const uint32_t n_corners = corner_row * corner_row * corner_row;
+        std::vector<float> corners(INPUT_DIM * n_corners), grad(INPUT_DIM * n_corners);
+        corner_values.resize(n_corners);
+        for (uint32_t i = 0; i < n_corners; ++i) {
+            corners[i] = grid.coord(i % corner_row * block);
+            corners[n_corners + i] = grid.coord(i / corner_row % corner_row * block);
+            corners[2 * n_corners + i] = grid.coord(i / corner_row / corner_row * block);
+        }
+        const auto eval_start = clock::now();
+        SirenWorkspace workspace;
+        model.forwardWithGradient(corner_values.data(), grad.data(), corners.data(), n_corners, workspace);
+        stats.eval_seconds += seconds_since(eval_start);
+        stats.n_evaluated += n_corners;
+
+        float lipschitz = 1.0f;
+        for (uint32_t i = 0; i < n_corners; ++i)
+            lipschitz = std::max(lipschitz, length(float3(grad[i], grad[n_corners + i], grad[2 * n_corners + i])));
+        stats.lipschitz = lipschitz;
+
+        // every point of a block is within half its diagonal of a corner
+        const float reach = lipschitz * block * step * std::sqrt(3.0f) / 2.0f;
+        for (uint32_t b = 0; b < stats.n_blocks; ++b) {
+            const uint32_t x = b % n_blocks, y = b / n_blocks % n_blocks, z = b / n_blocks / n_blocks;
+            bool inside = false, outside = false, near = false;
+            for (uint32_t corner = 0; corner < 8; ++corner) {
+                const float v = corner_values[((z + (corner >> 2)) * corner_row + y + (corner >> 1 & 1)) * corner_row + \
+                    x + (corner & 1)];
+                inside |= v < 0.0f;
+                outside |= v >= 0.0f;
+                near |= std::fabs(v) <= reach;
+            }
+            active[b] = (inside && outside) || near;
+        }
+
+        // the corners estimate is confirmed by bounds over the whole block
+        if (cfg.bounded) {
+            const float half = block * step / 2;
+            parallel_for(stats.n_blocks, 1, 1, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t b = begin; b < end; ++b) {
+                    if (active[b])
+                        continue;
+                    const uint32_t x = b % n_blocks, y = b / n_blocks % n_blocks, z = b / n_blocks / n_blocks;
+                    const float3 center(grid.coord(x * block) + half, grid.coord(y * block) + half,
+                        grid.coord(z * block) + half);
+                    float lower, upper;
+                    siren_bounds(model, center, float3(half, half, half), lower, upper);
+                    active[b] = lower <= 0.0f && upper >= 0.0f;
+                }
+            });
+        }
+    }
+    for (uint8_t a: active)
+        stats.n_active_blocks += a;
+
+    // two slices of values and the vertex indices of two cell layers
+    std::vector<float> prev_values(row * row), values(row * row);
+    std::vector<uint32_t> prev_cells(res * res, NO_VERTEX), cells(res * res, NO_VERTEX);
+    std::vector<uint8_t> marked(row * row);
+    std::vector<uint32_t> ids;
+    std::vector<std::vector<float>> row_vertices(res);
+    std::vector<std::vector<uint32_t>> row_triangles(res);
+    std::vector<uint32_t> row_base(res);
+
+    for (uint32_t z = 0; z <= res; ++z) {
+        // points of cells in active blocks are evaluated, the others take the sign
+        // of their block, which the surface doesn't cross
+        std::fill(marked.begin(), marked.end(), 0);
+        for (uint32_t layer = z == 0 ? 0 : z - 1; layer <= std::min(z, res - 1); ++layer) {
+            const uint32_t bz = layer / block;
+            for (uint32_t by = 0; by < n_blocks; ++by) {
+                for (uint32_t bx = 0; bx < n_blocks; ++bx) {
+                    if (!active[(bz * n_blocks + by) * n_blocks + bx])
+                        continue;
+                    const uint32_t x_end = std::min((bx + 1) * block, res);
+                    for (uint32_t y = by * block; y <= std::min((by + 1) * block, res); ++y)
+                        std::fill(marked.begin() + y * row + bx * block, marked.begin() + y * row + x_end + 1, 1);
+                }
+            }
+        }
+        if (cfg.adaptive) {
+            for (uint32_t y = 0; y < row; ++y) {
+                const float *corner = corner_values.data() + (z / block * corner_row + y / block) * corner_row;
+                for (uint32_t x = 0; x < row; x += block)
+                    std::fill(values.begin() + y * row + x, values.begin() + y * row + std::min(x + block, row),
+                        corner[x / block] < 0.0f ? -1.0f : 1.0f);
+            }
+        }
+        ids.clear();
+        for (uint32_t i = 0; i < row * row; ++i) {
+            if (marked[i])
+                ids.push_back(i);
+        }
+        const auto eval_start = clock::now();
+        grid.evaluate(values.data(), ids.data(), ids.size(), row, grid.coord(z));
+        stats.eval_seconds += seconds_since(eval_start);
+        stats.n_evaluated += ids.size();
+
+        if (z == 0) {
+            std::swap(prev_values, values);
+            continue;
+        }
+
+        // vertices of the cell layer between slices z - 1 and z
+        const float *v0 = prev_values.data(), *v1 = values.data();
+        parallel_for(res, 1, 1, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t y = begin; y < end; ++y) {
+                std::vector<float> &out = row_vertices[y];
+                out.clear();
+                const uint8_t *block_row = active.data() + ((z - 1) / block * n_blocks + y / block) * n_blocks;
+                for (uint32_t x = 0; x < res; ++x) {
+                    // the surface doesn't cross inactive blocks
+                    if (!block_row[x / block]) {
+                        const uint32_t x_end = std::min((x / block + 1) * block, res);
+                        std::fill(cells.begin() + y * res + x, cells.begin() + y * res + x_end, NO_VERTEX);
+                        x = x_end - 1;
+                        continue;
+                    }
+                    float c[8];
+                    for (uint32_t corner = 0; corner < 8; ++corner) {
+                        const float *slice = corner & 4 ? v1 : v0;
+                        c[corner] = slice[(y + (corner >> 1 & 1)) * row + x + (corner & 1)];
+                    }
+                    uint32_t signs = 0;
+                    for (uint32_t corner = 0; corner < 8; ++corner)
+                        signs |= uint32_t(c[corner] < 0.0f) << corner;
+                    if (signs == 0 || signs == 0xff) {
+                        cells[y * res + x] = NO_VERTEX;
+                        continue;
+                    }
+
+                    // mean of the crossings of the cell's 12 edges
+                    float3 sum(0.0f);
+                    uint32_t n_crossings = 0;
+                    for (uint32_t corner = 0; corner < 8; ++corner) {
+                        for (uint32_t axis = 0; axis < 3; ++axis) {
+                            const uint32_t bit = 1u << axis, other = corner | bit;
+                            if ((corner & bit) || ((signs >> corner ^ signs >> other) & 1) == 0)
+                                continue;
+                            const float t = c[corner] / (c[corner] - c[other]);
+                            float3 p(float(corner & 1), float(corner >> 1 & 1), float(corner >> 2));
+                            p[axis] += t;
+                            sum += p;
+                            ++n_crossings;
+                        }
+                    }
+                    sum = sum / float(n_crossings);
+                    cells[y * res + x] = out.size() / 3;
+                    out.push_back(grid.coord(x) + sum.x * step);
+                    out.push_back(grid.coord(y) + sum.y * step);
+                    out.push_back(grid.coord(z - 1) + sum.z * step);
+                }
+            }
+        });
+
+        // rows are numbered in order, so the mesh doesn't depend on the number of threads
+        for (uint32_t y = 0; y < res; ++y) {
+            row_base[y] = stats.n_vertices;
+            writer.addVertices(row_vertices[y].data(), row_vertices[y].size() / 3);
+            stats.n_vertices += row_vertices[y].size() / 3;
+        }
+
+        // quads around crossed edges whose four cells are known: edges along z between
+        // the two slices, and edges along x and y in slice z - 1 (cells of layers z - 2 and z - 1)
+        parallel_for(res, 1, 1, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t y = begin; y < end; ++y) {
+                for (uint32_t x = 0; x < res; ++x) {
+                    if (cells[y * res + x] != NO_VERTEX)
+                        cells[y * res + x] += row_base[y];
+                }
+            }
+        });
+        parallel_for(res, 1, 1, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t y = begin; y < end; ++y) {
+                std::vector<uint32_t> &out = row_triangles[y];
+                out.clear();
+                // a, b, c, d counterclockwise around the edge's axis, flipped if the inside
+                // is on the far end of the edge
+                auto quad = [&](uint32_t a, uint32_t b, uint32_t c, uint32_t d, bool flip) {
+                    if (a == NO_VERTEX || b == NO_VERTEX || c == NO_VERTEX || d == NO_VERTEX)
+                        return;
+                    if (flip)
+                        std::swap(b, d);
+                    out.insert(out.end(), {a, b, c, a, c, d});
+                };
+                const uint32_t *cur = cells.data(), *prev = prev_cells.data();
+                const uint8_t *block_row = active.data() + ((z - 1) / block * n_blocks + y / block) * n_blocks;
+                for (uint32_t x = 0; x < res; ++x) {
+                    // all three edges touch cell (x, y, z - 1), crossed edges only touch active cells
+                    if (!block_row[x / block]) {
+                        x = std::min((x / block + 1) * block, res) - 1;
+                        continue;
+                    }
+                    const uint32_t p = y * row + x;
+                    if (x > 0 && y > 0 && (v0[p] < 0.0f) != (v1[p] < 0.0f))
+                        quad(cur[(y - 1) * res + x - 1], cur[(y - 1) * res + x], cur[y * res + x],
+                            cur[y * res + x - 1], v1[p] < 0.0f);
+                    if (z < 2)
+                        continue;
+                    if (y > 0 && (v0[p] < 0.0f) != (v0[p + 1] < 0.0f))
+                        quad(prev[(y - 1) * res + x], prev[y * res + x], cur[y * res + x],
+                            cur[(y - 1) * res + x], v0[p + 1] < 0.0f);
+                    if (x > 0 && (v0[p] < 0.0f) != (v0[p + row] < 0.0f))
+                        quad(prev[y * res + x - 1], cur[y * res + x - 1], cur[y * res + x],
+                            prev[y * res + x], v0[p + row] < 0.0f);
+                }
+            }
+        });
+        for (uint32_t y = 0; y < res; ++y) {
+            writer.addTriangles(row_triangles[y].data(), row_triangles[y].size() / 3);
+            stats.n_triangles += row_triangles[y].size() / 3;
+        }
+
+        std::swap(prev_values, values);
+        std::swap(prev_cells, cells);
+    }
+
+    writer.finish();
+    stats.total_seconds = seconds_since(start);
+    return stats;
+}
@@ -0,0 +1,263 @@
+#include "nsdf_file.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define NSDF_HAS_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::MappedFile(const std::string &path)
+{
+#ifdef NSDF_HAS_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Can't open " + path);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Can't stat " + path);
+    }
+    m_size = st.st_size;
+
+    if (m_size > 0) {
+        void *ptr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Can't map " + path);
+        }
+        m_data = static_cast<const uint8_t *>(ptr);
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+#else
+    std::ifstream fin(path, std::ios::binary | std::ios::ate);
+    if (!fin)
+        throw std::runtime_error("Can't open " + path);
+    m_size = fin.tellg();
+    m_buffer.resize(m_size);
+    fin.seekg(0);
+    fin.read(reinterpret_cast<char *>(m_buffer.data()), m_size);
+    m_data = m_buffer.data();
+#endif
+}
+
+
+MappedFile::~MappedFile()
+{
+#ifdef NSDF_HAS_MMAP
+    if (m_data != nullptr)
+        munmap(const_cast<uint8_t *>(m_data), m_size);
+#endif
+}
+
+
+const uint8_t *MappedFile::data() const
+{
+    return m_data;
+}
+
+
+size_t MappedFile::size() const
+{
+    return m_size;
+}
+
+
+uint64_t nsdf_checksum(const uint8_t *data, size_t size, uint64_t hash)
+{
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+
+uint64_t siren_n_params(int n_hidden, int hidden_size)
+{
+    // first layer takes 3 coordinates, last one outputs a single distance
+    uint64_t h = hidden_size;
+    return (3 * h + h) + n_hidden * (h * h + h) + (h + 1);
+}
+
+
+static const char *nsdf_kind_name(NsdfKind kind)
+{
+    switch (kind) {
+    case NsdfKind::Samples: return "samples";
+    case NsdfKind::Weights: return "weights";
+    case NsdfKind::SdfCache: return "sdf cache";
+    }
+    return "unknown data";
+}
+
+
+static NsdfLayout nsdf_kind_layout(NsdfKind kind)
+{
+    if (kind == NsdfKind::Samples)
+        return NsdfLayout::SoA;
+    if (kind == NsdfKind::Weights)
+        return NsdfLayout::LayerMajor;
+    return NsdfLayout::Bricks;
+}
+
+
+void check_nsdf_header(const NsdfHeader &h, NsdfKind kind, uint64_t file_size, const std::string &path)
+{
+    if (std::memcmp(h.magic, NSDF_MAGIC, sizeof(NSDF_MAGIC)) != 0)
+        throw std::runtime_error(path + " is not an NSDF file");
+    if (h.version != NSDF_VERSION)
+        throw std::runtime_error(path + " has unsupported NSDF version " + std::to_string(h.version));
+    if (h.kind != kind)
+        throw std::runtime_error(path + " holds " + nsdf_kind_name(h.kind) + ", expected " + \
+            nsdf_kind_name(kind));
+    if (h.dtype != NsdfDtype::Float32)
+        throw std::runtime_error(path + " has unsupported dtype");
+
+    if (h.layout != nsdf_kind_layout(kind))
+        throw std::runtime_error(path + " has unsupported layout");
+    if (h.alignment == 0 || h.payload_offset % h.alignment != 0 || h.payload_offset % sizeof(float) != 0)
+        throw std::runtime_error(path + " has misaligned payload");
+    // every payload is made of 4-byte words; the sizes come from the file, so
+    // they are compared without products or sums that could overflow
+    const uint64_t item_bytes = (kind == NsdfKind::Samples ? 4 : 1) * sizeof(float);
+    if (h.payload_offset > file_size || h.payload_size > file_size - h.payload_offset || \
+        h.payload_size % item_bytes != 0 || h.payload_size / item_bytes != h.count)
+        throw std::runtime_error(path + " is truncated");
+}
+
+
+NsdfFile::NsdfFile(const std::string &path, NsdfKind kind, bool verify_checksum)
+    : m_file(path)
+{
+    if (m_file.size() < sizeof(NsdfHeader))
+        throw std::runtime_error(path + " is too small to be an NSDF file");
+    std::memcpy(&m_header, m_file.data(), sizeof(NsdfHeader));
+    check_nsdf_header(m_header, kind, m_file.size(), path);
+
+    const NsdfHeader &h = m_header;
+    if (verify_checksum && \
+        nsdf_checksum(m_file.data() + h.payload_offset, h.payload_size) != h.checksum)
+        throw std::runtime_error(path + " is corrupted: checksum mismatch");
+}
+
+
+const NsdfHeader &NsdfFile::header() const
+{
+    return m_header;
+}
+
+
+const float *NsdfFile::payload() const
+{
+    return reinterpret_cast<const float *>(m_file.data() + m_header.payload_offset);
+}
+
+
+const float *NsdfFile::points() const
+{
+    return payload();
+}
+
+
+const float *NsdfFile::sdfs() const
+{
+    return payload() + 3 * m_header.count;
+}
+
+
+bool is_nsdf_file(const std::string &path)
+{
+    std::ifstream fin(path, std::ios::binary);
+    char magic[sizeof(NSDF_MAGIC)];
+    return fin.read(magic, sizeof(magic)) && std::memcmp(magic, NSDF_MAGIC, sizeof(magic)) == 0;
+}
+
+
+void save_nsdf(const std::string &path, NsdfHeader header,
+    const std::vector<std::pair<const void *, uint64_t>> &parts)
+{
+    std::memcpy(header.magic, NSDF_MAGIC, sizeof(NSDF_MAGIC));
+    header.version = NSDF_VERSION;
+    header.dtype = NsdfDtype::Float32;
+    header.alignment = NSDF_ALIGNMENT;
+    header.payload_offset = (sizeof(NsdfHeader) + NSDF_ALIGNMENT - 1) / NSDF_ALIGNMENT * NSDF_ALIGNMENT;
+
+    header.payload_size = 0;
+    header.checksum = nsdf_checksum(nullptr, 0);
+    for (auto [data, size]: parts) {
+        header.checksum = nsdf_checksum(
+            static_cast<const uint8_t *>(data), size, header.checksum);
+        header.payload_size += size;
+    }
+
+    std::ofstream fout(path, std::ios::binary);
+    if (!fout)
+        throw std::runtime_error("Can't write " + path);
+    std::vector<char> head(header.payload_offset, 0);
+    std::memcpy(head.data(), &header, sizeof(NsdfHeader));
+    fout.write(head.data(), head.size());
+    for (auto [data, size]: parts)
+        fout.write(static_cast<const char *>(data), size);
+    if (!fout)
+        throw std::runtime_error("Failed writing " + path);
+}
+
+
+void save_nsdf_samples(const std::string &path, const float *points, const float *sdfs, uint64_t n)
+{
+    NsdfHeader header{};
+    header.kind = NsdfKind::Samples;
+    header.layout = NsdfLayout::SoA;
+    header.count = n;
+    save_nsdf(path, header, {{points, 3 * n * sizeof(float)}, {sdfs, n * sizeof(float)}});
+}
+
+
+void save_nsdf_weights(const std::string &path, const std::vector<float> &weights,
+    int n_hidden, int hidden_size)
+{
+    NsdfHeader header{};
+    header.kind = NsdfKind::Weights;
+    header.layout = NsdfLayout::LayerMajor;
+    header.n_hidden = n_hidden;
+    header.hidden_size = hidden_size;
+    header.count = weights.size();
+    save_nsdf(path, header, {{weights.data(), weights.size() * sizeof(float)}});
+}
+
+
+std::vector<float> load_weights(const std::string &path, int n_hidden, int hidden_size)
+{
+    const std::string arch = "n_hidden = " + std::to_string(n_hidden) + \
+        ", hidden_size = " + std::to_string(hidden_size);
+
+    if (is_nsdf_file(path)) {
+        NsdfFile file(path, NsdfKind::Weights);
+        const NsdfHeader &h = file.header();
+        if (h.n_hidden != uint32_t(n_hidden) || h.hidden_size != uint32_t(hidden_size))
+            throw std::runtime_error(path + " holds weights for n_hidden = " + \
+                std::to_string(h.n_hidden) + ", hidden_size = " + std::to_string(h.hidden_size) + \
+                ", not " + arch);
+        if (h.count != siren_n_params(n_hidden, hidden_size))
+            throw std::runtime_error(path + " has " + std::to_string(h.count) + \
+                " weights, which doesn't match " + arch);
+        return std::vector<float>(file.payload(), file.payload() + h.count);
+    }
+
+    // headerless file: only the number of weights can be checked
+    MappedFile file(path);
+    if (file.size() != siren_n_params(n_hidden, hidden_size) * sizeof(float))
+        throw std::runtime_error(path + " has " + std::to_string(file.size() / sizeof(float)) + \
+            " weights, which doesn't match " + arch);
+    const float *data = reinterpret_cast<const float *>(file.data());
+    return std::vector<float>(data, data + file.size() / sizeof(float));
+}
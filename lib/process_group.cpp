@@ -0,0 +1,302 @@
+#include "process_group.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PG_HAS_SOCKETS
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef PG_HAS_SOCKETS
+
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static const int SEND_FLAGS = 0;
+#endif
+
+
+static sockaddr_un socket_address(const std::string &path)
+{
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("Socket path " + path + " is too long");
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
+
+// only a socket left over by a finished run is removed, any other file at the path is kept
+static void remove_stale_socket(const std::string &path, const sockaddr_un &addr)
+{
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0)
+        return;
+    if (!S_ISSOCK(st.st_mode))
+        throw std::runtime_error(path + " exists and is not a socket");
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0)
+        throw std::runtime_error("Can't create socket");
+    const bool in_use = connect(probe, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == 0;
+    close(probe);
+    if (in_use)
+        throw std::runtime_error("Socket " + path + " is in use by another process group");
+    unlink(path.c_str());
+}
+
+
+static int accept_with_timeout(int server, double timeout_sec)
+{
+    pollfd pfd{server, POLLIN, 0};
+    int ready = poll(&pfd, 1, int(timeout_sec * 1000));
+    if (ready <= 0)
+        return -1;
+    return accept(server, nullptr, nullptr);
+}
+
+#endif
+
+
+ProcessGroup::ProcessGroup(int rank, int world_size, const std::string &socket_path, double timeout_sec)
+    : m_rank(rank), m_world_size(world_size)
+{
+    if (world_size < 1 || rank < 0 || rank >= world_size)
+        throw std::runtime_error("Rank " + std::to_string(rank) + " is out of world size " + \
+            std::to_string(world_size));
+    if (world_size == 1)
+        return;
+
+#ifdef PG_HAS_SOCKETS
+    sockaddr_un addr = socket_address(socket_path);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout_sec);
+    auto seconds_left = [&]() {
+        return std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+    };
+
+    if (rank == 0) {
+        int server = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (server < 0)
+            throw std::runtime_error("Can't create socket");
+        try {
+            remove_stale_socket(socket_path, addr);
+        } catch (...) {
+            close(server);
+            throw;
+        }
+        if (bind(server, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || \
+            listen(server, world_size) != 0) {
+            close(server);
+            throw std::runtime_error("Can't listen on " + socket_path);
+        }
+
+        // every rank introduces itself with its number right after connecting
+        m_peers.assign(world_size, -1);
+        for (int n_connected = 1; n_connected < world_size; ++n_connected) {
+            int fd = accept_with_timeout(server, std::max(seconds_left(), 0.0));
+            int32_t peer = -1;
+            if (fd < 0 || recv(fd, &peer, sizeof(peer), MSG_WAITALL) != sizeof(peer) || \
+                peer <= 0 || peer >= world_size || m_peers[peer] >= 0) {
+                if (fd >= 0)
+                    close(fd);
+                for (int peer_fd: m_peers)
+                    if (peer_fd >= 0)
+                        close(peer_fd);
+                close(server);
+                unlink(socket_path.c_str());
+                throw std::runtime_error("Not all ranks connected to " + socket_path);
+            }
+            m_peers[peer] = fd;
+        }
+        close(server);
+        unlink(socket_path.c_str());
+    } else {
+        // rank 0 may not be listening yet
+        int fd = -1;
+        while (true) {
+            fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0)
+                throw std::runtime_error("Can't create socket");
+            if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0)
+                break;
+            close(fd);
+            if (seconds_left() <= 0)
+                throw std::runtime_error("Can't connect to rank 0 at " + socket_path);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        int32_t self = rank;
+        send_all(fd, &self, sizeof(self));
+        m_peers.assign(1, fd);
+    }
+    m_stats = CommStats{};
+#else
+    (void)socket_path;
+    (void)timeout_sec;
+    throw std::runtime_error("Multi-process training needs Unix domain sockets");
+#endif
+}
+
+
+ProcessGroup::~ProcessGroup()
+{
+#ifdef PG_HAS_SOCKETS
+    for (int fd: m_peers)
+        if (fd >= 0)
+            close(fd);
+#endif
+}
+
+
+int ProcessGroup::rank() const
+{
+    return m_rank;
+}
+
+
+int ProcessGroup::worldSize() const
+{
+    return m_world_size;
+}
+
+
+CommStats ProcessGroup::stats() const
+{
+    return m_stats;
+}
+
+
+void ProcessGroup::send_all(int fd, const void *data, size_t size)
+{
+#ifdef PG_HAS_SOCKETS
+    const char *ptr = static_cast<const char *>(data);
+    while (size > 0) {
+        ssize_t sent = send(fd, ptr, size, SEND_FLAGS);
+        if (sent <= 0)
+            throw std::runtime_error("Lost connection between ranks");
+        ptr += sent;
+        size -= sent;
+        m_stats.bytes_sent += sent;
+    }
+#endif
+}
+
+
+void ProcessGroup::recv_all(int fd, void *data, size_t size)
+{
+#ifdef PG_HAS_SOCKETS
+    char *ptr = static_cast<char *>(data);
+    while (size > 0) {
+        ssize_t received = recv(fd, ptr, size, 0);
+        if (received <= 0)
+            throw std::runtime_error("Lost connection between ranks");
+        ptr += received;
+        size -= received;
+        m_stats.bytes_received += received;
+    }
+#endif
+}
+
+
+void ProcessGroup::allreduceSum(float *data, size_t n)
+{
+    if (m_world_size == 1)
+        return;
+    auto start = std::chrono::steady_clock::now();
+
+    const size_t size = n * sizeof(float);
+    if (m_rank == 0) {
+        m_recv_buffer.resize(n);
+        for (int peer = 1; peer < m_world_size; ++peer) {
+            recv_all(m_peers[peer], m_recv_buffer.data(), size);
+            for (size_t i = 0; i < n; ++i)
+                data[i] += m_recv_buffer[i];
+        }
+        for (int peer = 1; peer < m_world_size; ++peer)
+            send_all(m_peers[peer], data, size);
+    } else {
+        send_all(m_peers[0], data, size);
+        recv_all(m_peers[0], data, size);
+    }
+
+    m_stats.comm_ms += std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    m_stats.n_calls += 1;
+}
+
+
+void ProcessGroup::broadcast(float *data, size_t n)
+{
+    if (m_world_size == 1)
+        return;
+    auto start = std::chrono::steady_clock::now();
+
+    if (m_rank == 0) {
+        for (int peer = 1; peer < m_world_size; ++peer)
+            send_all(m_peers[peer], data, n * sizeof(float));
+    } else {
+        recv_all(m_peers[0], data, n * sizeof(float));
+    }
+
+    m_stats.comm_ms += std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    m_stats.n_calls += 1;
+}
+
+
+void ProcessGroup::barrier()
+{
+    float token = 0.0f;
+    allreduceSum(&token, 1);
+}
+
+
+#ifdef PG_HAS_SOCKETS
+static std::vector<pid_t> spawned_ranks;
+#endif
+
+
+int spawn_local_ranks(int world_size)
+{
+#ifdef PG_HAS_SOCKETS
+    for (int rank = 1; rank < world_size; ++rank) {
+        pid_t pid = fork();
+        if (pid < 0)
+            throw std::runtime_error("Can't start rank " + std::to_string(rank));
+        if (pid == 0) {
+            spawned_ranks.clear();
+            return rank;
+        }
+        spawned_ranks.push_back(pid);
+    }
+    return 0;
+#else
+    if (world_size > 1)
+        throw std::runtime_error("Multi-process training needs fork");
+    return 0;
+#endif
+}
+
+
+bool wait_local_ranks()
+{
+    bool ok = true;
+#ifdef PG_HAS_SOCKETS
+    for (pid_t pid: spawned_ranks) {
+        int status = 0;
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            ok = false;
+    }
+    spawned_ranks.clear();
+#endif
+    return ok;
+}
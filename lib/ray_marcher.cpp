@@ -1,15 +1,26 @@
 #include "ray_marcher.h"
+#include "thread_pool.h"
+
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+
+// field of view of the camera, in degrees
+static const float FOV = 90.0f;
+// a ray that left the cube by more than this is done
+static const float CUBE_EPS = 1e-4f;
 
 
 float3 RayMarcher::EstimateNormal(float3 p) const
-{  
-    float eps = 1e-4;
-    float d = sdf(p);
-    return normalize(float3(
-        sdf(float3(p.x + eps, p.y, p.z)) - d,
-        sdf(float3(p.x, p.y + eps, p.z)) - d,
-        sdf(float3(p.x, p.y, p.z + eps)) - d
-    ));
+{
+    float point[INPUT_DIM] = { p.x, p.y, p.z };
+    float dist, grad[INPUT_DIM];
+    sdfGradBatch(&dist, grad, point, 1);
+    return normalize(float3(grad[0], grad[1], grad[2]));
 }
 
 
@@ -26,6 +37,23 @@ float unitCubeSDF(float3 p)
 }
 
 
+// gradient of unitCubeSDF: direction to the nearest surface point outside,
+// normal of the nearest face inside
+float3 unitCubeGradient(float3 p)
+{
+    float3 d = abs(p) - float3(1.0f, 1.0f, 1.0f);
+    float3 s(p.x < 0.0f ? -1.0f : 1.0f, p.y < 0.0f ? -1.0f : 1.0f, p.z < 0.0f ? -1.0f : 1.0f);
+    float3 outside = vecMax(d, 0.0f);
+    if (length(outside) > 0.0f)
+        return normalize(outside) * s;
+    if (d.x >= d.y && d.x >= d.z)
+        return float3(s.x, 0.0f, 0.0f);
+    if (d.y >= d.z)
+        return float3(0.0f, s.y, 0.0f);
+    return float3(0.0f, 0.0f, s.z);
+}
+
+
 std::ostream &operator<<(std::ostream &os, float3 p)
 {
     os << p.x << " " << p.y << " " << p.z;
@@ -33,68 +61,890 @@ std::ostream &operator<<(std::ostream &os, float3 p)
 }
 
 
+void MarchStats::addRay(uint32_t steps)
+{
+    uint32_t bin = 0;
+    while (bin + 1 < N_BINS && steps >= (1u << bin))
+        ++bin;
+    step_histogram[bin] += 1;
+    n_rays += 1;
+    n_steps += steps;
+}
+
+
+void MarchStats::merge(const MarchStats &other)
+{
+    for (uint32_t bin = 0; bin < N_BINS; ++bin)
+        step_histogram[bin] += other.step_histogram[bin];
+    n_rays += other.n_rays;
+    n_steps += other.n_steps;
+    n_node_skips += other.n_node_skips;
+}
+
+
+// Marching state of a ray, its position is origin + t dir
+struct RayState
+{
+    float3 origin, dir;
+    float t = 0.0f;
+    // the last sample, and the last one in front of the surface with its step
+    float dist = 0.0f;
+    float front_t = -1.0f, front_dist = 0.0f;
+    float step = 0.0f, relaxation = 1.0f;
+    uint32_t steps = 0;
+    // a cone hit whose refinement found the ray passing the surface
+    bool missed = false;
+
+    float3 pos() const { return origin + dir * t; }
+};
+
+
+enum class MarchResult
+{
+    Continue,
+    Hit,
+    Miss
+};
+
+
+// Takes a step from the sdf bound dist at the ray's position, which is one lookup
+static MarchResult march_step(const MarchCfg &cfg, float cone, RayState &ray, float dist)
+{
+    ray.steps += 1;
+    const float r = dist / cfg.lipschitz;
+    // the spheres of this and the previous sample don't overlap: the relaxed step may have
+    // jumped over the surface, go back to the previous sample and take a plain step from it
+    if (ray.relaxation > 1.0f && ray.front_t >= 0.0f &&
+        std::fabs(r) + ray.front_dist / cfg.lipschitz < ray.step) {
+        ray.step = ray.front_dist / cfg.lipschitz;
+        ray.t = ray.front_t + ray.step;
+        ray.relaxation = 1.0f;
+        return MarchResult::Continue;
+    }
+
+    ray.dist = dist;
+    if (dist > cfg.max_dist)
+        return MarchResult::Miss;
+    if (r <= max(cfg.min_dist, cone * ray.t))
+        return MarchResult::Hit;
+
+    ray.front_t = ray.t;
+    ray.front_dist = dist;
+    ray.step = ray.relaxation * r;
+    ray.t += ray.step;
+    // after a plain fallback step the next one is relaxed again
+    ray.relaxation = cfg.relaxation;
+    return MarchResult::Continue;
+}
+
+
+// Where to sample next while refining a hit: the secant through the last two samples,
+// which is regula falsi once the last one is behind the surface
+static float refine_guess(const RayState &ray)
+{
+    if (ray.front_t < 0.0f)
+        return ray.t + ray.dist;
+    const float slope = (ray.front_dist - ray.dist) / (ray.t - ray.front_t);
+    if (ray.dist <= 0.0f)
+        return ray.front_t + ray.front_dist / max(slope, 1e-6f);
+    // in front of the surface: a grazing ray could shoot far, so steps are at most 4 sdf
+    return ray.t + ray.dist / clamp(slope, 0.25f, 1.0f);
+}
+
+
+static void refine_update(RayState &ray, float t, float dist)
+{
+    ray.steps += 1;
+    if (ray.missed)
+        return;
+    // the sdf grows in front of the surface: the ray went past it within the hit threshold
+    if (ray.dist > 0.0f && dist >= ray.dist && t > ray.t) {
+        ray.missed = true;
+        return;
+    }
+    if (dist > 0.0f && ray.dist <= 0.0f) {
+        // the bracket closes in from the front
+        ray.front_t = t;
+        ray.front_dist = dist;
+        return;
+    }
+    if (ray.dist > 0.0f) {
+        ray.front_t = ray.t;
+        ray.front_dist = ray.dist;
+    }
+    ray.t = t;
+    ray.dist = dist;
+}
+
+
+// After refinement a cone hit has to end up behind the surface or this close to it in
+// cone radii, otherwise it is a ray grazing the silhouette
+static const float REFINED_HIT_CONE = 0.25f;
+
+static bool refined_hit(const MarchCfg &cfg, float cone, const RayState &ray)
+{
+    return !ray.missed && (cfg.refine_steps == 0 ||
+        ray.dist <= max(cfg.min_dist, REFINED_HIT_CONE * cone * ray.t));
+}
+
+
+// final hit point: the sample closest to the surface, moved by its sdf along the ray
+static float3 hit_point(const RayState &ray)
+{
+    if (ray.front_t >= 0.0f && std::fabs(ray.front_dist) < std::fabs(ray.dist))
+        return ray.origin + ray.dir * (ray.front_t + ray.front_dist);
+    return ray.origin + ray.dir * (ray.t + ray.dist);
+}
+
+
+// Moves the ray to where it enters the cube, then past empty leaves in front of it.
+// False if the ray misses the cube or has left it.
+static bool clip_ray(const SdfOctree &octree, RayState &ray, bool first, uint64_t &n_skips)
+{
+    if (first) {
+        float t_near, t_far;
+        const float3 corner(1.0f, 1.0f, 1.0f);
+        if (!ray_box_intersection(ray.origin, ray.dir, -corner, corner, t_near, t_far) || t_far < 0.0f)
+            return false;
+        ray.t = max(t_near, 0.0f);
+    }
+    for (;;) {
+        const float3 p = ray.pos();
+        // the cube is convex, a ray that has been in it and is outside now won't come back
+        if (unitCubeSDF(p) > CUBE_EPS)
+            return false;
+        const float skip = octree.emptyDistance(p, ray.dir);
+        if (skip == 0.0f)
+            return true;
+        ray.t += skip;
+        // the previous sample is behind the skipped leaves, over-relaxation starts anew
+        ray.front_t = -1.0f;
+        n_skips += 1;
+    }
+}
+
+
 uint32_t RayMarcher::MarchOneRay(float3 rayPos, float3 rayDir) const
 {
-    int max_iterations = 100;
-    float max_dist = 100.0f;
-    float min_dist = 1e-4;
+    MarchStats stats;
+    return MarchOneRay(rayPos, rayDir, stats);
+}
+
 
-    float4 resColor(0.0f);
-    for (int i = 0; i < max_iterations; ++i) {
-        float dist = sdf(rayPos);
+uint32_t RayMarcher::MarchOneRay(float3 rayPos, float3 rayDir, MarchStats &stats) const
+{
+    const MarchCfg &cfg = m_march_cfg;
+    const float cone = cfg.hit_pixels * m_pixel_footprint;
 
-        if (dist > max_dist) {
+    RayState ray;
+    ray.origin = rayPos;
+    ray.dir = rayDir;
+    ray.relaxation = cfg.relaxation;
+    uint32_t color = RealColorToUint32(float4(0.0f));
+    for (uint32_t i = 0; i < cfg.max_iterations; ++i) {
+        if (m_octree && !clip_ray(*m_octree, ray, i == 0, stats.n_node_skips))
             break;
-        }
 
-        float3 new_pos = rayPos + rayDir * dist;
+        const MarchResult result = march_step(cfg, cone, ray, marchDistance(ray.pos()));
+        if (result == MarchResult::Miss)
+            break;
 
-        if (dist <= min_dist) {
-            float3 lightDirection = normalize(m_light.direction - new_pos);
-            float3 normal = EstimateNormal(new_pos);
-            float color = max(0.1f, dot(lightDirection, normal)) * m_light.intensity;
-            return RealColorToUint32(float4(color, color, color, 1.0f));
+        if (result == MarchResult::Hit) {
+            for (uint32_t j = 0; j < cfg.refine_steps && !ray.missed; ++j) {
+                const float t = refine_guess(ray);
+                refine_update(ray, t, sdf(ray.origin + ray.dir * t));
+            }
+            if (!refined_hit(cfg, cone, ray))
+                break;
+            const float3 p = hit_point(ray);
+            float3 lightDirection = normalize(m_light.direction - p);
+            float3 normal = EstimateNormal(p);
+            float shade = max(0.1f, dot(lightDirection, normal)) * m_light.intensity;
+            color = RealColorToUint32(float4(shade, shade, shade, 1.0f));
+            break;
         }
-
-        rayPos = new_pos;
     }
 
-    return RealColorToUint32(resColor);
+    stats.addRay(ray.steps);
+    return color;
 }
 
 
 float RayMarcher::sdf(float3 p) const
 {
-    std::vector<float> point = { p.x, p.y, p.z };
-    std::vector<float> dist(1);
-    m_nn->forward(dist.data(), point.data(), 1);
-    return max(dist[0], unitCubeSDF(p));
+    float point[INPUT_DIM] = { p.x, p.y, p.z };
+    float dist;
+    m_model->forward(&dist, point, 1);
+    return max(dist, unitCubeSDF(p));
 }
 
 
-RayMarcher::RayMarcher(Camera cam, Light light, std::shared_ptr<SirenNetwork> net)
+static void camera_matrices(const Camera &cam, float4x4 &worldViewInv, float4x4 &worldViewProjInv)
 {
     const float4x4 view = lookAt(cam.pos, cam.look_at, cam.up);
-    const float4x4 proj = perspectiveMatrix(90.0f, 1.0f, cam.z_near, cam.z_far);
-    m_worldViewInv      = inverse4x4(view);
-    m_worldViewProjInv  = inverse4x4(proj);
-    m_nn = net;
+    const float4x4 proj = perspectiveMatrix(FOV, 1.0f, cam.z_near, cam.z_far);
+    worldViewInv      = inverse4x4(view);
+    worldViewProjInv  = inverse4x4(proj);
+}
+
+
+// primary ray through the center of pixel (x, y) of a camera given by its inverse matrices
+static void eye_ray(uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+    const float4x4 &worldViewInv, const float4x4 &worldViewProjInv, float3 &rayPos, float3 &rayDir)
+{
+    rayDir = EyeRayDir((float(x) + 0.5f) / float(width), (float(y) + 0.5f) / float(height), worldViewProjInv);
+    rayPos = float3(0.0f, 0.0f, 0.0f);
+    transform_ray3f(worldViewInv, &rayPos, &rayDir);
+}
+
+
+RayMarcher::RayMarcher(Camera cam, Light light, std::shared_ptr<const SirenModel> model,
+    RenderMode mode, uint32_t tile_size)
+{
+    setCamera(cam);
+    m_model = model;
     m_light = light;
+    m_mode = mode;
+    m_tile_size = std::max(tile_size, 1u);
+}
+
+
+const TileStats &RayMarcher::getTileStats() const
+{
+    return m_tile_stats;
+}
+
+
+const MarchStats &RayMarcher::getMarchStats() const
+{
+    return m_march_stats;
+}
+
+
+const ProgressiveStats &RayMarcher::getProgressiveStats() const
+{
+    return m_progressive_stats;
+}
+
+
+void RayMarcher::setSdfCache(std::shared_ptr<const SdfCache> cache, float band)
+{
+    if (cache && !cache->matches(*m_model))
+        throw std::runtime_error("Sdf cache was baked from a different model");
+    m_cache = cache;
+    m_cache_band = band;
+}
+
+
+void RayMarcher::setOctree(std::shared_ptr<const SdfOctree> octree)
+{
+    m_octree = octree;
+}
+
+
+void RayMarcher::setMarchCfg(const MarchCfg &cfg)
+{
+    if (!(cfg.relaxation >= 1.0f && cfg.relaxation < 2.0f))
+        throw std::runtime_error("Over-relaxation must be in [1, 2)");
+    if (!(cfg.lipschitz > 0.0f))
+        throw std::runtime_error("Lipschitz constant must be positive");
+    m_march_cfg = cfg;
+}
+
+
+const MarchCfg &RayMarcher::getMarchCfg() const
+{
+    return m_march_cfg;
+}
+
+
+void RayMarcher::setProgressiveCfg(const ProgressiveCfg &cfg)
+{
+    if (cfg.coarse_step == 0 || (cfg.coarse_step & (cfg.coarse_step - 1)) != 0)
+        throw std::runtime_error("Progressive coarse step must be a power of two");
+    m_progressive_cfg = cfg;
+}
+
+
+void RayMarcher::setRenderSink(std::shared_ptr<RenderSink> sink)
+{
+    m_sink = sink;
+}
+
+
+float RayMarcher::marchDistance(float3 p) const
+{
+    if (m_cache) {
+        float bound = max(m_cache->lowerBound(p), unitCubeSDF(p));
+        if (bound > m_cache_band)
+            return bound;
+    }
+    return sdf(p);
+}
+
+
+void RayMarcher::marchDistanceBatch(SirenWorkspace &workspace, float *dist, const float *points,
+    uint32_t n) const
+{
+    if (!m_cache) {
+        sdfBatch(workspace, dist, points, n);
+        return;
+    }
+
+    // points within the band are gathered into one network batch
+    thread_local std::vector<uint32_t> near_ids;
+    thread_local std::vector<float> near_points, near_dist;
+    near_ids.clear();
+    for (uint32_t i = 0; i < n; ++i) {
+        float3 p(points[i], points[n + i], points[2 * n + i]);
+        dist[i] = max(m_cache->lowerBound(p), unitCubeSDF(p));
+        if (dist[i] <= m_cache_band)
+            near_ids.push_back(i);
+    }
+
+    const uint32_t n_near = near_ids.size();
+    if (n_near == 0)
+        return;
+    near_points.resize(INPUT_DIM * n_near);
+    near_dist.resize(n_near);
+    for (uint32_t j = 0; j < n_near; ++j) {
+        for (int dim = 0; dim < INPUT_DIM; ++dim)
+            near_points[dim * n_near + j] = points[dim * n + near_ids[j]];
+    }
+    sdfBatch(workspace, near_dist.data(), near_points.data(), n_near);
+    for (uint32_t j = 0; j < n_near; ++j)
+        dist[near_ids[j]] = near_dist[j];
+}
+
+
+void RayMarcher::EyeRay(uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+    float3 &rayPos, float3 &rayDir) const
+{
+    eye_ray(x, y, width, height, m_worldViewInv, m_worldViewProjInv, rayPos, rayDir);
+}
+
+
+void RayMarcher::setCamera(const Camera &cam)
+{
+    camera_matrices(cam, m_worldViewInv, m_worldViewProjInv);
 }
 
 
 std::vector<uint> RayMarcher::render(uint32_t width, uint32_t height) const
+{
+    m_march_stats = MarchStats{};
+    m_pixel_footprint = 2.0f * std::tan(FOV * float(M_PI) / 360.0f) / float(std::max(width, 1u));
+    if (m_mode == RenderMode::Tiled)
+        return renderTiled(width, height);
+    if (m_mode == RenderMode::Progressive)
+        return renderProgressive(width, height);
+
+    std::vector<uint> out_color = m_mode == RenderMode::Wavefront ?
+        renderWavefront(width, height) : renderPerPixel(width, height);
+    sendToSink(0, 0, width, height, out_color.data(), true);
+    return out_color;
+}
+
+
+void RayMarcher::sendToSink(uint32_t x0, uint32_t y0, uint32_t w, uint32_t h, const uint *pixels,
+    bool final) const
+{
+    if (!m_sink || w == 0 || h == 0)
+        return;
+    std::lock_guard<std::mutex> lock(m_sink_mutex);
+    m_sink->writeTile(x0, y0, w, h, pixels, final);
+}
+
+
+std::vector<uint> RayMarcher::renderPerPixel(uint32_t width, uint32_t height) const
 {
     std::vector<uint> out_color(width * height);
 
+    MarchStats stats;
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            float3 rayPos, rayDir;
+            EyeRay(x, y, width, height, rayPos, rayDir);
+            out_color[y * width + x] = MarchOneRay(rayPos, rayDir, stats);
+        }
+    }
+    m_march_stats.merge(stats);
+
+    return out_color;
+}
+
+
+void RayMarcher::sdfBatch(float *dist, const float *points, uint32_t n) const
+{
+    thread_local SirenWorkspace workspace;
+    sdfBatch(workspace, dist, points, n);
+}
+
+
+void RayMarcher::sdfBatch(SirenWorkspace &workspace, float *dist, const float *points,
+    uint32_t n) const
+{
+    m_model->forward(dist, points, n, workspace);
+
+    for (uint32_t i = 0; i < n; ++i) {
+        float3 p(points[i], points[n + i], points[2 * n + i]);
+        dist[i] = max(dist[i], unitCubeSDF(p));
+    }
+}
+
+
+void RayMarcher::sdfGradBatch(float *dist, float *grad, const float *points, uint32_t n) const
+{
+    thread_local SirenWorkspace workspace;
+    sdfGradBatch(workspace, dist, grad, points, n);
+}
+
+
+void RayMarcher::sdfGradBatch(SirenWorkspace &workspace, float *dist, float *grad,
+    const float *points, uint32_t n) const
+{
+    m_model->forwardWithGradient(dist, grad, points, n, workspace);
+
+    // sdf is max(network, cube), the gradient comes from the larger one
+    for (uint32_t i = 0; i < n; ++i) {
+        float3 p(points[i], points[n + i], points[2 * n + i]);
+        float cube = unitCubeSDF(p);
+        if (cube > dist[i]) {
+            dist[i] = cube;
+            float3 g = unitCubeGradient(p);
+            for (int dim = 0; dim < INPUT_DIM; ++dim)
+                grad[dim * n + i] = g[dim];
+        }
+    }
+}
+
+
+void RayMarcher::MarchRays(const float3 *rayPos, const float3 *rayDir, uint32_t n_rays,
+    uint *out_color) const
+{
+    thread_local SirenWorkspace workspace;
+    MarchRays(workspace, rayPos, rayDir, n_rays, out_color);
+}
+
+
+void RayMarcher::MarchRays(SirenWorkspace &workspace, const float3 *rayPos, const float3 *rayDir,
+    uint32_t n_rays, uint *out_color) const
+{
+    const MarchCfg &cfg = m_march_cfg;
+    const float cone = cfg.hit_pixels * m_pixel_footprint;
+
+    // states of all rays, the active ones are listed in ray_ids and their positions are
+    // gathered in SoA layout [3 x n_active] for every lookup
+    std::vector<RayState> rays(n_rays);
+    std::vector<uint32_t> ray_ids(n_rays), next_ray_ids;
+    for (uint32_t i = 0; i < n_rays; ++i) {
+        rays[i].origin = rayPos[i];
+        rays[i].dir = rayDir[i];
+        rays[i].relaxation = cfg.relaxation;
+        ray_ids[i] = i;
+        out_color[i] = RealColorToUint32(float4(0.0f));
+    }
+
+    std::vector<float> pos(INPUT_DIM * n_rays), dist(n_rays);
+    std::vector<uint32_t> hit_ids;
+    MarchStats stats;
+
+    for (uint32_t iter = 0; iter < cfg.max_iterations && !ray_ids.empty(); ++iter) {
+        if (m_octree) {
+            // rays that miss the cube or have left it are dropped before the lookup
+            next_ray_ids.clear();
+            for (uint32_t id: ray_ids) {
+                if (clip_ray(*m_octree, rays[id], iter == 0, stats.n_node_skips))
+                    next_ray_ids.push_back(id);
+            }
+            std::swap(ray_ids, next_ray_ids);
+        }
+
+        const uint32_t n_active = ray_ids.size();
+        for (uint32_t j = 0; j < n_active; ++j) {
+            const float3 p = rays[ray_ids[j]].pos();
+            for (int dim = 0; dim < INPUT_DIM; ++dim)
+                pos[dim * n_active + j] = p[dim];
+        }
+        marchDistanceBatch(workspace, dist.data(), pos.data(), n_active);
+
+        next_ray_ids.clear();
+        for (uint32_t j = 0; j < n_active; ++j) {
+            const uint32_t id = ray_ids[j];
+            const MarchResult result = march_step(cfg, cone, rays[id], dist[j]);
+            if (result == MarchResult::Hit)
+                hit_ids.push_back(id);
+            else if (result == MarchResult::Continue)
+                next_ray_ids.push_back(id);
+        }
+        std::swap(ray_ids, next_ray_ids);
+    }
+
+    // refinement of all hits together, on the network sdf
+    std::vector<float> refine_t(hit_ids.size());
+    for (uint32_t j = 0; j < cfg.refine_steps && !hit_ids.empty(); ++j) {
+        const uint32_t n_hits = hit_ids.size();
+        for (uint32_t h = 0; h < n_hits; ++h) {
+            const RayState &ray = rays[hit_ids[h]];
+            refine_t[h] = refine_guess(ray);
+            const float3 p = ray.origin + ray.dir * refine_t[h];
+            for (int dim = 0; dim < INPUT_DIM; ++dim)
+                pos[dim * n_hits + h] = p[dim];
+        }
+        sdfBatch(workspace, dist.data(), pos.data(), n_hits);
+        next_ray_ids.clear();
+        for (uint32_t h = 0; h < n_hits; ++h) {
+            refine_update(rays[hit_ids[h]], refine_t[h], dist[h]);
+            if (!rays[hit_ids[h]].missed)
+                next_ray_ids.push_back(hit_ids[h]);
+        }
+        std::swap(hit_ids, next_ray_ids);
+    }
+    next_ray_ids.clear();
+    for (uint32_t id: hit_ids) {
+        if (refined_hit(cfg, cone, rays[id]))
+            next_ray_ids.push_back(id);
+    }
+    std::swap(hit_ids, next_ray_ids);
+
+    for (const RayState &ray: rays)
+        stats.addRay(ray.steps);
+    {
+        std::lock_guard<std::mutex> lock(m_march_stats_mutex);
+        m_march_stats.merge(stats);
+    }
+
+    // shading: normals are sdf gradients at the hit points, all in one batch
+    const uint32_t n_hits = hit_ids.size();
+    if (n_hits == 0)
+        return;
+
+    std::vector<float> hits(INPUT_DIM * n_hits);
+    for (uint32_t h = 0; h < n_hits; ++h) {
+        const float3 p = hit_point(rays[hit_ids[h]]);
+        for (int dim = 0; dim < INPUT_DIM; ++dim)
+            hits[dim * n_hits + h] = p[dim];
+    }
+
+    std::vector<float> hit_dist(n_hits), hit_grad(INPUT_DIM * n_hits);
+    sdfGradBatch(workspace, hit_dist.data(), hit_grad.data(), hits.data(), n_hits);
+
+    for (uint32_t h = 0; h < n_hits; ++h) {
+        float3 p(hits[h], hits[n_hits + h], hits[2 * n_hits + h]);
+        float3 normal = normalize(float3(
+            hit_grad[h], hit_grad[n_hits + h], hit_grad[2 * n_hits + h]));
+        float3 lightDirection = normalize(m_light.direction - p);
+        float color = max(0.1f, dot(lightDirection, normal)) * m_light.intensity;
+        out_color[hit_ids[h]] = RealColorToUint32(float4(color, color, color, 1.0f));
+    }
+}
+
+
+std::vector<uint> RayMarcher::renderWavefront(uint32_t width, uint32_t height) const
+{
+    std::vector<float3> rayPos(width * height), rayDir(width * height);
     for (uint32_t y = 0; y < height; ++y) {
         for (uint32_t x = 0; x < width; ++x) {
-            float3 rayDir = EyeRayDir((float(x) + 0.5f) / float(width), (float(y) + 0.5f) / float(height), m_worldViewProjInv); 
-            float3 rayPos = float3(0.0f, 0.0f, 0.0f);
-            transform_ray3f(m_worldViewInv, &rayPos, &rayDir);
-            out_color[y * width + x] = MarchOneRay(rayPos, rayDir);
+            EyeRay(x, y, width, height, rayPos[y * width + x], rayDir[y * width + x]);
+        }
+    }
+
+    std::vector<uint> out_color(width * height);
+    MarchRays(rayPos.data(), rayDir.data(), width * height, out_color.data());
+    return out_color;
+}
+
+
+// Tiles of one worker, its owner takes them from the front and thieves from the back
+struct TileQueue
+{
+    std::mutex mutex;
+    std::deque<uint32_t> tiles;
+};
+
+
+static bool pop_tile(TileQueue &queue, bool steal, uint32_t &tile)
+{
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tiles.empty())
+        return false;
+    if (steal) {
+        tile = queue.tiles.back();
+        queue.tiles.pop_back();
+    } else {
+        tile = queue.tiles.front();
+        queue.tiles.pop_front();
+    }
+    return true;
+}
+
+
+std::vector<uint> RayMarcher::renderTiled(uint32_t width, uint32_t height) const
+{
+    using clock = std::chrono::high_resolution_clock;
+
+    const uint32_t tile_size = m_tile_size;
+    const uint32_t tiles_x = (width + tile_size - 1) / tile_size;
+    const uint32_t tiles_y = (height + tile_size - 1) / tile_size;
+    const uint32_t n_tiles = tiles_x * tiles_y;
+
+    std::vector<uint> out_color(width * height);
+    m_tile_stats = TileStats{};
+    if (n_tiles == 0)
+        return out_color;
+
+    ThreadPool &pool = nn_thread_pool();
+    const uint32_t n_workers = std::min<uint32_t>(pool.size(), n_tiles);
+
+    // every worker starts with a contiguous band of tiles: neighbouring tiles
+    // cost about the same, so unbalanced bands are evened out by stealing
+    std::vector<TileQueue> queues(n_workers);
+    for (uint32_t tile = 0; tile < n_tiles; ++tile)
+        queues[uint64_t(tile) * n_workers / n_tiles].tiles.push_back(tile);
+
+    std::vector<float> tile_ms(n_tiles), busy_ms(n_workers);
+    std::atomic<uint32_t> n_steals{0};
+
+    pool.run(n_workers, [&](uint32_t worker) {
+        // the model is shared, every worker only owns its scratch memory
+        SirenWorkspace workspace;
+
+        std::vector<float3> rayPos(tile_size * tile_size), rayDir(tile_size * tile_size);
+        std::vector<uint> color(tile_size * tile_size);
+
+        for (;;) {
+            uint32_t tile;
+            bool found = pop_tile(queues[worker], false, tile);
+            for (uint32_t i = 1; !found && i < n_workers; ++i) {
+                found = pop_tile(queues[(worker + i) % n_workers], true, tile);
+                if (found)
+                    n_steals += 1;
+            }
+            if (!found)
+                break;
+
+            auto start = clock::now();
+            const uint32_t x0 = tile % tiles_x * tile_size, y0 = tile / tiles_x * tile_size;
+            const uint32_t w = std::min(tile_size, width - x0), h = std::min(tile_size, height - y0);
+            for (uint32_t y = 0; y < h; ++y) {
+                for (uint32_t x = 0; x < w; ++x)
+                    EyeRay(x0 + x, y0 + y, width, height, rayPos[y * w + x], rayDir[y * w + x]);
+            }
+
+            MarchRays(workspace, rayPos.data(), rayDir.data(), w * h, color.data());
+            for (uint32_t y = 0; y < h; ++y)
+                std::copy(color.begin() + y * w, color.begin() + (y + 1) * w,
+                    out_color.begin() + (y0 + y) * width + x0);
+            sendToSink(x0, y0, w, h, color.data(), true);
+
+            float elapsed = float(std::chrono::duration_cast<std::chrono::microseconds>(
+                clock::now() - start).count()) / 1e3f;
+            tile_ms[tile] = elapsed;
+            busy_ms[worker] += elapsed;
+        }
+    });
+
+    m_tile_stats.n_tiles = n_tiles;
+    m_tile_stats.n_workers = n_workers;
+    m_tile_stats.n_steals = n_steals;
+    m_tile_stats.min_tile_ms = *std::min_element(tile_ms.begin(), tile_ms.end());
+    m_tile_stats.max_tile_ms = *std::max_element(tile_ms.begin(), tile_ms.end());
+    for (float ms: tile_ms)
+        m_tile_stats.mean_tile_ms += ms / n_tiles;
+    m_tile_stats.worker_busy_ms = busy_ms;
+
+    return out_color;
+}
+
+
+std::vector<std::vector<uint>> RayMarcher::renderViews(const std::vector<Camera> &cams, uint32_t width,
+    uint32_t height, uint32_t chunk_rays) const
+{
+    m_march_stats = MarchStats{};
+    m_pixel_footprint = 2.0f * std::tan(FOV * float(M_PI) / 360.0f) / float(std::max(width, 1u));
+
+    const uint32_t n_views = cams.size(), n_pixels = width * height;
+    std::vector<float4x4> view_inv(n_views), view_proj_inv(n_views);
+    for (uint32_t v = 0; v < n_views; ++v)
+        camera_matrices(cams[v], view_inv[v], view_proj_inv[v]);
+
+    std::vector<std::vector<uint>> images(n_views, std::vector<uint>(n_pixels));
+    // rays are numbered view by view, pixels row by row
+    const uint64_t n_rays = uint64_t(n_views) * n_pixels;
+    const uint64_t chunk = std::max(chunk_rays, 1u);
+    const uint64_t n_chunks = (n_rays + chunk - 1) / chunk;
+    if (n_chunks == 0)
+        return images;
+
+    ThreadPool &pool = nn_thread_pool();
+    const uint32_t n_workers = std::min<uint64_t>(pool.size(), n_chunks);
+    std::atomic<uint64_t> next_chunk{0};
+    pool.run(n_workers, [&](uint32_t) {
+        SirenWorkspace workspace;
+        std::vector<float3> rayPos(chunk), rayDir(chunk);
+        std::vector<uint> color(chunk);
+
+        for (uint64_t c = next_chunk++; c < n_chunks; c = next_chunk++) {
+            const uint64_t begin = c * chunk, end = std::min(n_rays, begin + chunk);
+            for (uint64_t r = begin; r < end; ++r) {
+                const uint32_t v = r / n_pixels, p = r % n_pixels;
+                eye_ray(p % width, p / width, width, height, view_inv[v], view_proj_inv[v],
+                    rayPos[r - begin], rayDir[r - begin]);
+            }
+            MarchRays(workspace, rayPos.data(), rayDir.data(), end - begin, color.data());
+            for (uint64_t r = begin; r < end; ++r)
+                images[r / n_pixels][r % n_pixels] = color[r - begin];
+        }
+    });
+
+    return images;
+}
+
+
+// largest difference of the 8 bit channels of two colors
+static uint32_t color_difference(uint a, uint b)
+{
+    uint32_t diff = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        const int ca = (a >> shift) & 0xFF, cb = (b >> shift) & 0xFF;
+        diff = std::max<uint32_t>(diff, std::abs(ca - cb));
+    }
+    return diff;
+}
+
+
+// bilinear interpolation of the corner colors c[0..3] = (x0, y0), (x1, y0), (x0, y1), (x1, y1)
+static uint interpolate_color(const uint *c, float fx, float fy)
+{
+    uint color = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        const float top = ((c[0] >> shift) & 0xFF) * (1.0f - fx) + ((c[1] >> shift) & 0xFF) * fx;
+        const float bottom = ((c[2] >> shift) & 0xFF) * (1.0f - fx) + ((c[3] >> shift) & 0xFF) * fx;
+        color |= uint(top * (1.0f - fy) + bottom * fy + 0.5f) << shift;
+    }
+    return color;
+}
+
+
+std::vector<uint> RayMarcher::renderProgressive(uint32_t width, uint32_t height) const
+{
+    using clock = std::chrono::high_resolution_clock;
+    const auto start = clock::now();
+
+    const uint32_t coarse = m_progressive_cfg.coarse_step;
+    const uint32_t tile_size = m_tile_size;
+    const uint32_t tiles_x = (width + tile_size - 1) / tile_size;
+    const uint32_t n_tiles = tiles_x * ((height + tile_size - 1) / tile_size);
+
+    std::vector<uint> out_color(width * height), preview;
+    m_progressive_stats = ProgressiveStats{};
+    if (n_tiles == 0)
+        return out_color;
+
+    ThreadPool &pool = nn_thread_pool();
+    const uint32_t n_workers = std::min<uint32_t>(pool.size(), n_tiles);
+    std::atomic<uint32_t> n_interpolated{0};
+
+    for (uint32_t step = coarse; step > 0; step /= 2) {
+        const bool first = step == coarse, last = step == 1;
+        const uint32_t cell = 2 * step;
+        std::atomic<uint32_t> next_tile{0}, n_marched{0};
+
+        // a pass writes only pixels on its grid and reads the previous passes' ones,
+        // so tiles of a pass are independent
+        pool.run(n_workers, [&](uint32_t) {
+            SirenWorkspace workspace;
+            std::vector<float3> rayPos, rayDir;
+            std::vector<uint32_t> pixel_ids;
+            std::vector<uint> color, tile_color;
+
+            for (uint32_t tile = next_tile++; tile < n_tiles; tile = next_tile++) {
+                const uint32_t x0 = tile % tiles_x * tile_size, y0 = tile / tiles_x * tile_size;
+                const uint32_t w = std::min(tile_size, width - x0), h = std::min(tile_size, height - y0);
+
+                pixel_ids.clear();
+                uint32_t tile_interpolated = 0;
+                for (uint32_t y = (y0 + step - 1) / step * step; y < y0 + h; y += step) {
+                    for (uint32_t x = (x0 + step - 1) / step * step; x < x0 + w; x += step) {
+                        if (first) {
+                            pixel_ids.push_back(y * width + x);
+                            continue;
+                        }
+                        // done by a previous pass
+                        if (x % cell == 0 && y % cell == 0)
+                            continue;
+                        const uint32_t cx = x - x % cell, cy = y - y % cell;
+                        if (cx + cell >= width || cy + cell >= height) {
+                            pixel_ids.push_back(y * width + x);
+                            continue;
+                        }
+                        const uint corners[4] = {
+                            out_color[cy * width + cx], out_color[cy * width + cx + cell],
+                            out_color[(cy + cell) * width + cx], out_color[(cy + cell) * width + cx + cell] };
+                        uint32_t diff = 0;
+                        for (int c = 1; c < 4; ++c)
+                            diff = std::max(diff, color_difference(corners[0], corners[c]));
+                        if (diff > m_progressive_cfg.tolerance) {
+                            pixel_ids.push_back(y * width + x);
+                            continue;
+                        }
+                        out_color[y * width + x] = interpolate_color(corners,
+                            float(x - cx) / cell, float(y - cy) / cell);
+                        tile_interpolated += 1;
+                    }
+                }
+
+                const uint32_t n_rays = pixel_ids.size();
+                rayPos.resize(n_rays);
+                rayDir.resize(n_rays);
+                color.resize(n_rays);
+                for (uint32_t i = 0; i < n_rays; ++i)
+                    EyeRay(pixel_ids[i] % width, pixel_ids[i] / width, width, height, rayPos[i], rayDir[i]);
+                if (n_rays > 0)
+                    MarchRays(workspace, rayPos.data(), rayDir.data(), n_rays, color.data());
+                for (uint32_t i = 0; i < n_rays; ++i)
+                    out_color[pixel_ids[i]] = color[i];
+                n_marched += n_rays;
+                n_interpolated += tile_interpolated;
+
+                if (last) {
+                    tile_color.resize(w * h);
+                    for (uint32_t y = 0; y < h; ++y)
+                        std::copy_n(out_color.begin() + (y0 + y) * width + x0, w, tile_color.begin() + y * w);
+                    sendToSink(x0, y0, w, h, tile_color.data(), true);
+                }
+            }
+        });
+        m_progressive_stats.marched.push_back(n_marched);
+
+        if (!last && m_sink) {
+            // every pixel takes the color of the nearest one on the grid up and left of it
+            preview.resize(width * height);
+            for (uint32_t y = 0; y < height; ++y) {
+                for (uint32_t x = 0; x < width; ++x)
+                    preview[y * width + x] = out_color[(y - y % step) * width + x - x % step];
+            }
+            sendToSink(0, 0, width, height, preview.data(), false);
         }
+        if (first)
+            m_progressive_stats.first_pass_ms = float(std::chrono::duration_cast<std::chrono::microseconds>(
+                clock::now() - start).count()) / 1e3f;
     }
+    m_progressive_stats.n_interpolated = n_interpolated;
 
     return out_color;
 }
+
+
+RenderMode render_mode_from_string(const std::string &mode)
+{
+    if (mode == "wavefront")
+        return RenderMode::Wavefront;
+    if (mode == "per_pixel")
+        return RenderMode::PerPixel;
+    if (mode == "tiled")
+        return RenderMode::Tiled;
+    if (mode == "progressive")
+        return RenderMode::Progressive;
+    throw std::runtime_error("Unknown render mode: " + mode);
+}
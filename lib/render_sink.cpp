@@ -0,0 +1,84 @@
+#include "render_sink.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+
+static const uint32_t BMP_HEADER_BYTES = 54;
+
+
+static void put_le(unsigned char *dst, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+        dst[i] = (value >> (8 * i)) & 0xFF;
+}
+
+
+// Rows go bottom up as in LiteImage::SaveBMP, each padded to 4 bytes
+class BmpSink : public RenderSink
+{
+public:
+    BmpSink(const std::string &path, uint32_t width, uint32_t height)
+        : m_path(path), m_width(width), m_height(height), m_row_bytes((3 * width + 3) / 4 * 4)
+    {
+        m_out.open(path, std::ios::binary | std::ios::trunc);
+        if (!m_out)
+            throw std::runtime_error("Can't write " + path);
+
+        unsigned char header[BMP_HEADER_BYTES] = {'B', 'M'};
+        const uint32_t data_bytes = m_row_bytes * height;
+        put_le(header + 2, BMP_HEADER_BYTES + data_bytes, 4);
+        put_le(header + 10, BMP_HEADER_BYTES, 4);
+        put_le(header + 14, 40, 4);
+        put_le(header + 18, width, 4);
+        put_le(header + 22, height, 4);
+        put_le(header + 26, 1, 2);
+        put_le(header + 28, 24, 2);
+        put_le(header + 34, data_bytes, 4);
+        m_out.write(reinterpret_cast<const char *>(header), BMP_HEADER_BYTES);
+        const std::vector<char> row(m_row_bytes, 0);
+        for (uint32_t y = 0; y < height; ++y)
+            m_out.write(row.data(), m_row_bytes);
+        check();
+    }
+
+    // previews and final tiles are written alike, the last write of a pixel wins
+    void writeTile(uint32_t x0, uint32_t y0, uint32_t w, uint32_t h, const uint32_t *pixels,
+        bool) override
+    {
+        if (x0 + w > m_width || y0 + h > m_height)
+            throw std::runtime_error("Tile is outside the image of " + m_path);
+        m_row.resize(3 * w);
+        for (uint32_t y = 0; y < h; ++y) {
+            for (uint32_t x = 0; x < w; ++x) {
+                const uint32_t p = pixels[y * w + x];
+                m_row[3 * x] = char(p >> 16);
+                m_row[3 * x + 1] = char(p >> 8);
+                m_row[3 * x + 2] = char(p);
+            }
+            m_out.seekp(BMP_HEADER_BYTES + uint64_t(y0 + y) * m_row_bytes + 3 * x0);
+            m_out.write(m_row.data(), m_row.size());
+        }
+        m_out.flush();
+        check();
+    }
+
+private:
+    void check()
+    {
+        if (!m_out)
+            throw std::runtime_error("Failed writing " + m_path);
+    }
+
+    std::string m_path;
+    uint32_t m_width, m_height, m_row_bytes;
+    std::ofstream m_out;
+    std::vector<char> m_row;
+};
+
+
+std::shared_ptr<RenderSink> make_bmp_sink(const std::string &path, uint32_t width, uint32_t height)
+{
+    return std::make_shared<BmpSink>(path, width, height);
+}
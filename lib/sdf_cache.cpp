@@ -0,0 +1,269 @@
+#include "sdf_cache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+
+// a brick gets fine samples if a corner is closer to the surface than this many brick
+// diagonals (scaled by the lipschitz bound): a coarse brick then stays at least
+// half a diagonal away from the surface
+static const float FINE_BRICK_DIAGONALS = 1.0f;
+// points evaluated by one model call while baking
+static const uint32_t BAKE_CHUNK = 1 << 16;
+
+
+static uint64_t cube(uint64_t n)
+{
+    return n * n * n;
+}
+
+
+// words of the payload after the header
+static uint64_t payload_words(const SdfCacheHeader &h)
+{
+    return cube(h.bricks_per_axis + 1) + cube(h.bricks_per_axis) + h.n_fine * cube(h.brick_res + 1);
+}
+
+
+// point of a (res + 1)^3 lattice with the given origin and spacing, x fastest
+static float3 lattice_point(uint64_t i, uint32_t res, float3 origin, float step)
+{
+    const uint32_t side = res + 1;
+    return origin + float3(float(i % side), float(i / side % side), float(i / side / side)) * step;
+}
+
+
+// res[i] = model(point(i)) for i < n, in chunks of BAKE_CHUNK points
+template <typename PointFn>
+static void evaluate_points(const SirenModel &model, float *res, uint64_t n, PointFn point)
+{
+    std::vector<float> batch(INPUT_DIM * BAKE_CHUNK);
+    for (uint64_t begin = 0; begin < n; begin += BAKE_CHUNK) {
+        const uint32_t count = std::min<uint64_t>(BAKE_CHUNK, n - begin);
+        for (uint32_t i = 0; i < count; ++i) {
+            const float3 p = point(begin + i);
+            batch[i] = p.x;
+            batch[count + i] = p.y;
+            batch[2 * count + i] = p.z;
+        }
+        model.forward(res + begin, batch.data(), count);
+    }
+}
+
+
+// trilinear interpolation in a (side)^3 block of values, x fastest,
+// inside the cell with corner (x, y, z) at t in [0, 1]^3
+static float trilinear(const float *values, uint32_t side, uint32_t x, uint32_t y, uint32_t z, float3 t)
+{
+    const float *v = values + (uint64_t(z) * side + y) * side + x;
+    const uint64_t dy = side, dz = uint64_t(side) * side;
+    const float x00 = v[0] + (v[1] - v[0]) * t.x;
+    const float x10 = v[dy] + (v[dy + 1] - v[dy]) * t.x;
+    const float x01 = v[dz] + (v[dz + 1] - v[dz]) * t.x;
+    const float x11 = v[dz + dy] + (v[dz + dy + 1] - v[dz + dy]) * t.x;
+    const float y0 = x00 + (x10 - x00) * t.y;
+    const float y1 = x01 + (x11 - x01) * t.y;
+    return y0 + (y1 - y0) * t.z;
+}
+
+
+uint64_t sdf_cache_weights_checksum(const SirenModel &model)
+{
+    const std::vector<float> &weights = model.getWeights();
+    return nsdf_checksum(reinterpret_cast<const uint8_t *>(weights.data()),
+        weights.size() * sizeof(float));
+}
+
+
+SdfCache::SdfCache(const SirenModel &model, uint32_t bricks_per_axis, uint32_t brick_res)
+{
+    if (bricks_per_axis == 0 || brick_res == 0)
+        throw std::runtime_error("Sdf cache needs at least one brick and one cell per brick");
+
+    const uint32_t n_bricks = cube(bricks_per_axis);
+    const float brick_size = 2.0f / bricks_per_axis;
+    const float3 cube_min(-1.0f, -1.0f, -1.0f);
+
+    // coarse values at brick corners, the gradient there bounds the interpolation error
+    const uint32_t n_corners = cube(bricks_per_axis + 1);
+    std::vector<float> corners(INPUT_DIM * n_corners), coarse(n_corners), grad(INPUT_DIM * n_corners);
+    for (uint32_t i = 0; i < n_corners; ++i) {
+        const float3 p = lattice_point(i, bricks_per_axis, cube_min, brick_size);
+        for (int dim = 0; dim < INPUT_DIM; ++dim)
+            corners[dim * n_corners + i] = p[dim];
+    }
+    SirenWorkspace workspace;
+    model.forwardWithGradient(coarse.data(), grad.data(), corners.data(), n_corners, workspace);
+    float lipschitz = 1.0f;
+    for (uint32_t i = 0; i < n_corners; ++i)
+        lipschitz = std::max(lipschitz, length(float3(grad[i], grad[n_corners + i], grad[2 * n_corners + i])));
+
+    // bricks the surface may pass through or come close to get fine samples
+    const uint32_t side = bricks_per_axis + 1;
+    const float fine_distance = FINE_BRICK_DIAGONALS * lipschitz * brick_size * std::sqrt(3.0f);
+    std::vector<int32_t> bricks(n_bricks, -1);
+    std::vector<uint32_t> fine_bricks;
+    for (uint32_t b = 0; b < n_bricks; ++b) {
+        const uint32_t x = b % bricks_per_axis, y = b / bricks_per_axis % bricks_per_axis;
+        const uint32_t z = b / bricks_per_axis / bricks_per_axis;
+        float min_abs = std::numeric_limits<float>::max();
+        for (uint32_t corner = 0; corner < 8; ++corner) {
+            const uint32_t i = ((z + (corner >> 2)) * side + y + (corner >> 1 & 1)) * side + x + (corner & 1);
+            min_abs = std::min(min_abs, std::fabs(coarse[i]));
+        }
+        if (min_abs < fine_distance) {
+            bricks[b] = fine_bricks.size();
+            fine_bricks.push_back(b);
+        }
+    }
+
+    m_header = SdfCacheHeader{};
+    m_header.bricks_per_axis = bricks_per_axis;
+    m_header.brick_res = brick_res;
+    m_header.n_fine = fine_bricks.size();
+    m_header.precision = uint32_t(model.getPrecision());
+    m_header.weights_checksum = sdf_cache_weights_checksum(model);
+    m_header.lipschitz = lipschitz;
+
+    m_data.resize(sizeof(SdfCacheHeader) + payload_words(m_header) * sizeof(float));
+    uint8_t *dst = m_data.data();
+    std::memcpy(dst, &m_header, sizeof(SdfCacheHeader));
+    dst += sizeof(SdfCacheHeader);
+    std::memcpy(dst, coarse.data(), coarse.size() * sizeof(float));
+    dst += coarse.size() * sizeof(float);
+    std::memcpy(dst, bricks.data(), bricks.size() * sizeof(int32_t));
+    dst += bricks.size() * sizeof(int32_t);
+
+    // fine values are written in place, brick by brick
+    const uint64_t block = cube(brick_res + 1);
+    const float cell = brick_size / brick_res;
+    evaluate_points(model, reinterpret_cast<float *>(dst), fine_bricks.size() * block, [&](uint64_t i) {
+        const uint32_t b = fine_bricks[i / block];
+        const float3 origin = cube_min + float3(float(b % bricks_per_axis),
+            float(b / bricks_per_axis % bricks_per_axis), float(b / bricks_per_axis / bricks_per_axis)) * brick_size;
+        return lattice_point(i % block, brick_res, origin, cell);
+    });
+
+    bind(m_data.data());
+}
+
+
+SdfCache::SdfCache(const std::string &path, bool verify_checksum)
+    : m_file(std::make_unique<NsdfFile>(path, NsdfKind::SdfCache, verify_checksum))
+{
+    const NsdfHeader &h = m_file->header();
+    if (h.payload_size < sizeof(SdfCacheHeader))
+        throw std::runtime_error(path + " is truncated");
+
+    const uint8_t *payload = reinterpret_cast<const uint8_t *>(m_file->payload());
+    SdfCacheHeader header;
+    std::memcpy(&header, payload, sizeof(SdfCacheHeader));
+    if (header.bricks_per_axis == 0 || header.brick_res == 0 || header.n_fine > cube(header.bricks_per_axis) || \
+        h.payload_size != sizeof(SdfCacheHeader) + payload_words(header) * sizeof(float))
+        throw std::runtime_error(path + " has inconsistent sdf cache parameters");
+
+    bind(payload);
+    for (uint32_t b = 0; b < cube(m_header.bricks_per_axis); ++b) {
+        if (m_bricks[b] < -1 || m_bricks[b] >= int32_t(m_header.n_fine))
+            throw std::runtime_error(path + " has a broken brick table");
+    }
+}
+
+
+void SdfCache::bind(const uint8_t *payload)
+{
+    std::memcpy(&m_header, payload, sizeof(SdfCacheHeader));
+    m_coarse = reinterpret_cast<const float *>(payload + sizeof(SdfCacheHeader));
+    m_bricks = reinterpret_cast<const int32_t *>(m_coarse + cube(m_header.bricks_per_axis + 1));
+    m_fine = reinterpret_cast<const float *>(m_bricks + cube(m_header.bricks_per_axis));
+
+    // trilinear weights of a cell of size h sum |p - corner| to at most h sqrt(3) / 2,
+    // an L-Lipschitz sdf can't be below the interpolation by more than L times that
+    const float brick_size = 2.0f / m_header.bricks_per_axis;
+    m_coarse_slack = m_header.lipschitz * brick_size * std::sqrt(3.0f) / 2.0f;
+    m_fine_slack = m_coarse_slack / m_header.brick_res;
+}
+
+
+void SdfCache::save(const std::string &path) const
+{
+    const uint8_t *payload = m_file ? reinterpret_cast<const uint8_t *>(m_file->payload()) : m_data.data();
+    const uint64_t size = sizeof(SdfCacheHeader) + payload_words(m_header) * sizeof(float);
+
+    NsdfHeader header{};
+    header.kind = NsdfKind::SdfCache;
+    header.layout = NsdfLayout::Bricks;
+    header.count = size / sizeof(float);
+    save_nsdf(path, header, {{payload, size}});
+}
+
+
+bool SdfCache::matches(const SirenModel &model) const
+{
+    return m_header.precision == uint32_t(model.getPrecision()) && \
+        m_header.weights_checksum == sdf_cache_weights_checksum(model);
+}
+
+
+float SdfCache::interpolate(float3 p, float &slack) const
+{
+    const uint32_t n = m_header.bricks_per_axis;
+    const float3 u = (p + float3(1.0f, 1.0f, 1.0f)) * (0.5f * n);
+    const uint32_t x = std::min(uint32_t(std::max(u.x, 0.0f)), n - 1);
+    const uint32_t y = std::min(uint32_t(std::max(u.y, 0.0f)), n - 1);
+    const uint32_t z = std::min(uint32_t(std::max(u.z, 0.0f)), n - 1);
+    const float3 t = u - float3(float(x), float(y), float(z));
+    const int32_t fine = m_bricks[(z * n + y) * n + x];
+    if (fine < 0) {
+        slack = m_coarse_slack;
+        return trilinear(m_coarse, n + 1, x, y, z, t);
+    }
+
+    const uint32_t res = m_header.brick_res;
+    const float3 v = t * float(res);
+    const uint32_t cx = std::min(uint32_t(v.x), res - 1), cy = std::min(uint32_t(v.y), res - 1);
+    const uint32_t cz = std::min(uint32_t(v.z), res - 1);
+    slack = m_fine_slack;
+    return trilinear(m_fine + fine * cube(res + 1), res + 1, cx, cy, cz,
+        v - float3(float(cx), float(cy), float(cz)));
+}
+
+
+float SdfCache::value(float3 p) const
+{
+    float slack;
+    return interpolate(p, slack);
+}
+
+
+float SdfCache::lowerBound(float3 p) const
+{
+    // outside the cube the ray marcher's sdf is bounded by the cube alone
+    if (!(std::fabs(p.x) <= 1.0f && std::fabs(p.y) <= 1.0f && std::fabs(p.z) <= 1.0f))
+        return -std::numeric_limits<float>::infinity();
+
+    float slack;
+    const float v = interpolate(p, slack);
+    return v - slack;
+}
+
+
+const SdfCacheHeader &SdfCache::getHeader() const
+{
+    return m_header;
+}
+
+
+float SdfCache::getLipschitz() const
+{
+    return m_header.lipschitz;
+}
+
+
+size_t SdfCache::getMemoryBytes() const
+{
+    return payload_words(m_header) * sizeof(float);
+}
@@ -0,0 +1,269 @@
+#include "sdf_octree.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "thread_pool.h"
+
+
+// a leaf is skipped only if its bound clears the hit threshold by this much, which
+// covers float rounding in the network and the error of quantized models
+static const float EMPTY_MARGIN = 1e-2f;
+// a skip ends this far past the leaf's exit, so that the next lookup lands in the next leaf
+static const float SKIP_EPS = 1e-5f;
+static const double SIREN_W0 = 30.0;
+static const double PI = 3.14159265358979323846;
+
+
+// [out_dim, in_dim] of every layer, weights are laid out as in SirenModel
+static std::vector<std::pair<int,int>> siren_layers(const SirenModel &model)
+{
+    const int h = model.getHiddenSize();
+    std::vector<std::pair<int,int>> layers{{h, INPUT_DIM}};
+    for (int i = 0; i < model.getNumHidden(); ++i)
+        layers.push_back({h, h});
+    layers.push_back({1, h});
+    return layers;
+}
+
+
+// exact range of sin over [a, b]
+static void sin_range(double a, double b, double &lower, double &upper)
+{
+    if (b - a >= 2.0 * PI) {
+        lower = -1.0;
+        upper = 1.0;
+        return;
+    }
+    lower = std::min(std::sin(a), std::sin(b));
+    upper = std::max(std::sin(a), std::sin(b));
+    // a maximum pi/2 + 2 pi k or a minimum -pi/2 + 2 pi k inside the interval
+    if (std::floor((b - PI / 2) / (2 * PI)) >= std::ceil((a - PI / 2) / (2 * PI)))
+        upper = 1.0;
+    if (std::floor((b + PI / 2) / (2 * PI)) >= std::ceil((a + PI / 2) / (2 * PI)))
+        lower = -1.0;
+}
+
+
+void siren_bounds(const SirenModel &model, float3 center, float3 half, float &lower, float &upper)
+{
+    const auto layers = siren_layers(model);
+    const float *w = model.getWeights().data();
+    const double r[INPUT_DIM] = { half.x, half.y, half.z };
+
+    // Taylor model: every value is v + g . (p - center) + e with |e| <= err, columns of
+    // g are stored one after another. Alongside runs plain interval arithmetic in
+    // mid +- rad form, its intervals are clipped to the Taylor ranges.
+    const int max_dim = std::max(model.getHiddenSize(), INPUT_DIM);
+    std::vector<double> v(max_dim), g(INPUT_DIM * max_dim), err(max_dim), mid(max_dim), rad(max_dim);
+    std::vector<double> next_v(max_dim), next_g(INPUT_DIM * max_dim), next_err(max_dim),
+        next_mid(max_dim), next_rad(max_dim);
+    for (int k = 0; k < INPUT_DIM; ++k) {
+        v[k] = mid[k] = center[k];
+        rad[k] = r[k];
+        err[k] = 0.0;
+        for (int d = 0; d < INPUT_DIM; ++d)
+            g[d * max_dim + k] = d == k;
+    }
+
+    for (size_t l = 0; l < layers.size(); ++l) {
+        auto [out_dim, in_dim] = layers[l];
+        const float *bias = w + out_dim * in_dim;
+        const bool last = l + 1 == layers.size();
+        for (int o = 0; o < out_dim; ++o) {
+            const float *row = w + o * in_dim;
+            double zv = bias[o], zg[INPUT_DIM] = {0.0, 0.0, 0.0}, ze = 0.0, zm = bias[o], zr = 0.0;
+            for (int k = 0; k < in_dim; ++k) {
+                const double wk = row[k];
+                zv += wk * v[k];
+                ze += std::fabs(wk) * err[k];
+                zm += wk * mid[k];
+                zr += std::fabs(wk) * rad[k];
+            }
+            for (int d = 0; d < INPUT_DIM; ++d)
+                for (int k = 0; k < in_dim; ++k)
+                    zg[d] += row[k] * g[d * max_dim + k];
+
+            double s_max = ze;
+            for (int d = 0; d < INPUT_DIM; ++d)
+                s_max += std::fabs(zg[d]) * r[d];
+            // the pre-activation lies in both ranges
+            double lo = std::max(zm - zr, zv - s_max), hi = std::min(zm + zr, zv + s_max);
+            if (!last) {
+                // sin(w0 (zv + s)) = sin(w0 zv) + w0 cos(w0 zv) s + rem, |rem| <= (w0 s)^2 / 2
+                const double c = std::cos(SIREN_W0 * zv);
+                for (int d = 0; d < INPUT_DIM; ++d)
+                    zg[d] *= SIREN_W0 * c;
+                ze = SIREN_W0 * std::fabs(c) * ze + 0.5 * SIREN_W0 * SIREN_W0 * s_max * s_max;
+                zv = std::sin(SIREN_W0 * zv);
+
+                double spread = ze;
+                for (int d = 0; d < INPUT_DIM; ++d)
+                    spread += std::fabs(zg[d]) * r[d];
+                sin_range(SIREN_W0 * lo, SIREN_W0 * hi, lo, hi);
+                lo = std::max(lo, zv - spread);
+                hi = std::min(hi, zv + spread);
+            }
+            next_v[o] = zv;
+            for (int d = 0; d < INPUT_DIM; ++d)
+                next_g[d * max_dim + o] = zg[d];
+            next_err[o] = ze;
+            next_mid[o] = (lo + hi) / 2;
+            next_rad[o] = (hi - lo) / 2;
+        }
+        std::swap(v, next_v);
+        std::swap(g, next_g);
+        std::swap(err, next_err);
+        std::swap(mid, next_mid);
+        std::swap(rad, next_rad);
+        w = bias + out_dim;
+    }
+    lower = float(mid[0] - rad[0]);
+    upper = float(mid[0] + rad[0]);
+}
+
+
+float siren_lipschitz_bound(const SirenModel &model)
+{
+    const auto layers = siren_layers(model);
+    const float *w = model.getWeights().data();
+    double bound = 1.0;
+    for (size_t l = 0; l < layers.size(); ++l) {
+        auto [out_dim, in_dim] = layers[l];
+        // ||W||_2 <= min(||W||_F, sqrt(||W||_1 ||W||_inf))
+        double frobenius = 0.0, max_row = 0.0;
+        std::vector<double> col(in_dim, 0.0);
+        for (int o = 0; o < out_dim; ++o) {
+            double row = 0.0;
+            for (int k = 0; k < in_dim; ++k) {
+                const double wk = std::fabs(w[o * in_dim + k]);
+                frobenius += wk * wk;
+                row += wk;
+                col[k] += wk;
+            }
+            max_row = std::max(max_row, row);
+        }
+        const double max_col = *std::max_element(col.begin(), col.end());
+        bound *= std::min(std::sqrt(frobenius), std::sqrt(max_row * max_col));
+        if (l + 1 < layers.size())
+            bound *= SIREN_W0;
+        w += out_dim * in_dim + out_dim;
+    }
+    return float(bound);
+}
+
+
+bool ray_box_intersection(float3 origin, float3 dir, float3 box_min, float3 box_max,
+    float &t_near, float &t_far)
+{
+    t_near = -std::numeric_limits<float>::infinity();
+    t_far = std::numeric_limits<float>::infinity();
+    for (int dim = 0; dim < 3; ++dim) {
+        if (dir[dim] == 0.0f) {
+            if (origin[dim] < box_min[dim] || origin[dim] > box_max[dim])
+                return false;
+            continue;
+        }
+        const float inv = 1.0f / dir[dim];
+        float t0 = (box_min[dim] - origin[dim]) * inv, t1 = (box_max[dim] - origin[dim]) * inv;
+        if (t0 > t1)
+            std::swap(t0, t1);
+        t_near = std::max(t_near, t0);
+        t_far = std::min(t_far, t1);
+    }
+    return t_near <= t_far;
+}
+
+
+SdfOctree::SdfOctree(const SirenModel &model, uint32_t max_depth)
+    : m_max_depth(max_depth)
+{
+    // breadth first: children of a node are appended together, so they stay adjacent.
+    // Bounds of a level are computed in parallel.
+    struct Box { float3 center; float half; };
+    std::vector<Box> boxes{{float3(0.0f, 0.0f, 0.0f), 1.0f}};
+    m_nodes.push_back({0.0f, 0});
+    size_t level_begin = 0;
+    for (uint32_t depth = 0; level_begin < boxes.size(); ++depth) {
+        const size_t level_end = boxes.size();
+        parallel_for(level_end - level_begin, 1, 1, [&](uint32_t begin, uint32_t end) {
+            for (size_t i = level_begin + begin; i < level_begin + end; ++i) {
+                const float h = boxes[i].half;
+                float upper;
+                siren_bounds(model, boxes[i].center, float3(h, h, h), m_nodes[i].lower, upper);
+            }
+        });
+
+        for (size_t i = level_begin; i < level_end; ++i) {
+            const Box box = boxes[i];
+            if (m_nodes[i].lower > EMPTY_MARGIN) {
+                m_empty_leaves += 1;
+                // the cube's volume is 8, a box's is 8 half^3
+                m_empty_volume += box.half * box.half * box.half;
+                continue;
+            }
+            if (depth == max_depth)
+                continue;
+
+            m_nodes[i].children = m_nodes.size();
+            const float quarter = box.half / 2;
+            for (uint32_t child = 0; child < 8; ++child) {
+                const float3 offset(child & 1 ? quarter : -quarter, child & 2 ? quarter : -quarter,
+                    child & 4 ? quarter : -quarter);
+                boxes.push_back({box.center + offset, quarter});
+                m_nodes.push_back({0.0f, 0});
+            }
+        }
+        level_begin = level_end;
+    }
+}
+
+
+float SdfOctree::emptyDistance(float3 p, float3 dir) const
+{
+    if (!(std::fabs(p.x) <= 1.0f && std::fabs(p.y) <= 1.0f && std::fabs(p.z) <= 1.0f))
+        return 0.0f;
+
+    float3 center(0.0f, 0.0f, 0.0f);
+    float half = 1.0f;
+    uint32_t node = 0;
+    while (m_nodes[node].children != 0) {
+        half /= 2;
+        const uint32_t child = (p.x >= center.x) | (p.y >= center.y) << 1 | (p.z >= center.z) << 2;
+        center += float3(child & 1 ? half : -half, child & 2 ? half : -half, child & 4 ? half : -half);
+        node = m_nodes[node].children + child;
+    }
+    if (!(m_nodes[node].lower > EMPTY_MARGIN))
+        return 0.0f;
+
+    float t_near, t_far;
+    const float3 extent(half, half, half);
+    if (!ray_box_intersection(p, dir, center - extent, center + extent, t_near, t_far))
+        return 0.0f;
+    return std::max(t_far, 0.0f) + SKIP_EPS;
+}
+
+
+const std::vector<SdfOctreeNode> &SdfOctree::getNodes() const
+{
+    return m_nodes;
+}
+
+
+uint32_t SdfOctree::getMaxDepth() const
+{
+    return m_max_depth;
+}
+
+
+uint32_t SdfOctree::getEmptyLeaves() const
+{
+    return m_empty_leaves;
+}
+
+
+float SdfOctree::getEmptyVolume() const
+{
+    return m_empty_volume;
+}
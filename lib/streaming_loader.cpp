@@ -0,0 +1,296 @@
+#include "streaming_loader.h"
+#include "nsdf_file.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+
+static const uint32_t N_DIMS = 3;
+
+
+SampleReader::SampleReader(const std::string &path)
+    : m_file(path, std::ios::binary | std::ios::ate)
+{
+    if (!m_file)
+        throw std::runtime_error("Can't open " + path);
+    const uint64_t file_size = m_file.tellg();
+    m_file.seekg(0);
+
+    if (is_nsdf_file(path)) {
+        // the checksum needs the whole payload, so it isn't verified while streaming
+        NsdfHeader header;
+        if (file_size < sizeof(NsdfHeader) || \
+            !m_file.read(reinterpret_cast<char *>(&header), sizeof(NsdfHeader)))
+            throw std::runtime_error(path + " is too small to be an NSDF file");
+        check_nsdf_header(header, NsdfKind::Samples, file_size, path);
+
+        m_soa = true;
+        m_size = header.count;
+        m_points_offset = header.payload_offset;
+        m_sdfs_offset = header.payload_offset + N_DIMS * m_size * sizeof(float);
+        return;
+    }
+
+    // headerless: int n, [n x 3] points, then sdfs up to the end of the file
+    int n = 0;
+    if (file_size >= sizeof(int))
+        m_file.read(reinterpret_cast<char *>(&n), sizeof(int));
+    const uint64_t n_floats = file_size > sizeof(int) ? (file_size - sizeof(int)) / sizeof(float) : 0;
+    const uint64_t n_points = std::min<uint64_t>(std::max(n, 0), n_floats / N_DIMS);
+
+    m_soa = false;
+    m_size = std::min(n_points, n_floats - N_DIMS * n_points);
+    m_points_offset = sizeof(int);
+    m_sdfs_offset = sizeof(int) + N_DIMS * n_points * sizeof(float);
+}
+
+
+uint64_t SampleReader::size() const
+{
+    return m_size;
+}
+
+
+void SampleReader::read(uint64_t start, uint32_t count, float *points, float *sdfs)
+{
+    if (start + count > m_size)
+        throw std::runtime_error("Sample chunk is out of range");
+
+    auto read_floats = [&](uint64_t offset, float *dst, uint64_t n) {
+        m_file.seekg(offset);
+        if (!m_file.read(reinterpret_cast<char *>(dst), n * sizeof(float)))
+            throw std::runtime_error("Failed reading samples");
+    };
+
+    if (m_soa) {
+        for (uint32_t dim = 0; dim < N_DIMS; ++dim)
+            read_floats(m_points_offset + (dim * m_size + start) * sizeof(float),
+                points + dim * count, count);
+    } else {
+        m_aos.resize(N_DIMS * count);
+        read_floats(m_points_offset + N_DIMS * start * sizeof(float), m_aos.data(), N_DIMS * count);
+        for (uint32_t i = 0; i < count; ++i) {
+            for (uint32_t dim = 0; dim < N_DIMS; ++dim)
+                points[dim * count + i] = m_aos[i * N_DIMS + dim];
+        }
+    }
+    read_floats(m_sdfs_offset + start * sizeof(float), sdfs, count);
+}
+
+
+StreamingLoader::StreamingLoader(const std::string &path, const StreamingLoaderConfig &config)
+    : m_config(config), m_reader(path), m_gen(config.seed)
+{
+    if (config.batch_size == 0 || config.chunk_size == 0 || config.shuffle_buffer_size == 0)
+        throw std::runtime_error("Batch, chunk and shuffle buffer sizes must be positive");
+    if (config.first_sample > m_reader.size())
+        throw std::runtime_error("First sample is past the end of " + path);
+    m_first = config.first_sample;
+    m_size = m_reader.size() - m_first;
+    if (config.n_samples > 0)
+        m_size = std::min(m_size, config.n_samples);
+
+    // nothing is gained from buffers larger than the dataset
+    const uint64_t n = std::max<uint64_t>(m_size, 1);
+    m_config.chunk_size = std::min<uint64_t>(m_config.chunk_size, n);
+    m_config.shuffle_buffer_size = std::min<uint64_t>(m_config.shuffle_buffer_size, n);
+
+    for (int slot = 0; slot < 2; ++slot) {
+        m_chunks[slot].points.resize(N_DIMS * m_config.chunk_size);
+        m_chunks[slot].sdfs.resize(m_config.chunk_size);
+        m_free.push_back(slot);
+    }
+    m_buffer_points.resize(N_DIMS * m_config.shuffle_buffer_size);
+    m_buffer_sdfs.resize(m_config.shuffle_buffer_size);
+
+    m_thread = std::thread(&StreamingLoader::prefetch_loop, this);
+}
+
+
+StreamingLoader::~StreamingLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+
+uint64_t StreamingLoader::size() const
+{
+    return m_size;
+}
+
+
+LoaderStats StreamingLoader::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    return m_stats;
+}
+
+
+void StreamingLoader::prefetch_loop()
+{
+    const uint64_t chunk_size = m_config.chunk_size;
+    std::vector<uint64_t> order((m_size + chunk_size - 1) / chunk_size);
+    std::iota(order.begin(), order.end(), 0);
+    // chunks are visited in a new order every epoch, samples within them by the shuffle buffer
+    std::mt19937 gen(m_config.seed + 1);
+    std::shuffle(order.begin(), order.end(), gen);
+    size_t pos = 0;
+
+    while (true) {
+        int slot;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [&]() { return m_stop || !m_free.empty(); });
+            if (m_stop)
+                return;
+            slot = m_free.back();
+            m_free.pop_back();
+        }
+
+        Chunk &chunk = m_chunks[slot];
+        if (pos == order.size()) {
+            chunk.size = 0;
+            chunk.end_of_epoch = true;
+            std::shuffle(order.begin(), order.end(), gen);
+            pos = 0;
+        } else {
+            const uint64_t start = order[pos++] * chunk_size;
+            chunk.size = std::min(chunk_size, m_size - start);
+            chunk.end_of_epoch = false;
+            try {
+                m_reader.read(m_first + start, chunk.size, chunk.points.data(), chunk.sdfs.data());
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_error = std::current_exception();
+                m_cv.notify_all();
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(m_stats_mutex);
+            m_stats.n_chunks += 1;
+            m_stats.bytes_read += (N_DIMS + 1) * chunk.size * sizeof(float);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_ready.push_back(slot);
+        }
+        m_cv.notify_all();
+    }
+}
+
+
+void StreamingLoader::acquire_chunk()
+{
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const bool stalled = m_ready.empty() && !m_error;
+    m_cv.wait(lock, [&]() { return !m_ready.empty() || m_error; });
+    if (m_ready.empty())
+        std::rethrow_exception(m_error);
+    m_current = m_ready.front();
+    m_ready.pop_front();
+    m_chunk_pos = 0;
+    lock.unlock();
+
+    if (stalled) {
+        std::lock_guard<std::mutex> stats_lock(m_stats_mutex);
+        m_stats.stall_ms += std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        m_stats.n_stalls += 1;
+    }
+}
+
+
+void StreamingLoader::release_chunk()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.push_back(m_current);
+    }
+    m_current = -1;
+    m_cv.notify_all();
+}
+
+
+bool StreamingLoader::fill_shuffle_buffer()
+{
+    const uint32_t capacity = m_config.shuffle_buffer_size;
+    while (m_buffer_size < capacity && !m_epoch_input_done) {
+        if (m_current < 0) {
+            acquire_chunk();
+            if (m_chunks[m_current].end_of_epoch) {
+                release_chunk();
+                m_epoch_input_done = true;
+                break;
+            }
+        }
+
+        // the chunk is handed back as soon as it's copied, so the next read overlaps training
+        const Chunk &chunk = m_chunks[m_current];
+        const uint32_t count = std::min(capacity - m_buffer_size, chunk.size - m_chunk_pos);
+        for (uint32_t dim = 0; dim < N_DIMS; ++dim)
+            std::memcpy(m_buffer_points.data() + dim * capacity + m_buffer_size,
+                chunk.points.data() + dim * chunk.size + m_chunk_pos, count * sizeof(float));
+        std::memcpy(m_buffer_sdfs.data() + m_buffer_size, chunk.sdfs.data() + m_chunk_pos,
+            count * sizeof(float));
+        m_buffer_size += count;
+        m_chunk_pos += count;
+        if (m_chunk_pos == chunk.size)
+            release_chunk();
+    }
+    return m_buffer_size > 0;
+}
+
+
+bool StreamingLoader::nextBatch(BatchWorkspace &workspace)
+{
+    const uint32_t batch_size = m_config.batch_size;
+    const uint32_t capacity = m_config.shuffle_buffer_size;
+    if (workspace.points.size() < N_DIMS * batch_size)
+        workspace.points.resize(N_DIMS * batch_size);
+    if (workspace.sdf.size() < batch_size)
+        workspace.sdf.resize(batch_size);
+
+    // every sample is taken from a random slot of the buffer, the last one fills the hole.
+    // The buffer is topped up once per batch, again only if it runs dry on the way
+    uint32_t count = 0;
+    while (count < batch_size && fill_shuffle_buffer()) {
+        const uint32_t end = count + std::min(batch_size - count, m_buffer_size);
+        for (; count < end; ++count) {
+            const uint32_t j = std::uniform_int_distribution<uint32_t>(0, m_buffer_size - 1)(m_gen);
+            const uint32_t last = m_buffer_size - 1;
+            for (uint32_t dim = 0; dim < N_DIMS; ++dim) {
+                float *column = m_buffer_points.data() + dim * capacity;
+                workspace.points[dim * batch_size + count] = column[j];
+                column[j] = column[last];
+            }
+            workspace.sdf[count] = m_buffer_sdfs[j];
+            m_buffer_sdfs[j] = m_buffer_sdfs[last];
+            --m_buffer_size;
+        }
+    }
+
+    if (count == 0) {
+        m_epoch_input_done = false;
+        workspace.size = 0;
+        return false;
+    }
+
+    // the last batch of an epoch is short, keep its coordinates contiguous
+    if (count < batch_size) {
+        for (uint32_t dim = 1; dim < N_DIMS; ++dim)
+            std::memmove(workspace.points.data() + dim * count,
+                workspace.points.data() + dim * batch_size, count * sizeof(float));
+    }
+    workspace.size = count;
+    return true;
+}
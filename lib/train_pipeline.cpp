@@ -0,0 +1,359 @@
+#include "train_pipeline.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+
+BatchSource shuffled_batches(const PointDataset &dataset, uint32_t batch_size, uint32_t seed)
+{
+    if (batch_size == 0)
+        throw std::runtime_error("Batch size must be positive");
+
+    struct State
+    {
+        std::vector<uint32_t> idxs;
+        uint32_t pos = 0;
+        bool in_epoch = false;
+        std::mt19937 gen;
+    };
+    auto state = std::make_shared<State>();
+    state->idxs.resize(dataset.size());
+    std::iota(state->idxs.begin(), state->idxs.end(), 0);
+    state->gen.seed(seed);
+
+    // the dataset itself isn't permuted, so it can be shared with other readers
+    return [&dataset, batch_size, state](BatchWorkspace &workspace) {
+        State &s = *state;
+        if (!s.in_epoch) {
+            std::shuffle(s.idxs.begin(), s.idxs.end(), s.gen);
+            s.pos = 0;
+            s.in_epoch = true;
+        }
+        if (s.pos == s.idxs.size()) {
+            s.in_epoch = false;
+            return false;
+        }
+        uint32_t count = std::min<uint32_t>(batch_size, s.idxs.size() - s.pos);
+        dataset.gather(s.idxs.data() + s.pos, count, workspace);
+        s.pos += count;
+        return true;
+    };
+}
+
+
+BatchSource dataset_batches(PointDataset &dataset, uint32_t batch_size, uint32_t seed)
+{
+    if (batch_size == 0)
+        throw std::runtime_error("Batch size must be positive");
+
+    struct State
+    {
+        uint32_t batch_idx = 0;
+        bool in_epoch = false;
+        std::mt19937 gen;
+    };
+    auto state = std::make_shared<State>();
+    state->gen.seed(seed);
+
+    return [&dataset, batch_size, state](BatchWorkspace &workspace) {
+        State &s = *state;
+        if (!s.in_epoch) {
+            dataset.shuffle(s.gen);
+            s.batch_idx = 0;
+            s.in_epoch = true;
+        }
+        if (s.batch_idx == dataset.numBatches(batch_size)) {
+            s.in_epoch = false;
+            return false;
+        }
+        workspace.view = dataset.batch(s.batch_idx++, batch_size);
+        workspace.size = workspace.view.size;
+        return true;
+    };
+}
+
+
+double PipelineStats::meanQueueDepth() const
+{
+    return n_steps > 0 ? double(queue_depth_sum) / n_steps : 0.0;
+}
+
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+TrainPipeline::TrainPipeline(SirenNetwork &net, BatchSource source, const TrainPipelineConfig &config)
+    : TrainPipeline(&net, nullptr, std::move(source), config)
+{
+}
+
+
+TrainPipeline::TrainPipeline(DataParallelSiren &net, BatchSource source, const TrainPipelineConfig &config)
+    : TrainPipeline(nullptr, &net, std::move(source), config)
+{
+}
+
+
+TrainPipeline::TrainPipeline(SirenNetwork *net, DataParallelSiren *replicas, BatchSource source,
+    const TrainPipelineConfig &config)
+    : m_net(net), m_replicas(replicas), m_source(std::move(source)), m_config(config),
+      m_preds(net ? net->getMaxBatchSize() : replicas->getMaxBatchSize()),
+      m_n_weights(net ? net->getWeights().size() : replicas->getWeights().size())
+{
+    if (config.queue_depth == 0)
+        throw std::runtime_error("Pipeline queue depth must be positive");
+    if (config.micro_batch_size > 0) {
+#ifdef USE_VULKAN
+        throw std::runtime_error("Micro-batches are only supported on CPU");
+#endif
+        if (replicas)
+            throw std::runtime_error("Micro-batches need a single network, not replicas");
+        if (config.micro_batch_size > uint32_t(net->getMaxBatchSize()))
+            throw std::runtime_error("Micro-batch of " + std::to_string(config.micro_batch_size) + \
+                " points exceeds the network max batch size " + std::to_string(net->getMaxBatchSize()));
+    }
+
+    // queued batches plus the one in training and the one in loss reduction
+    m_slots.resize(config.queue_depth + 2);
+    for (int slot = m_slots.size() - 1; slot >= 0; --slot)
+        m_free.push_back(slot);
+
+    m_prepare_thread = std::thread(&TrainPipeline::prepare_loop, this);
+    m_loss_thread = std::thread(&TrainPipeline::loss_loop, this);
+}
+
+
+TrainPipeline::~TrainPipeline()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_prepare_thread.join();
+    m_loss_thread.join();
+}
+
+
+PipelineStats TrainPipeline::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+
+void TrainPipeline::forward(const PointBatch &batch)
+{
+#ifndef USE_VULKAN
+    if (m_config.micro_batch_size > 0) {
+        // predictions of all micro-batches are gathered for the loss thread
+        if (m_preds.size() < batch.size)
+            m_preds.resize(batch.size);
+        m_net->zeroGradients();
+        for (uint32_t start = 0; start < batch.size; start += m_config.micro_batch_size) {
+            const uint32_t count = std::min(m_config.micro_batch_size, batch.size - start);
+            m_net->forward(m_preds.data() + start, batch.points + start, count, batch.stride);
+            m_net->backwardAccumulate(batch.sdf + start, float(count) / batch.size);
+        }
+        return;
+    }
+#endif
+    if (m_replicas)
+        m_replicas->forward(m_preds.data(), batch.points, batch.size, batch.stride);
+    else
+        m_net->forward(m_preds.data(), batch.points, batch.size, batch.stride);
+}
+
+
+void TrainPipeline::backward_step(const PointBatch &batch)
+{
+    if (m_replicas) {
+        m_replicas->backward(batch.sdf);
+        if (m_config.gradient_hook)
+            m_config.gradient_hook(m_replicas->getWeightsGradientsData(), m_n_weights);
+        m_replicas->step(m_config.lr);
+    } else {
+#ifndef USE_VULKAN
+        // nothing has to see the gradients between backward and step
+        if (m_config.fused_step && !m_config.gradient_hook && m_config.micro_batch_size == 0) {
+            m_net->backwardStep(batch.sdf, m_config.lr);
+            return;
+        }
+#endif
+        // micro-batches have already accumulated their gradients in forward
+        if (m_config.micro_batch_size == 0)
+            m_net->backward(batch.sdf);
+        if (m_config.gradient_hook)
+            m_config.gradient_hook(m_net->getWeightsGradientsData(), m_n_weights);
+        m_net->step(m_config.lr);
+    }
+}
+
+
+const float *TrainPipeline::predictions() const
+{
+    if (m_replicas)
+        return m_replicas->getPredictions();
+#ifdef USE_VULKAN
+    // the device network returns its result only through forward's output
+    return m_preds.data();
+#else
+    // micro-batches overwrite each other's predictions in the network
+    return m_config.micro_batch_size > 0 ? m_preds.data() : m_net->getPredictions();
+#endif
+}
+
+
+void TrainPipeline::prepare_loop()
+{
+    bool epoch_done = false;
+    while (true) {
+        int slot;
+        {
+            // after the end of an epoch all slots have to come back first
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [&]() {
+                return m_stop || (!m_free.empty() && m_ready.size() < m_config.queue_depth && \
+                    (!epoch_done || m_free.size() == m_slots.size()));
+            });
+            if (m_stop)
+                return;
+            slot = m_free.back();
+            m_free.pop_back();
+        }
+
+        Slot &s = m_slots[slot];
+        s.batch.view = PointBatch{};
+        try {
+            s.end_of_epoch = !m_source(s.batch);
+            epoch_done = s.end_of_epoch;
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_error = std::current_exception();
+            m_cv.notify_all();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_ready.push_back(slot);
+        }
+        m_cv.notify_all();
+    }
+}
+
+
+void TrainPipeline::loss_loop()
+{
+    while (true) {
+        int slot;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [&]() { return m_stop || m_loss_slot >= 0; });
+            if (m_stop)
+                return;
+            slot = m_loss_slot;
+        }
+
+        const PointBatch batch = m_slots[slot].batch.batch();
+        float loss = mse_loss(predictions(), batch.sdf, batch.size);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_loss_sum += loss;
+            m_loss_count += 1;
+            m_loss_slot = -1;
+        }
+        m_cv.notify_all();
+    }
+}
+
+
+int TrainPipeline::take_batch()
+{
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const uint32_t depth = m_ready.size();
+    m_cv.wait(lock, [&]() { return !m_ready.empty() || m_error; });
+    if (m_ready.empty())
+        std::rethrow_exception(m_error);
+
+    int slot = m_ready.front();
+    m_ready.pop_front();
+    if (depth == 0)
+        m_stats.batch_stall_ms += elapsed_ms(start);
+    if (!m_slots[slot].end_of_epoch) {
+        m_stats.n_steps += 1;
+        m_stats.queue_depth_sum += depth;
+        m_stats.max_queue_depth = std::max(m_stats.max_queue_depth, depth);
+    }
+    return slot;
+}
+
+
+void TrainPipeline::wait_loss()
+{
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_loss_slot < 0)
+        return;
+    m_cv.wait(lock, [&]() { return m_loss_slot < 0; });
+    m_stats.loss_stall_ms += elapsed_ms(start);
+}
+
+
+float TrainPipeline::runEpoch()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_loss_sum = 0.0f;
+        m_loss_count = 0;
+    }
+
+    // a slot goes back to the preparing thread once both its step and its loss are done
+    auto release = [&](int slot) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_free.push_back(slot);
+        }
+        m_cv.notify_all();
+    };
+
+    int prev_slot = -1;
+    while (true) {
+        int slot = take_batch();
+        if (m_slots[slot].end_of_epoch) {
+            release(slot);
+            break;
+        }
+
+        // the previous step's loss is still being read from the predictions
+        wait_loss();
+        if (prev_slot >= 0)
+            release(prev_slot);
+        const PointBatch batch = m_slots[slot].batch.batch();
+        forward(batch);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_loss_slot = slot;
+        }
+        m_cv.notify_all();
+
+        backward_step(batch);
+        prev_slot = slot;
+    }
+    wait_loss();
+    if (prev_slot >= 0)
+        release(prev_slot);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_loss_count > 0 ? m_loss_sum / m_loss_count : 0.0f;
+}
@@ -1,36 +1,41 @@
 #include "utils.h"
+#include "nsdf_file.h"
+
+#include <cstring>
 
 
 
 std::vector<float> load_floats(const std::string &path)
 {
-    std::ifstream fin(path, std::ios::binary);
-    std::vector<float> values;
-    float f;
-    while (fin.read(reinterpret_cast<char*>(&f), sizeof(float)))
-        values.push_back(f);
+    MappedFile file(path);
+    std::vector<float> values(file.size() / sizeof(float));
+    std::memcpy(values.data(), file.data(), values.size() * sizeof(float));
     return values;
 }
 
 
 VectorPair load_points(const std::string &sample_path)
 {
-    std::vector<float> points, gt_sdf;
-    std::ifstream fin(sample_path, std::ios::binary);
-
-    int n;
-    fin.read(reinterpret_cast<char*>(&n), sizeof(int));
-
-    float f;
-    int i = 0;
-    while ((i < 3 * n) && fin.read(reinterpret_cast<char*>(&f), sizeof(float))) {
-        points.push_back(f);
-        ++i;
+    if (is_nsdf_file(sample_path)) {
+        NsdfFile file(sample_path, NsdfKind::Samples);
+        const uint64_t n = file.header().count;
+        std::vector<float> points = transpose(
+            std::vector<float>(file.points(), file.points() + 3 * n), 3, n);
+        return VectorPair{points, std::vector<float>(file.sdfs(), file.sdfs() + n)};
     }
 
-    while (fin.read(reinterpret_cast<char*>(&f), sizeof(float)))
-        gt_sdf.push_back(f);
+    // headerless: int n, [n x 3] points, then sdfs up to the end of the file
+    MappedFile file(sample_path);
+    int n = 0;
+    if (file.size() >= sizeof(int))
+        std::memcpy(&n, file.data(), sizeof(int));
+
+    const float *data = reinterpret_cast<const float *>(file.data() + sizeof(int));
+    size_t n_floats = file.size() > sizeof(int) ? (file.size() - sizeof(int)) / sizeof(float) : 0;
+    size_t n_points = std::min<size_t>(3 * size_t(std::max(n, 0)), n_floats);
 
+    std::vector<float> points(data, data + n_points);
+    std::vector<float> gt_sdf(data + n_points, data + n_floats);
     return VectorPair{points, gt_sdf};
 }
 
@@ -85,13 +90,19 @@ std::vector<float> transpose(const std::vector<float> &m, int n_rows, int n_cols
 
 
 float mse_loss(const std::vector<float> &y_pred, const std::vector<float> &y_gt)
+{
+    return mse_loss(y_pred.data(), y_gt.data(), y_pred.size());
+}
+
+
+float mse_loss(const float *y_pred, const float *y_gt, uint32_t n)
 {
     float mse = 0.0f;
-    for (int i = 0; i < y_pred.size(); ++i) {
+    for (uint32_t i = 0; i < n; ++i) {
         float diff = y_pred[i] - y_gt[i];
         mse += diff * diff;
     }
-    return mse / y_pred.size();
+    return mse / n;
 }
 
 
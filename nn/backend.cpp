@@ -0,0 +1,101 @@
+#include "backend.h"
+
+#include <stdexcept>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+
+#if defined(NN_HAS_AVX2) || defined(NN_HAS_AVX512)
+
+#if defined(_MSC_VER)
+static bool cpu_has_avx2()
+{
+    int info[4];
+    __cpuidex(info, 7, 0);
+    bool avx2 = info[1] & (1 << 5);
+    __cpuidex(info, 1, 0);
+    bool fma = info[2] & (1 << 12), osxsave = info[2] & (1 << 27);
+    return avx2 && fma && osxsave && (_xgetbv(0) & 0x6) == 0x6;
+}
+
+static bool cpu_has_avx512()
+{
+    int info[4];
+    __cpuidex(info, 7, 0);
+    bool avx512f = info[1] & (1 << 16), avx512bw = info[1] & (1 << 30);
+    return avx512f && avx512bw && cpu_has_avx2() && (_xgetbv(0) & 0xe6) == 0xe6;
+}
+#else
+// __builtin_cpu_supports also checks that the OS saves the wide registers
+static bool cpu_has_avx2()
+{
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+static bool cpu_has_avx512()
+{
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && cpu_has_avx2();
+}
+#endif
+
+#endif
+
+
+static const NNBackend *find_backend(const std::string &name)
+{
+    if (name == "scalar")
+        return &scalar_backend();
+#if defined(NN_HAS_AVX2)
+    if (name == "avx2" && cpu_has_avx2())
+        return &avx2_backend();
+#endif
+#if defined(NN_HAS_AVX512)
+    if (name == "avx512" && cpu_has_avx512())
+        return &avx512_backend();
+#endif
+#if defined(NN_HAS_NEON)
+    if (name == "neon")
+        return &neon_backend();
+#endif
+    return nullptr;
+}
+
+
+std::vector<std::string> available_nn_backends()
+{
+    std::vector<std::string> names;
+    for (auto name: {"scalar", "neon", "avx2", "avx512"}) {
+        if (find_backend(name) != nullptr)
+            names.push_back(name);
+    }
+    return names;
+}
+
+
+static const NNBackend *&active_backend()
+{
+    static const NNBackend *backend = find_backend(available_nn_backends().back());
+    return backend;
+}
+
+
+const NNBackend &nn_backend()
+{
+    return *active_backend();
+}
+
+
+void set_nn_backend(const std::string &name)
+{
+    if (name == "auto") {
+        active_backend() = find_backend(available_nn_backends().back());
+        return;
+    }
+
+    const NNBackend *backend = find_backend(name);
+    if (backend == nullptr)
+        throw std::runtime_error("NN backend " + name + " is not available on this CPU");
+    active_backend() = backend;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Packed int8 weights: blocks of INT8_ROWS rows (the last one zero padded), each
+// stored as depth / INT8_GROUP groups of INT8_ROWS x INT8_GROUP bytes, so that one
+// group is a dot product step over 4 depth values for every row of the block
+// (the operand shape of vpmaddubsw / vpdpbusd)
+static const uint32_t INT8_ROWS = 16;
+static const uint32_t INT8_GROUP = 4;
+
+
+// Table of CPU kernels used by SirenNetwork. Each instruction set provides its
+// own table, the best one supported by the running CPU is picked at startup.
+// All kernels work on contiguous row-major data, offsets are applied by the caller.
+// sin/cos are evaluated with the polynomial from fast_math.h.
+struct NNBackend
+{
+    const char *name;
+
+    // GEMM register tile: c_tile[mr x nr] (+)= a_panel[mr x kc] * b_panel[kc x nr],
+    // panels are packed k-major by gemm_blocked
+    uint32_t mr, nr;
+    void (*gemm_micro_kernel)(uint32_t kc, const float *a_panel, const float *b_panel,
+        float *c_tile, uint32_t ldc, bool accumulate);
+
+    // res[i, j] = inp[i, j] + vec[i]
+    void (*add_bias)(float *res, const float *inp, const float *vec,
+        uint32_t n_rows, uint32_t n_cols);
+    // res[i] = sin(30 * inp[i])
+    void (*sin_activation)(float *res, const float *inp, uint32_t n);
+    // res[i] = 30 * cos(30 * inp[i]) * out_grads[i]
+    void (*sin_grad)(float *res, const float *inp, const float *out_grads, uint32_t n);
+    // sin_res[i] = sin(30 * inp[i]) and dsin_res[i] = 30 * cos(30 * inp[i]) in one pass
+    void (*sin_cos)(float *sin_res, float *dsin_res, const float *inp, uint32_t n);
+    // res[i] += sum_j inp[i, j]
+    void (*bias_grad)(float *res, const float *inp, uint32_t n_rows, uint32_t n_cols);
+    // res[i] = 2 * (preds[i] - gt[i]) / n
+    void (*mse_grad)(float *res, const float *preds, const float *gt, uint32_t n);
+    // Adam update, m_scale and v_scale are the bias corrections 1 / (1 - beta^t);
+    // params are also scaled by 1 - lr * weight_decay (AdamW)
+    void (*adam_step)(float *params, const float *grads, float *adam_m, float *adam_v,
+        uint32_t n, float lr, float beta1, float beta2, float eps,
+        float m_scale, float v_scale, float weight_decay);
+    // SGD with momentum: buf = momentum * buf + grads,
+    // params = (1 - lr * weight_decay) * params - lr * buf
+    void (*sgd_step)(float *params, const float *grads, float *buf,
+        uint32_t n, float lr, float momentum, float weight_decay);
+    // Lion: params = (1 - lr * weight_decay) * params - lr * sign(beta1 * m + (1 - beta1) * grads),
+    // then m = beta2 * m + (1 - beta2) * grads
+    void (*lion_step)(float *params, const float *grads, float *lion_m,
+        uint32_t n, float lr, float beta1, float beta2, float weight_decay);
+    // res[j * ldc + o] = w_scales[o] * x_scale * sum_k w[o, k] * x[j * depth + k] + bias[o]:
+    // int8 matrix w[out_dim x depth] times n int8 points stored one after another,
+    // products summed in int32; values are in [-127, 127], depth is a multiple of
+    // INT8_GROUP. w is packed by INT8_ROWS rows, see pack_int8_weights
+    void (*linear_int8)(float *res, uint32_t ldc, const int8_t *w_packed, const float *w_scales,
+        const float *bias, const int8_t *x, float x_scale, uint32_t out_dim, uint32_t depth,
+        uint32_t n);
+};
+
+
+const NNBackend &scalar_backend();
+#if defined(NN_HAS_AVX2)
+const NNBackend &avx2_backend();
+#endif
+#if defined(NN_HAS_AVX512)
+const NNBackend &avx512_backend();
+#endif
+#if defined(NN_HAS_NEON)
+const NNBackend &neon_backend();
+#endif
+
+
+// Currently active backend, selected on first use
+const NNBackend &nn_backend();
+
+// Selects backend by name: "auto", "scalar", "avx2", "avx512" or "neon".
+// Throws if the backend isn't compiled in or isn't supported by this CPU.
+void set_nn_backend(const std::string &name);
+
+// Backends that are both compiled in and supported by this CPU, best last
+std::vector<std::string> available_nn_backends();
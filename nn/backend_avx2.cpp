@@ -0,0 +1,362 @@
+#include "backend.h"
+#include "fast_math.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+
+
+static const uint32_t MR = 6;
+static const uint32_t NR = 16;
+
+
+static void gemm_micro_kernel(uint32_t kc, const float *a_panel, const float *b_panel,
+    float *c_tile, uint32_t ldc, bool accumulate)
+{
+    // 12 accumulators + 2 B vectors + 1 broadcast fit into 16 ymm registers
+    __m256 acc[MR][2];
+    for (uint32_t i = 0; i < MR; ++i) {
+        acc[i][0] = _mm256_setzero_ps();
+        acc[i][1] = _mm256_setzero_ps();
+    }
+
+    for (uint32_t p = 0; p < kc; ++p) {
+        __m256 b0 = _mm256_loadu_ps(b_panel + p * NR);
+        __m256 b1 = _mm256_loadu_ps(b_panel + p * NR + 8);
+        for (uint32_t i = 0; i < MR; ++i) {
+            __m256 a = _mm256_broadcast_ss(a_panel + p * MR + i);
+            acc[i][0] = _mm256_fmadd_ps(a, b0, acc[i][0]);
+            acc[i][1] = _mm256_fmadd_ps(a, b1, acc[i][1]);
+        }
+    }
+
+    for (uint32_t i = 0; i < MR; ++i) {
+        float *c = c_tile + i * ldc;
+        if (accumulate) {
+            acc[i][0] = _mm256_add_ps(acc[i][0], _mm256_loadu_ps(c));
+            acc[i][1] = _mm256_add_ps(acc[i][1], _mm256_loadu_ps(c + 8));
+        }
+        _mm256_storeu_ps(c, acc[i][0]);
+        _mm256_storeu_ps(c + 8, acc[i][1]);
+    }
+}
+
+
+static float hsum(__m256 v)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+
+// *r += part, the rounding error of the addition (TwoSum) is accumulated in *e
+static inline void add_compensated(__m256 *r, __m256 *e, __m256 part)
+{
+    __m256 sum = _mm256_add_ps(*r, part);
+    __m256 bb = _mm256_sub_ps(sum, *r);
+    *e = _mm256_add_ps(*e,
+        _mm256_add_ps(_mm256_sub_ps(*r, _mm256_sub_ps(sum, bb)), _mm256_sub_ps(part, bb)));
+    *r = sum;
+}
+
+
+// 8-lane version of fast_sincos_w0: *s = sin(30 x), *c = cos(30 x)
+static void sincos_ps(__m256 x, __m256 *s, __m256 *c)
+{
+    __m256i q = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(FAST_W0_2_OVER_PI)));
+    __m256 j = _mm256_cvtepi32_ps(q);
+
+    const __m256 w0 = _mm256_set1_ps(FAST_W0);
+    __m256 head = _mm256_and_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(FAST_HEAD_MASK)));
+    __m256 tail = _mm256_sub_ps(x, head);
+
+    // r + e = 30 x - j * pi/2, the rounding errors of the reduction are kept in e
+    __m256 r = _mm256_fnmadd_ps(j, _mm256_set1_ps(FAST_PIO2_HI), _mm256_mul_ps(head, w0));
+    __m256 e = _mm256_setzero_ps();
+    add_compensated(&r, &e, _mm256_mul_ps(j, _mm256_set1_ps(-FAST_PIO2_MID)));
+    add_compensated(&r, &e, _mm256_mul_ps(tail, w0));
+    add_compensated(&r, &e, _mm256_mul_ps(j, _mm256_set1_ps(-FAST_PIO2_LO)));
+    __m256 z = _mm256_mul_ps(r, r);
+
+    // sin(r + e) ~ sin(r) + e, cos(r + e) ~ cos(r) - r e
+    __m256 ps = _mm256_fmadd_ps(z, _mm256_set1_ps(FAST_SIN_S3), _mm256_set1_ps(FAST_SIN_S2));
+    ps = _mm256_fmadd_ps(z, ps, _mm256_set1_ps(FAST_SIN_S1));
+    __m256 sin_r = _mm256_add_ps(r, _mm256_fmadd_ps(_mm256_mul_ps(r, z), ps, e));
+
+    __m256 pc = _mm256_fmadd_ps(z, _mm256_set1_ps(FAST_COS_C3), _mm256_set1_ps(FAST_COS_C2));
+    pc = _mm256_fmadd_ps(z, pc, _mm256_set1_ps(FAST_COS_C1));
+    __m256 cos_r = _mm256_add_ps(_mm256_fnmadd_ps(_mm256_set1_ps(0.5f), z, _mm256_set1_ps(1.0f)),
+        _mm256_fmsub_ps(_mm256_mul_ps(z, z), pc, _mm256_mul_ps(r, e)));
+
+    // odd quadrants swap sin and cos, the sign comes from bit 1 of q (q + 1 for cos)
+    const __m256i one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2);
+    __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+    __m256 sin_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, two), 30));
+    __m256 cos_sign = _mm256_castsi256_ps(
+        _mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, one), two), 30));
+
+    *s = _mm256_xor_ps(_mm256_blendv_ps(sin_r, cos_r, swap), sin_sign);
+    *c = _mm256_xor_ps(_mm256_blendv_ps(cos_r, sin_r, swap), cos_sign);
+}
+
+
+static void add_bias(float *res, const float *inp, const float *vec,
+    uint32_t n_rows, uint32_t n_cols)
+{
+    for (uint32_t i = 0; i < n_rows; ++i) {
+        const float *x = inp + i * n_cols;
+        float *y = res + i * n_cols;
+        __m256 b = _mm256_set1_ps(vec[i]);
+        uint32_t j = 0;
+        for (; j + 8 <= n_cols; j += 8)
+            _mm256_storeu_ps(y + j, _mm256_add_ps(_mm256_loadu_ps(x + j), b));
+        for (; j < n_cols; ++j)
+            y[j] = x[j] + vec[i];
+    }
+}
+
+
+static void sin_activation(float *res, const float *inp, uint32_t n)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 s, c;
+        sincos_ps(_mm256_loadu_ps(inp + i), &s, &c);
+        _mm256_storeu_ps(res + i, s);
+    }
+    for (; i < n; ++i)
+        res[i] = fast_sin_w0(inp[i]);
+}
+
+
+static void sin_grad(float *res, const float *inp, const float *out_grads, uint32_t n)
+{
+    const __m256 w0 = _mm256_set1_ps(FAST_W0);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 s, c;
+        sincos_ps(_mm256_loadu_ps(inp + i), &s, &c);
+        _mm256_storeu_ps(res + i, _mm256_mul_ps(_mm256_mul_ps(w0, c), _mm256_loadu_ps(out_grads + i)));
+    }
+    for (; i < n; ++i)
+        res[i] = 30.0f * fast_cos_w0(inp[i]) * out_grads[i];
+}
+
+
+static void sin_cos(float *sin_res, float *dsin_res, const float *inp, uint32_t n)
+{
+    const __m256 w0 = _mm256_set1_ps(FAST_W0);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 s, c;
+        sincos_ps(_mm256_loadu_ps(inp + i), &s, &c);
+        _mm256_storeu_ps(sin_res + i, s);
+        _mm256_storeu_ps(dsin_res + i, _mm256_mul_ps(w0, c));
+    }
+    for (; i < n; ++i) {
+        float s, c;
+        fast_sincos_w0(inp[i], &s, &c);
+        sin_res[i] = s;
+        dsin_res[i] = 30.0f * c;
+    }
+}
+
+
+static void bias_grad(float *res, const float *inp, uint32_t n_rows, uint32_t n_cols)
+{
+    for (uint32_t i = 0; i < n_rows; ++i) {
+        const float *x = inp + i * n_cols;
+        __m256 acc = _mm256_setzero_ps();
+        uint32_t j = 0;
+        for (; j + 8 <= n_cols; j += 8)
+            acc = _mm256_add_ps(acc, _mm256_loadu_ps(x + j));
+        float sum = hsum(acc);
+        for (; j < n_cols; ++j)
+            sum += x[j];
+        res[i] += sum;
+    }
+}
+
+
+static void mse_grad(float *res, const float *preds, const float *gt, uint32_t n)
+{
+    float scale = 2.0f / n;
+    __m256 s = _mm256_set1_ps(scale);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(preds + i), _mm256_loadu_ps(gt + i));
+        _mm256_storeu_ps(res + i, _mm256_mul_ps(s, diff));
+    }
+    for (; i < n; ++i)
+        res[i] = scale * (preds[i] - gt[i]);
+}
+
+
+static void adam_step(float *params, const float *grads, float *adam_m, float *adam_v,
+    uint32_t n, float lr, float beta1, float beta2, float eps,
+    float m_scale, float v_scale, float weight_decay)
+{
+    const float decay = 1 - lr * weight_decay;
+    const __m256 b1 = _mm256_set1_ps(beta1), b1c = _mm256_set1_ps(1 - beta1);
+    const __m256 b2 = _mm256_set1_ps(beta2), b2c = _mm256_set1_ps(1 - beta2);
+    const __m256 ms = _mm256_set1_ps(lr * m_scale), vs = _mm256_set1_ps(v_scale);
+    const __m256 e = _mm256_set1_ps(eps), d = _mm256_set1_ps(decay);
+
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 g = _mm256_loadu_ps(grads + i);
+        __m256 m = _mm256_fmadd_ps(b1, _mm256_loadu_ps(adam_m + i), _mm256_mul_ps(b1c, g));
+        __m256 v = _mm256_fmadd_ps(b2, _mm256_loadu_ps(adam_v + i),
+            _mm256_mul_ps(b2c, _mm256_mul_ps(g, g)));
+        _mm256_storeu_ps(adam_m + i, m);
+        _mm256_storeu_ps(adam_v + i, v);
+
+        __m256 denom = _mm256_add_ps(_mm256_sqrt_ps(_mm256_mul_ps(v, vs)), e);
+        __m256 p = _mm256_sub_ps(_mm256_mul_ps(d, _mm256_loadu_ps(params + i)),
+            _mm256_div_ps(_mm256_mul_ps(ms, m), denom));
+        _mm256_storeu_ps(params + i, p);
+    }
+    for (; i < n; ++i) {
+        adam_m[i] = beta1 * adam_m[i] + (1 - beta1) * grads[i];
+        adam_v[i] = beta2 * adam_v[i] + (1 - beta2) * grads[i] * grads[i];
+        params[i] = decay * params[i] - lr * m_scale * adam_m[i] / (std::sqrt(adam_v[i] * v_scale) + eps);
+    }
+}
+
+
+static void sgd_step(float *params, const float *grads, float *buf,
+    uint32_t n, float lr, float momentum, float weight_decay)
+{
+    const float decay = 1 - lr * weight_decay;
+    const __m256 mu = _mm256_set1_ps(momentum), l = _mm256_set1_ps(lr), d = _mm256_set1_ps(decay);
+
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 b = _mm256_fmadd_ps(mu, _mm256_loadu_ps(buf + i), _mm256_loadu_ps(grads + i));
+        _mm256_storeu_ps(buf + i, b);
+        _mm256_storeu_ps(params + i,
+            _mm256_fnmadd_ps(l, b, _mm256_mul_ps(d, _mm256_loadu_ps(params + i))));
+    }
+    for (; i < n; ++i) {
+        buf[i] = momentum * buf[i] + grads[i];
+        params[i] = decay * params[i] - lr * buf[i];
+    }
+}
+
+
+static void lion_step(float *params, const float *grads, float *lion_m,
+    uint32_t n, float lr, float beta1, float beta2, float weight_decay)
+{
+    const float decay = 1 - lr * weight_decay;
+    const __m256 b1 = _mm256_set1_ps(beta1), b1c = _mm256_set1_ps(1 - beta1);
+    const __m256 b2 = _mm256_set1_ps(beta2), b2c = _mm256_set1_ps(1 - beta2);
+    const __m256 l = _mm256_set1_ps(lr), d = _mm256_set1_ps(decay);
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 g = _mm256_loadu_ps(grads + i), m = _mm256_loadu_ps(lion_m + i);
+        __m256 u = _mm256_fmadd_ps(b1, m, _mm256_mul_ps(b1c, g));
+        __m256 sign = _mm256_sub_ps(_mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GT_OQ), one),
+            _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_LT_OQ), one));
+        _mm256_storeu_ps(params + i,
+            _mm256_fnmadd_ps(l, sign, _mm256_mul_ps(d, _mm256_loadu_ps(params + i))));
+        _mm256_storeu_ps(lion_m + i, _mm256_fmadd_ps(b2, m, _mm256_mul_ps(b2c, g)));
+    }
+    for (; i < n; ++i) {
+        float u = beta1 * lion_m[i] + (1 - beta1) * grads[i];
+        float sign = float(u > 0) - float(u < 0);
+        params[i] = decay * params[i] - lr * sign;
+        lion_m[i] = beta2 * lion_m[i] + (1 - beta2) * grads[i];
+    }
+}
+
+
+// rows [o0, o0 + INT8_ROWS) of P points in int32 lanes, acc[2 p] holds rows 0-7 and
+// acc[2 p + 1] rows 8-15. maddubs multiplies unsigned by signed bytes, so |w| goes
+// with x carrying the sign of w; a pair of products of values in [-127, 127] fits
+// int16 without saturation
+template <uint32_t P>
+static inline void dot_block_i8(__m256i *acc, const int8_t *block, const int8_t *x, uint32_t depth)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    for (uint32_t p = 0; p < 2 * P; ++p)
+        acc[p] = _mm256_setzero_si256();
+    for (uint32_t g = 0; g < depth / INT8_GROUP; ++g) {
+        const int8_t *wg = block + g * INT8_ROWS * INT8_GROUP;
+        __m256i w0 = _mm256_loadu_si256((const __m256i *)wg);
+        __m256i w1 = _mm256_loadu_si256((const __m256i *)(wg + 32));
+        __m256i w0_abs = _mm256_sign_epi8(w0, w0), w1_abs = _mm256_sign_epi8(w1, w1);
+        for (uint32_t p = 0; p < P; ++p) {
+            int32_t xg;
+            std::memcpy(&xg, x + p * depth + g * INT8_GROUP, sizeof(xg));
+            __m256i xv = _mm256_set1_epi32(xg);
+            acc[2 * p] = _mm256_add_epi32(acc[2 * p],
+                _mm256_madd_epi16(_mm256_maddubs_epi16(w0_abs, _mm256_sign_epi8(xv, w0)), ones));
+            acc[2 * p + 1] = _mm256_add_epi32(acc[2 * p + 1],
+                _mm256_madd_epi16(_mm256_maddubs_epi16(w1_abs, _mm256_sign_epi8(xv, w1)), ones));
+        }
+    }
+}
+
+
+// out[r] = acc * scale + bias of the first rows of the block
+static inline void store_block_i8(float *out, const __m256i *acc, const __m256 *scale,
+    const __m256 *bias, uint32_t rows)
+{
+    __m256 r0 = _mm256_fmadd_ps(_mm256_cvtepi32_ps(acc[0]), scale[0], bias[0]);
+    __m256 r1 = _mm256_fmadd_ps(_mm256_cvtepi32_ps(acc[1]), scale[1], bias[1]);
+    if (rows == INT8_ROWS) {
+        _mm256_storeu_ps(out, r0);
+        _mm256_storeu_ps(out + 8, r1);
+    } else {
+        alignas(32) float tmp[INT8_ROWS];
+        _mm256_store_ps(tmp, r0);
+        _mm256_store_ps(tmp + 8, r1);
+        std::copy(tmp, tmp + rows, out);
+    }
+}
+
+
+static void linear_int8(float *res, uint32_t ldc, const int8_t *w_packed, const float *w_scales,
+    const float *bias, const int8_t *x, float x_scale, uint32_t out_dim, uint32_t depth, uint32_t n)
+{
+    for (uint32_t o0 = 0; o0 < out_dim; o0 += INT8_ROWS) {
+        const int8_t *block = w_packed + o0 * depth;
+        const uint32_t rows = std::min(INT8_ROWS, out_dim - o0);
+        alignas(32) float s[INT8_ROWS] = {}, b[INT8_ROWS] = {};
+        for (uint32_t r = 0; r < rows; ++r) {
+            s[r] = w_scales[o0 + r] * x_scale;
+            b[r] = bias[o0 + r];
+        }
+        const __m256 scale[2] = {_mm256_load_ps(s), _mm256_load_ps(s + 8)};
+        const __m256 bias_v[2] = {_mm256_load_ps(b), _mm256_load_ps(b + 8)};
+
+        // four points share every load of the weights
+        __m256i acc[8];
+        uint32_t j = 0;
+        for (; j + 4 <= n; j += 4) {
+            dot_block_i8<4>(acc, block, x + j * depth, depth);
+            for (uint32_t p = 0; p < 4; ++p)
+                store_block_i8(res + (j + p) * ldc + o0, acc + 2 * p, scale, bias_v, rows);
+        }
+        for (; j < n; ++j) {
+            dot_block_i8<1>(acc, block, x + j * depth, depth);
+            store_block_i8(res + j * ldc + o0, acc, scale, bias_v, rows);
+        }
+    }
+}
+
+
+const NNBackend &avx2_backend()
+{
+    static const NNBackend backend = {
+        "avx2", MR, NR, gemm_micro_kernel,
+        add_bias, sin_activation, sin_grad, sin_cos, bias_grad, mse_grad, adam_step,
+        sgd_step, lion_step, linear_int8
+    };
+    return backend;
+}
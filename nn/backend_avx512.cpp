@@ -0,0 +1,305 @@
+#include "backend.h"
+#include "fast_math.h"
+
+#include <algorithm>
+#include <cstring>
+#include <immintrin.h>
+
+
+static const uint32_t MR = 8;
+static const uint32_t NR = 32;
+
+
+static void gemm_micro_kernel(uint32_t kc, const float *a_panel, const float *b_panel,
+    float *c_tile, uint32_t ldc, bool accumulate)
+{
+    // 16 accumulators out of 32 zmm registers
+    __m512 acc[MR][2];
+    for (uint32_t i = 0; i < MR; ++i) {
+        acc[i][0] = _mm512_setzero_ps();
+        acc[i][1] = _mm512_setzero_ps();
+    }
+
+    for (uint32_t p = 0; p < kc; ++p) {
+        __m512 b0 = _mm512_loadu_ps(b_panel + p * NR);
+        __m512 b1 = _mm512_loadu_ps(b_panel + p * NR + 16);
+        for (uint32_t i = 0; i < MR; ++i) {
+            __m512 a = _mm512_set1_ps(a_panel[p * MR + i]);
+            acc[i][0] = _mm512_fmadd_ps(a, b0, acc[i][0]);
+            acc[i][1] = _mm512_fmadd_ps(a, b1, acc[i][1]);
+        }
+    }
+
+    for (uint32_t i = 0; i < MR; ++i) {
+        float *c = c_tile + i * ldc;
+        if (accumulate) {
+            acc[i][0] = _mm512_add_ps(acc[i][0], _mm512_loadu_ps(c));
+            acc[i][1] = _mm512_add_ps(acc[i][1], _mm512_loadu_ps(c + 16));
+        }
+        _mm512_storeu_ps(c, acc[i][0]);
+        _mm512_storeu_ps(c + 16, acc[i][1]);
+    }
+}
+
+
+static __mmask16 tail_mask(uint32_t n)
+{
+    return n >= 16 ? __mmask16(0xffff) : __mmask16((1u << n) - 1);
+}
+
+
+// *r += part, the rounding error of the addition (TwoSum) is accumulated in *e
+static inline void add_compensated(__m512 *r, __m512 *e, __m512 part)
+{
+    __m512 sum = _mm512_add_ps(*r, part);
+    __m512 bb = _mm512_sub_ps(sum, *r);
+    *e = _mm512_add_ps(*e,
+        _mm512_add_ps(_mm512_sub_ps(*r, _mm512_sub_ps(sum, bb)), _mm512_sub_ps(part, bb)));
+    *r = sum;
+}
+
+
+// 16-lane version of fast_sincos_w0: *s = sin(30 x), *c = cos(30 x)
+static void sincos_ps(__m512 x, __m512 *s, __m512 *c)
+{
+    __m512i q = _mm512_cvtps_epi32(_mm512_mul_ps(x, _mm512_set1_ps(FAST_W0_2_OVER_PI)));
+    __m512 j = _mm512_cvtepi32_ps(q);
+
+    const __m512 w0 = _mm512_set1_ps(FAST_W0);
+    __m512 head = _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(x),
+        _mm512_set1_epi32(FAST_HEAD_MASK)));
+    __m512 tail = _mm512_sub_ps(x, head);
+
+    // r + e = 30 x - j * pi/2, the rounding errors of the reduction are kept in e
+    __m512 r = _mm512_fnmadd_ps(j, _mm512_set1_ps(FAST_PIO2_HI), _mm512_mul_ps(head, w0));
+    __m512 e = _mm512_setzero_ps();
+    add_compensated(&r, &e, _mm512_mul_ps(j, _mm512_set1_ps(-FAST_PIO2_MID)));
+    add_compensated(&r, &e, _mm512_mul_ps(tail, w0));
+    add_compensated(&r, &e, _mm512_mul_ps(j, _mm512_set1_ps(-FAST_PIO2_LO)));
+    __m512 z = _mm512_mul_ps(r, r);
+
+    // sin(r + e) ~ sin(r) + e, cos(r + e) ~ cos(r) - r e
+    __m512 ps = _mm512_fmadd_ps(z, _mm512_set1_ps(FAST_SIN_S3), _mm512_set1_ps(FAST_SIN_S2));
+    ps = _mm512_fmadd_ps(z, ps, _mm512_set1_ps(FAST_SIN_S1));
+    __m512 sin_r = _mm512_add_ps(r, _mm512_fmadd_ps(_mm512_mul_ps(r, z), ps, e));
+
+    __m512 pc = _mm512_fmadd_ps(z, _mm512_set1_ps(FAST_COS_C3), _mm512_set1_ps(FAST_COS_C2));
+    pc = _mm512_fmadd_ps(z, pc, _mm512_set1_ps(FAST_COS_C1));
+    __m512 cos_r = _mm512_add_ps(_mm512_fnmadd_ps(_mm512_set1_ps(0.5f), z, _mm512_set1_ps(1.0f)),
+        _mm512_fmsub_ps(_mm512_mul_ps(z, z), pc, _mm512_mul_ps(r, e)));
+
+    // odd quadrants swap sin and cos, the sign comes from bit 1 of q (q + 1 for cos)
+    const __m512i one = _mm512_set1_epi32(1), two = _mm512_set1_epi32(2);
+    __mmask16 swap = _mm512_test_epi32_mask(q, one);
+    __m512i sin_sign = _mm512_slli_epi32(_mm512_and_si512(q, two), 30);
+    __m512i cos_sign = _mm512_slli_epi32(_mm512_and_si512(_mm512_add_epi32(q, one), two), 30);
+
+    __m512 sv = _mm512_mask_blend_ps(swap, sin_r, cos_r);
+    __m512 cv = _mm512_mask_blend_ps(swap, cos_r, sin_r);
+    *s = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(sv), sin_sign));
+    *c = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(cv), cos_sign));
+}
+
+
+static void add_bias(float *res, const float *inp, const float *vec,
+    uint32_t n_rows, uint32_t n_cols)
+{
+    for (uint32_t i = 0; i < n_rows; ++i) {
+        const float *x = inp + i * n_cols;
+        float *y = res + i * n_cols;
+        __m512 b = _mm512_set1_ps(vec[i]);
+        for (uint32_t j = 0; j < n_cols; j += 16) {
+            __mmask16 k = tail_mask(n_cols - j);
+            _mm512_mask_storeu_ps(y + j, k, _mm512_add_ps(_mm512_maskz_loadu_ps(k, x + j), b));
+        }
+    }
+}
+
+
+static void sin_activation(float *res, const float *inp, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i += 16) {
+        __mmask16 k = tail_mask(n - i);
+        __m512 s, c;
+        sincos_ps(_mm512_maskz_loadu_ps(k, inp + i), &s, &c);
+        _mm512_mask_storeu_ps(res + i, k, s);
+    }
+}
+
+
+static void sin_grad(float *res, const float *inp, const float *out_grads, uint32_t n)
+{
+    const __m512 w0 = _mm512_set1_ps(FAST_W0);
+    for (uint32_t i = 0; i < n; i += 16) {
+        __mmask16 k = tail_mask(n - i);
+        __m512 s, c;
+        sincos_ps(_mm512_maskz_loadu_ps(k, inp + i), &s, &c);
+        _mm512_mask_storeu_ps(res + i, k,
+            _mm512_mul_ps(_mm512_mul_ps(w0, c), _mm512_maskz_loadu_ps(k, out_grads + i)));
+    }
+}
+
+
+static void sin_cos(float *sin_res, float *dsin_res, const float *inp, uint32_t n)
+{
+    const __m512 w0 = _mm512_set1_ps(FAST_W0);
+    for (uint32_t i = 0; i < n; i += 16) {
+        __mmask16 k = tail_mask(n - i);
+        __m512 s, c;
+        sincos_ps(_mm512_maskz_loadu_ps(k, inp + i), &s, &c);
+        _mm512_mask_storeu_ps(sin_res + i, k, s);
+        _mm512_mask_storeu_ps(dsin_res + i, k, _mm512_mul_ps(w0, c));
+    }
+}
+
+
+static void bias_grad(float *res, const float *inp, uint32_t n_rows, uint32_t n_cols)
+{
+    for (uint32_t i = 0; i < n_rows; ++i) {
+        const float *x = inp + i * n_cols;
+        __m512 acc = _mm512_setzero_ps();
+        for (uint32_t j = 0; j < n_cols; j += 16)
+            acc = _mm512_add_ps(acc, _mm512_maskz_loadu_ps(tail_mask(n_cols - j), x + j));
+        res[i] += _mm512_reduce_add_ps(acc);
+    }
+}
+
+
+static void mse_grad(float *res, const float *preds, const float *gt, uint32_t n)
+{
+    __m512 s = _mm512_set1_ps(2.0f / n);
+    for (uint32_t i = 0; i < n; i += 16) {
+        __mmask16 k = tail_mask(n - i);
+        __m512 diff = _mm512_sub_ps(_mm512_maskz_loadu_ps(k, preds + i),
+            _mm512_maskz_loadu_ps(k, gt + i));
+        _mm512_mask_storeu_ps(res + i, k, _mm512_mul_ps(s, diff));
+    }
+}
+
+
+static void adam_step(float *params, const float *grads, float *adam_m, float *adam_v,
+    uint32_t n, float lr, float beta1, float beta2, float eps,
+    float m_scale, float v_scale, float weight_decay)
+{
+    const __m512 b1 = _mm512_set1_ps(beta1), b1c = _mm512_set1_ps(1 - beta1);
+    const __m512 b2 = _mm512_set1_ps(beta2), b2c = _mm512_set1_ps(1 - beta2);
+    const __m512 ms = _mm512_set1_ps(lr * m_scale), vs = _mm512_set1_ps(v_scale);
+    const __m512 e = _mm512_set1_ps(eps), d = _mm512_set1_ps(1 - lr * weight_decay);
+
+    for (uint32_t i = 0; i < n; i += 16) {
+        __mmask16 k = tail_mask(n - i);
+        __m512 g = _mm512_maskz_loadu_ps(k, grads + i);
+        __m512 m = _mm512_fmadd_ps(b1, _mm512_maskz_loadu_ps(k, adam_m + i), _mm512_mul_ps(b1c, g));
+        __m512 v = _mm512_fmadd_ps(b2, _mm512_maskz_loadu_ps(k, adam_v + i),
+            _mm512_mul_ps(b2c, _mm512_mul_ps(g, g)));
+        _mm512_mask_storeu_ps(adam_m + i, k, m);
+        _mm512_mask_storeu_ps(adam_v + i, k, v);
+
+        __m512 denom = _mm512_add_ps(_mm512_sqrt_ps(_mm512_mul_ps(v, vs)), e);
+        __m512 p = _mm512_sub_ps(_mm512_mul_ps(d, _mm512_maskz_loadu_ps(k, params + i)),
+            _mm512_div_ps(_mm512_mul_ps(ms, m), denom));
+        _mm512_mask_storeu_ps(params + i, k, p);
+    }
+}
+
+
+static void sgd_step(float *params, const float *grads, float *buf,
+    uint32_t n, float lr, float momentum, float weight_decay)
+{
+    const __m512 mu = _mm512_set1_ps(momentum), l = _mm512_set1_ps(lr);
+    const __m512 d = _mm512_set1_ps(1 - lr * weight_decay);
+
+    for (uint32_t i = 0; i < n; i += 16) {
+        __mmask16 k = tail_mask(n - i);
+        __m512 b = _mm512_fmadd_ps(mu, _mm512_maskz_loadu_ps(k, buf + i), _mm512_maskz_loadu_ps(k, grads + i));
+        _mm512_mask_storeu_ps(buf + i, k, b);
+        _mm512_mask_storeu_ps(params + i, k,
+            _mm512_fnmadd_ps(l, b, _mm512_mul_ps(d, _mm512_maskz_loadu_ps(k, params + i))));
+    }
+}
+
+
+static void lion_step(float *params, const float *grads, float *lion_m,
+    uint32_t n, float lr, float beta1, float beta2, float weight_decay)
+{
+    const __m512 b1 = _mm512_set1_ps(beta1), b1c = _mm512_set1_ps(1 - beta1);
+    const __m512 b2 = _mm512_set1_ps(beta2), b2c = _mm512_set1_ps(1 - beta2);
+    const __m512 l = _mm512_set1_ps(lr), d = _mm512_set1_ps(1 - lr * weight_decay);
+    const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.0f);
+
+    for (uint32_t i = 0; i < n; i += 16) {
+        __mmask16 k = tail_mask(n - i);
+        __m512 g = _mm512_maskz_loadu_ps(k, grads + i), m = _mm512_maskz_loadu_ps(k, lion_m + i);
+        __m512 u = _mm512_fmadd_ps(b1, m, _mm512_mul_ps(b1c, g));
+        __m512 sign = _mm512_sub_ps(_mm512_maskz_mov_ps(_mm512_cmp_ps_mask(u, zero, _CMP_GT_OQ), one),
+            _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(u, zero, _CMP_LT_OQ), one));
+        _mm512_mask_storeu_ps(params + i, k,
+            _mm512_fnmadd_ps(l, sign, _mm512_mul_ps(d, _mm512_maskz_loadu_ps(k, params + i))));
+        _mm512_mask_storeu_ps(lion_m + i, k, _mm512_fmadd_ps(b2, m, _mm512_mul_ps(b2c, g)));
+    }
+}
+
+
+// rows [o0, o0 + INT8_ROWS) of P points in int32 lanes, lane r is row o0 + r.
+// maddubs multiplies unsigned by signed bytes, so |w| goes with x negated where w
+// is negative; a pair of products of values in [-127, 127] fits int16 without
+// saturation. |w| and its sign are shared by the points
+template <uint32_t P>
+static inline void dot_block_i8(__m512i *acc, const int8_t *block, const int8_t *x, uint32_t depth)
+{
+    const __m512i ones = _mm512_set1_epi16(1), zero = _mm512_setzero_si512();
+    for (uint32_t p = 0; p < P; ++p)
+        acc[p] = _mm512_setzero_si512();
+    for (uint32_t g = 0; g < depth / INT8_GROUP; ++g) {
+        __m512i w = _mm512_loadu_si512(block + g * INT8_ROWS * INT8_GROUP);
+        __m512i w_abs = _mm512_abs_epi8(w);
+        __mmask64 negative = _mm512_movepi8_mask(w);
+        for (uint32_t p = 0; p < P; ++p) {
+            int32_t xg;
+            std::memcpy(&xg, x + p * depth + g * INT8_GROUP, sizeof(xg));
+            __m512i xv = _mm512_set1_epi32(xg);
+            xv = _mm512_mask_sub_epi8(xv, negative, zero, xv);
+            acc[p] = _mm512_add_epi32(acc[p], _mm512_madd_epi16(_mm512_maddubs_epi16(w_abs, xv), ones));
+        }
+    }
+}
+
+
+static void linear_int8(float *res, uint32_t ldc, const int8_t *w_packed, const float *w_scales,
+    const float *bias, const int8_t *x, float x_scale, uint32_t out_dim, uint32_t depth, uint32_t n)
+{
+    const __m512 xs = _mm512_set1_ps(x_scale);
+    for (uint32_t o0 = 0; o0 < out_dim; o0 += INT8_ROWS) {
+        const int8_t *block = w_packed + o0 * depth;
+        const __mmask16 mask = tail_mask(std::min(INT8_ROWS, out_dim - o0));
+        const __m512 scale = _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, w_scales + o0), xs);
+        const __m512 b = _mm512_maskz_loadu_ps(mask, bias + o0);
+
+        // four points share every load of the weights
+        __m512i acc[4];
+        uint32_t j = 0;
+        for (; j + 4 <= n; j += 4) {
+            dot_block_i8<4>(acc, block, x + j * depth, depth);
+            for (uint32_t p = 0; p < 4; ++p) {
+                _mm512_mask_storeu_ps(res + (j + p) * ldc + o0, mask,
+                    _mm512_fmadd_ps(_mm512_cvtepi32_ps(acc[p]), scale, b));
+            }
+        }
+        for (; j < n; ++j) {
+            dot_block_i8<1>(acc, block, x + j * depth, depth);
+            _mm512_mask_storeu_ps(res + j * ldc + o0, mask,
+                _mm512_fmadd_ps(_mm512_cvtepi32_ps(acc[0]), scale, b));
+        }
+    }
+}
+
+
+const NNBackend &avx512_backend()
+{
+    static const NNBackend backend = {
+        "avx512", MR, NR, gemm_micro_kernel,
+        add_bias, sin_activation, sin_grad, sin_cos, bias_grad, mse_grad, adam_step,
+        sgd_step, lion_step, linear_int8
+    };
+    return backend;
+}
@@ -0,0 +1,297 @@
+#include "backend.h"
+#include "fast_math.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <arm_neon.h>
+
+
+static const uint32_t MR = 8;
+static const uint32_t NR = 8;
+
+
+static void gemm_micro_kernel(uint32_t kc, const float *a_panel, const float *b_panel,
+    float *c_tile, uint32_t ldc, bool accumulate)
+{
+    // 16 accumulators out of 32 q registers
+    float32x4_t acc[MR][2];
+    for (uint32_t i = 0; i < MR; ++i) {
+        acc[i][0] = vdupq_n_f32(0.0f);
+        acc[i][1] = vdupq_n_f32(0.0f);
+    }
+
+    for (uint32_t p = 0; p < kc; ++p) {
+        float32x4_t b0 = vld1q_f32(b_panel + p * NR);
+        float32x4_t b1 = vld1q_f32(b_panel + p * NR + 4);
+        for (uint32_t i = 0; i < MR; ++i) {
+            float a = a_panel[p * MR + i];
+            acc[i][0] = vfmaq_n_f32(acc[i][0], b0, a);
+            acc[i][1] = vfmaq_n_f32(acc[i][1], b1, a);
+        }
+    }
+
+    for (uint32_t i = 0; i < MR; ++i) {
+        float *c = c_tile + i * ldc;
+        if (accumulate) {
+            acc[i][0] = vaddq_f32(acc[i][0], vld1q_f32(c));
+            acc[i][1] = vaddq_f32(acc[i][1], vld1q_f32(c + 4));
+        }
+        vst1q_f32(c, acc[i][0]);
+        vst1q_f32(c + 4, acc[i][1]);
+    }
+}
+
+
+// *r += part, the rounding error of the addition (TwoSum) is accumulated in *e
+static inline void add_compensated(float32x4_t *r, float32x4_t *e, float32x4_t part)
+{
+    float32x4_t sum = vaddq_f32(*r, part);
+    float32x4_t bb = vsubq_f32(sum, *r);
+    *e = vaddq_f32(*e,
+        vaddq_f32(vsubq_f32(*r, vsubq_f32(sum, bb)), vsubq_f32(part, bb)));
+    *r = sum;
+}
+
+
+// 4-lane version of fast_sincos_w0: *s = sin(30 x), *c = cos(30 x)
+static void sincos_ps(float32x4_t x, float32x4_t *s, float32x4_t *c)
+{
+    int32x4_t q = vcvtnq_s32_f32(vmulq_n_f32(x, FAST_W0_2_OVER_PI));
+    float32x4_t j = vcvtq_f32_s32(q);
+
+    float32x4_t head = vreinterpretq_f32_u32(
+        vandq_u32(vreinterpretq_u32_f32(x), vdupq_n_u32(FAST_HEAD_MASK)));
+    float32x4_t tail = vsubq_f32(x, head);
+
+    // r + e = 30 x - j * pi/2, the rounding errors of the reduction are kept in e
+    float32x4_t r = vfmsq_n_f32(vmulq_n_f32(head, FAST_W0), j, FAST_PIO2_HI);
+    float32x4_t e = vdupq_n_f32(0.0f);
+    add_compensated(&r, &e, vmulq_n_f32(j, -FAST_PIO2_MID));
+    add_compensated(&r, &e, vmulq_n_f32(tail, FAST_W0));
+    add_compensated(&r, &e, vmulq_n_f32(j, -FAST_PIO2_LO));
+    float32x4_t z = vmulq_f32(r, r);
+
+    // sin(r + e) ~ sin(r) + e, cos(r + e) ~ cos(r) - r e
+    float32x4_t ps = vfmaq_n_f32(vdupq_n_f32(FAST_SIN_S2), z, FAST_SIN_S3);
+    ps = vfmaq_f32(vdupq_n_f32(FAST_SIN_S1), z, ps);
+    float32x4_t sin_r = vaddq_f32(r, vfmaq_f32(e, vmulq_f32(r, z), ps));
+
+    float32x4_t pc = vfmaq_n_f32(vdupq_n_f32(FAST_COS_C2), z, FAST_COS_C3);
+    pc = vfmaq_f32(vdupq_n_f32(FAST_COS_C1), z, pc);
+    float32x4_t cos_r = vaddq_f32(vfmsq_n_f32(vdupq_n_f32(1.0f), z, 0.5f),
+        vfmsq_f32(vmulq_f32(vmulq_f32(z, z), pc), r, e));
+
+    // odd quadrants swap sin and cos, the sign comes from bit 1 of q (q + 1 for cos)
+    uint32x4_t uq = vreinterpretq_u32_s32(q);
+    uint32x4_t swap = vtstq_u32(uq, vdupq_n_u32(1));
+    uint32x4_t sin_sign = vshlq_n_u32(vandq_u32(uq, vdupq_n_u32(2)), 30);
+    uint32x4_t cos_sign = vshlq_n_u32(vandq_u32(vaddq_u32(uq, vdupq_n_u32(1)), vdupq_n_u32(2)), 30);
+
+    float32x4_t sv = vbslq_f32(swap, cos_r, sin_r);
+    float32x4_t cv = vbslq_f32(swap, sin_r, cos_r);
+    *s = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(sv), sin_sign));
+    *c = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(cv), cos_sign));
+}
+
+
+static void add_bias(float *res, const float *inp, const float *vec,
+    uint32_t n_rows, uint32_t n_cols)
+{
+    for (uint32_t i = 0; i < n_rows; ++i) {
+        const float *x = inp + i * n_cols;
+        float *y = res + i * n_cols;
+        float32x4_t b = vdupq_n_f32(vec[i]);
+        uint32_t j = 0;
+        for (; j + 4 <= n_cols; j += 4)
+            vst1q_f32(y + j, vaddq_f32(vld1q_f32(x + j), b));
+        for (; j < n_cols; ++j)
+            y[j] = x[j] + vec[i];
+    }
+}
+
+
+static void sin_activation(float *res, const float *inp, uint32_t n)
+{
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t s, c;
+        sincos_ps(vld1q_f32(inp + i), &s, &c);
+        vst1q_f32(res + i, s);
+    }
+    for (; i < n; ++i)
+        res[i] = fast_sin_w0(inp[i]);
+}
+
+
+static void sin_grad(float *res, const float *inp, const float *out_grads, uint32_t n)
+{
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t s, c;
+        sincos_ps(vld1q_f32(inp + i), &s, &c);
+        vst1q_f32(res + i, vmulq_f32(vmulq_n_f32(c, 30.0f), vld1q_f32(out_grads + i)));
+    }
+    for (; i < n; ++i)
+        res[i] = 30.0f * fast_cos_w0(inp[i]) * out_grads[i];
+}
+
+
+static void sin_cos(float *sin_res, float *dsin_res, const float *inp, uint32_t n)
+{
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t s, c;
+        sincos_ps(vld1q_f32(inp + i), &s, &c);
+        vst1q_f32(sin_res + i, s);
+        vst1q_f32(dsin_res + i, vmulq_n_f32(c, 30.0f));
+    }
+    for (; i < n; ++i) {
+        float s, c;
+        fast_sincos_w0(inp[i], &s, &c);
+        sin_res[i] = s;
+        dsin_res[i] = 30.0f * c;
+    }
+}
+
+
+static void bias_grad(float *res, const float *inp, uint32_t n_rows, uint32_t n_cols)
+{
+    for (uint32_t i = 0; i < n_rows; ++i) {
+        const float *x = inp + i * n_cols;
+        float32x4_t acc = vdupq_n_f32(0.0f);
+        uint32_t j = 0;
+        for (; j + 4 <= n_cols; j += 4)
+            acc = vaddq_f32(acc, vld1q_f32(x + j));
+        float sum = vaddvq_f32(acc);
+        for (; j < n_cols; ++j)
+            sum += x[j];
+        res[i] += sum;
+    }
+}
+
+
+static void mse_grad(float *res, const float *preds, const float *gt, uint32_t n)
+{
+    float scale = 2.0f / n;
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t diff = vsubq_f32(vld1q_f32(preds + i), vld1q_f32(gt + i));
+        vst1q_f32(res + i, vmulq_n_f32(diff, scale));
+    }
+    for (; i < n; ++i)
+        res[i] = scale * (preds[i] - gt[i]);
+}
+
+
+static void adam_step(float *params, const float *grads, float *adam_m, float *adam_v,
+    uint32_t n, float lr, float beta1, float beta2, float eps,
+    float m_scale, float v_scale, float weight_decay)
+{
+    const float decay = 1 - lr * weight_decay;
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t g = vld1q_f32(grads + i);
+        float32x4_t m = vfmaq_n_f32(vmulq_n_f32(vld1q_f32(adam_m + i), beta1), g, 1 - beta1);
+        float32x4_t v = vfmaq_n_f32(vmulq_n_f32(vld1q_f32(adam_v + i), beta2),
+            vmulq_f32(g, g), 1 - beta2);
+        vst1q_f32(adam_m + i, m);
+        vst1q_f32(adam_v + i, v);
+
+        float32x4_t denom = vaddq_f32(vsqrtq_f32(vmulq_n_f32(v, v_scale)), vdupq_n_f32(eps));
+        float32x4_t step = vdivq_f32(vmulq_n_f32(m, lr * m_scale), denom);
+        vst1q_f32(params + i, vsubq_f32(vmulq_n_f32(vld1q_f32(params + i), decay), step));
+    }
+    for (; i < n; ++i) {
+        adam_m[i] = beta1 * adam_m[i] + (1 - beta1) * grads[i];
+        adam_v[i] = beta2 * adam_v[i] + (1 - beta2) * grads[i] * grads[i];
+        params[i] = decay * params[i] - lr * m_scale * adam_m[i] / (std::sqrt(adam_v[i] * v_scale) + eps);
+    }
+}
+
+
+static void sgd_step(float *params, const float *grads, float *buf,
+    uint32_t n, float lr, float momentum, float weight_decay)
+{
+    const float decay = 1 - lr * weight_decay;
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t b = vfmaq_n_f32(vld1q_f32(grads + i), vld1q_f32(buf + i), momentum);
+        vst1q_f32(buf + i, b);
+        vst1q_f32(params + i, vfmsq_n_f32(vmulq_n_f32(vld1q_f32(params + i), decay), b, lr));
+    }
+    for (; i < n; ++i) {
+        buf[i] = momentum * buf[i] + grads[i];
+        params[i] = decay * params[i] - lr * buf[i];
+    }
+}
+
+
+static void lion_step(float *params, const float *grads, float *lion_m,
+    uint32_t n, float lr, float beta1, float beta2, float weight_decay)
+{
+    const float decay = 1 - lr * weight_decay;
+    const float32x4_t zero = vdupq_n_f32(0.0f), one = vdupq_n_f32(1.0f);
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t g = vld1q_f32(grads + i), m = vld1q_f32(lion_m + i);
+        float32x4_t u = vfmaq_n_f32(vmulq_n_f32(m, beta1), g, 1 - beta1);
+        float32x4_t sign = vsubq_f32(vbslq_f32(vcgtq_f32(u, zero), one, zero),
+            vbslq_f32(vcltq_f32(u, zero), one, zero));
+        vst1q_f32(params + i, vfmsq_n_f32(vmulq_n_f32(vld1q_f32(params + i), decay), sign, lr));
+        vst1q_f32(lion_m + i, vfmaq_n_f32(vmulq_n_f32(m, beta2), g, 1 - beta2));
+    }
+    for (; i < n; ++i) {
+        float u = beta1 * lion_m[i] + (1 - beta1) * grads[i];
+        float sign = float(u > 0) - float(u < 0);
+        params[i] = decay * params[i] - lr * sign;
+        lion_m[i] = beta2 * lion_m[i] + (1 - beta2) * grads[i];
+    }
+}
+
+
+static void linear_int8(float *res, uint32_t ldc, const int8_t *w_packed, const float *w_scales,
+    const float *bias, const int8_t *x, float x_scale, uint32_t out_dim, uint32_t depth, uint32_t n)
+{
+    const uint32_t n_groups = depth / INT8_GROUP;
+    for (uint32_t j = 0; j < n; ++j) {
+        const int8_t *xj = x + j * depth;
+        for (uint32_t o0 = 0; o0 < out_dim; o0 += INT8_ROWS) {
+            // a group of the block is four vectors of 4 rows x 4 values; the widening
+            // products of a row are summed pairwise into two int32 lanes
+            const int8_t *block = w_packed + o0 * depth;
+            int32x4_t acc[8];
+            for (auto &a: acc)
+                a = vdupq_n_s32(0);
+            for (uint32_t g = 0; g < n_groups; ++g) {
+                int32_t xg;
+                std::memcpy(&xg, xj + g * INT8_GROUP, sizeof(xg));
+                int8x16_t xv = vreinterpretq_s8_s32(vdupq_n_s32(xg));
+                const int8_t *wg = block + g * INT8_ROWS * INT8_GROUP;
+                for (uint32_t q = 0; q < 4; ++q) {
+                    int8x16_t wv = vld1q_s8(wg + 16 * q);
+                    acc[2 * q] = vpadalq_s16(acc[2 * q], vmull_s8(vget_low_s8(wv), vget_low_s8(xv)));
+                    acc[2 * q + 1] = vpadalq_s16(acc[2 * q + 1], vmull_high_s8(wv, xv));
+                }
+            }
+
+            int32_t sums[INT8_ROWS];
+            for (uint32_t q = 0; q < 4; ++q)
+                vst1q_s32(sums + 4 * q, vpaddq_s32(acc[2 * q], acc[2 * q + 1]));
+            const uint32_t rows = std::min(INT8_ROWS, out_dim - o0);
+            for (uint32_t r = 0; r < rows; ++r)
+                res[j * ldc + o0 + r] = float(sums[r]) * (w_scales[o0 + r] * x_scale) + bias[o0 + r];
+        }
+    }
+}
+
+
+const NNBackend &neon_backend()
+{
+    static const NNBackend backend = {
+        "neon", MR, NR, gemm_micro_kernel,
+        add_bias, sin_activation, sin_grad, sin_cos, bias_grad, mse_grad, adam_step,
+        sgd_step, lion_step, linear_int8
+    };
+    return backend;
+}
@@ -0,0 +1,170 @@
+#include "backend.h"
+#include "fast_math.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+static const uint32_t MR = 4;
+static const uint32_t NR = 8;
+
+
+// Plain loops over a fixed-size tile, left to the compiler to vectorize.
+// GCC prefers to vectorize the k loop with gathers here, which is several times
+// slower than SLP over the unrolled tile, so loop vectorization is turned off.
+#if defined(__GNUC__) && !defined(__clang__)
+__attribute__((optimize("no-tree-loop-vectorize")))
+#endif
+static void gemm_micro_kernel(uint32_t kc, const float *a_panel, const float *b_panel,
+    float *c_tile, uint32_t ldc, bool accumulate)
+{
+    float acc[MR][NR] = {};
+    for (uint32_t p = 0; p < kc; ++p) {
+        const float *a = a_panel + p * MR;
+        const float *b = b_panel + p * NR;
+        for (uint32_t i = 0; i < MR; ++i) {
+            for (uint32_t j = 0; j < NR; ++j) {
+                acc[i][j] += a[i] * b[j];
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < MR; ++i) {
+        float *c = c_tile + i * ldc;
+        if (accumulate) {
+            for (uint32_t j = 0; j < NR; ++j)
+                c[j] += acc[i][j];
+        } else {
+            for (uint32_t j = 0; j < NR; ++j)
+                c[j] = acc[i][j];
+        }
+    }
+}
+
+
+static void add_bias(float *res, const float *inp, const float *vec,
+    uint32_t n_rows, uint32_t n_cols)
+{
+    for (uint32_t i = 0; i < n_rows; ++i) {
+        for (uint32_t j = 0; j < n_cols; ++j) {
+            res[i * n_cols + j] = inp[i * n_cols + j] + vec[i];
+        }
+    }
+}
+
+
+static void sin_activation(float *res, const float *inp, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i)
+        res[i] = fast_sin_w0(inp[i]);
+}
+
+
+static void sin_grad(float *res, const float *inp, const float *out_grads, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i)
+        res[i] = 30.0f * fast_cos_w0(inp[i]) * out_grads[i];
+}
+
+
+static void sin_cos(float *sin_res, float *dsin_res, const float *inp, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i) {
+        float s, c;
+        fast_sincos_w0(inp[i], &s, &c);
+        sin_res[i] = s;
+        dsin_res[i] = 30.0f * c;
+    }
+}
+
+
+static void bias_grad(float *res, const float *inp, uint32_t n_rows, uint32_t n_cols)
+{
+    for (uint32_t i = 0; i < n_rows; ++i) {
+        float sum = 0.0f;
+        for (uint32_t j = 0; j < n_cols; ++j)
+            sum += inp[i * n_cols + j];
+        res[i] += sum;
+    }
+}
+
+
+static void mse_grad(float *res, const float *preds, const float *gt, uint32_t n)
+{
+    float scale = 2.0f / n;
+    for (uint32_t i = 0; i < n; ++i)
+        res[i] = scale * (preds[i] - gt[i]);
+}
+
+
+static void adam_step(float *params, const float *grads, float *adam_m, float *adam_v,
+    uint32_t n, float lr, float beta1, float beta2, float eps,
+    float m_scale, float v_scale, float weight_decay)
+{
+    const float decay = 1 - lr * weight_decay;
+    for (uint32_t i = 0; i < n; ++i) {
+        adam_m[i] = beta1 * adam_m[i] + (1 - beta1) * grads[i];
+        adam_v[i] = beta2 * adam_v[i] + (1 - beta2) * grads[i] * grads[i];
+        params[i] = decay * params[i] - lr * adam_m[i] * m_scale / (std::sqrt(adam_v[i] * v_scale) + eps);
+    }
+}
+
+
+static void sgd_step(float *params, const float *grads, float *buf,
+    uint32_t n, float lr, float momentum, float weight_decay)
+{
+    const float decay = 1 - lr * weight_decay;
+    for (uint32_t i = 0; i < n; ++i) {
+        buf[i] = momentum * buf[i] + grads[i];
+        params[i] = decay * params[i] - lr * buf[i];
+    }
+}
+
+
+static void lion_step(float *params, const float *grads, float *lion_m,
+    uint32_t n, float lr, float beta1, float beta2, float weight_decay)
+{
+    const float decay = 1 - lr * weight_decay;
+    for (uint32_t i = 0; i < n; ++i) {
+        float u = beta1 * lion_m[i] + (1 - beta1) * grads[i];
+        float sign = float(u > 0) - float(u < 0);
+        params[i] = decay * params[i] - lr * sign;
+        lion_m[i] = beta2 * lion_m[i] + (1 - beta2) * grads[i];
+    }
+}
+
+
+static void linear_int8(float *res, uint32_t ldc, const int8_t *w_packed, const float *w_scales,
+    const float *bias, const int8_t *x, float x_scale, uint32_t out_dim, uint32_t depth, uint32_t n)
+{
+    const uint32_t n_groups = depth / INT8_GROUP;
+    for (uint32_t j = 0; j < n; ++j) {
+        const int8_t *xj = x + j * depth;
+        for (uint32_t o0 = 0; o0 < out_dim; o0 += INT8_ROWS) {
+            const int8_t *block = w_packed + o0 * depth;
+            int32_t acc[INT8_ROWS] = {};
+            for (uint32_t g = 0; g < n_groups; ++g) {
+                const int8_t *wg = block + g * INT8_ROWS * INT8_GROUP;
+                const int8_t *xg = xj + g * INT8_GROUP;
+                for (uint32_t r = 0; r < INT8_ROWS; ++r) {
+                    for (uint32_t kk = 0; kk < INT8_GROUP; ++kk)
+                        acc[r] += int32_t(wg[r * INT8_GROUP + kk]) * xg[kk];
+                }
+            }
+            const uint32_t rows = std::min(INT8_ROWS, out_dim - o0);
+            for (uint32_t r = 0; r < rows; ++r)
+                res[j * ldc + o0 + r] = float(acc[r]) * (w_scales[o0 + r] * x_scale) + bias[o0 + r];
+        }
+    }
+}
+
+
+const NNBackend &scalar_backend()
+{
+    static const NNBackend backend = {
+        "scalar", MR, NR, gemm_micro_kernel,
+        add_bias, sin_activation, sin_grad, sin_cos, bias_grad, mse_grad, adam_step,
+        sgd_step, lion_step, linear_int8
+    };
+    return backend;
+}
@@ -0,0 +1,168 @@
+#include "data_parallel.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+// parameters summed by one thread, a few pages per replica
+static const uint32_t MIN_REDUCE_ITEMS = 1 << 12;
+static const uint32_t REDUCE_ALIGN = 64;
+
+
+DataParallelSiren::DataParallelSiren(int n_hidden, int hidden_size, int batch_size, int n_replicas)
+    : m_max_batch_size(batch_size)
+{
+    if (batch_size <= 0)
+        throw std::runtime_error("Batch size must be positive");
+    if (n_replicas <= 0)
+        n_replicas = nn_threads();
+    n_replicas = std::min(n_replicas, batch_size);
+
+    const int shard_size = (batch_size + n_replicas - 1) / n_replicas;
+    for (int r = 0; r < n_replicas; ++r)
+        m_replicas.push_back(std::make_unique<SirenNetwork>(n_hidden, hidden_size, shard_size));
+    // replicas start from the same random initialization
+    setWeights(m_replicas.front()->getWeights());
+
+    m_preds.resize(batch_size);
+    m_shard_begin.resize(n_replicas + 1);
+}
+
+
+void DataParallelSiren::setWeights(const std::vector<float> &weights)
+{
+    for (auto &replica: m_replicas)
+        replica->setWeights(weights);
+    m_weights_changed = false;
+}
+
+
+std::vector<float> DataParallelSiren::getWeights() const
+{
+    return m_replicas.front()->getWeights();
+}
+
+
+int DataParallelSiren::getMaxBatchSize() const
+{
+    return m_max_batch_size;
+}
+
+
+int DataParallelSiren::getNumReplicas() const
+{
+    return m_replicas.size();
+}
+
+
+void DataParallelSiren::split(int batch_size)
+{
+    if (batch_size > m_max_batch_size)
+        throw std::runtime_error("Batch of " + std::to_string(batch_size) + \
+            " points is larger than the network's max batch size " + std::to_string(m_max_batch_size));
+
+    const int n = m_replicas.size();
+    const int shard_size = (batch_size + n - 1) / n;
+    for (int r = 0; r <= n; ++r)
+        m_shard_begin[r] = std::min(r * shard_size, batch_size);
+    m_batch_size = batch_size;
+}
+
+
+void DataParallelSiren::forward(float *res, const float *input, int batch_size, int input_stride)
+{
+    split(batch_size);
+    const int stride = input_stride > 0 ? input_stride : batch_size;
+    const std::vector<float> &weights = m_replicas.front()->m_weights_biases;
+    const bool broadcast = m_weights_changed;
+
+    // kernels called from a pool task run on that task's thread
+    nn_thread_pool().run(m_replicas.size(), [&](uint32_t r) {
+        const int begin = m_shard_begin[r], count = m_shard_begin[r + 1] - begin;
+        if (count == 0)
+            return;
+        SirenNetwork &replica = *m_replicas[r];
+        if (broadcast && r > 0)
+            std::copy(weights.begin(), weights.end(), replica.m_weights_biases.begin());
+        replica.forward(m_preds.data() + begin, input + begin, count, stride);
+    });
+    m_weights_changed = false;
+
+    std::copy(m_preds.begin(), m_preds.begin() + batch_size, res);
+}
+
+
+void DataParallelSiren::backward(const float *y_gt)
+{
+    nn_thread_pool().run(m_replicas.size(), [&](uint32_t r) {
+        const int begin = m_shard_begin[r];
+        if (m_shard_begin[r + 1] > begin)
+            m_replicas[r]->backward(y_gt + begin);
+    });
+    reduce_gradients();
+}
+
+
+void DataParallelSiren::reduce_gradients()
+{
+    // every replica's gradient is the mean over its shard, the batch mean
+    // weighs them by shard size; empty shards take no part
+    std::vector<const float *> grads;
+    std::vector<float> scales;
+    for (size_t r = 0; r < m_replicas.size(); ++r) {
+        const int count = m_shard_begin[r + 1] - m_shard_begin[r];
+        if (count > 0) {
+            grads.push_back(m_replicas[r]->m_weights_grads.data());
+            scales.push_back(float(count) / m_batch_size);
+        }
+    }
+
+    // reduce-scatter by parameter ranges: a thread reads its range of every
+    // replica once and writes the sum in place of the first replica's gradients,
+    // which only the optimizer reads, so no broadcast of gradients is needed.
+    // The first shard is never empty, so grads[0] is the destination itself
+    float *dst = m_replicas.front()->m_weights_grads.data();
+    const uint32_t n_params = m_replicas.front()->m_weights_grads.size();
+    parallel_for(n_params, MIN_REDUCE_ITEMS, REDUCE_ALIGN, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i)
+            dst[i] = scales[0] * grads[0][i];
+        for (size_t r = 1; r < grads.size(); ++r) {
+            const float *src = grads[r];
+            const float scale = scales[r];
+            for (uint32_t i = begin; i < end; ++i)
+                dst[i] += scale * src[i];
+        }
+    });
+}
+
+
+void DataParallelSiren::step(float lr)
+{
+    m_replicas.front()->step(lr);
+    m_weights_changed = true;
+}
+
+
+void DataParallelSiren::setOptimizer(const OptimizerConfig &config)
+{
+    m_replicas.front()->setOptimizer(config);
+}
+
+
+const float *DataParallelSiren::getPredictions() const
+{
+    return m_preds.data();
+}
+
+
+std::vector<float> DataParallelSiren::getWeightsGradients() const
+{
+    return m_replicas.front()->getWeightsGradients();
+}
+
+
+float *DataParallelSiren::getWeightsGradientsData()
+{
+    return m_replicas.front()->getWeightsGradientsData();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "siren.h"
+
+
+// Data-parallel training over SirenNetwork replicas. A batch is split into one
+// contiguous shard per replica; the replicas run forward and backward on their
+// shards at the same time, one per pool thread. Their gradients are then combined,
+// weighted by shard size, and a single optimizer step is made on the first replica's
+// weights, which the others copy before their next forward.
+// The result is the same as training one network on the whole batch, up to the
+// order of floating point sums.
+class DataParallelSiren
+{
+public:
+    // batch_size is the whole batch, every replica gets room for its share of it;
+    // n_replicas = 0 means one per nn thread
+    DataParallelSiren(int n_hidden, int hidden_size, int batch_size, int n_replicas = 0);
+
+    void setWeights(const std::vector<float> &weights);
+    std::vector<float> getWeights() const;
+    int getMaxBatchSize() const;
+    int getNumReplicas() const;
+
+    // same contracts as SirenNetwork's
+    void forward(float *res, const float *input, int batch_size, int input_stride = 0);
+    void backward(const float *y_gt);
+    void step(float lr);
+    // optimizer of the step, only the first replica keeps its state
+    void setOptimizer(const OptimizerConfig &config);
+    // predictions of the last forward for the whole batch, valid until the next forward
+    const float *getPredictions() const;
+
+    // combined gradients of the last backward, for testing purposes
+    std::vector<float> getWeightsGradients() const;
+    // the same in place, step reads them from here
+    float *getWeightsGradientsData();
+
+private:
+    // first sample of the shard of every replica, plus the batch size at the end
+    void split(int batch_size);
+    // weighted sum of replica gradients into the first replica's, split by parameter ranges
+    void reduce_gradients();
+
+    std::vector<std::unique_ptr<SirenNetwork>> m_replicas;
+    std::vector<int> m_shard_begin;
+    int m_batch_size = 0, m_max_batch_size;
+    std::vector<float> m_preds;
+    // replicas' weights are stale after a step until their next forward
+    bool m_weights_changed = false;
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+
+// Polynomial sin(w0 x) / cos(w0 x) for SIREN activations, w0 = 30, shared by
+// all NN backends (the SIMD versions mirror fast_sincos_w0 lane by lane).
+//
+// w0 x is never rounded to float: x is split into a 12-bit head, whose product
+// with w0 is exact, and a tail. The head product is reduced by j * pi/2 with a
+// three-step Cody-Waite subtraction, the tail is added back, and the rounding
+// errors of these additions are carried along as a correction term. r in
+// [-pi/4, pi/4] then goes through minimax polynomials for sin(r) and cos(r)
+// that are selected and negated by the quadrant j mod 4.
+//
+// Accuracy against double precision sin(30 x) / cos(30 x), checked by
+// test/unit/fast_math.cpp, for |x| <= 30:
+// - absolute error below 1e-7;
+// - max 1.3 ulp for sin and 1.6 ulp for cos wherever |result| >= 1/16,
+//   ~85% of sin results are correctly rounded;
+// - next to zeros of sin/cos, where the result itself is tiny, the error in ulp
+//   grows (up to ~40 ulp) while staying below 1e-7 in absolute terms.
+// SIREN pre-activations stay of order 1, well inside this range.
+
+static const float FAST_W0 = 30.0f;
+static const float FAST_W0_2_OVER_PI = 19.09859317102744f;
+// clears the low 12 mantissa bits, so that head * w0 fits in 16 bits
+static const uint32_t FAST_HEAD_MASK = 0xFFFFF000u;
+
+// pi/2 split in three, the first two have short mantissas so that j * part is exact
+static const float FAST_PIO2_HI = 1.5703125f;
+static const float FAST_PIO2_MID = 4.837512969970703125e-4f;
+static const float FAST_PIO2_LO = 7.54978995489188216e-8f;
+
+// sin(r) ~ r + r^3 * (S1 + S2 r^2 + S3 r^4)
+static const float FAST_SIN_S1 = -1.6666654611e-1f;
+static const float FAST_SIN_S2 = 8.3321608736e-3f;
+static const float FAST_SIN_S3 = -1.9515295891e-4f;
+
+// cos(r) ~ 1 - r^2 / 2 + r^4 * (C1 + C2 r^2 + C3 r^4)
+static const float FAST_COS_C1 = 4.166664568298827e-2f;
+static const float FAST_COS_C2 = -1.388731625493765e-3f;
+static const float FAST_COS_C3 = 2.443315711809948e-5f;
+
+
+// rounding error of s = a + b (Knuth's TwoSum)
+inline float fast_two_sum_err(float a, float b, float s)
+{
+    float bb = s - a;
+    return (a - (s - bb)) + (b - bb);
+}
+
+
+// *s = sin(30 x), *c = cos(30 x)
+inline void fast_sincos_w0(float x, float *s, float *c)
+{
+    // nearest quadrant; SIMD versions break ties to even, either choice keeps |r| <= pi/4
+    float y = x * FAST_W0_2_OVER_PI;
+    int32_t q = int32_t(y + std::copysign(0.5f, y));
+    float j = float(q);
+
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(float));
+    bits &= FAST_HEAD_MASK;
+    float head;
+    std::memcpy(&head, &bits, sizeof(float));
+    float tail = x - head;
+
+    // r + e = 30 x - j * pi/2, the rounding errors of the reduction are kept in e
+    float r = head * FAST_W0 - j * FAST_PIO2_HI;
+    float mid = -j * FAST_PIO2_MID, tail_w0 = tail * FAST_W0, lo = -j * FAST_PIO2_LO;
+    float r_prev = r;
+    r = r + mid;
+    float e = fast_two_sum_err(r_prev, mid, r);
+    r_prev = r;
+    r = r + tail_w0;
+    e += fast_two_sum_err(r_prev, tail_w0, r);
+    r_prev = r;
+    r = r + lo;
+    e += fast_two_sum_err(r_prev, lo, r);
+    float z = r * r;
+
+    // sin(r + e) ~ sin(r) + e, cos(r + e) ~ cos(r) - r e
+    float sin_r = r + (r * z * (FAST_SIN_S1 + z * (FAST_SIN_S2 + z * FAST_SIN_S3)) + e);
+    float cos_r = 1.0f - 0.5f * z + (z * z * (FAST_COS_C1 + z * (FAST_COS_C2 + z * FAST_COS_C3)) - r * e);
+
+    // odd quadrants swap sin and cos, the sign comes from bit 1 of q (q + 1 for cos);
+    // done with bit masks, branches on q mispredict all the time
+    uint32_t sin_bits, cos_bits;
+    std::memcpy(&sin_bits, &sin_r, sizeof(float));
+    std::memcpy(&cos_bits, &cos_r, sizeof(float));
+    uint32_t uq = uint32_t(q);
+    uint32_t swap = 0u - (uq & 1u);
+    uint32_t sv = ((sin_bits & ~swap) | (cos_bits & swap)) ^ ((uq & 2u) << 30);
+    uint32_t cv = ((cos_bits & ~swap) | (sin_bits & swap)) ^ (((uq + 1u) & 2u) << 30);
+    std::memcpy(s, &sv, sizeof(float));
+    std::memcpy(c, &cv, sizeof(float));
+}
+
+
+inline float fast_sin_w0(float x)
+{
+    float s, c;
+    fast_sincos_w0(x, &s, &c);
+    return s;
+}
+
+
+inline float fast_cos_w0(float x)
+{
+    float s, c;
+    fast_sincos_w0(x, &s, &c);
+    return c;
+}
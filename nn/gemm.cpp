@@ -0,0 +1,215 @@
+#include "gemm.h"
+#include "backend.h"
+#include "thread_pool.h"
+
+#include <vector>
+#include <algorithm>
+
+
+// Cache blocking: a KC x NR panel of B stays in L1,
+// an MC x KC block of A in L2 and a KC x NC block of B in L3.
+// MC and NC are measured in register tiles of the active backend.
+static const uint32_t KC = 256;
+static const uint32_t MC_TILES = 16;
+static const uint32_t NC_TILES = 128;
+
+// Largest register tile among the backends
+static const uint32_t MAX_TILE = 8 * 32;
+
+// Below this amount of work packing costs more than it saves
+static const uint64_t MIN_BLOCKED_FLOPS = 4096;
+
+// Smallest amount of work worth handing to another thread
+static const uint64_t MIN_THREAD_FLOPS = 1 << 18;
+
+
+// packs rows [row0, row0 + mc) x depth [p0, p0 + kc) of A into mr-row panels,
+// rows past the matrix end are zero padded
+static void pack_a(float *dst, MatrixView a, uint32_t row0, uint32_t mc, uint32_t p0, uint32_t kc,
+    uint32_t mr)
+{
+    for (uint32_t ir = 0; ir < mc; ir += mr) {
+        uint32_t rows = std::min(mr, mc - ir);
+        for (uint32_t p = 0; p < kc; ++p) {
+            const float *src = a.data + (p0 + p) * a.col_stride;
+            for (uint32_t i = 0; i < rows; ++i)
+                dst[i] = src[(row0 + ir + i) * a.row_stride];
+            for (uint32_t i = rows; i < mr; ++i)
+                dst[i] = 0.0f;
+            dst += mr;
+        }
+    }
+}
+
+
+// packs depth [p0, p0 + kc) x columns [col0, col0 + nc) of B into nr-column panels
+static void pack_b(float *dst, MatrixView b, uint32_t p0, uint32_t kc, uint32_t col0, uint32_t nc,
+    uint32_t nr)
+{
+    for (uint32_t jr = 0; jr < nc; jr += nr) {
+        uint32_t cols = std::min(nr, nc - jr);
+        for (uint32_t p = 0; p < kc; ++p) {
+            const float *src = b.data + (p0 + p) * b.row_stride;
+            for (uint32_t j = 0; j < cols; ++j)
+                dst[j] = src[(col0 + jr + j) * b.col_stride];
+            for (uint32_t j = cols; j < nr; ++j)
+                dst[j] = 0.0f;
+            dst += nr;
+        }
+    }
+}
+
+
+// applies the epilogue to rows [row0, row0 + rows) x columns [col0, col0 + cols) of C
+static void apply_epilogue(const GemmEpilogue &epilogue, const NNBackend &backend,
+    float *c, uint32_t ldc, uint32_t row0, uint32_t rows, uint32_t col0, uint32_t cols)
+{
+    for (uint32_t i = row0; i < row0 + rows; ++i) {
+        float *row = c + i * ldc + col0;
+        if (epilogue.bias)
+            backend.add_bias(row, row, epilogue.bias + i, 1, cols);
+        if (epilogue.scale) {
+            const float *scale = epilogue.scale + i * epilogue.ld_scale + col0;
+            for (uint32_t j = 0; j < cols; ++j)
+                row[j] *= scale[j];
+        }
+        if (epilogue.activation) {
+            float *act = epilogue.activation + i * epilogue.ld_activation + col0;
+            backend.sin_activation(act, row, cols);
+        }
+    }
+}
+
+
+void gemm_blocked(float *c, uint32_t ldc, MatrixView a, MatrixView b,
+    uint32_t m, uint32_t n, uint32_t k, const GemmEpilogue &epilogue)
+{
+    const NNBackend &backend = nn_backend();
+    const bool has_epilogue = epilogue.bias || epilogue.scale || epilogue.activation;
+
+    if (k == 0) {
+        if (!epilogue.accumulate) {
+            for (uint32_t i = 0; i < m; ++i)
+                std::fill(c + i * ldc, c + i * ldc + n, 0.0f);
+        }
+        if (has_epilogue)
+            apply_epilogue(epilogue, backend, c, ldc, 0, m, 0, n);
+        return;
+    }
+
+    const uint32_t mr = backend.mr, nr = backend.nr;
+    const uint32_t mc_max = MC_TILES * mr, nc_max = NC_TILES * nr;
+    auto micro_kernel = backend.gemm_micro_kernel;
+
+    thread_local std::vector<float> a_packed, b_packed;
+    a_packed.resize(mc_max * KC);
+    b_packed.resize(nc_max * KC);
+
+    // edge tiles are computed in full into this buffer, then partially copied
+    float edge_tile[MAX_TILE];
+
+    for (uint32_t jc = 0; jc < n; jc += nc_max) {
+        uint32_t nc = std::min(nc_max, n - jc);
+        for (uint32_t pc = 0; pc < k; pc += KC) {
+            uint32_t kc = std::min(KC, k - pc);
+            bool accumulate = pc > 0 || epilogue.accumulate;
+            bool last_block = pc + kc == k;
+            pack_b(b_packed.data(), b, pc, kc, jc, nc, nr);
+
+            for (uint32_t ic = 0; ic < m; ic += mc_max) {
+                uint32_t mc = std::min(mc_max, m - ic);
+                pack_a(a_packed.data(), a, ic, mc, pc, kc, mr);
+
+                for (uint32_t jr = 0; jr < nc; jr += nr) {
+                    const float *b_panel = b_packed.data() + jr * kc;
+                    uint32_t cols = std::min(nr, nc - jr);
+
+                    for (uint32_t ir = 0; ir < mc; ir += mr) {
+                        const float *a_panel = a_packed.data() + ir * kc;
+                        uint32_t rows = std::min(mr, mc - ir);
+                        float *c_tile = c + (ic + ir) * ldc + jc + jr;
+
+                        if (rows == mr && cols == nr) {
+                            micro_kernel(kc, a_panel, b_panel, c_tile, ldc, accumulate);
+                        } else {
+                            micro_kernel(kc, a_panel, b_panel, edge_tile, nr, false);
+                            for (uint32_t i = 0; i < rows; ++i) {
+                                for (uint32_t j = 0; j < cols; ++j) {
+                                    if (accumulate)
+                                        c_tile[i * ldc + j] += edge_tile[i * nr + j];
+                                    else
+                                        c_tile[i * ldc + j] = edge_tile[i * nr + j];
+                                }
+                            }
+                        }
+
+                        if (last_block && has_epilogue)
+                            apply_epilogue(epilogue, backend, c, ldc, ic + ir, rows, jc + jr, cols);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+void gemm_reference(float *c, uint32_t ldc, MatrixView a, MatrixView b,
+    uint32_t m, uint32_t n, uint32_t k, bool accumulate)
+{
+    for (uint32_t i = 0; i < m; ++i) {
+        for (uint32_t j = 0; j < n; ++j) {
+            float value = 0.0f;
+            for (uint32_t p = 0; p < k; ++p) {
+                value += a.data[i * a.row_stride + p * a.col_stride] * \
+                    b.data[p * b.row_stride + j * b.col_stride];
+            }
+            if (accumulate)
+                c[i * ldc + j] += value;
+            else
+                c[i * ldc + j] = value;
+        }
+    }
+}
+
+
+void gemm(float *c, uint32_t ldc, MatrixView a, MatrixView b,
+    uint32_t m, uint32_t n, uint32_t k, const GemmEpilogue &epilogue)
+{
+    if (uint64_t(m) * n * k < MIN_BLOCKED_FLOPS) {
+        gemm_reference(c, ldc, a, b, m, n, k, epilogue.accumulate);
+        if (epilogue.bias || epilogue.scale || epilogue.activation)
+            apply_epilogue(epilogue, nn_backend(), c, ldc, 0, m, 0, n);
+        return;
+    }
+
+    // C is split into slices of whole register tiles, so every element is computed
+    // by the same sequence of operations whatever the number of threads is
+    const NNBackend &backend = nn_backend();
+    const uint64_t flops_per_row = uint64_t(n) * k, flops_per_col = uint64_t(m) * k;
+
+    if (n >= m) {
+        uint32_t min_cols = (MIN_THREAD_FLOPS + flops_per_col - 1) / flops_per_col;
+        parallel_for(n, min_cols, backend.nr, [&](uint32_t begin, uint32_t end) {
+            GemmEpilogue slice = epilogue;
+            if (slice.scale)
+                slice.scale += begin;
+            if (slice.activation)
+                slice.activation += begin;
+            MatrixView b_slice{b.data + begin * b.col_stride, b.row_stride, b.col_stride};
+            gemm_blocked(c + begin, ldc, a, b_slice, m, end - begin, k, slice);
+        });
+    } else {
+        uint32_t min_rows = (MIN_THREAD_FLOPS + flops_per_row - 1) / flops_per_row;
+        parallel_for(m, min_rows, backend.mr, [&](uint32_t begin, uint32_t end) {
+            GemmEpilogue slice = epilogue;
+            if (slice.bias)
+                slice.bias += begin;
+            if (slice.scale)
+                slice.scale += begin * slice.ld_scale;
+            if (slice.activation)
+                slice.activation += begin * slice.ld_activation;
+            MatrixView a_slice{a.data + begin * a.row_stride, a.row_stride, a.col_stride};
+            gemm_blocked(c + begin * ldc, ldc, a_slice, b, end - begin, n, k, slice);
+        });
+    }
+}
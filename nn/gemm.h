@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+
+// Read-only view of a row-major matrix (or of a transposed one):
+// element (i, j) is data[i * row_stride + j * col_stride].
+struct MatrixView
+{
+    const float *data;
+    uint32_t row_stride, col_stride;
+};
+
+
+// Optional post-processing of C, applied to each tile right after its last
+// K block, while it is still in L1, in this order:
+// - bias: C[i, j] += bias[i];
+// - scale: C[i, j] *= scale[i * ld_scale + j];
+// - activation: activation[i * ld_activation + j] = sin(30 * C[i, j]),
+//   may point to C itself to keep only the activated values.
+struct GemmEpilogue
+{
+    // C += A * B instead of overwriting C
+    bool accumulate = false;
+    const float *bias = nullptr;
+    const float *scale = nullptr;
+    uint32_t ld_scale = 0;
+    float *activation = nullptr;
+    uint32_t ld_activation = 0;
+};
+
+
+// C[m x n] = A[m x k] * B[k x n], C is row-major with leading dimension ldc.
+// Dispatches to the packed, cache-blocked implementation and falls back to
+// gemm_reference for shapes too small to amortize packing. Large products are
+// split over nn_thread_pool() by slices of whole register tiles, so the result
+// doesn't depend on the number of threads.
+void gemm(float *c, uint32_t ldc, MatrixView a, MatrixView b,
+    uint32_t m, uint32_t n, uint32_t k, const GemmEpilogue &epilogue = GemmEpilogue{});
+
+// Packed, cache-blocked and register-tiled GEMM, usable for any shape
+void gemm_blocked(float *c, uint32_t ldc, MatrixView a, MatrixView b,
+    uint32_t m, uint32_t n, uint32_t k, const GemmEpilogue &epilogue = GemmEpilogue{});
+
+// Naive triple loop, used as a fallback and as the accuracy reference in tests
+void gemm_reference(float *c, uint32_t ldc, MatrixView a, MatrixView b,
+    uint32_t m, uint32_t n, uint32_t k, bool accumulate = false);
@@ -0,0 +1,116 @@
+#include "optimizer.h"
+#include "backend.h"
+#include "thread_pool.h"
+
+#include <cmath>
+#include <stdexcept>
+
+
+// same split as the other elementwise kernels
+static const uint32_t MIN_THREAD_ITEMS = 1 << 14;
+static const uint32_t THREAD_ALIGN = 64;
+
+
+OptimizerType optimizer_type_from_string(const std::string &name)
+{
+    if (name == "adam")
+        return OptimizerType::Adam;
+    if (name == "adamw")
+        return OptimizerType::AdamW;
+    if (name == "sgd")
+        return OptimizerType::SGD;
+    if (name == "lion")
+        return OptimizerType::Lion;
+    throw std::runtime_error("Unknown optimizer: " + name + ", expected adam, adamw, sgd or lion");
+}
+
+
+Optimizer::Optimizer(uint32_t n_params, const OptimizerConfig &config)
+    : m_config(config), m_n_params(n_params), m_m(n_params)
+{
+    if (config.type == OptimizerType::Adam || config.type == OptimizerType::AdamW)
+        m_v.resize(n_params);
+}
+
+
+const OptimizerConfig &Optimizer::config() const
+{
+    return m_config;
+}
+
+
+uint32_t Optimizer::size() const
+{
+    return m_n_params;
+}
+
+
+int Optimizer::steps() const
+{
+    return m_t - 1;
+}
+
+
+void Optimizer::beginStep(float lr)
+{
+    if (m_in_step)
+        throw std::runtime_error("Optimizer step is already in progress");
+    m_in_step = true;
+    m_lr = lr;
+    // bias corrections are the same for every parameter
+    m_m_scale = 1.0f / (1.0f - std::pow(m_config.beta1, m_t));
+    m_v_scale = 1.0f / (1.0f - std::pow(m_config.beta2, m_t));
+}
+
+
+void Optimizer::update(float *params, const float *grads, uint32_t begin, uint32_t end)
+{
+    if (!m_in_step)
+        throw std::runtime_error("Optimizer update outside of a step");
+    if (begin > end || end > m_n_params)
+        throw std::runtime_error("Optimizer update range is out of bounds");
+
+    const NNBackend &be = nn_backend();
+    const OptimizerConfig &c = m_config;
+    const float weight_decay = c.type == OptimizerType::Adam ? 0.0f : c.weight_decay;
+    // every parameter is updated independently, so ranges go to different threads
+    parallel_for(end - begin, MIN_THREAD_ITEMS, THREAD_ALIGN, [&](uint32_t first, uint32_t last) {
+        const uint32_t i = begin + first, n = last - first;
+        switch (c.type) {
+        case OptimizerType::Adam:
+        case OptimizerType::AdamW:
+            be.adam_step(params + i, grads + i, m_m.data() + i, m_v.data() + i, n,
+                m_lr, c.beta1, c.beta2, c.eps, m_m_scale, m_v_scale, weight_decay);
+            break;
+        case OptimizerType::SGD:
+            be.sgd_step(params + i, grads + i, m_m.data() + i, n, m_lr, c.momentum, weight_decay);
+            break;
+        case OptimizerType::Lion:
+            be.lion_step(params + i, grads + i, m_m.data() + i, n, m_lr, c.beta1, c.beta2, weight_decay);
+            break;
+        }
+    });
+}
+
+
+void Optimizer::endStep()
+{
+    if (!m_in_step)
+        throw std::runtime_error("Optimizer step wasn't started");
+    m_in_step = false;
+    m_t += 1;
+}
+
+
+void Optimizer::abortStep()
+{
+    m_in_step = false;
+}
+
+
+void Optimizer::step(float *params, const float *grads, float lr)
+{
+    beginStep(lr);
+    update(params, grads, 0, m_n_params);
+    endStep();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+enum class OptimizerType
+{
+    Adam,
+    AdamW,
+    SGD,
+    Lion
+};
+
+// "adam", "adamw", "sgd" or "lion"; throws on anything else
+OptimizerType optimizer_type_from_string(const std::string &name);
+
+
+struct OptimizerConfig
+{
+    OptimizerType type = OptimizerType::Adam;
+    // Adam/AdamW: moment decay rates; Lion: update and momentum interpolation
+    float beta1 = 0.9f, beta2 = 0.99f;
+    float eps = 1e-8f;
+    // SGD only
+    float momentum = 0.9f;
+    // decoupled decay, params are scaled by 1 - lr * weight_decay every step;
+    // ignored by plain Adam
+    float weight_decay = 0.0f;
+};
+
+
+// First-order optimizer over a flat parameter vector, keeps its own state.
+// A step is split into beginStep, any number of update calls on disjoint
+// ranges and endStep, so e.g. every layer can be updated right after its
+// gradients are computed. Step-wide values such as Adam bias corrections are
+// computed once in beginStep; ranges are spread over the nn thread pool and
+// updated by the vectorized kernels of the active backend.
+class Optimizer
+{
+public:
+    explicit Optimizer(uint32_t n_params = 0, const OptimizerConfig &config = OptimizerConfig());
+
+    const OptimizerConfig &config() const;
+    uint32_t size() const;
+    // number of finished steps
+    int steps() const;
+
+    void beginStep(float lr);
+    // updates params[begin, end) from grads[begin, end)
+    void update(float *params, const float *grads, uint32_t begin, uint32_t end);
+    void endStep();
+    // leaves a step that failed half way, ranges updated so far keep their new
+    // values but the step isn't counted
+    void abortStep();
+
+    // whole step over all parameters
+    void step(float *params, const float *grads, float lr);
+
+private:
+    OptimizerConfig m_config;
+    uint32_t m_n_params;
+    // Adam: first and second moments; SGD: velocity in m_m; Lion: momentum in m_m
+    std::vector<float> m_m, m_v;
+    // steps are counted from 1, as in the bias corrections
+    int m_t = 1;
+    bool m_in_step = false;
+    float m_lr = 0.0f, m_m_scale = 1.0f, m_v_scale = 1.0f;
+};
@@ -0,0 +1,224 @@
+#include "quantize.h"
+#include "backend.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+
+// same threshold as gemm: smallest amount of work worth handing to another thread
+static const uint64_t MIN_THREAD_OPS = 1 << 18;
+
+
+Precision precision_from_string(const std::string &name)
+{
+    if (name == "fp32")
+        return Precision::FP32;
+    if (name == "fp16")
+        return Precision::FP16;
+    if (name == "bf16")
+        return Precision::BF16;
+    if (name == "int8")
+        return Precision::INT8;
+    throw std::runtime_error("Unknown precision: " + name + ", expected fp32, fp16, bf16 or int8");
+}
+
+
+const char *precision_name(Precision precision)
+{
+    switch (precision) {
+    case Precision::FP32: return "fp32";
+    case Precision::FP16: return "fp16";
+    case Precision::BF16: return "bf16";
+    case Precision::INT8: return "int8";
+    }
+    return "unknown";
+}
+
+
+static uint32_t float_bits(float x)
+{
+    uint32_t u;
+    std::memcpy(&u, &x, sizeof(u));
+    return u;
+}
+
+
+static float bits_float(uint32_t u)
+{
+    float x;
+    std::memcpy(&x, &u, sizeof(x));
+    return x;
+}
+
+
+// Branch-light conversions in the spirit of F. Giesen's half <-> float snippets:
+// subnormals are handled by adding / subtracting a magic constant in float
+uint16_t float_to_fp16(float x)
+{
+    const uint32_t f32_infinity = 255u << 23, f16_max = (127u + 16) << 23;
+    // 0.5 in the exponent of the smallest fp16 subnormal, adding it aligns the mantissa
+    const uint32_t denorm_magic = ((127u - 15) + (23 - 10) + 1) << 23;
+
+    uint32_t u = float_bits(x);
+    const uint32_t sign = u & 0x80000000u;
+    u ^= sign;
+
+    uint16_t h;
+    if (u >= f16_max) {
+        // too big for fp16, or infinity / NaN already
+        h = u > f32_infinity ? 0x7e00 : 0x7c00;
+    } else if (u < (113u << 23)) {
+        // subnormal or zero in fp16, the float addition does the rounding
+        h = uint16_t(float_bits(bits_float(u) + bits_float(denorm_magic)) - denorm_magic);
+    } else {
+        const uint32_t mantissa_odd = (u >> 13) & 1;
+        u += ((15u - 127) << 23) + 0xfff + mantissa_odd;
+        h = uint16_t(u >> 13);
+    }
+    return h | uint16_t(sign >> 16);
+}
+
+
+float fp16_to_float(uint16_t h)
+{
+    const uint32_t shifted_exp = 0x7c00u << 13;
+    uint32_t u = uint32_t(h & 0x7fff) << 13;
+    const uint32_t exp = u & shifted_exp;
+    u += (127u - 15) << 23;
+
+    float x;
+    if (exp == shifted_exp) {
+        // infinity / NaN
+        x = bits_float(u + ((128u - 16) << 23));
+    } else if (exp == 0) {
+        // zero / subnormal: renormalized by the float subtraction
+        x = bits_float(u + (1u << 23)) - bits_float(113u << 23);
+    } else {
+        x = bits_float(u);
+    }
+    return bits_float(float_bits(x) | (uint32_t(h & 0x8000) << 16));
+}
+
+
+uint16_t float_to_bf16(float x)
+{
+    const uint32_t u = float_bits(x);
+    if ((u & 0x7fffffffu) > 0x7f800000u)
+        return uint16_t((u >> 16) | 0x40);
+    return uint16_t((u + 0x7fff + ((u >> 16) & 1)) >> 16);
+}
+
+
+float bf16_to_float(uint16_t h)
+{
+    return bits_float(uint32_t(h) << 16);
+}
+
+
+void round_to_half(float *x, uint32_t n, Precision format)
+{
+    if (format == Precision::BF16) {
+        for (uint32_t i = 0; i < n; ++i)
+            x[i] = bf16_to_float(float_to_bf16(x[i]));
+    } else {
+        for (uint32_t i = 0; i < n; ++i)
+            x[i] = fp16_to_float(float_to_fp16(x[i]));
+    }
+}
+
+
+// adding and subtracting 1.5 * 2^23 rounds to nearest even without a libm call,
+// so the loops vectorize
+static inline int8_t round_int8(float x, float inv_scale)
+{
+    const float round_magic = 12582912.0f;
+    float q = x * inv_scale;
+    q = q > 127.0f ? 127.0f : q;
+    q = q < -127.0f ? -127.0f : q;
+    return int8_t(int32_t((q + round_magic) - round_magic));
+}
+
+
+void quantize_int8(int8_t *dst, const float *src, uint32_t n, float scale)
+{
+    const float inv_scale = 1.0f / scale;
+    for (uint32_t i = 0; i < n; ++i)
+        dst[i] = round_int8(src[i], inv_scale);
+}
+
+
+void quantize_rows_int8(int8_t *dst, float *scales, const float *w, uint32_t rows, uint32_t cols)
+{
+    for (uint32_t o = 0; o < rows; ++o) {
+        float max_abs = 0.0f;
+        for (uint32_t k = 0; k < cols; ++k)
+            max_abs = std::max(max_abs, std::fabs(w[o * cols + k]));
+        scales[o] = max_abs > 0.0f ? max_abs / 127.0f : 1.0f;
+        quantize_int8(dst + o * cols, w + o * cols, cols, scales[o]);
+    }
+}
+
+
+uint32_t int8_depth(uint32_t in_dim)
+{
+    return (in_dim + INT8_GROUP - 1) / INT8_GROUP * INT8_GROUP;
+}
+
+
+size_t int8_packed_size(uint32_t out_dim, uint32_t in_dim)
+{
+    const size_t blocks = (out_dim + INT8_ROWS - 1) / INT8_ROWS;
+    return blocks * INT8_ROWS * int8_depth(in_dim);
+}
+
+
+void pack_int8_weights(int8_t *dst, const int8_t *w, uint32_t out_dim, uint32_t in_dim)
+{
+    const uint32_t depth = int8_depth(in_dim);
+    std::fill(dst, dst + int8_packed_size(out_dim, in_dim), 0);
+    for (uint32_t o = 0; o < out_dim; ++o) {
+        int8_t *block = dst + o / INT8_ROWS * INT8_ROWS * depth;
+        const uint32_t r = o % INT8_ROWS;
+        for (uint32_t k = 0; k < in_dim; ++k) {
+            const uint32_t g = k / INT8_GROUP;
+            block[(g * INT8_ROWS + r) * INT8_GROUP + k % INT8_GROUP] = w[o * in_dim + k];
+        }
+    }
+}
+
+
+void quantize_int8_points(int8_t *dst, MatrixView src, uint32_t n, uint32_t dim, float scale)
+{
+    const uint32_t depth = int8_depth(dim);
+    const float inv_scale = 1.0f / scale;
+    for (uint32_t j = 0; j < n; ++j) {
+        int8_t *point = dst + size_t(j) * depth;
+        const float *coords = src.data + size_t(j) * src.row_stride;
+        // points stored one by one are read contiguously, so that the loop vectorizes
+        if (src.col_stride == 1) {
+            for (uint32_t i = 0; i < dim; ++i)
+                point[i] = round_int8(coords[i], inv_scale);
+        } else {
+            for (uint32_t i = 0; i < dim; ++i)
+                point[i] = round_int8(coords[size_t(i) * src.col_stride], inv_scale);
+        }
+        std::fill(point + dim, point + depth, 0);
+    }
+}
+
+
+void linear_int8(float *res, uint32_t ldc, const int8_t *w_packed, const float *w_scales,
+    const float *bias, const int8_t *x, float x_scale, uint32_t out_dim, uint32_t in_dim, uint32_t n)
+{
+    const NNBackend &backend = nn_backend();
+    const uint32_t depth = int8_depth(in_dim);
+    const uint64_t ops_per_point = std::max<uint64_t>(uint64_t(out_dim) * depth, 1);
+    const uint32_t min_points = (MIN_THREAD_OPS + ops_per_point - 1) / ops_per_point;
+    parallel_for(n, min_points, 1, [&](uint32_t begin, uint32_t end) {
+        backend.linear_int8(res + size_t(begin) * ldc, ldc, w_packed, w_scales, bias,
+            x + size_t(begin) * depth, x_scale, out_dim, depth, end - begin);
+    });
+}
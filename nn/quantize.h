@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <cstddef>
+
+#include "gemm.h"
+
+
+// Number format of the weights and activations SirenModel evaluates with
+enum class Precision
+{
+    FP32,
+    FP16,   // IEEE half rounding of fp32 values, fp32 accumulation
+    BF16,   // bfloat16 rounding of fp32 values, fp32 accumulation
+    INT8    // symmetric int8, per output channel weight scales, int32 accumulation
+};
+
+// "fp32", "fp16", "bf16" or "int8"; throws on anything else
+Precision precision_from_string(const std::string &name);
+const char *precision_name(Precision precision);
+
+
+// Conversions round to nearest even; fp16 overflows to infinity and keeps
+// subnormals, NaNs stay NaNs
+uint16_t float_to_fp16(float x);
+float fp16_to_float(uint16_t h);
+uint16_t float_to_bf16(float x);
+float bf16_to_float(uint16_t h);
+
+// x[i] rounded to a 16-bit format (FP16 or BF16), kept as fp32
+void round_to_half(float *x, uint32_t n, Precision format);
+
+// dst[i] = round(src[i] / scale), clamped to [-127, 127]
+void quantize_int8(int8_t *dst, const float *src, uint32_t n, float scale);
+// dst[o, k] = round(w[o, k] / scales[o]) for a [rows x cols] matrix,
+// scales[o] = max_k |w[o, k]| / 127 (1 for a zero row)
+void quantize_rows_int8(int8_t *dst, float *scales, const float *w, uint32_t rows, uint32_t cols);
+
+// Operands of linear_int8. Depth of a layer with in_dim inputs, padded to whole
+// INT8_GROUPs (backend.h) with zeros
+uint32_t int8_depth(uint32_t in_dim);
+// bytes of a packed [out_dim x in_dim] matrix
+size_t int8_packed_size(uint32_t out_dim, uint32_t in_dim);
+// w[out_dim x in_dim] in the packed layout of NNBackend::linear_int8
+void pack_int8_weights(int8_t *dst, const int8_t *w, uint32_t out_dim, uint32_t in_dim);
+// n points of dim coordinates, coordinate i of point j is src(j, i); quantized by
+// scale into rows of int8_depth(dim) bytes, one per point
+void quantize_int8_points(int8_t *dst, MatrixView src, uint32_t n, uint32_t dim, float scale);
+
+// res[j * ldc + o] = w_scales[o] * x_scale * sum_k w[o, k] * x[j, k] + bias[o] with int32
+// accumulation: packed w[out_dim x in_dim] times n points from quantize_int8_points,
+// results are stored point by point. Points are spread over nn_thread_pool()
+void linear_int8(float *res, uint32_t ldc, const int8_t *w_packed, const float *w_scales,
+    const float *bias, const int8_t *x, float x_scale, uint32_t out_dim, uint32_t in_dim, uint32_t n);
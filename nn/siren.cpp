@@ -1,11 +1,40 @@
 #include "siren.h"
 
+#ifndef KERNEL_SLICER
+#include "gemm.h"
+#include "backend.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+// elementwise kernels hand at least this many floats to a thread,
+// ranges are aligned to whole cache lines
+static const uint32_t MIN_THREAD_ITEMS = 1 << 14;
+static const uint32_t THREAD_ALIGN = 64;
+
+// network buffers are sized for the batch given at construction
+static void check_batch_size(int batch_size, int max_batch_size)
+{
+    if (batch_size > max_batch_size)
+        throw std::runtime_error("Batch of " + std::to_string(batch_size) + \
+            " points exceeds the network max batch size " + std::to_string(max_batch_size));
+}
+#endif
+
 
 void SirenNetwork::kernel2D_matmul(
     float *c, float *a, float *b,
     uint32_t a_rows, uint32_t b_rows, uint32_t b_cols,
     uint32_t c_offset, uint32_t a_offset, uint32_t b_offset)
 {
+#ifndef KERNEL_SLICER
+    gemm(c + c_offset, b_cols,
+        MatrixView{a + a_offset, b_rows, 1},
+        MatrixView{b + b_offset, b_cols, 1},
+        a_rows, b_cols, b_rows);
+#else
     for (uint32_t i = 0; i < a_rows; ++i) {
         for (uint32_t j = 0; j < b_cols; ++j) {
             float value = 0.0f;
@@ -15,6 +44,7 @@ void SirenNetwork::kernel2D_matmul(
             c[c_offset + i * b_cols + j] = value;
         }
     }
+#endif
 }
 
 
@@ -23,12 +53,20 @@ void SirenNetwork::kernel2D_add_bias(
     uint32_t n_rows, uint32_t n_cols,
     uint32_t res_offset, uint32_t input_offset, uint32_t vec_offset)
 {
+#ifndef KERNEL_SLICER
+    parallel_for(n_rows, MIN_THREAD_ITEMS / std::max(n_cols, 1u), 1, [&](uint32_t begin, uint32_t end) {
+        nn_backend().add_bias(
+            res + res_offset + begin * n_cols, inp + input_offset + begin * n_cols,
+            vec + vec_offset + begin, end - begin, n_cols);
+    });
+#else
     for (uint32_t i = 0; i < n_rows; ++i) {
         for (uint32_t j = 0; j < n_cols; ++j) {
             res[res_offset + i * n_cols + j] = inp[input_offset + i * n_cols + j] + \
                                             vec[vec_offset + i];
         }
     }
+#endif
 }
 
 
@@ -37,12 +75,98 @@ void SirenNetwork::kernel2D_sin_activation(
     uint32_t n_rows, uint32_t n_cols,
     uint32_t res_offset, uint32_t input_offset)
 {
+#ifndef KERNEL_SLICER
+    parallel_for(n_rows * n_cols, MIN_THREAD_ITEMS, THREAD_ALIGN, [&](uint32_t begin, uint32_t end) {
+        nn_backend().sin_activation(
+            res + res_offset + begin, inp + input_offset + begin, end - begin);
+    });
+#else
     for (uint32_t i = 0; i < n_rows; ++i) {
         for (uint32_t j = 0; j < n_cols; ++j) {
             float x = 30.0 * inp[input_offset + i * n_cols + j];
             res[res_offset + i * n_cols + j] = sin(x);
         }
     }
+#endif
+}
+
+
+void SirenNetwork::kernel2D_linear(
+    float *res, float *weights, float *inp,
+    uint32_t out_dim, uint32_t in_dim, uint32_t n_cols,
+    uint32_t res_offset, uint32_t w_offset, uint32_t input_offset)
+{
+#ifndef KERNEL_SLICER
+    GemmEpilogue epilogue;
+    epilogue.bias = weights + w_offset + out_dim * in_dim;
+    gemm(res + res_offset, n_cols,
+        MatrixView{weights + w_offset, in_dim, 1},
+        MatrixView{inp + input_offset, n_cols, 1},
+        out_dim, n_cols, in_dim, epilogue);
+#else
+    uint32_t b_offset = w_offset + out_dim * in_dim;
+    for (uint32_t i = 0; i < out_dim; ++i) {
+        for (uint32_t j = 0; j < n_cols; ++j) {
+            float value = 0.0f;
+            for (uint32_t k = 0; k < in_dim; ++k) {
+                value += weights[w_offset + i * in_dim + k] * inp[input_offset + k * n_cols + j];
+            }
+            res[res_offset + i * n_cols + j] = value + weights[b_offset + i];
+        }
+    }
+#endif
+}
+
+
+void SirenNetwork::kernel2D_linear_sin(
+    float *res, float *act, float *weights, float *inp,
+    uint32_t out_dim, uint32_t in_dim, uint32_t n_cols,
+    uint32_t res_offset, uint32_t act_offset,
+    uint32_t w_offset, uint32_t input_offset)
+{
+#ifndef KERNEL_SLICER
+    GemmEpilogue epilogue;
+    epilogue.bias = weights + w_offset + out_dim * in_dim;
+    epilogue.activation = act + act_offset;
+    epilogue.ld_activation = n_cols;
+    gemm(res + res_offset, n_cols,
+        MatrixView{weights + w_offset, in_dim, 1},
+        MatrixView{inp + input_offset, n_cols, 1},
+        out_dim, n_cols, in_dim, epilogue);
+#else
+    uint32_t b_offset = w_offset + out_dim * in_dim;
+    for (uint32_t i = 0; i < out_dim; ++i) {
+        for (uint32_t j = 0; j < n_cols; ++j) {
+            float value = 0.0f;
+            for (uint32_t k = 0; k < in_dim; ++k) {
+                value += weights[w_offset + i * in_dim + k] * inp[input_offset + k * n_cols + j];
+            }
+            value += weights[b_offset + i];
+            res[res_offset + i * n_cols + j] = value;
+            act[act_offset + i * n_cols + j] = sin(30.0 * value);
+        }
+    }
+#endif
+}
+
+
+void SirenNetwork::kernel1D_fill(float *res, float value, uint32_t n, uint32_t res_offset)
+{
+#ifndef KERNEL_SLICER
+    std::fill(res + res_offset, res + res_offset + n, value);
+#else
+    for (uint32_t i = 0; i < n; ++i) {
+        res[res_offset + i] = value;
+    }
+#endif
+}
+
+
+void SirenNetwork::kernel1D_scale(float *res, float scale, uint32_t n, uint32_t res_offset)
+{
+    for (uint32_t i = 0; i < n; ++i) {
+        res[res_offset + i] *= scale;
+    }
 }
 
 
@@ -51,9 +175,13 @@ void SirenNetwork::kernel1D_mse_grad(
     uint32_t n_samples,
     uint32_t res_offset, uint32_t preds_offset, uint32_t gt_offset)
 {
+#ifndef KERNEL_SLICER
+    nn_backend().mse_grad(res + res_offset, preds + preds_offset, gt + gt_offset, n_samples);
+#else
     for (uint32_t i = 0; i < n_samples; ++i) {
         res[res_offset + i] = 2 * (preds[preds_offset + i] - gt[gt_offset + i]) / n_samples;
     }
+#endif
 }
 
 
@@ -62,11 +190,18 @@ void SirenNetwork::kernel2D_bias_grad(
     uint32_t n_rows, uint32_t n_cols,
     uint32_t res_offset, uint32_t input_offset)
 {
+#ifndef KERNEL_SLICER
+    parallel_for(n_rows, MIN_THREAD_ITEMS / std::max(n_cols, 1u), 1, [&](uint32_t begin, uint32_t end) {
+        nn_backend().bias_grad(
+            res + res_offset + begin, inp + input_offset + begin * n_cols, end - begin, n_cols);
+    });
+#else
     for (uint32_t i = 0; i < n_rows; ++i) {
         for (uint32_t j = 0; j < n_cols; ++j) {
             res[res_offset + i] += inp[input_offset + i * n_cols + j];
         }
     }
+#endif
 }
 
 
@@ -75,6 +210,12 @@ void SirenNetwork::kernel2D_matmul_transposed_right(
     uint32_t a_rows, uint32_t b_rows, uint32_t b_cols,
     uint32_t c_offset, uint32_t a_offset, uint32_t b_offset)
 {
+#ifndef KERNEL_SLICER
+    gemm(c + c_offset, b_cols,
+        MatrixView{a + a_offset, b_rows, 1},
+        MatrixView{b + b_offset, 1, b_rows},
+        a_rows, b_cols, b_rows);
+#else
     for (uint32_t i = 0; i < a_rows; ++i) {
         for (uint32_t j = 0; j < b_cols; ++j) {
             float value = 0.0f;
@@ -84,6 +225,33 @@ void SirenNetwork::kernel2D_matmul_transposed_right(
             c[c_offset + i * b_cols + j] = value;
         }
     }
+#endif
+}
+
+
+void SirenNetwork::kernel2D_matmul_transposed_right_add(
+    float *c, float *a, float *b,
+    uint32_t a_rows, uint32_t b_rows, uint32_t b_cols,
+    uint32_t c_offset, uint32_t a_offset, uint32_t b_offset)
+{
+#ifndef KERNEL_SLICER
+    GemmEpilogue epilogue;
+    epilogue.accumulate = true;
+    gemm(c + c_offset, b_cols,
+        MatrixView{a + a_offset, b_rows, 1},
+        MatrixView{b + b_offset, 1, b_rows},
+        a_rows, b_cols, b_rows, epilogue);
+#else
+    for (uint32_t i = 0; i < a_rows; ++i) {
+        for (uint32_t j = 0; j < b_cols; ++j) {
+            float value = 0.0f;
+            for (uint32_t k = 0; k < b_rows; ++k) {
+                value += a[a_offset + i * b_rows + k] * b[b_offset + j * b_rows + k];
+            }
+            c[c_offset + i * b_cols + j] += value;
+        }
+    }
+#endif
 }
 
 
@@ -92,6 +260,12 @@ void SirenNetwork::kernel2D_matmul_transposed_left(
     uint32_t a_rows, uint32_t b_rows, uint32_t b_cols,
     uint32_t c_offset, uint32_t a_offset, uint32_t b_offset)
 {
+#ifndef KERNEL_SLICER
+    gemm(c + c_offset, b_cols,
+        MatrixView{a + a_offset, 1, a_rows},
+        MatrixView{b + b_offset, b_cols, 1},
+        a_rows, b_cols, b_rows);
+#else
     for (uint32_t i = 0; i < a_rows; ++i) {
         for (uint32_t j = 0; j < b_cols; ++j) {
             float value = 0.0f;
@@ -101,6 +275,35 @@ void SirenNetwork::kernel2D_matmul_transposed_left(
             c[c_offset + i * b_cols + j] = value;
         }
     }
+#endif
+}
+
+
+void SirenNetwork::kernel2D_matmul_transposed_left_scaled(
+    float *c, float *a, float *b, float *scale,
+    uint32_t a_rows, uint32_t b_rows, uint32_t b_cols,
+    uint32_t c_offset, uint32_t a_offset, uint32_t b_offset,
+    uint32_t scale_offset)
+{
+#ifndef KERNEL_SLICER
+    GemmEpilogue epilogue;
+    epilogue.scale = scale + scale_offset;
+    epilogue.ld_scale = b_cols;
+    gemm(c + c_offset, b_cols,
+        MatrixView{a + a_offset, 1, a_rows},
+        MatrixView{b + b_offset, b_cols, 1},
+        a_rows, b_cols, b_rows, epilogue);
+#else
+    for (uint32_t i = 0; i < a_rows; ++i) {
+        for (uint32_t j = 0; j < b_cols; ++j) {
+            float value = 0.0f;
+            for (uint32_t k = 0; k < b_rows; ++k) {
+                value += a[a_offset + k * a_rows + i] * b[b_offset + k * b_cols + j];
+            }
+            c[c_offset + i * b_cols + j] = value * scale[scale_offset + i * b_cols + j];
+        }
+    }
+#endif
 }
 
 
@@ -109,6 +312,12 @@ void SirenNetwork::kernel2D_sin_grad(
     uint32_t n_rows, uint32_t n_cols,
     uint32_t res_offset, uint32_t input_offset, uint32_t out_grads_offset)
 {
+#ifndef KERNEL_SLICER
+    parallel_for(n_rows * n_cols, MIN_THREAD_ITEMS, THREAD_ALIGN, [&](uint32_t begin, uint32_t end) {
+        nn_backend().sin_grad(res + res_offset + begin, inp + input_offset + begin,
+            out_grads + out_grads_offset + begin, end - begin);
+    });
+#else
     for (uint32_t i = 0; i < n_rows; ++i) {
         for (uint32_t j = 0; j < n_cols; ++j) {
             uint32_t idx = i * n_cols + j;
@@ -116,12 +325,46 @@ void SirenNetwork::kernel2D_sin_grad(
             res[res_offset + idx] = 30.0 * x_cos * out_grads[out_grads_offset + idx];
         }
     }
+#endif
+}
+
+
+void SirenNetwork::kernel2D_sin_cos(
+    float *sin_res, float *dsin_res, float *inp,
+    uint32_t n_rows, uint32_t n_cols,
+    uint32_t sin_offset, uint32_t dsin_offset, uint32_t input_offset)
+{
+#ifndef KERNEL_SLICER
+    parallel_for(n_rows * n_cols, MIN_THREAD_ITEMS, THREAD_ALIGN, [&](uint32_t begin, uint32_t end) {
+        nn_backend().sin_cos(sin_res + sin_offset + begin, dsin_res + dsin_offset + begin,
+            inp + input_offset + begin, end - begin);
+    });
+#else
+    for (uint32_t i = 0; i < n_rows; ++i) {
+        for (uint32_t j = 0; j < n_cols; ++j) {
+            uint32_t idx = i * n_cols + j;
+            float x = 30.0 * inp[input_offset + idx];
+            sin_res[sin_offset + idx] = sin(x);
+            dsin_res[dsin_offset + idx] = 30.0 * cos(x);
+        }
+    }
+#endif
 }
 
 
 void SirenNetwork::kernel1D_Adam_step(
     float *params, float *grads, float *adam_m, float *adam_v, uint32_t n_params, float lr)
 {
+#ifndef KERNEL_SLICER
+    // bias corrections are the same for every parameter
+    float m_scale = 1.0f / (1.0f - std::pow(beta1, t));
+    float v_scale = 1.0f / (1.0f - std::pow(beta2, t));
+    // every parameter is updated independently, so ranges go to different threads
+    parallel_for(n_params, MIN_THREAD_ITEMS, THREAD_ALIGN, [&](uint32_t begin, uint32_t end) {
+        nn_backend().adam_step(params + begin, grads + begin, adam_m + begin, adam_v + begin,
+            end - begin, lr, beta1, beta2, eps, m_scale, v_scale, 0.0f);
+    });
+#else
     for (uint32_t i = 0; i < n_params; ++i) {
         adam_m[i] = beta1 * adam_m[i] + (1 - beta1) * grads[i];
         adam_v[i] = beta2 * adam_v[i] + (1 - beta2) * pow(grads[i], 2);
@@ -131,6 +374,7 @@ void SirenNetwork::kernel1D_Adam_step(
 
         params[i] -= lr * m_corr / (sqrt(v_corr) + eps);
     }
+#endif
     t += 1;
 }
 
@@ -138,6 +382,7 @@ void SirenNetwork::kernel1D_Adam_step(
 SirenNetwork::SirenNetwork(int n_hidden, int hidden_size, int batch_size)
 {
     m_batch_size = batch_size;
+    m_max_batch_size = batch_size;
 
     m_layers_shapes.push_back(std::pair<int,int>{hidden_size, INPUT_DIM});
     for (int i = 0; i < n_hidden; ++i) {
@@ -150,19 +395,27 @@ SirenNetwork::SirenNetwork(int n_hidden, int hidden_size, int batch_size)
 
     for (auto [out_dim, in_dim]: m_layers_shapes) {
         n_params += in_dim * out_dim + out_dim;
-        // two outputs for linear layer and one for sin activation
-        n_outputs += 3 * m_batch_size * out_dim;
+        // only pre-activations are kept, activations are recomputed in backward
+        n_outputs += m_batch_size * out_dim;
     }
-    // there is no activation after last linear layer
-    n_outputs -= m_batch_size * m_layers_shapes.back().first;
 
     m_weights_biases = std::vector<float>(n_params);
     m_weights_grads = std::vector<float>(n_params);
-    m_outputs = std::vector<float>(n_outputs);
     m_out_grads = std::vector<float>(n_outputs);
 
+    // two activation buffers: layer input and output in forward, sin and its
+    // derivative in backward
+    m_act_offset = n_outputs;
+    m_act_size = m_batch_size * hidden_size;
+    m_outputs = std::vector<float>(n_outputs + 2 * m_act_size);
+
+#if defined(KERNEL_SLICER) || defined(USE_VULKAN)
     m_adam_m = std::vector<float>(n_params);
     m_adam_v = std::vector<float>(n_params);
+#endif
+#ifndef KERNEL_SLICER
+    m_optimizer = Optimizer(n_params);
+#endif
     
     m_gt_buffer = std::vector<float>(m_batch_size * OUTPUT_DIM);
 
@@ -201,101 +454,209 @@ std::vector<float> SirenNetwork::getWeights() const
 }
 
 
+int SirenNetwork::getMaxBatchSize() const
+{
+    return m_max_batch_size;
+}
+
+
 std::vector<float> SirenNetwork::getWeightsGradients() const
 {
     return m_weights_grads;
 }
 
 
+float *SirenNetwork::getWeightsGradientsData()
+{
+    return m_weights_grads.data();
+}
+
+
 std::vector<float> SirenNetwork::getOutputsGradients() const
 {
     return m_out_grads;
 }
 
 
-void SirenNetwork::forward(float *res, const float *input, int batch_size)
+void SirenNetwork::forward(float *res, const float *input, int batch_size, int input_stride)
 {
+#ifndef KERNEL_SLICER
+    check_batch_size(batch_size, m_max_batch_size);
+    m_has_forward = true;
+#endif
     m_batch_size = batch_size;
 
     int first_in_dim = m_layers_shapes.front().second;
-    for (int i = 0; i < m_batch_size * first_in_dim; ++i) {
-        m_outputs[i] = input[i];
+    int stride = input_stride > 0 ? input_stride : m_batch_size;
+    for (int dim = 0; dim < first_in_dim; ++dim) {
+        for (int i = 0; i < m_batch_size; ++i) {
+            m_outputs[dim * m_batch_size + i] = input[dim * stride + i];
+        }
     }
 
+    // pre-activations are stored one after another, activations alternate
+    // between the two buffers
     uint32_t w_offset = 0, out_offset = m_batch_size * first_in_dim, in_offset = 0;
+    uint32_t act_offset = m_act_offset;
     int layer_i = 0;
     for (auto [out_dim, in_dim]: m_layers_shapes) {
-        kernel2D_matmul(
-            m_outputs.data(), m_weights_biases.data(), m_outputs.data(),
-            out_dim, in_dim, m_batch_size,
-            out_offset, w_offset, in_offset);
-        in_offset = out_offset;
+        if (layer_i < m_layers_shapes.size() - 1) {
+            kernel2D_linear_sin(
+                m_outputs.data(), m_outputs.data(), m_weights_biases.data(), m_outputs.data(),
+                out_dim, in_dim, m_batch_size,
+                out_offset, act_offset, w_offset, in_offset);
+            in_offset = act_offset;
+            act_offset = act_offset == m_act_offset ? m_act_offset + m_act_size : m_act_offset;
+        } else {
+            kernel2D_linear(
+                m_outputs.data(), m_weights_biases.data(), m_outputs.data(),
+                out_dim, in_dim, m_batch_size,
+                out_offset, w_offset, in_offset);
+            m_outputs_end = out_offset;
+        }
         out_offset += m_batch_size * out_dim;
-        w_offset += in_dim * out_dim;
+        w_offset += in_dim * out_dim + out_dim;
 
-        kernel2D_add_bias(
-            m_outputs.data(), m_outputs.data(), m_weights_biases.data(),
-            out_dim, m_batch_size,
-            out_offset, in_offset, w_offset);
-        in_offset = out_offset;
-        out_offset += m_batch_size * out_dim;
-        w_offset += out_dim;
+        ++layer_i;
+    }
+
+    int last_out_dim = m_layers_shapes.back().first;
+    for (int i = 0; i < m_batch_size * last_out_dim; ++i) {
+        res[i] = m_outputs[m_outputs_end + i];
+    }
+}
+
+
+void SirenNetwork::inference(float *res, const float *input, int batch_size)
+{
+#ifndef KERNEL_SLICER
+    check_batch_size(batch_size, m_max_batch_size);
+#endif
+    m_batch_size = batch_size;
+
+    int first_in_dim = m_layers_shapes.front().second;
+    for (int i = 0; i < m_batch_size * first_in_dim; ++i) {
+        m_outputs[i] = input[i];
+    }
 
+    // every hidden layer writes its activation over its pre-activation
+    uint32_t w_offset = 0, in_offset = 0, out_offset = m_act_offset;
+    int layer_i = 0;
+    for (auto [out_dim, in_dim]: m_layers_shapes) {
         if (layer_i < m_layers_shapes.size() - 1) {
-            kernel2D_sin_activation(
-                m_outputs.data(), m_outputs.data(),
-                m_batch_size, out_dim,
-                out_offset, in_offset);
-            in_offset = out_offset;
-            out_offset += m_batch_size * out_dim;
+            kernel2D_linear_sin(
+                m_outputs.data(), m_outputs.data(), m_weights_biases.data(), m_outputs.data(),
+                out_dim, in_dim, m_batch_size,
+                out_offset, out_offset, w_offset, in_offset);
+        } else {
+            kernel2D_linear(
+                m_outputs.data(), m_weights_biases.data(), m_outputs.data(),
+                out_dim, in_dim, m_batch_size,
+                out_offset, w_offset, in_offset);
         }
+        in_offset = out_offset;
+        out_offset = out_offset == m_act_offset ? m_act_offset + m_act_size : m_act_offset;
+        w_offset += in_dim * out_dim + out_dim;
 
         ++layer_i;
     }
 
     int last_out_dim = m_layers_shapes.back().first;
-    m_outputs_end = out_offset - m_batch_size * last_out_dim;
     for (int i = 0; i < m_batch_size * last_out_dim; ++i) {
-        res[i] = m_outputs[m_outputs_end + i];
+        res[i] = m_outputs[in_offset + i];
+    }
+}
+
+
+void SirenNetwork::forwardWithGradient(float *res, float *grad, const float *input, int batch_size)
+{
+    forward(res, input, batch_size);
+
+    // output is a scalar per point, so its gradient w.r.t. itself is one
+    int out_grads_offset = m_outputs_end;
+    int last_out_dim = m_layers_shapes.back().first;
+    for (int i = 0; i < m_batch_size * last_out_dim; ++i) {
+        m_out_grads[out_grads_offset + i] = 1.0f;
+    }
+
+    // same as backward, but only gradients w.r.t. layer inputs are computed
+    int sin_offset = m_act_offset, dsin_offset = m_act_offset + m_act_size;
+    int w_offset = m_weights_biases.size();
+    for (int i = m_layers_shapes.size() - 1; i >= 0; --i) {
+        auto [out_dim, in_dim] = m_layers_shapes[i];
+        int in_offset = out_grads_offset - m_batch_size * in_dim;
+        w_offset -= out_dim + in_dim * out_dim;
+
+        if (i > 0) {
+            kernel2D_sin_cos(
+                m_outputs.data(), m_outputs.data(), m_outputs.data(),
+                in_dim, m_batch_size,
+                sin_offset, dsin_offset, in_offset);
+            kernel2D_matmul_transposed_left_scaled(
+                m_out_grads.data(), m_weights_biases.data(), m_out_grads.data(), m_outputs.data(),
+                in_dim, out_dim, m_batch_size,
+                in_offset, w_offset, out_grads_offset, dsin_offset);
+        } else {
+            kernel2D_matmul_transposed_left(
+                m_out_grads.data(), m_weights_biases.data(), m_out_grads.data(),
+                in_dim, out_dim, m_batch_size,
+                in_offset, w_offset, out_grads_offset);
+        }
+        out_grads_offset = in_offset;
+    }
+
+    // input gradients are at the start of m_out_grads
+    int first_in_dim = m_layers_shapes.front().second;
+    for (int i = 0; i < m_batch_size * first_in_dim; ++i) {
+        grad[i] = m_out_grads[i];
     }
 }
 
 
 void SirenNetwork::backward(const float *y_gt)
 {
+#ifndef KERNEL_SLICER
+    if (!m_has_forward)
+        throw std::runtime_error("backward needs a forward pass first");
+#endif
     // copy input
     int last_out_dim = m_layers_shapes.back().first;
     for (int i = 0; i < m_batch_size * last_out_dim; ++i) {
         m_gt_buffer[i] = y_gt[i];
     }
     
+    // gradients of all layers are added up below, so a plain backward starts from zero
+#ifndef KERNEL_SLICER
+    if (!m_accumulate_grads)
+        kernel1D_fill(m_weights_grads.data(), 0.0f, m_weights_grads.size());
+#else
+    kernel1D_fill(m_weights_grads.data(), 0.0f, m_weights_grads.size());
+#endif
+
     // firstly: compute mse gradient
     // shape is [out_dim, batch_size]
-    int outputs_offset = m_outputs_end;
-    int out_grads_offset = outputs_offset;
+    int out_grads_offset = m_outputs_end;
     kernel1D_mse_grad(
         m_out_grads.data(), m_outputs.data(), m_gt_buffer.data(),
         m_batch_size,
-        out_grads_offset, outputs_offset);
-    
+        out_grads_offset, m_outputs_end);
+#ifndef KERNEL_SLICER
+    // everything below is linear in the loss gradient, so weighting it weighs the batch
+    if (m_grads_weight != 1.0f)
+        kernel1D_scale(m_out_grads.data(), m_grads_weight, m_batch_size * last_out_dim, out_grads_offset);
+#endif
+
+    // layer inputs are recomputed from the stored pre-activations together with
+    // sin derivative: sin goes to the first activation buffer, derivative to the second
+    int sin_offset = m_act_offset, dsin_offset = m_act_offset + m_act_size;
+
     // compute gradients for each layer iteratively
     int w_offset = m_weights_biases.size();
     for (int i = m_layers_shapes.size() - 1; i >= 0; --i) {
         auto [out_dim, in_dim] = m_layers_shapes[i];
-
-        if (i < m_layers_shapes.size() - 1) {
-            // compute sin grad
-            int out_grad_to_write = out_grads_offset - out_dim * m_batch_size;
-            outputs_offset -= m_batch_size * out_dim;
-            kernel2D_sin_grad(
-                m_out_grads.data(), m_outputs.data(), m_out_grads.data(),
-                out_dim, m_batch_size,
-                out_grad_to_write, outputs_offset, out_grads_offset);
-            out_grads_offset = out_grad_to_write;
-        }
+        int in_offset = out_grads_offset - m_batch_size * in_dim;
 
         // linear layer gradients: bias, weights, outputs
-        outputs_offset -= m_batch_size * out_dim;
         w_offset -= out_dim;
         kernel2D_bias_grad(
             m_weights_grads.data(), m_out_grads.data(),
@@ -303,28 +664,116 @@ void SirenNetwork::backward(const float *y_gt)
             w_offset, out_grads_offset);
 
         w_offset -= in_dim * out_dim;
-        outputs_offset -= m_batch_size * in_dim;
-        kernel2D_matmul_transposed_right(
+        int layer_input_offset = in_offset;
+        if (i > 0) {
+            kernel2D_sin_cos(
+                m_outputs.data(), m_outputs.data(), m_outputs.data(),
+                in_dim, m_batch_size,
+                sin_offset, dsin_offset, in_offset);
+            layer_input_offset = sin_offset;
+        }
+        kernel2D_matmul_transposed_right_add(
             m_weights_grads.data(), m_out_grads.data(), m_outputs.data(),
             out_dim, m_batch_size, in_dim,
-            w_offset, out_grads_offset, outputs_offset);
-        
-        int out_grad_to_write = out_grads_offset - in_dim * m_batch_size;
-        kernel2D_matmul_transposed_left(
-            m_out_grads.data(), m_weights_biases.data(), m_out_grads.data(),
-            in_dim, out_dim, m_batch_size,
-            out_grad_to_write, w_offset, out_grads_offset);
-        out_grads_offset = out_grad_to_write;
+            w_offset, out_grads_offset, layer_input_offset);
+
+        // gradient w.r.t. layer input, for hidden layers it goes through sin right away
+        if (i > 0) {
+            kernel2D_matmul_transposed_left_scaled(
+                m_out_grads.data(), m_weights_biases.data(), m_out_grads.data(), m_outputs.data(),
+                in_dim, out_dim, m_batch_size,
+                in_offset, w_offset, out_grads_offset, dsin_offset);
+        } else {
+            kernel2D_matmul_transposed_left(
+                m_out_grads.data(), m_weights_biases.data(), m_out_grads.data(),
+                in_dim, out_dim, m_batch_size,
+                in_offset, w_offset, out_grads_offset);
+        }
+#ifndef KERNEL_SLICER
+        // the layer's weights were last read above, its update can go right away
+        if (m_fuse_step)
+            m_optimizer.update(m_weights_biases.data(), m_weights_grads.data(),
+                w_offset, w_offset + in_dim * out_dim + out_dim);
+#endif
+        out_grads_offset = in_offset;
     }
 }
 
 
+const float *SirenNetwork::getPredictions() const
+{
+    return m_outputs.data() + m_outputs_end;
+}
+
+
 void SirenNetwork::step(float lr)
 {
+#ifndef KERNEL_SLICER
+    m_optimizer.step(m_weights_biases.data(), m_weights_grads.data(), lr);
+#else
     kernel1D_Adam_step(
         m_weights_biases.data(), m_weights_grads.data(), m_adam_m.data(), m_adam_v.data(),
         m_weights_biases.size(), lr);
+#endif
+}
+
+
+#ifndef KERNEL_SLICER
+void SirenNetwork::setOptimizer(const OptimizerConfig &config)
+{
+    m_optimizer = Optimizer(m_weights_biases.size(), config);
+}
+
+
+const Optimizer &SirenNetwork::getOptimizer() const
+{
+    return m_optimizer;
+}
+
+
+void SirenNetwork::zeroGradients()
+{
+    kernel1D_fill(m_weights_grads.data(), 0.0f, m_weights_grads.size());
+}
+
+
+void SirenNetwork::backwardAccumulate(const float *y_gt, float weight)
+{
+    m_accumulate_grads = true;
+    m_grads_weight = weight;
+    try {
+        backward(y_gt);
+    } catch (...) {
+        m_accumulate_grads = false;
+        m_grads_weight = 1.0f;
+        throw;
+    }
+    m_accumulate_grads = false;
+    m_grads_weight = 1.0f;
+}
+
+
+void SirenNetwork::scaleGradients(float scale)
+{
+    kernel1D_scale(m_weights_grads.data(), scale, m_weights_grads.size());
+}
+
+
+void SirenNetwork::backwardStep(const float *y_gt, float lr)
+{
+    m_optimizer.beginStep(lr);
+    m_fuse_step = true;
+    try {
+        backward(y_gt);
+    } catch (...) {
+        m_fuse_step = false;
+        m_optimizer.abortStep();
+        throw;
+    }
+    m_fuse_step = false;
+    m_optimizer.endStep();
 }
+#endif
 
 
 std::shared_ptr<SirenNetwork> getSirenNetwork(int n_hidden, int hidden_size, int batch_size)
@@ -6,6 +6,9 @@
 #include <memory>
 #include <random>
 
+#ifndef KERNEL_SLICER
+#include "optimizer.h"
+#endif
 
 #ifdef USE_VULKAN
 #include "vk_context.h"
@@ -26,14 +29,50 @@ public:
     SirenNetwork(int n_hidden, int hidden_size, int batch_size);
     void setWeights(const std::vector<float> &weights);
     std::vector<float> getWeights() const;
+    // max number of points a single forward call can process
+    int getMaxBatchSize() const;
 
     // for testing purposes
     std::vector<float> getWeightsGradients() const;
+    // gradients of the last backward in place, laid out as the weights; can be
+    // changed before step, e.g. averaged between processes. CPU builds only
+    float *getWeightsGradientsData();
+#ifndef KERNEL_SLICER
+    // Gradient buffer lifecycle. backward overwrites the gradients with those of its
+    // batch, backwardAccumulate adds them multiplied by weight. A large batch can be
+    // processed as micro-batches between zeroGradients and step: with weights
+    // micro_batch_size / batch_size the sum is the gradient of the whole batch's mean loss.
+    // CPU builds only
+    void zeroGradients();
+    void backwardAccumulate(const float *y_gt, float weight = 1.0f);
+    void scaleGradients(float scale);
+#endif
     std::vector<float> getOutputsGradients() const;
 
-    void forward(float *res, const float *input, int batch_size);
+    // keeps layers pre-activations for backward; input is [INPUT_DIM x batch_size]
+    // with rows input_stride floats apart (0 means batch_size), so a batch can be
+    // read straight from a larger dataset
+    void forward(float *res, const float *input, int batch_size, int input_stride = 0);
+    // same result as forward, but nothing is kept for backward
+    void inference(float *res, const float *input, int batch_size);
+    // forward plus gradient of the result w.r.t. input, grad is [INPUT_DIM x batch_size];
+    // overwrites gradients kept by backward
+    void forwardWithGradient(float *res, float *grad, const float *input, int batch_size);
     void backward(const float *y_gt);
     void step(float lr);
+    // result of the last forward, read in place from m_outputs; backward and step
+    // leave it intact, the next forward overwrites it. Host memory, CPU builds only
+    const float *getPredictions() const;
+#ifndef KERNEL_SLICER
+    // optimizer used by step, Adam by default; its state starts from scratch
+    void setOptimizer(const OptimizerConfig &config);
+    const Optimizer &getOptimizer() const;
+    // backward and step in one pass: the parameters of every layer are updated as
+    // soon as its gradients are ready and still in cache, instead of in a separate
+    // sweep over all of them. Same result as backward followed by step, but the
+    // gradients can't be changed in between. CPU builds only
+    void backwardStep(const float *y_gt, float lr);
+#endif
 
     void kernel2D_matmul(
         float *c, float *a, float *b,
@@ -48,6 +87,22 @@ public:
         uint32_t n_rows, uint32_t n_cols,
         uint32_t res_offset, uint32_t input_offset);
 
+    // fused linear layer: res = weights * inp + bias, bias follows the weights matrix
+    void kernel2D_linear(
+        float *res, float *weights, float *inp,
+        uint32_t out_dim, uint32_t in_dim, uint32_t n_cols,
+        uint32_t res_offset = 0, uint32_t w_offset = 0, uint32_t input_offset = 0);
+    // fused linear layer with activation: res as in kernel2D_linear, act = sin(30 * res);
+    // act may be res itself
+    void kernel2D_linear_sin(
+        float *res, float *act, float *weights, float *inp,
+        uint32_t out_dim, uint32_t in_dim, uint32_t n_cols,
+        uint32_t res_offset = 0, uint32_t act_offset = 0,
+        uint32_t w_offset = 0, uint32_t input_offset = 0);
+
+    void kernel1D_fill(float *res, float value, uint32_t n, uint32_t res_offset = 0);
+    void kernel1D_scale(float *res, float scale, uint32_t n, uint32_t res_offset = 0);
+
     void kernel1D_mse_grad(
         float *res, float *preds, float *gt,
         uint32_t n_samples,
@@ -60,16 +115,33 @@ public:
         float *res, float *inp, float *out_grads,
         uint32_t n_rows, uint32_t n_cols,
         uint32_t res_offset = 0, uint32_t input_offset = 0, uint32_t out_grads_offset = 0);
+    // sin_res = sin(30 * inp), dsin_res = 30 * cos(30 * inp)
+    void kernel2D_sin_cos(
+        float *sin_res, float *dsin_res, float *inp,
+        uint32_t n_rows, uint32_t n_cols,
+        uint32_t sin_offset = 0, uint32_t dsin_offset = 0, uint32_t input_offset = 0);
 
     // for backward
     void kernel2D_matmul_transposed_right(
         float *c, float *a, float *b,
         uint32_t a_rows, uint32_t b_rows, uint32_t b_cols,
         uint32_t c_offset = 0, uint32_t a_offset = 0, uint32_t b_offset = 0);
+    // same product added to c: weights gradients are accumulated like the bias ones
+    void kernel2D_matmul_transposed_right_add(
+        float *c, float *a, float *b,
+        uint32_t a_rows, uint32_t b_rows, uint32_t b_cols,
+        uint32_t c_offset = 0, uint32_t a_offset = 0, uint32_t b_offset = 0);
     void kernel2D_matmul_transposed_left(
         float *c, float *a, float *b,
         uint32_t a_rows, uint32_t b_rows, uint32_t b_cols,
         uint32_t c_offset = 0, uint32_t a_offset = 0, uint32_t b_offset = 0);
+    // kernel2D_matmul_transposed_left multiplied elementwise by scale, which is
+    // [a_rows x b_cols]: gradient through the sin activation in one pass
+    void kernel2D_matmul_transposed_left_scaled(
+        float *c, float *a, float *b, float *scale,
+        uint32_t a_rows, uint32_t b_rows, uint32_t b_cols,
+        uint32_t c_offset = 0, uint32_t a_offset = 0, uint32_t b_offset = 0,
+        uint32_t scale_offset = 0);
 
     void kernel1D_Adam_step(
         float *params, float *grads, float *adam_m, float *adam_v,
@@ -79,20 +151,40 @@ public:
     virtual void UpdateMembersPlainData() {}
     virtual void CommitDeviceData() {}
 protected:
+    // sums replicas' gradients into the first replica's m_weights_grads
+    friend class DataParallelSiren;
+
+    // m_outputs: input, pre-activation of every layer, then two activation buffers
+    // of m_act_size floats starting at m_act_offset;
+    // m_out_grads: gradients w.r.t. input and pre-activations, same offsets as m_outputs
     std::vector<float> m_weights_biases, m_weights_grads, m_outputs, m_out_grads;
     std::vector<std::pair<int,int>> m_layers_shapes;
-    int m_batch_size, m_outputs_end;
+    int m_batch_size, m_max_batch_size, m_outputs_end;
+    int m_act_offset, m_act_size;
     
     // for copying y_gt batch for loss computation
     std::vector<float> m_gt_buffer;
 
     // Adam optimizer
     // grad momentums
+    // only allocated for GPU builds, CPU builds keep them in m_optimizer
     std::vector<float> m_adam_m, m_adam_v;
 
     // betas and steps counter
     float beta1 = 0.9, beta2 = 0.99, eps = 1e-8;
     int t = 1;
+
+#ifndef KERNEL_SLICER
+    // step on CPU, kernel1D_Adam_step is what GPU builds run
+    Optimizer m_optimizer;
+    // set by backwardStep, backward then updates every layer right after its gradients
+    bool m_fuse_step = false;
+    // set by backwardAccumulate: backward adds weighted gradients instead of overwriting them
+    bool m_accumulate_grads = false;
+    float m_grads_weight = 1.0f;
+    // backward reads activations of the last forward
+    bool m_has_forward = false;
+#endif
 };
 
 
@@ -0,0 +1,26 @@
+#include "siren_fixed.h"
+
+
+template <int NHidden, int HiddenSize>
+static SirenFixedKernels make_kernels()
+{
+    using Net = SirenNetworkFixed<NHidden, HiddenSize>;
+    return SirenFixedKernels{NHidden, HiddenSize, &Net::transposeWeights, &Net::forward,
+        &Net::forwardWithGradient};
+}
+
+
+const SirenFixedKernels *find_siren_fixed(int n_hidden, int hidden_size)
+{
+    // common shapes, others go through the dynamic GEMM path
+    static const SirenFixedKernels kernels[] = {
+        make_kernels<2, 64>(),
+        make_kernels<3, 128>(),
+        make_kernels<4, 256>()
+    };
+    for (const auto &k: kernels) {
+        if (k.n_hidden == n_hidden && k.hidden_size == hidden_size)
+            return &k;
+    }
+    return nullptr;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstdint>
+
+#include "siren.h"
+#include "backend.h"
+
+
+// Inference of a SIREN whose architecture is known at compile time: every loop
+// bound and weight offset is a constant, so the per-point inner products are
+// unrolled and a layer's output stays in registers instead of going through
+// GEMM packing. Pays off for single points and small batches, where packing and
+// dynamic loop bounds dominate.
+// Kernels take the weights laid out as in SirenNetwork (every layer's matrix
+// followed by its bias) and the same buffer with every matrix transposed,
+// see transposeWeights: forward runs over rows of the transposed matrices,
+// the gradient w.r.t. input over rows of the original ones.
+template <int NHidden, int HiddenSize>
+struct SirenNetworkFixed
+{
+    static constexpr uint32_t H = HiddenSize;
+
+    // offset of a layer's matrix in the weights buffer, its bias follows it
+    static constexpr uint32_t weightsOffset(uint32_t layer)
+    {
+        return layer == 0 ? 0 : (INPUT_DIM * H + H) + (layer - 1) * (H * H + H);
+    }
+    static constexpr uint32_t N_PARAMS = weightsOffset(NHidden + 1) + H * OUTPUT_DIM + OUTPUT_DIM;
+
+    // weights_t[N_PARAMS]: matrices transposed, biases copied
+    static void transposeWeights(const float *weights, float *weights_t)
+    {
+        transpose_layer<INPUT_DIM, H>(weights, weights_t);
+        for (uint32_t i = 1; i <= NHidden; ++i)
+            transpose_layer<H, H>(weights + weightsOffset(i), weights_t + weightsOffset(i));
+        transpose_layer<H, OUTPUT_DIM>(weights + weightsOffset(NHidden + 1),
+            weights_t + weightsOffset(NHidden + 1));
+    }
+
+    // res[i] = f(input[:, i]) for i < n, input rows are stride floats apart
+    static void forward(const float *weights, const float *weights_t, float *res,
+        const float *input, uint32_t n, uint32_t stride)
+    {
+        for (uint32_t i = 0; i < n; ++i)
+            forward_point(weights, weights_t, res + i, nullptr, input + i, stride);
+    }
+
+    // forward plus gradient w.r.t. input, grad rows are stride floats apart as well
+    static void forwardWithGradient(const float *weights, const float *weights_t, float *res,
+        float *grad, const float *input, uint32_t n, uint32_t stride)
+    {
+        for (uint32_t i = 0; i < n; ++i)
+            forward_point(weights, weights_t, res + i, grad + i, input + i, stride);
+    }
+
+private:
+    template <uint32_t InDim, uint32_t OutDim>
+    static void transpose_layer(const float *w, float *w_t)
+    {
+        for (uint32_t o = 0; o < OutDim; ++o) {
+            for (uint32_t k = 0; k < InDim; ++k)
+                w_t[k * OutDim + o] = w[o * InDim + k];
+        }
+        for (uint32_t o = 0; o < OutDim; ++o)
+            w_t[OutDim * InDim + o] = w[OutDim * InDim + o];
+    }
+
+    // out = w * inp + bias, w_t is w transposed, bias follows it
+    template <uint32_t InDim, uint32_t OutDim>
+    static void linear(const float *w_t, const float *inp, float *out)
+    {
+        float acc[OutDim] = {};
+        for (uint32_t k = 0; k < InDim; ++k) {
+            const float x = inp[k];
+            const float *row = w_t + k * OutDim;
+            for (uint32_t o = 0; o < OutDim; ++o)
+                acc[o] += row[o] * x;
+        }
+        const float *bias = w_t + OutDim * InDim;
+        for (uint32_t o = 0; o < OutDim; ++o)
+            out[o] = acc[o] + bias[o];
+    }
+
+    // out = (w^T * g) * scale elementwise, w is [OutDim x InDim]
+    template <uint32_t InDim, uint32_t OutDim>
+    static void linear_transposed(const float *w, const float *g, const float *scale, float *out)
+    {
+        float acc[InDim] = {};
+        for (uint32_t o = 0; o < OutDim; ++o) {
+            const float go = g[o];
+            const float *row = w + o * InDim;
+            for (uint32_t k = 0; k < InDim; ++k)
+                acc[k] += row[k] * go;
+        }
+        for (uint32_t k = 0; k < InDim; ++k)
+            out[k] = scale ? acc[k] * scale[k] : acc[k];
+    }
+
+    // one point, the gradient is skipped if grad is null
+    static void forward_point(const float *weights, const float *weights_t, float *res, float *grad,
+        const float *input, uint32_t stride)
+    {
+        const NNBackend &backend = nn_backend();
+        float x[INPUT_DIM];
+        for (uint32_t d = 0; d < INPUT_DIM; ++d)
+            x[d] = input[d * stride];
+
+        // pre-activations of hidden layers are kept for the gradient
+        float pre[NHidden + 1][H];
+        float act[2][H];
+        linear<INPUT_DIM, H>(weights_t, x, pre[0]);
+        backend.sin_activation(act[0], pre[0], H);
+        for (uint32_t i = 1; i <= NHidden; ++i) {
+            linear<H, H>(weights_t + weightsOffset(i), act[(i - 1) % 2], pre[i]);
+            backend.sin_activation(act[i % 2], pre[i], H);
+        }
+        linear<H, OUTPUT_DIM>(weights_t + weightsOffset(NHidden + 1), act[NHidden % 2], res);
+        if (!grad)
+            return;
+
+        // from d(res) = 1 back to the input, act is reused for sin and its derivative;
+        // the output layer has a single row, so its gradient is that row times sin'
+        const float *w_last = weights + weightsOffset(NHidden + 1);
+        float g[2][H];
+        backend.sin_cos(act[0], act[1], pre[NHidden], H);
+        for (uint32_t j = 0; j < H; ++j)
+            g[0][j] = w_last[j] * act[1][j];
+        for (uint32_t i = NHidden; i > 0; --i) {
+            backend.sin_cos(act[0], act[1], pre[i - 1], H);
+            linear_transposed<H, H>(weights + weightsOffset(i), g[(NHidden - i) % 2], act[1],
+                g[(NHidden - i + 1) % 2]);
+        }
+        float input_grad[INPUT_DIM];
+        linear_transposed<INPUT_DIM, H>(weights, g[NHidden % 2], nullptr, input_grad);
+        for (uint32_t d = 0; d < INPUT_DIM; ++d)
+            grad[d * stride] = input_grad[d];
+    }
+};
+
+
+// Specialized kernels of one architecture, see SirenNetworkFixed
+struct SirenFixedKernels
+{
+    int n_hidden, hidden_size;
+    void (*transpose_weights)(const float *weights, float *weights_t);
+    void (*forward)(const float *weights, const float *weights_t, float *res,
+        const float *input, uint32_t n, uint32_t stride);
+    void (*forward_with_gradient)(const float *weights, const float *weights_t, float *res,
+        float *grad, const float *input, uint32_t n, uint32_t stride);
+};
+
+// kernels instantiated for the architecture (2x64, 3x128 and 4x256),
+// nullptr for any other one
+const SirenFixedKernels *find_siren_fixed(int n_hidden, int hidden_size);
@@ -0,0 +1,362 @@
+#include "siren_model.h"
+#include "gemm.h"
+#include "backend.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <string>
+#include <cmath>
+
+
+// up to this many points the specialized per-point kernels beat GEMM
+static const uint32_t FIXED_MAX_BATCH = 16;
+
+
+SirenModel::SirenModel(int n_hidden, int hidden_size, std::vector<float> weights,
+    uint32_t max_chunk)
+    : m_weights_biases(std::move(weights)), m_hidden_size(hidden_size),
+    m_max_chunk(std::max(max_chunk, 1u))
+{
+    m_layers_shapes.push_back(std::pair<int,int>{hidden_size, INPUT_DIM});
+    for (int i = 0; i < n_hidden; ++i) {
+        m_layers_shapes.push_back(std::pair<int,int>{hidden_size, hidden_size});
+    }
+    m_layers_shapes.push_back(std::pair<int,int>{OUTPUT_DIM, hidden_size});
+
+    size_t n_params = 0;
+    for (auto [out_dim, in_dim]: m_layers_shapes)
+        n_params += in_dim * out_dim + out_dim;
+    if (m_weights_biases.size() != n_params)
+        throw std::runtime_error("SirenModel expects " + std::to_string(n_params) + \
+            " weights, got " + std::to_string(m_weights_biases.size()));
+
+    m_fixed = find_siren_fixed(n_hidden, hidden_size);
+    if (m_fixed) {
+        m_weights_t.resize(n_params);
+        m_fixed->transpose_weights(m_weights_biases.data(), m_weights_t.data());
+    }
+}
+
+
+void SirenModel::forward(float *res, const float *input, uint32_t batch_size,
+    SirenWorkspace &workspace) const
+{
+    if (m_precision != Precision::FP32) {
+        forward_quantized(res, input, batch_size, workspace);
+        return;
+    }
+    if (m_fixed && batch_size <= FIXED_MAX_BATCH) {
+        m_fixed->forward(m_weights_biases.data(), m_weights_t.data(), res, input, batch_size, batch_size);
+        return;
+    }
+
+    const uint32_t chunk = std::min(batch_size, m_max_chunk);
+    const uint32_t act_size = chunk * m_hidden_size;
+    if (workspace.activations.size() < 2 * act_size)
+        workspace.activations.resize(2 * act_size);
+    float *act[2] = { workspace.activations.data(), workspace.activations.data() + act_size };
+
+    // input and result are read and written in place, columns [start, start + count)
+    // of a chunk are strided by batch_size
+    for (uint32_t start = 0; start < batch_size; start += chunk) {
+        uint32_t count = std::min(chunk, batch_size - start);
+
+        MatrixView layer_input{input + start, batch_size, 1};
+        const float *w = m_weights_biases.data();
+        for (size_t i = 0; i < m_layers_shapes.size(); ++i) {
+            auto [out_dim, in_dim] = m_layers_shapes[i];
+            MatrixView weights{w, uint32_t(in_dim), 1};
+
+            GemmEpilogue epilogue;
+            epilogue.bias = w + out_dim * in_dim;
+            if (i + 1 < m_layers_shapes.size()) {
+                float *out = act[i % 2];
+                epilogue.activation = out;
+                epilogue.ld_activation = count;
+                gemm(out, count, weights, layer_input, out_dim, count, in_dim, epilogue);
+                layer_input = MatrixView{out, count, 1};
+            } else {
+                gemm(res + start, batch_size, weights, layer_input, out_dim, count, in_dim, epilogue);
+            }
+            w += out_dim * in_dim + out_dim;
+        }
+    }
+}
+
+
+void SirenModel::forward(float *res, const float *input, uint32_t batch_size) const
+{
+    thread_local SirenWorkspace workspace;
+    forward(res, input, batch_size, workspace);
+}
+
+
+void SirenModel::forwardWithGradient(float *res, float *grad, const float *input,
+    uint32_t batch_size, SirenWorkspace &workspace) const
+{
+    if (m_fixed && batch_size <= FIXED_MAX_BATCH) {
+        m_fixed->forward_with_gradient(m_weights_biases.data(), m_weights_t.data(), res, grad, input,
+            batch_size, batch_size);
+        return;
+    }
+
+    const uint32_t n_hidden_layers = m_layers_shapes.size() - 1;
+    const uint32_t chunk = std::min(batch_size, m_max_chunk);
+    const uint32_t act_size = chunk * m_hidden_size;
+    if (workspace.activations.size() < 2 * act_size)
+        workspace.activations.resize(2 * act_size);
+    if (workspace.pre_activations.size() < n_hidden_layers * act_size)
+        workspace.pre_activations.resize(n_hidden_layers * act_size);
+    if (workspace.gradients.size() < 2 * act_size)
+        workspace.gradients.resize(2 * act_size);
+    float *act[2] = { workspace.activations.data(), workspace.activations.data() + act_size };
+    float *grads[2] = { workspace.gradients.data(), workspace.gradients.data() + act_size };
+    const NNBackend &backend = nn_backend();
+
+    // offset of every layer's weights, bias follows the matrix
+    std::vector<const float *> layer_weights;
+    const float *w = m_weights_biases.data();
+    for (auto [out_dim, in_dim]: m_layers_shapes) {
+        layer_weights.push_back(w);
+        w += out_dim * in_dim + out_dim;
+    }
+
+    for (uint32_t start = 0; start < batch_size; start += chunk) {
+        uint32_t count = std::min(chunk, batch_size - start);
+
+        // forward, keeping pre-activations of hidden layers
+        MatrixView layer_input{input + start, batch_size, 1};
+        for (uint32_t i = 0; i < m_layers_shapes.size(); ++i) {
+            auto [out_dim, in_dim] = m_layers_shapes[i];
+            MatrixView weights{layer_weights[i], uint32_t(in_dim), 1};
+
+            GemmEpilogue epilogue;
+            epilogue.bias = layer_weights[i] + out_dim * in_dim;
+            if (i < n_hidden_layers) {
+                float *pre = workspace.pre_activations.data() + i * act_size;
+                epilogue.activation = act[i % 2];
+                epilogue.ld_activation = count;
+                gemm(pre, count, weights, layer_input, out_dim, count, in_dim, epilogue);
+                layer_input = MatrixView{act[i % 2], count, 1};
+            } else {
+                gemm(res + start, batch_size, weights, layer_input, out_dim, count, in_dim, epilogue);
+            }
+        }
+
+        // backward from d(res) = 1; the output layer has a single row,
+        // so its gradient is the weight column times sin derivative
+        const uint32_t hidden = m_hidden_size;
+        const float *w_last = layer_weights.back();
+        float *pre = workspace.pre_activations.data() + (n_hidden_layers - 1) * act_size;
+        backend.sin_cos(act[0], act[1], pre, hidden * count);
+        float *g = grads[0];
+        for (uint32_t j = 0; j < hidden; ++j) {
+            for (uint32_t c = 0; c < count; ++c)
+                g[j * count + c] = w_last[j] * act[1][j * count + c];
+        }
+
+        // hidden layers: g = W^T g * sin'(pre) of the previous layer
+        for (uint32_t i = n_hidden_layers - 1; i > 0; --i) {
+            pre = workspace.pre_activations.data() + (i - 1) * act_size;
+            backend.sin_cos(act[0], act[1], pre, hidden * count);
+
+            GemmEpilogue epilogue;
+            epilogue.scale = act[1];
+            epilogue.ld_scale = count;
+            float *next = grads[(n_hidden_layers - i) % 2];
+            gemm(next, count, MatrixView{layer_weights[i], 1, hidden},
+                MatrixView{g, count, 1}, hidden, count, hidden, epilogue);
+            g = next;
+        }
+
+        // first layer maps the gradient back to input space
+        gemm(grad + start, batch_size, MatrixView{layer_weights[0], 1, uint32_t(INPUT_DIM)},
+            MatrixView{g, count, 1}, INPUT_DIM, count, hidden);
+    }
+}
+
+
+void SirenModel::forward_quantized(float *res, const float *input, uint32_t batch_size,
+    SirenWorkspace &workspace) const
+{
+    const NNBackend &backend = nn_backend();
+    const uint32_t hidden = m_hidden_size;
+    const uint32_t chunk = std::min(batch_size, m_max_chunk);
+    const uint32_t act_size = chunk * hidden;
+    if (workspace.activations.size() < 2 * act_size)
+        workspace.activations.resize(2 * act_size);
+    if (m_precision == Precision::INT8 && workspace.int8_activations.size() < chunk * int8_depth(hidden))
+        workspace.int8_activations.resize(chunk * int8_depth(hidden));
+    float *act[2] = { workspace.activations.data(), workspace.activations.data() + act_size };
+
+    for (uint32_t start = 0; start < batch_size; start += chunk) {
+        uint32_t count = std::min(chunk, batch_size - start);
+
+        // the first layer is fp32; its output is stored by channels as GEMM
+        // writes it, int8 layers then write theirs point by point
+        GemmEpilogue first;
+        first.bias = m_weights_biases.data() + hidden * INPUT_DIM;
+        first.activation = act[0];
+        first.ld_activation = count;
+        gemm(act[0], count, MatrixView{m_weights_biases.data(), uint32_t(INPUT_DIM), 1},
+            MatrixView{input + start, batch_size, 1}, hidden, count, INPUT_DIM, first);
+
+        const float *w = m_weights_biases.data() + hidden * INPUT_DIM + hidden;
+        size_t q_offset = 0, scale_offset = 0;
+        for (size_t i = 1; i < m_layers_shapes.size(); ++i) {
+            auto [out_dim, in_dim] = m_layers_shapes[i];
+            const bool last = i + 1 == m_layers_shapes.size();
+            const float *bias = w + out_dim * in_dim;
+            float *inp = act[(i - 1) % 2];
+            float *out = last ? res + start : act[i % 2];
+
+            if (m_precision == Precision::INT8) {
+                int8_t *x = workspace.int8_activations.data();
+                const MatrixView points = i == 1 ? MatrixView{inp, 1, count} : \
+                    MatrixView{inp, uint32_t(in_dim), 1};
+                quantize_int8_points(x, points, count, in_dim, m_input_scales[i]);
+                linear_int8(out, last ? 1 : out_dim, m_weights_int8.data() + q_offset,
+                    m_row_scales.data() + scale_offset, bias, x, m_input_scales[i], out_dim, in_dim, count);
+                q_offset += int8_packed_size(out_dim, in_dim);
+            } else {
+                // emulation: activations are rounded like the weights were,
+                // the data stays fp32
+                round_to_half(inp, in_dim * count, m_precision);
+                GemmEpilogue epilogue;
+                epilogue.bias = bias;
+                gemm(out, last ? batch_size : count, MatrixView{w, uint32_t(in_dim), 1},
+                    MatrixView{inp, count, 1}, out_dim, count, in_dim, epilogue);
+            }
+            if (!last)
+                backend.sin_activation(out, out, out_dim * count);
+
+            w += out_dim * in_dim + out_dim;
+            scale_offset += out_dim;
+        }
+    }
+}
+
+
+std::vector<float> SirenModel::activation_ranges(const float *input, uint32_t n) const
+{
+    std::vector<float> ranges(m_layers_shapes.size(), 0.0f);
+    std::vector<float> act[2];
+    for (auto &a: act)
+        a.resize(size_t(m_max_chunk) * m_hidden_size);
+
+    for (uint32_t start = 0; start < n; start += m_max_chunk) {
+        uint32_t count = std::min(m_max_chunk, n - start);
+        MatrixView layer_input{input + start, n, 1};
+        const float *w = m_weights_biases.data();
+        // the output layer's result isn't an input of anything
+        for (size_t i = 0; i + 1 < m_layers_shapes.size(); ++i) {
+            auto [out_dim, in_dim] = m_layers_shapes[i];
+            float *out = act[i % 2].data();
+            GemmEpilogue epilogue;
+            epilogue.bias = w + out_dim * in_dim;
+            epilogue.activation = out;
+            epilogue.ld_activation = count;
+            gemm(out, count, MatrixView{w, uint32_t(in_dim), 1}, layer_input, out_dim, count, in_dim,
+                epilogue);
+            for (uint32_t j = 0; j < out_dim * count; ++j)
+                ranges[i + 1] = std::max(ranges[i + 1], std::fabs(out[j]));
+            layer_input = MatrixView{out, count, 1};
+            w += out_dim * in_dim + out_dim;
+        }
+    }
+    return ranges;
+}
+
+
+void SirenModel::quantize(Precision precision, const float *calibration, uint32_t n_calibration)
+{
+    if (m_precision != Precision::FP32)
+        throw std::runtime_error("SirenModel is already quantized");
+    if (precision == Precision::FP32)
+        return;
+
+    if (precision == Precision::INT8) {
+        // the scales come from the fp32 network, before its weights are rounded
+        m_input_scales.assign(m_layers_shapes.size(), 1.0f);
+        if (calibration && n_calibration > 0) {
+            std::vector<float> ranges = activation_ranges(calibration, n_calibration);
+            for (size_t i = 1; i < ranges.size(); ++i) {
+                if (ranges[i] > 0.0f)
+                    m_input_scales[i] = ranges[i] / 127.0f;
+            }
+        } else {
+            for (size_t i = 1; i < m_input_scales.size(); ++i)
+                m_input_scales[i] = 1.0f / 127.0f;
+        }
+    }
+
+    // every matrix but the first is rounded, the fp32 copy keeps the rounded
+    // values for forwardWithGradient
+    float *w = m_weights_biases.data() + m_hidden_size * INPUT_DIM + m_hidden_size;
+    for (size_t i = 1; i < m_layers_shapes.size(); ++i) {
+        auto [out_dim, in_dim] = m_layers_shapes[i];
+        const uint32_t size = out_dim * in_dim;
+        if (precision == Precision::INT8) {
+            const size_t offset = m_weights_int8.size(), scale_offset = m_row_scales.size();
+            m_weights_int8.resize(offset + int8_packed_size(out_dim, in_dim));
+            m_row_scales.resize(scale_offset + out_dim);
+            std::vector<int8_t> q(size);
+            const float *scales = m_row_scales.data() + scale_offset;
+            quantize_rows_int8(q.data(), m_row_scales.data() + scale_offset, w, out_dim, in_dim);
+            pack_int8_weights(m_weights_int8.data() + offset, q.data(), out_dim, in_dim);
+            for (uint32_t j = 0; j < size; ++j)
+                w[j] = q[j] * scales[j / in_dim];
+        } else {
+            round_to_half(w, size, precision);
+        }
+        w += size + out_dim;
+    }
+
+    if (m_fixed)
+        m_fixed->transpose_weights(m_weights_biases.data(), m_weights_t.data());
+    m_precision = precision;
+}
+
+
+Precision SirenModel::getPrecision() const
+{
+    return m_precision;
+}
+
+
+size_t SirenModel::getWeightsBytes() const
+{
+    // fp16/bf16 only round the fp32 weights
+    if (m_precision != Precision::INT8)
+        return m_weights_biases.size() * sizeof(float);
+    // fp32 first layer and biases, plus the int8 matrices and their scales
+    size_t n_fp32 = m_hidden_size * INPUT_DIM;
+    for (auto [out_dim, in_dim]: m_layers_shapes)
+        n_fp32 += out_dim;
+    return (n_fp32 + m_row_scales.size() + m_input_scales.size()) * sizeof(float) + \
+        m_weights_int8.size() * sizeof(int8_t);
+}
+
+
+const std::vector<float> &SirenModel::getWeights() const
+{
+    return m_weights_biases;
+}
+
+
+bool SirenModel::isSpecialized() const
+{
+    return m_fixed != nullptr;
+}
+
+
+int SirenModel::getHiddenSize() const
+{
+    return m_hidden_size;
+}
+
+
+int SirenModel::getNumHidden() const
+{
+    return m_layers_shapes.size() - 2;
+}
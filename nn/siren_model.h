@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+#include "siren.h"
+#include "siren_fixed.h"
+#include "quantize.h"
+
+
+// Scratch memory of SirenModel::forward. Grows on first use and is reused
+// afterwards, one workspace must not be used by two threads at once.
+struct SirenWorkspace
+{
+    // two activation buffers, layers read from one and write to the other
+    std::vector<float> activations;
+    // for forwardWithGradient: pre-activations of hidden layers and two gradient buffers
+    std::vector<float> pre_activations, gradients;
+    // for int8 models: quantized activations
+    std::vector<int8_t> int8_activations;
+};
+
+
+// Read-only SIREN for inference. Weights are fixed at construction and all
+// scratch memory is passed in, so one model can be evaluated from many threads
+// at once and with any batch size. Architectures with compile-time kernels
+// (siren_fixed.h) evaluate small batches with them, bigger ones go through GEMM.
+// A model can be quantized to evaluate forward in reduced precision.
+class SirenModel
+{
+public:
+    // weights are laid out as in SirenNetwork: every layer's matrix followed by its bias;
+    // throws if their number doesn't match the architecture.
+    // Batches are evaluated by at most max_chunk points, which bounds the workspace size.
+    SirenModel(int n_hidden, int hidden_size, std::vector<float> weights,
+        uint32_t max_chunk = 4096);
+
+    // res[batch_size] = f(input), input is [INPUT_DIM x batch_size]
+    void forward(float *res, const float *input, uint32_t batch_size,
+        SirenWorkspace &workspace) const;
+    // same with a workspace owned by the calling thread
+    void forward(float *res, const float *input, uint32_t batch_size) const;
+
+    // forward plus gradient of the result w.r.t. input, grad is [INPUT_DIM x batch_size]
+    void forwardWithGradient(float *res, float *grad, const float *input, uint32_t batch_size,
+        SirenWorkspace &workspace) const;
+
+    // Switches forward to a reduced precision, once, before the model is shared.
+    // fp16/bf16 only emulate the accuracy: weights and activations are rounded
+    // to the format but stay fp32, so memory and speed are those of fp32.
+    // int8 keeps every layer's matrix in int8 and multiplies in int32 with per
+    // output channel weight scales and a per layer activation scale, which is
+    // max |activation| over the calibration points ([INPUT_DIM x n_calibration]),
+    // or 1, the range of sin, without them. The first layer stays fp32: it reads raw
+    // coordinates and holds a negligible share of the weights.
+    // forwardWithGradient stays fp32, over the dequantized weights.
+    void quantize(Precision precision, const float *calibration = nullptr,
+        uint32_t n_calibration = 0);
+    Precision getPrecision() const;
+    // memory the weights are read from by forward, in bytes
+    size_t getWeightsBytes() const;
+
+    // after quantize these are the dequantized weights
+    const std::vector<float> &getWeights() const;
+    // true if small batches use the compile-time specialized kernels
+    bool isSpecialized() const;
+    int getHiddenSize() const;
+    int getNumHidden() const;
+
+private:
+    void forward_quantized(float *res, const float *input, uint32_t batch_size,
+        SirenWorkspace &workspace) const;
+    // max |input| of every layer but the first one, fp32
+    std::vector<float> activation_ranges(const float *input, uint32_t n) const;
+
+    std::vector<float> m_weights_biases;
+    // [out_dim, in_dim] of every linear layer
+    std::vector<std::pair<int,int>> m_layers_shapes;
+    int m_hidden_size;
+    uint32_t m_max_chunk;
+    // null if the architecture isn't specialized
+    const SirenFixedKernels *m_fixed;
+    // weights with every matrix transposed, for m_fixed
+    std::vector<float> m_weights_t;
+
+    Precision m_precision = Precision::FP32;
+    // int8 matrices of every layer but the first one, one after another
+    std::vector<int8_t> m_weights_int8;
+    // int8: scales of the matrices' rows, one after another, and of every layer's input
+    std::vector<float> m_row_scales, m_input_scales;
+};
@@ -0,0 +1,196 @@
+#include "thread_pool.h"
+
+#include <memory>
+#include <utility>
+#include <algorithm>
+
+
+// set while the thread executes a task, nested jobs then run serially
+static thread_local bool t_in_task = false;
+
+// marks the thread as running tasks until the scope ends
+struct InTaskScope
+{
+    bool previous = t_in_task;
+    InTaskScope() { t_in_task = true; }
+    ~InTaskScope() { t_in_task = previous; }
+};
+
+
+ThreadPool::ThreadPool(int n_threads)
+{
+    for (int i = 1; i < n_threads; ++i)
+        m_workers.emplace_back([this]() { worker_loop(); });
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_job_cv.notify_all();
+    for (auto &worker: m_workers)
+        worker.join();
+}
+
+
+int ThreadPool::size() const
+{
+    return m_workers.size() + 1;
+}
+
+
+void ThreadPool::run(uint32_t n_tasks, const std::function<void(uint32_t)> &fn)
+{
+    if (n_tasks == 0)
+        return;
+
+    std::unique_lock<std::mutex> run_lock(m_run_mutex, std::defer_lock);
+    if (m_workers.empty() || n_tasks == 1 || t_in_task || !run_lock.try_lock()) {
+        InTaskScope scope;
+        for (uint32_t i = 0; i < n_tasks; ++i)
+            fn(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_fn = &fn;
+        m_n_tasks = n_tasks;
+        m_next_task = 0;
+        m_pending_workers = m_workers.size();
+        ++m_generation;
+    }
+    m_job_cv.notify_all();
+
+    process_tasks();
+
+    // workers keep a pointer to fn until they check out
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done_cv.wait(lock, [this]() { return m_pending_workers == 0; });
+    m_fn = nullptr;
+    if (m_error)
+        std::rethrow_exception(std::exchange(m_error, nullptr));
+}
+
+
+void ThreadPool::process_tasks()
+{
+    InTaskScope scope;
+    for (;;) {
+        uint32_t task = m_next_task.fetch_add(1);
+        if (task >= m_n_tasks)
+            break;
+        try {
+            (*m_fn)(task);
+        } catch (...) {
+            // the rest of the job is skipped, run rethrows the first error
+            m_next_task = m_n_tasks;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_error)
+                m_error = std::current_exception();
+        }
+    }
+}
+
+
+void ThreadPool::worker_loop()
+{
+    uint64_t seen_generation = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_job_cv.wait(lock, [&]() { return m_stop || m_generation != seen_generation; });
+            if (m_stop)
+                return;
+            seen_generation = m_generation;
+        }
+
+        process_tasks();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_pending_workers == 0)
+            m_done_cv.notify_one();
+    }
+}
+
+
+static int &requested_nn_threads()
+{
+    static int n_threads = 0;
+    return n_threads;
+}
+
+
+static std::unique_ptr<ThreadPool> &active_pool()
+{
+    static std::unique_ptr<ThreadPool> pool;
+    return pool;
+}
+
+
+int nn_threads()
+{
+    int n_threads = requested_nn_threads();
+    if (n_threads <= 0)
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    return n_threads;
+}
+
+
+void set_nn_threads(int n_threads)
+{
+    requested_nn_threads() = n_threads;
+    active_pool() = nullptr;
+}
+
+
+ScopedNNThreads::ScopedNNThreads(int n_threads)
+    : m_previous(requested_nn_threads())
+{
+    set_nn_threads(n_threads);
+}
+
+
+ScopedNNThreads::~ScopedNNThreads()
+{
+    set_nn_threads(m_previous);
+}
+
+
+ThreadPool &nn_thread_pool()
+{
+    static std::mutex create_mutex;
+    std::lock_guard<std::mutex> lock(create_mutex);
+    auto &pool = active_pool();
+    if (!pool)
+        pool = std::make_unique<ThreadPool>(nn_threads());
+    return *pool;
+}
+
+
+void parallel_for(uint32_t n, uint32_t min_size, uint32_t align,
+    const std::function<void(uint32_t, uint32_t)> &fn)
+{
+    if (n == 0)
+        return;
+
+    ThreadPool &pool = nn_thread_pool();
+    uint32_t n_threads = pool.size();
+    uint32_t chunk = std::max(min_size, (n + n_threads - 1) / n_threads);
+    align = std::max(align, 1u);
+    chunk = (chunk + align - 1) / align * align;
+
+    uint32_t n_chunks = (n + chunk - 1) / chunk;
+    if (n_chunks <= 1) {
+        fn(0, n);
+        return;
+    }
+
+    pool.run(n_chunks, [&](uint32_t i) {
+        uint32_t begin = i * chunk;
+        fn(begin, std::min(n, begin + chunk));
+    });
+}
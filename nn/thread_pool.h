@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <exception>
+
+
+// Persistent pool of worker threads. The calling thread takes part in every job,
+// so a pool of size 1 has no workers and runs everything inline.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int n_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // number of threads a job is spread over, including the caller
+    int size() const;
+
+    // Calls fn(task) for every task in [0, n_tasks) and returns when all are done.
+    // Tasks are handed out dynamically, so they must write to disjoint memory.
+    // Calls made from inside a task, or while another thread's job is running,
+    // are executed serially on the calling thread.
+    // If a task throws, tasks that haven't started are skipped and the first
+    // exception is rethrown once the job is over.
+    void run(uint32_t n_tasks, const std::function<void(uint32_t)> &fn);
+
+private:
+    void worker_loop();
+    void process_tasks();
+
+    std::vector<std::thread> m_workers;
+
+    // serializes jobs, a busy pool makes run fall back to serial execution
+    std::mutex m_run_mutex;
+
+    std::mutex m_mutex;
+    std::condition_variable m_job_cv, m_done_cv;
+    const std::function<void(uint32_t)> *m_fn = nullptr;
+    uint32_t m_n_tasks = 0;
+    std::atomic<uint32_t> m_next_task{0};
+    // incremented for every job, workers use it to notice a new one
+    uint64_t m_generation = 0;
+    // workers that haven't finished the current job yet
+    int m_pending_workers = 0;
+    // first exception thrown by a task of the current job
+    std::exception_ptr m_error;
+    bool m_stop = false;
+};
+
+
+// Pool used by the NN kernels, created on first use with nn_threads() threads
+ThreadPool &nn_thread_pool();
+
+// Number of threads for the NN kernels, 0 means all hardware threads.
+// Must not be called while kernels are running.
+void set_nn_threads(int n_threads);
+int nn_threads();
+
+// Sets the number of NN threads for its scope and restores the previous setting
+// when it ends, also if an exception leaves the scope
+class ScopedNNThreads
+{
+public:
+    explicit ScopedNNThreads(int n_threads);
+    ~ScopedNNThreads();
+
+    ScopedNNThreads(const ScopedNNThreads &) = delete;
+    ScopedNNThreads &operator=(const ScopedNNThreads &) = delete;
+
+private:
+    int m_previous;
+};
+
+// Splits [0, n) into at most nn_threads() ranges and calls fn(begin, end) for each
+// of them in parallel. Every range but the last is a multiple of align and holds
+// at least min_size items, so small inputs stay on the calling thread.
+void parallel_for(uint32_t n, uint32_t min_size, uint32_t align,
+    const std::function<void(uint32_t, uint32_t)> &fn);
@@ -0,0 +1,130 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <random>
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+#include "backend.h"
+#include "gemm.h"
+#include "quantize.h"
+#include "utils.h"
+
+
+static std::vector<float> random_vector(int n, std::mt19937 &gen, float lo = -1.0f, float hi = 1.0f)
+{
+    std::uniform_real_distribution<float> dis(lo, hi);
+    std::vector<float> v(n);
+    for (auto &x: v)
+        x = dis(gen);
+    return v;
+}
+
+
+TEST_CASE( "every available backend matches the scalar one", "[backend]" )
+{
+    std::mt19937 gen(3);
+    const NNBackend &ref = scalar_backend();
+
+    // odd sizes exercise the vector tails
+    const uint32_t n_rows = 13, n_cols = 517, n = n_rows * n_cols;
+    auto x = random_vector(n, gen);
+    auto y = random_vector(n, gen);
+    auto bias = random_vector(n_rows, gen);
+
+    for (const auto &name: available_nn_backends()) {
+        set_nn_backend(name);
+        const NNBackend &be = nn_backend();
+        std::cout << "[Backend] Checking " << be.name << std::endl;
+
+        std::vector<float> res(n), res_gt(n);
+        be.add_bias(res.data(), x.data(), bias.data(), n_rows, n_cols);
+        ref.add_bias(res_gt.data(), x.data(), bias.data(), n_rows, n_cols);
+        REQUIRE( res == res_gt );
+
+        be.sin_activation(res.data(), x.data(), n);
+        ref.sin_activation(res_gt.data(), x.data(), n);
+        REQUIRE( mse_loss(res, res_gt) < 1e-12f );
+
+        be.sin_grad(res.data(), x.data(), y.data(), n);
+        ref.sin_grad(res_gt.data(), x.data(), y.data(), n);
+        REQUIRE( mse_loss(res, res_gt) < 1e-9f );
+
+        std::vector<float> row_sums(n_rows), row_sums_gt(n_rows);
+        be.bias_grad(row_sums.data(), x.data(), n_rows, n_cols);
+        ref.bias_grad(row_sums_gt.data(), x.data(), n_rows, n_cols);
+        REQUIRE( mse_loss(row_sums, row_sums_gt) < 1e-9f );
+
+        be.mse_grad(res.data(), x.data(), y.data(), n);
+        ref.mse_grad(res_gt.data(), x.data(), y.data(), n);
+        REQUIRE( mse_loss(res, res_gt) < 1e-12f );
+
+        auto params = random_vector(n, gen), params_gt = params;
+        std::vector<float> m(n), v(n), m_gt(n), v_gt(n);
+        for (int step = 1; step <= 3; ++step) {
+            float m_scale = 1.0f / (1.0f - std::pow(0.9f, step));
+            float v_scale = 1.0f / (1.0f - std::pow(0.99f, step));
+            be.adam_step(params.data(), y.data(), m.data(), v.data(), n,
+                1e-3f, 0.9f, 0.99f, 1e-8f, m_scale, v_scale, 1e-2f);
+            ref.adam_step(params_gt.data(), y.data(), m_gt.data(), v_gt.data(), n,
+                1e-3f, 0.9f, 0.99f, 1e-8f, m_scale, v_scale, 1e-2f);
+        }
+        REQUIRE( mse_loss(params, params_gt) < 1e-12f );
+
+        std::fill(m.begin(), m.end(), 0.0f);
+        std::fill(m_gt.begin(), m_gt.end(), 0.0f);
+        for (int step = 0; step < 3; ++step) {
+            be.sgd_step(params.data(), y.data(), m.data(), n, 1e-3f, 0.9f, 1e-2f);
+            ref.sgd_step(params_gt.data(), y.data(), m_gt.data(), n, 1e-3f, 0.9f, 1e-2f);
+        }
+        REQUIRE( mse_loss(params, params_gt) < 1e-12f );
+        REQUIRE( mse_loss(m, m_gt) < 1e-12f );
+
+        std::fill(m.begin(), m.end(), 0.0f);
+        std::fill(m_gt.begin(), m_gt.end(), 0.0f);
+        for (int step = 0; step < 3; ++step) {
+            be.lion_step(params.data(), y.data(), m.data(), n, 1e-3f, 0.9f, 0.99f, 1e-2f);
+            ref.lion_step(params_gt.data(), y.data(), m_gt.data(), n, 1e-3f, 0.9f, 0.99f, 1e-2f);
+        }
+        REQUIRE( mse_loss(params, params_gt) < 1e-12f );
+        REQUIRE( mse_loss(m, m_gt) < 1e-12f );
+
+        const uint32_t gm = 37, gn = 75, gk = 300;
+        auto a = random_vector(gm * gk, gen);
+        auto b = random_vector(gk * gn, gen);
+        std::vector<float> c(gm * gn), c_gt(gm * gn);
+        gemm_blocked(c.data(), gn, MatrixView{a.data(), gk, 1}, MatrixView{b.data(), gn, 1}, gm, gn, gk);
+        gemm_reference(c_gt.data(), gn, MatrixView{a.data(), gk, 1}, MatrixView{b.data(), gn, 1}, gm, gn, gk);
+        REQUIRE( mse_loss(c, c_gt) < 1e-9f );
+
+        // int8 values span the whole [-127, 127], the last block of rows is partial
+        const uint32_t qo = 37, qk = 152, qn = 9, ldq = qo + 2;
+        std::uniform_int_distribution<int> int8_dis(-127, 127);
+        std::vector<int8_t> wq(qo * qk), xq(qn * qk), wq_packed(int8_packed_size(qo, qk));
+        for (auto &value: wq)
+            value = int8_dis(gen);
+        for (auto &value: xq)
+            value = int8_dis(gen);
+        wq[0] = xq[0] = -127;
+        wq[1] = xq[1] = 127;
+        pack_int8_weights(wq_packed.data(), wq.data(), qo, qk);
+        auto w_scales = random_vector(qo, gen, 0.0f, 1.0f);
+        auto q_bias = random_vector(qo, gen);
+        std::vector<float> q_res(qn * ldq), q_res_gt(qn * ldq);
+        be.linear_int8(q_res.data(), ldq, wq_packed.data(), w_scales.data(), q_bias.data(), xq.data(),
+            1e-2f, qo, qk, qn);
+        ref.linear_int8(q_res_gt.data(), ldq, wq_packed.data(), w_scales.data(), q_bias.data(), xq.data(),
+            1e-2f, qo, qk, qn);
+        // int32 sums are exact, only the final scaling may round differently (FMA)
+        for (size_t i = 0; i < q_res.size(); ++i)
+            REQUIRE( std::fabs(q_res[i] - q_res_gt[i]) <= 1e-6f * std::max(1.0f, std::fabs(q_res_gt[i])) );
+    }
+
+    set_nn_backend("auto");
+}
+
+
+TEST_CASE( "unknown backend is rejected", "[backend]" )
+{
+    REQUIRE_THROWS( set_nn_backend("no_such_isa") );
+}
@@ -0,0 +1,96 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include "data_parallel.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+
+TEST_CASE( "single replica trains exactly like SirenNetwork", "[data_parallel]" )
+{
+    const auto [points, sdfs] = load_points("data/points/sdf1_test.bin");
+    const uint32_t n = sdfs.size(), batch_size = 512;
+    const auto init = load_floats("data/weights/sdf1_gt_weights.bin");
+
+    SirenNetwork net(2, 64, batch_size);
+    DataParallelSiren replicas(2, 64, batch_size, 1);
+    net.setWeights(init);
+    replicas.setWeights(init);
+
+    std::vector<float> input = transpose(points, n, 3), preds(batch_size), dp_preds(batch_size);
+    for (uint32_t start = 0; start + batch_size <= n; start += batch_size) {
+        net.forward(preds.data(), input.data() + start, batch_size, n);
+        replicas.forward(dp_preds.data(), input.data() + start, batch_size, n);
+        REQUIRE( preds == dp_preds );
+        net.backward(sdfs.data() + start);
+        replicas.backward(sdfs.data() + start);
+        net.step(1e-4f);
+        replicas.step(1e-4f);
+    }
+    REQUIRE( replicas.getWeights() == net.getWeights() );
+}
+
+
+TEST_CASE( "replicas match one network on the whole batch", "[data_parallel]" )
+{
+    const auto [points, sdfs] = load_points("data/points/sdf1_test.bin");
+    const uint32_t n = sdfs.size(), batch_size = 500;
+    const auto init = load_floats("data/weights/sdf1_gt_weights.bin");
+
+    // shards of 167, 167 and 166 points, so the gradients need weighting by shard size
+    const ScopedNNThreads threads(3);
+    SirenNetwork net(2, 64, batch_size);
+    DataParallelSiren replicas(2, 64, batch_size, 3);
+    REQUIRE( replicas.getNumReplicas() == 3 );
+    net.setWeights(init);
+    replicas.setWeights(init);
+
+    std::vector<float> input = transpose(points, n, 3), preds(batch_size), dp_preds(batch_size);
+    for (uint32_t start = 0; start + batch_size <= n; start += batch_size) {
+        net.forward(preds.data(), input.data() + start, batch_size, n);
+        replicas.forward(dp_preds.data(), input.data() + start, batch_size, n);
+        float max_err = 0.0f;
+        for (uint32_t i = 0; i < batch_size; ++i) {
+            max_err = std::max(max_err, std::fabs(dp_preds[i] - preds[i]));
+            REQUIRE( replicas.getPredictions()[i] == dp_preds[i] );
+        }
+        REQUIRE( max_err < 1e-5f );
+
+        net.backward(sdfs.data() + start);
+        replicas.backward(sdfs.data() + start);
+        const auto grads = net.getWeightsGradients(), dp_grads = replicas.getWeightsGradients();
+        max_err = 0.0f;
+        for (size_t i = 0; i < grads.size(); ++i)
+            max_err = std::max(max_err, std::fabs(dp_grads[i] - grads[i]) / (1.0f + std::fabs(grads[i])));
+        REQUIRE( max_err < 1e-4f );
+
+        net.step(1e-4f);
+        replicas.step(1e-4f);
+    }
+
+    const auto weights = net.getWeights(), dp_weights = replicas.getWeights();
+    float max_err = 0.0f;
+    for (size_t i = 0; i < weights.size(); ++i)
+        max_err = std::max(max_err, std::fabs(dp_weights[i] - weights[i]));
+    REQUIRE( max_err < 1e-4f );
+}
+
+
+TEST_CASE( "replicas handle batches smaller than their number", "[data_parallel]" )
+{
+    const auto [points, sdfs] = load_points("data/points/sdf1_test.bin");
+    const uint32_t n = sdfs.size();
+
+    DataParallelSiren replicas(2, 64, 64, 4);
+    replicas.setWeights(load_floats("data/weights/sdf1_gt_weights.bin"));
+    std::vector<float> input = transpose(points, n, 3), preds(64);
+
+    // only the first replicas get points, the rest must not take part in the reduction
+    replicas.forward(preds.data(), input.data(), 2, n);
+    replicas.backward(sdfs.data());
+    replicas.step(1e-4f);
+    REQUIRE_THROWS_AS( replicas.forward(preds.data(), input.data(), 65, n), std::runtime_error );
+}
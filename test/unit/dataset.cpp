@@ -0,0 +1,85 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <array>
+
+#include "dataset.h"
+#include "siren.h"
+#include "utils.h"
+
+
+TEST_CASE( "dataset batches are strided views in network layout", "[dataset]" )
+{
+    const auto [points, sdfs] = load_points("data/points/sdf1_test.bin");
+    PointDataset dataset(points, sdfs);
+    const uint32_t n = sdfs.size(), batch_size = 7;
+
+    REQUIRE( dataset.size() == n );
+    REQUIRE( dataset.numBatches(batch_size) == (n + batch_size - 1) / batch_size );
+
+    uint32_t total = 0;
+    for (uint32_t b = 0; b < dataset.numBatches(batch_size); ++b) {
+        PointBatch batch = dataset.batch(b, batch_size);
+        REQUIRE( batch.stride == n );
+        for (uint32_t i = 0; i < batch.size; ++i) {
+            uint32_t sample = b * batch_size + i;
+            for (int dim = 0; dim < 3; ++dim)
+                REQUIRE( batch.points[dim * batch.stride + i] == points[sample * 3 + dim] );
+            REQUIRE( batch.sdf[i] == sdfs[sample] );
+        }
+        total += batch.size;
+    }
+    REQUIRE( total == n );
+}
+
+
+TEST_CASE( "dataset shuffle keeps samples together", "[dataset]" )
+{
+    const auto [points, sdfs] = load_points("data/points/sdf1_test.bin");
+    PointDataset dataset(points, sdfs);
+    const uint32_t n = dataset.size();
+
+    std::mt19937 gen(5);
+    dataset.shuffle(gen);
+
+    // every (point, sdf) sample is still present exactly once
+    using Sample = std::array<float, 4>;
+    std::vector<Sample> before, after;
+    PointBatch all = dataset.batch(0, n);
+    for (uint32_t i = 0; i < n; ++i) {
+        before.push_back({points[3 * i], points[3 * i + 1], points[3 * i + 2], sdfs[i]});
+        after.push_back({all.points[i], all.points[n + i], all.points[2 * n + i], all.sdf[i]});
+    }
+    REQUIRE( before != after );
+    std::sort(before.begin(), before.end());
+    std::sort(after.begin(), after.end());
+    REQUIRE( before == after );
+}
+
+
+TEST_CASE( "network reads strided batches and gathered ones alike", "[dataset]" )
+{
+    const std::vector<float> weights = load_floats("data/weights/sdf1_gt_weights.bin");
+    const auto [points, sdfs] = load_points("data/points/sdf1_test.bin");
+    PointDataset dataset(points, sdfs);
+
+    const uint32_t batch_size = 16;
+    auto net = getSirenNetwork(2, 64, batch_size);
+    net->setWeights(weights);
+    net->CommitDeviceData();
+    net->UpdateMembersPlainData();
+
+    PointBatch batch = dataset.batch(1, batch_size);
+    std::vector<float> strided(batch_size), gathered(batch_size);
+    net->forward(strided.data(), batch.points, batch.size, batch.stride);
+
+    std::vector<uint32_t> idxs(batch_size);
+    for (uint32_t i = 0; i < batch_size; ++i)
+        idxs[i] = batch_size + i;
+    BatchWorkspace workspace;
+    dataset.gather(idxs.data(), batch_size, workspace);
+    net->forward(gathered.data(), workspace.points.data(), workspace.size);
+
+    REQUIRE( strided == gathered );
+    REQUIRE( std::equal(batch.sdf, batch.sdf + batch_size, workspace.sdf.begin()) );
+}
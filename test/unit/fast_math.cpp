@@ -0,0 +1,83 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <random>
+#include <iostream>
+
+#include "siren.h"
+#include "backend.h"
+#include "fast_math.h"
+#include "utils.h"
+
+
+// distance from got to ref in units of the last place of ref rounded to float
+static double ulp_error(float got, double ref)
+{
+    float ref_f = std::fabs(float(ref));
+    float ulp = std::nextafter(ref_f, INFINITY) - ref_f;
+    return std::fabs(got - ref) / ulp;
+}
+
+
+TEST_CASE( "fast sincos accuracy against libm", "[fast_math]" )
+{
+    std::mt19937 gen(11);
+
+    for (double range: {3.0, 30.0}) {
+        std::uniform_real_distribution<float> dis(-range, range);
+        double max_abs = 0.0, max_ulp = 0.0;
+        for (int i = 0; i < 1000000; ++i) {
+            float x = dis(gen), s, c;
+            fast_sincos_w0(x, &s, &c);
+            double s_gt = std::sin(30.0 * x), c_gt = std::cos(30.0 * x);
+
+            max_abs = std::max(max_abs, std::max(std::fabs(s - s_gt), std::fabs(c - c_gt)));
+            if (std::fabs(s_gt) >= 1.0 / 16)
+                max_ulp = std::max(max_ulp, ulp_error(s, s_gt));
+            if (std::fabs(c_gt) >= 1.0 / 16)
+                max_ulp = std::max(max_ulp, ulp_error(c, c_gt));
+        }
+        std::cout << "[Fast sincos] |x| <= " << range << ": max abs error = " << max_abs << \
+            ", max ulp error = " << max_ulp << std::endl;
+
+        REQUIRE( max_abs < 1e-7 );
+        REQUIRE( max_ulp <= 2.0 );
+    }
+}
+
+
+TEST_CASE( "backend sin kernels on test_unit activations", "[fast_math]" )
+{
+    // first layer pre-activations of the network from the backward tests
+    const auto weights = load_floats("data/test_unit/weights.bin");
+    auto [points, sdf] = load_points("data/test_unit/points.bin");
+    const int batch_size = sdf.size(), hidden_size = 10;
+    points = transpose(points, batch_size, INPUT_DIM);
+
+    auto net = getSirenNetwork(2, hidden_size, batch_size);
+    std::vector<float> z(hidden_size * batch_size);
+    net->kernel2D_matmul(z.data(), const_cast<float*>(weights.data()), points.data(),
+        hidden_size, INPUT_DIM, batch_size);
+    net->kernel2D_add_bias(z.data(), z.data(), const_cast<float*>(weights.data()),
+        hidden_size, batch_size, 0, 0, hidden_size * INPUT_DIM);
+
+    const uint32_t n = z.size();
+    for (const auto &name: available_nn_backends()) {
+        set_nn_backend(name);
+        std::vector<float> s(n), ds(n), s_only(n);
+        nn_backend().sin_cos(s.data(), ds.data(), z.data(), n);
+        nn_backend().sin_activation(s_only.data(), z.data(), n);
+
+        double max_abs = 0.0;
+        for (uint32_t i = 0; i < n; ++i) {
+            double x = 30.0 * double(z[i]);
+            max_abs = std::max(max_abs, std::fabs(s[i] - std::sin(x)));
+            max_abs = std::max(max_abs, std::fabs(ds[i] / 30.0 - std::cos(x)));
+        }
+        std::cout << "[Fast sincos] " << name << " max abs error on fixtures = " << \
+            max_abs << std::endl;
+
+        REQUIRE( s == s_only );
+        REQUIRE( max_abs < 1e-7 );
+    }
+    set_nn_backend("auto");
+}
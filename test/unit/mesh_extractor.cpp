@@ -0,0 +1,159 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "mesh_extractor.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+
+// keeps the whole mesh in memory
+struct MemoryMeshWriter : public MeshWriter
+{
+    std::vector<float> vertices;
+    std::vector<uint32_t> triangles;
+
+    void addVertices(const float *xyz, uint32_t n) override
+    {
+        vertices.insert(vertices.end(), xyz, xyz + 3 * n);
+    }
+
+    void addTriangles(const uint32_t *indices, uint32_t n) override
+    {
+        // only vertices that already arrived are referenced
+        for (uint32_t i = 0; i < 3 * n; ++i)
+            REQUIRE( indices[i] < vertices.size() / 3 );
+        triangles.insert(triangles.end(), indices, indices + 3 * n);
+    }
+
+    void finish() override {}
+};
+
+
+TEST_CASE( "adaptive mesh equals dense mesh and lies on the surface", "[mesh]" )
+{
+    const std::vector<float> weights = load_floats("data/weights/sdf1_gt_weights.bin");
+    const SirenModel model(2, 64, weights);
+
+    MeshExtractionCfg cfg;
+    cfg.resolution = 50;
+    cfg.adaptive = false;
+    MemoryMeshWriter dense;
+    const MeshStats dense_stats = extract_mesh(model, cfg, dense);
+    REQUIRE( dense_stats.n_evaluated == dense_stats.n_grid_points );
+
+    // block size doesn't divide the resolution, batches are split over threads
+    cfg.adaptive = true;
+    cfg.block_size = 8;
+    cfg.batch_size = 1000;
+    MemoryMeshWriter adaptive;
+    MeshStats stats;
+    {
+        const ScopedNNThreads threads(3);
+        stats = extract_mesh(model, cfg, adaptive);
+    }
+
+    REQUIRE( stats.n_evaluated < dense_stats.n_evaluated );
+    REQUIRE( stats.n_active_blocks < stats.n_blocks );
+    REQUIRE( stats.n_vertices == adaptive.vertices.size() / 3 );
+    REQUIRE( stats.n_triangles == adaptive.triangles.size() / 3 );
+    REQUIRE( adaptive.vertices == dense.vertices );
+    REQUIRE( adaptive.triangles == dense.triangles );
+    REQUIRE( stats.n_triangles > 1000 );
+
+    // vertices are within a cell of the zero level set
+    const uint32_t n = stats.n_vertices;
+    const std::vector<float> points = transpose(adaptive.vertices, n, 3);
+    std::vector<float> sdf(n);
+    model.forward(sdf.data(), points.data(), n);
+    for (float d: sdf)
+        REQUIRE( std::fabs(d) < 2.0f / cfg.resolution );
+
+    // triangles face outwards, so the enclosed volume is positive
+    double volume = 0.0;
+    for (uint32_t t = 0; t < stats.n_triangles; ++t) {
+        const float *a = &adaptive.vertices[3 * adaptive.triangles[3 * t]];
+        const float *b = &adaptive.vertices[3 * adaptive.triangles[3 * t + 1]];
+        const float *c = &adaptive.vertices[3 * adaptive.triangles[3 * t + 2]];
+        volume += (a[0] * (b[1] * c[2] - b[2] * c[1]) - a[1] * (b[0] * c[2] - b[2] * c[0]) + \
+            a[2] * (b[0] * c[1] - b[1] * c[0])) / 6.0;
+    }
+    REQUIRE( volume > 0.0 );
+}
+
+
+TEST_CASE( "bounded adaptive mesh skips only blocks with a proven sign", "[mesh]" )
+{
+    const std::vector<float> weights = load_floats("data/weights/sdf1_gt_weights.bin");
+    const SirenModel model(2, 64, weights);
+
+    // bounds get tight for boxes of 1/32 of the cube
+    MeshExtractionCfg cfg;
+    cfg.resolution = 96;
+    cfg.adaptive = false;
+    MemoryMeshWriter dense;
+    extract_mesh(model, cfg, dense);
+
+    cfg.adaptive = true;
+    cfg.block_size = 3;
+    MemoryMeshWriter estimated;
+    const MeshStats estimated_stats = extract_mesh(model, cfg, estimated);
+    cfg.bounded = true;
+    MemoryMeshWriter bounded;
+    const MeshStats stats = extract_mesh(model, cfg, bounded);
+
+    REQUIRE( stats.n_active_blocks >= estimated_stats.n_active_blocks );
+    REQUIRE( stats.n_active_blocks < stats.n_blocks );
+    REQUIRE( bounded.vertices == dense.vertices );
+    REQUIRE( bounded.triangles == dense.triangles );
+}
+
+
+TEST_CASE( "mesh writers produce PLY and OBJ", "[mesh]" )
+{
+    const float vertices[] = {0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1};
+    const uint32_t triangles[] = {0, 2, 1, 0, 1, 3, 0, 3, 2, 1, 2, 3};
+
+    const std::string ply_path = "mesh_test.ply", obj_path = "mesh_test.obj";
+    for (const std::string &path: {ply_path, obj_path}) {
+        auto writer = make_mesh_writer(path);
+        writer->addVertices(vertices, 2);
+        writer->addTriangles(triangles, 1);
+        writer->addVertices(vertices + 6, 2);
+        writer->addTriangles(triangles + 3, 3);
+        writer->finish();
+    }
+
+    {
+        std::ifstream ply(ply_path, std::ios::binary);
+        std::stringstream content;
+        content << ply.rdbuf();
+        const std::string data = content.str();
+        const std::string header_end = "end_header\n";
+        const size_t body = data.find(header_end) + header_end.size();
+        REQUIRE( data.find("element vertex 4\n") != std::string::npos );
+        REQUIRE( data.find("element face 4\n") != std::string::npos );
+        REQUIRE( data.size() - body == 4 * 3 * sizeof(float) + 4 * (1 + 3 * sizeof(int32_t)) );
+        std::ifstream spool(ply_path + ".vertices");
+        REQUIRE_FALSE( spool.good() );
+    }
+    {
+        std::ifstream obj(obj_path);
+        std::string line;
+        int n_vertices = 0, n_faces = 0;
+        while (std::getline(obj, line)) {
+            n_vertices += line[0] == 'v';
+            n_faces += line[0] == 'f';
+        }
+        REQUIRE( n_vertices == 4 );
+        REQUIRE( n_faces == 4 );
+    }
+    std::remove(ply_path.c_str());
+    std::remove(obj_path.c_str());
+
+    REQUIRE_THROWS_AS( make_mesh_writer("mesh.stl"), std::runtime_error );
+}
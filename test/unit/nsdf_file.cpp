@@ -0,0 +1,100 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+#include "nsdf_file.h"
+#include "siren.h"
+#include "utils.h"
+
+
+TEST_CASE( "samples survive NSDF round trip", "[nsdf]" )
+{
+    const auto [points, sdfs] = load_points("data/points/sdf1_test.bin");
+    const uint32_t n = sdfs.size();
+    const std::string path = "nsdf_test_samples.nsdf";
+
+    std::vector<float> points_soa = transpose(points, n, 3);
+    save_nsdf_samples(path, points_soa.data(), sdfs.data(), n);
+    REQUIRE( is_nsdf_file(path) );
+    REQUIRE_FALSE( is_nsdf_file("data/points/sdf1_test.bin") );
+
+    {
+        NsdfFile file(path, NsdfKind::Samples);
+        const NsdfHeader &h = file.header();
+        REQUIRE( h.count == n );
+        REQUIRE( h.payload_offset % NSDF_ALIGNMENT == 0 );
+        REQUIRE( reinterpret_cast<uintptr_t>(file.points()) % NSDF_ALIGNMENT == 0 );
+        REQUIRE( std::vector<float>(file.points(), file.points() + 3 * n) == points_soa );
+        REQUIRE( std::vector<float>(file.sdfs(), file.sdfs() + n) == sdfs );
+
+        REQUIRE_THROWS_AS( NsdfFile(path, NsdfKind::Weights), std::runtime_error );
+    }
+
+    // load_points reads both formats the same way
+    const auto [nsdf_points, nsdf_sdfs] = load_points(path);
+    REQUIRE( nsdf_points == points );
+    REQUIRE( nsdf_sdfs == sdfs );
+
+    std::remove(path.c_str());
+}
+
+
+TEST_CASE( "header sizes that overflow are rejected", "[nsdf]" )
+{
+    const std::string path = "nsdf_test_header.nsdf";
+    const std::vector<float> points = {0.1f, 0.2f, 0.3f}, sdfs = {0.5f};
+    save_nsdf_samples(path, points.data(), sdfs.data(), 1);
+    const NsdfHeader valid = NsdfFile(path, NsdfKind::Samples).header();
+    const uint64_t file_size = valid.payload_offset + valid.payload_size;
+    REQUIRE_NOTHROW( check_nsdf_header(valid, NsdfKind::Samples, file_size, path) );
+
+    // 16 * count wraps around to the stored payload size
+    NsdfHeader h = valid;
+    h.count = (uint64_t(1) << 60) + 1;
+    REQUIRE_THROWS_AS( check_nsdf_header(h, NsdfKind::Samples, file_size, path), std::runtime_error );
+
+    // payload_offset + payload_size wraps around to a small number
+    h = valid;
+    h.payload_size = -uint64_t(NSDF_ALIGNMENT);
+    h.count = h.payload_size / 16;
+    h.payload_offset = 2 * NSDF_ALIGNMENT;
+    REQUIRE_THROWS_AS( check_nsdf_header(h, NsdfKind::Samples, file_size, path), std::runtime_error );
+
+    std::remove(path.c_str());
+}
+
+
+TEST_CASE( "weights are checked against the architecture", "[nsdf]" )
+{
+    const std::string bin_path = "data/weights/sdf1_gt_weights.bin";
+    const std::string path = "nsdf_test_weights.nsdf";
+
+    const auto weights = load_weights(bin_path, 2, 64);
+    REQUIRE( weights == load_floats(bin_path) );
+    REQUIRE( weights.size() == siren_n_params(2, 64) );
+    REQUIRE_THROWS_AS( load_weights(bin_path, 3, 64), std::runtime_error );
+
+    save_nsdf_weights(path, weights, 2, 64);
+    REQUIRE( load_weights(path, 2, 64) == weights );
+    REQUIRE_THROWS_AS( load_weights(path, 1, 64), std::runtime_error );
+    REQUIRE_THROWS_AS( load_weights(path, 2, 32), std::runtime_error );
+
+    // the header matches the architecture but the weights don't
+    save_nsdf_weights(path, std::vector<float>(weights.begin(), weights.end() - 1), 2, 64);
+    REQUIRE_THROWS_AS( load_weights(path, 2, 64), std::runtime_error );
+    save_nsdf_weights(path, weights, 2, 64);
+
+    // flip one payload byte
+    {
+        std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(NSDF_ALIGNMENT + 5);
+        char c = 0x5a;
+        f.write(&c, 1);
+    }
+    REQUIRE_THROWS_AS( load_weights(path, 2, 64), std::runtime_error );
+    REQUIRE_NOTHROW( NsdfFile(path, NsdfKind::Weights, false) );
+
+    std::remove(path.c_str());
+}
@@ -0,0 +1,153 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+
+#include "optimizer.h"
+#include "siren.h"
+#include "utils.h"
+
+
+static std::vector<float> random_vector(int n, std::mt19937 &gen)
+{
+    std::uniform_real_distribution<float> dis(-1.0f, 1.0f);
+    std::vector<float> v(n);
+    for (auto &x: v)
+        x = dis(gen);
+    return v;
+}
+
+
+static float max_error(const std::vector<float> &a, const std::vector<float> &b)
+{
+    float err = 0.0f;
+    for (size_t i = 0; i < a.size(); ++i)
+        err = std::max(err, std::fabs(a[i] - b[i]));
+    return err;
+}
+
+
+// straightforward per-parameter update of the given optimizer
+static void reference_step(const OptimizerConfig &c, std::vector<float> &params,
+    const std::vector<float> &grads, std::vector<float> &m, std::vector<float> &v, float lr, int t)
+{
+    const float wd = c.type == OptimizerType::Adam ? 0.0f : c.weight_decay;
+    for (size_t i = 0; i < params.size(); ++i) {
+        const float g = grads[i];
+        params[i] *= 1 - lr * wd;
+        if (c.type == OptimizerType::SGD) {
+            m[i] = c.momentum * m[i] + g;
+            params[i] -= lr * m[i];
+        } else if (c.type == OptimizerType::Lion) {
+            float u = c.beta1 * m[i] + (1 - c.beta1) * g;
+            params[i] -= lr * (u > 0 ? 1.0f : (u < 0 ? -1.0f : 0.0f));
+            m[i] = c.beta2 * m[i] + (1 - c.beta2) * g;
+        } else {
+            m[i] = c.beta1 * m[i] + (1 - c.beta1) * g;
+            v[i] = c.beta2 * v[i] + (1 - c.beta2) * g * g;
+            float m_corr = m[i] / (1 - std::pow(c.beta1, t));
+            float v_corr = v[i] / (1 - std::pow(c.beta2, t));
+            params[i] -= lr * m_corr / (std::sqrt(v_corr) + c.eps);
+        }
+    }
+}
+
+
+TEST_CASE( "optimizers match their reference updates", "[optimizer]" )
+{
+    std::mt19937 gen(5);
+    // odd size exercises the vector tails and uneven thread ranges
+    const uint32_t n = 40013;
+    const auto init = random_vector(n, gen);
+
+    for (const char *name: {"adam", "adamw", "sgd", "lion"}) {
+        OptimizerConfig config;
+        config.type = optimizer_type_from_string(name);
+        config.weight_decay = 1e-2f;
+        Optimizer optimizer(n, config);
+
+        std::vector<float> params = init, params_gt = init, m(n), v(n);
+        for (int t = 1; t <= 3; ++t) {
+            const auto grads = random_vector(n, gen);
+            optimizer.step(params.data(), grads.data(), 1e-3f);
+            reference_step(config, params_gt, grads, m, v, 1e-3f, t);
+        }
+        REQUIRE( optimizer.steps() == 3 );
+        REQUIRE( max_error(params, params_gt) < 1e-6f );
+    }
+
+    REQUIRE_THROWS_AS( optimizer_type_from_string("rmsprop"), std::runtime_error );
+}
+
+
+TEST_CASE( "optimizer step can be split into ranges", "[optimizer]" )
+{
+    std::mt19937 gen(6);
+    const uint32_t n = 10007;
+    const auto grads = random_vector(n, gen);
+    std::vector<float> whole = random_vector(n, gen), split = whole;
+
+    Optimizer a(n), b(n);
+    a.step(whole.data(), grads.data(), 1e-3f);
+    b.beginStep(1e-3f);
+    // ranges are updated in any order, as backward goes from the last layer
+    b.update(split.data(), grads.data(), 5000, n);
+    b.update(split.data(), grads.data(), 0, 5000);
+    b.endStep();
+    REQUIRE( max_error(whole, split) < 1e-7f );
+
+    REQUIRE_THROWS_AS( b.update(split.data(), grads.data(), 0, n), std::runtime_error );
+    b.beginStep(1e-3f);
+    REQUIRE_THROWS_AS( b.update(split.data(), grads.data(), 0, n + 1), std::runtime_error );
+}
+
+
+TEST_CASE( "fused backwardStep matches backward then step", "[optimizer]" )
+{
+    const auto [points, sdfs] = load_points("data/points/sdf1_test.bin");
+    const uint32_t n = sdfs.size(), batch_size = 512;
+    const auto init = load_floats("data/weights/sdf1_gt_weights.bin");
+    std::vector<float> input = transpose(points, n, 3), preds(batch_size);
+
+    for (const char *name: {"adam", "adamw", "sgd", "lion"}) {
+        OptimizerConfig config;
+        config.type = optimizer_type_from_string(name);
+        config.weight_decay = 1e-2f;
+
+        SirenNetwork net(2, 64, batch_size), fused(2, 64, batch_size);
+        net.setWeights(init);
+        fused.setWeights(init);
+        net.setOptimizer(config);
+        fused.setOptimizer(config);
+
+        for (uint32_t start = 0; start + batch_size <= n; start += batch_size) {
+            net.forward(preds.data(), input.data() + start, batch_size, n);
+            net.backward(sdfs.data() + start);
+            net.step(1e-4f);
+            fused.forward(preds.data(), input.data() + start, batch_size, n);
+            fused.backwardStep(sdfs.data() + start, 1e-4f);
+        }
+        REQUIRE( fused.getOptimizer().steps() == net.getOptimizer().steps() );
+        REQUIRE( max_error(fused.getWeights(), net.getWeights()) < 1e-5f );
+    }
+}
+
+
+TEST_CASE( "network steps again after a failed backwardStep", "[optimizer]" )
+{
+    const auto [points, sdfs] = load_points("data/points/sdf1_test.bin");
+    const uint32_t batch_size = 256;
+    std::vector<float> input = transpose(points, sdfs.size(), 3), preds(batch_size);
+
+    SirenNetwork net(2, 64, batch_size);
+    net.setWeights(load_floats("data/weights/sdf1_gt_weights.bin"));
+    // no forward pass yet, so backward throws inside the step
+    REQUIRE_THROWS_AS( net.backwardStep(sdfs.data(), 1e-4f), std::runtime_error );
+    REQUIRE( net.getOptimizer().steps() == 0 );
+
+    net.forward(preds.data(), input.data(), batch_size, sdfs.size());
+    REQUIRE_NOTHROW( net.backwardStep(sdfs.data(), 1e-4f) );
+    REQUIRE( net.getOptimizer().steps() == 1 );
+}
@@ -0,0 +1,142 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "process_group.h"
+#include "train_pipeline.h"
+#include "utils.h"
+
+
+static std::string test_socket_path()
+{
+    return "/tmp/neural_sdf_test_" + std::to_string(std::random_device{}()) + ".sock";
+}
+
+
+// runs fn(rank) for every rank on its own thread; sockets work the same between threads
+template <typename Fn>
+static void run_ranks(int world_size, Fn fn)
+{
+    std::vector<std::thread> threads;
+    for (int rank = 0; rank < world_size; ++rank)
+        threads.emplace_back(fn, rank);
+    for (auto &thread: threads)
+        thread.join();
+}
+
+
+TEST_CASE( "process group collectives", "[process_group]" )
+{
+    const int world_size = 3;
+    const std::string path = test_socket_path();
+    std::vector<std::vector<float>> sums(world_size), broadcasts(world_size);
+
+    run_ranks(world_size, [&](int rank) {
+        ProcessGroup group(rank, world_size, path);
+        std::vector<float> data(1000);
+        for (size_t i = 0; i < data.size(); ++i)
+            data[i] = rank * 1000.0f + i;
+        group.allreduceSum(data.data(), data.size());
+        sums[rank] = data;
+
+        std::vector<float> value(4, float(rank + 1));
+        group.broadcast(value.data(), value.size());
+        broadcasts[rank] = value;
+        group.barrier();
+    });
+
+    for (int rank = 0; rank < world_size; ++rank) {
+        for (size_t i = 0; i < 1000; ++i)
+            REQUIRE( sums[rank][i] == 3000.0f + 3.0f * i );
+        REQUIRE( broadcasts[rank] == std::vector<float>(4, 1.0f) );
+    }
+}
+
+
+TEST_CASE( "process group of one does nothing", "[process_group]" )
+{
+    ProcessGroup group(0, 1, "");
+    float value = 5.0f;
+    group.allreduceSum(&value, 1);
+    group.broadcast(&value, 1);
+    REQUIRE( value == 5.0f );
+    REQUIRE( group.stats().n_calls == 0 );
+    REQUIRE_THROWS_AS( ProcessGroup(2, 2, ""), std::runtime_error );
+}
+
+
+TEST_CASE( "process group doesn't remove a file that is not a socket", "[process_group]" )
+{
+    const std::string path = test_socket_path();
+    std::ofstream(path) << "not a socket";
+    REQUIRE_THROWS_AS( ProcessGroup(0, 2, path, 0.1), std::runtime_error );
+    std::ifstream file(path);
+    std::string content;
+    std::getline(file, content);
+    REQUIRE( content == "not a socket" );
+    std::remove(path.c_str());
+}
+
+
+TEST_CASE( "ranks averaging gradients train like one network on their joint batch", "[process_group]" )
+{
+    const auto [points, sdfs] = load_points("data/points/sdf1_test.bin");
+    PointDataset dataset(points, sdfs);
+    const uint32_t world_size = 2, batch_size = 128, n_steps = 10;
+    const float lr = 1e-4f;
+    const auto init = load_floats("data/weights/sdf1_gt_weights.bin");
+
+    // step s of rank r takes samples [(2s + r) * batch_size, ...), the joint batch is both
+    auto batch_source = [&](uint32_t first, uint32_t step_batches, uint32_t step_size) {
+        auto step = std::make_shared<uint32_t>(0);
+        return BatchSource([&dataset, first, step_batches, step_size, step](BatchWorkspace &ws) {
+            if (*step == n_steps) {
+                *step = 0;
+                return false;
+            }
+            std::vector<uint32_t> idxs(step_size);
+            for (uint32_t i = 0; i < step_size; ++i)
+                idxs[i] = (*step * step_batches + first) * batch_size + i;
+            dataset.gather(idxs.data(), step_size, ws);
+            *step += 1;
+            return true;
+        });
+    };
+
+    SirenNetwork joint(2, 64, world_size * batch_size);
+    joint.setWeights(init);
+    TrainPipelineConfig config;
+    config.lr = lr;
+    TrainPipeline(joint, batch_source(0, world_size, world_size * batch_size), config).runEpoch();
+
+    const std::string path = test_socket_path();
+    std::vector<std::vector<float>> weights(world_size);
+    run_ranks(world_size, [&](int rank) {
+        ProcessGroup group(rank, world_size, path);
+        SirenNetwork net(2, 64, batch_size);
+        net.setWeights(init);
+        TrainPipelineConfig rank_config;
+        rank_config.lr = lr;
+        rank_config.gradient_hook = [&](float *grads, uint32_t n_weights) {
+            group.allreduceSum(grads, n_weights);
+            for (uint32_t i = 0; i < n_weights; ++i)
+                grads[i] /= world_size;
+        };
+        TrainPipeline(net, batch_source(rank, world_size, batch_size), rank_config).runEpoch();
+        weights[rank] = net.getWeights();
+    });
+
+    // ranks stay in sync exactly, the joint network differs only by summation order
+    REQUIRE( weights[0] == weights[1] );
+    const auto joint_weights = joint.getWeights();
+    float max_err = 0.0f;
+    for (size_t i = 0; i < joint_weights.size(); ++i)
+        max_err = std::max(max_err, std::fabs(weights[0][i] - joint_weights[i]));
+    REQUIRE( max_err < 1e-4f );
+}
@@ -0,0 +1,110 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "quantize.h"
+
+
+TEST_CASE( "fp16 and bf16 round trip every value", "[quantize]" )
+{
+    uint32_t fp16_mismatches = 0, bf16_mismatches = 0;
+    for (uint32_t bits = 0; bits < 0x10000; ++bits) {
+        const uint16_t h = bits;
+        const float fp16 = fp16_to_float(h), bf16 = bf16_to_float(h);
+        if (std::isnan(fp16) ? !std::isnan(fp16_to_float(float_to_fp16(fp16))) : float_to_fp16(fp16) != h)
+            ++fp16_mismatches;
+        if (std::isnan(bf16) ? !std::isnan(bf16_to_float(float_to_bf16(bf16))) : float_to_bf16(bf16) != h)
+            ++bf16_mismatches;
+    }
+    REQUIRE( fp16_mismatches == 0 );
+    REQUIRE( bf16_mismatches == 0 );
+}
+
+
+TEST_CASE( "fp16 and bf16 round to nearest even", "[quantize]" )
+{
+    REQUIRE( fp16_to_float(float_to_fp16(1.0f)) == 1.0f );
+    REQUIRE( fp16_to_float(float_to_fp16(-65504.0f)) == -65504.0f );
+    REQUIRE( std::isinf(fp16_to_float(float_to_fp16(1e5f))) );
+    // smallest subnormal and half of it, a tie that goes to zero
+    REQUIRE( fp16_to_float(float_to_fp16(std::ldexp(1.0f, -24))) == std::ldexp(1.0f, -24) );
+    REQUIRE( fp16_to_float(float_to_fp16(std::ldexp(1.0f, -25))) == 0.0f );
+
+    // ties between neighbours 2^-10 apart for fp16 and 2^-7 for bf16
+    REQUIRE( fp16_to_float(float_to_fp16(1.0f + std::ldexp(1.0f, -11))) == 1.0f );
+    REQUIRE( fp16_to_float(float_to_fp16(1.0f + 3 * std::ldexp(1.0f, -11))) == 1.0f + std::ldexp(1.0f, -9) );
+    REQUIRE( bf16_to_float(float_to_bf16(1.0f + std::ldexp(1.0f, -8))) == 1.0f );
+    REQUIRE( bf16_to_float(float_to_bf16(1.0f + 3 * std::ldexp(1.0f, -8))) == 1.0f + std::ldexp(1.0f, -6) );
+    REQUIRE( std::isnan(bf16_to_float(float_to_bf16(std::numeric_limits<float>::quiet_NaN()))) );
+
+    // relative error of a random value is at most half an ulp of the format
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<float> dis(-4.0f, 4.0f);
+    for (int i = 0; i < 1000; ++i) {
+        const float x = dis(gen);
+        REQUIRE( std::fabs(fp16_to_float(float_to_fp16(x)) - x) <= std::fabs(x) * std::ldexp(1.0f, -11) );
+        REQUIRE( std::fabs(bf16_to_float(float_to_bf16(x)) - x) <= std::fabs(x) * std::ldexp(1.0f, -8) );
+    }
+}
+
+
+TEST_CASE( "int8 linear layer matches dequantized fp32", "[quantize]" )
+{
+    // depth isn't a multiple of the group and rows don't fill the last block
+    const uint32_t out_dim = 37, in_dim = 63, n = 300, ldc = out_dim + 5;
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<float> dis(-1.0f, 1.0f);
+    std::vector<float> w(out_dim * in_dim), x(in_dim * n), bias(out_dim);
+    for (auto *v: {&w, &x, &bias}) {
+        for (auto &value: *v)
+            value = dis(gen);
+    }
+    // one all-zero row gets a unit scale
+    std::fill(w.begin(), w.begin() + in_dim, 0.0f);
+
+    std::vector<int8_t> w_q(w.size()), w_packed(int8_packed_size(out_dim, in_dim));
+    std::vector<float> w_scales(out_dim);
+    quantize_rows_int8(w_q.data(), w_scales.data(), w.data(), out_dim, in_dim);
+    REQUIRE( w_scales[0] == 1.0f );
+    pack_int8_weights(w_packed.data(), w_q.data(), out_dim, in_dim);
+
+    // x is [in_dim x n] as the network stores a layer's input, points are quantized one by one
+    const float x_scale = 1.0f / 127;
+    const uint32_t depth = int8_depth(in_dim);
+    REQUIRE( depth == 64 );
+    std::vector<int8_t> x_q(n * depth);
+    quantize_int8_points(x_q.data(), MatrixView{x.data(), 1, n}, n, in_dim, x_scale);
+
+    std::vector<float> res(n * ldc);
+    linear_int8(res.data(), ldc, w_packed.data(), w_scales.data(), bias.data(), x_q.data(), x_scale,
+        out_dim, in_dim, n);
+
+    float max_err = 0.0f;
+    for (uint32_t j = 0; j < n; ++j) {
+        REQUIRE( x_q[j * depth + in_dim] == 0 );
+        for (uint32_t o = 0; o < out_dim; ++o) {
+            double exact = bias[o], dequantized = bias[o];
+            for (uint32_t k = 0; k < in_dim; ++k) {
+                exact += double(w[o * in_dim + k]) * x[k * n + j];
+                dequantized += double(w_q[o * in_dim + k]) * w_scales[o] * x_q[j * depth + k] * x_scale;
+            }
+            REQUIRE( std::fabs(res[j * ldc + o] - dequantized) < 1e-4 );
+            max_err = std::max(max_err, float(std::fabs(res[j * ldc + o] - exact)));
+        }
+    }
+    // half a step of both operands over 63 products
+    REQUIRE( max_err < 0.1f );
+}
+
+
+TEST_CASE( "precision is parsed by name", "[quantize]" )
+{
+    for (Precision p: {Precision::FP32, Precision::FP16, Precision::BF16, Precision::INT8})
+        REQUIRE( precision_from_string(precision_name(p)) == p );
+    REQUIRE_THROWS_AS( precision_from_string("fp8"), std::runtime_error );
+}
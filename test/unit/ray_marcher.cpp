@@ -0,0 +1,237 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cmath>
+#include <atomic>
+#include <stdexcept>
+
+#include "ray_marcher.h"
+#include "thread_pool.h"
+
+
+TEST_CASE( "tiled render matches wavefront render", "[ray_marcher]" )
+{
+    const std::vector<float> weights = load_floats("data/weights/sdf1_gt_weights.bin");
+    const Camera cam = load_cam("conf/camera_1.txt");
+    const Light light = load_light("conf/light.txt");
+
+    auto model = std::make_shared<const SirenModel>(2, 64, weights, 1024);
+
+    // tile size doesn't divide the frame, so border tiles are partial
+    const uint32_t width = 72, height = 56;
+    auto wavefront = RayMarcher(cam, light, model, RenderMode::Wavefront).render(width, height);
+
+    RayMarcher tiled_marcher(cam, light, model, RenderMode::Tiled, 16);
+    std::vector<uint> tiled_single, tiled;
+    {
+        const ScopedNNThreads threads(1);
+        tiled_single = tiled_marcher.render(width, height);
+    }
+    {
+        const ScopedNNThreads threads(3);
+        tiled = tiled_marcher.render(width, height);
+    }
+    const TileStats &stats = tiled_marcher.getTileStats();
+
+    REQUIRE( tiled == tiled_single );
+    REQUIRE( stats.n_tiles == 5 * 4 );
+    REQUIRE( stats.n_workers == 3 );
+    REQUIRE( stats.worker_busy_ms.size() == 3 );
+    REQUIRE( stats.min_tile_ms <= stats.mean_tile_ms );
+    REQUIRE( stats.mean_tile_ms <= stats.max_tile_ms );
+
+    // batches of different size may round the last bits differently
+    int n_different = 0;
+    for (uint32_t i = 0; i < width * height; ++i)
+        n_different += tiled[i] != wavefront[i];
+    REQUIRE( n_different <= 2 );
+}
+
+
+TEST_CASE( "relaxed cone marching keeps the image with fewer steps", "[ray_marcher]" )
+{
+    const std::vector<float> weights = load_floats("data/weights/sdf1_gt_weights.bin");
+    const Camera cam = load_cam("conf/camera_1.txt");
+    const Light light = load_light("conf/light.txt");
+    auto model = std::make_shared<const SirenModel>(2, 64, weights, 1024);
+
+    const uint32_t width = 96, height = 96;
+    RayMarcher plain_marcher(cam, light, model, RenderMode::Wavefront);
+    const auto plain = plain_marcher.render(width, height);
+    const MarchStats plain_stats = plain_marcher.getMarchStats();
+
+    MarchCfg cfg;
+    cfg.relaxation = 1.3f;
+    cfg.hit_pixels = 0.5f;
+    cfg.refine_steps = 2;
+    std::vector<std::vector<uint>> images;
+    for (RenderMode mode: {RenderMode::PerPixel, RenderMode::Wavefront}) {
+        RayMarcher marcher(cam, light, model, mode);
+        marcher.setMarchCfg(cfg);
+        images.push_back(marcher.render(width, height));
+        const MarchStats &stats = marcher.getMarchStats();
+        REQUIRE( stats.n_rays == width * height );
+        REQUIRE( stats.n_steps < plain_stats.n_steps );
+    }
+
+    // hits along the silhouette may come and go, that is under 0.3% of the image
+    int n_different = 0, n_modes_different = 0;
+    for (uint32_t i = 0; i < width * height; ++i) {
+        n_different += images[1][i] != plain[i];
+        n_modes_different += images[0][i] != images[1][i];
+    }
+    REQUIRE( n_different <= 24 );
+    REQUIRE( n_modes_different <= 2 );
+
+    cfg.relaxation = 2.0f;
+    REQUIRE_THROWS_AS( plain_marcher.setMarchCfg(cfg), std::runtime_error );
+    cfg.relaxation = 1.0f;
+    cfg.lipschitz = 0.0f;
+    REQUIRE_THROWS_AS( plain_marcher.setMarchCfg(cfg), std::runtime_error );
+}
+
+
+// keeps every tile it gets
+struct MemorySink : public RenderSink
+{
+    struct Tile { uint32_t x0, y0, w, h; std::vector<uint32_t> pixels; bool final; };
+    std::vector<Tile> tiles;
+
+    void writeTile(uint32_t x0, uint32_t y0, uint32_t w, uint32_t h, const uint32_t *pixels,
+        bool final) override
+    {
+        tiles.push_back({x0, y0, w, h, std::vector<uint32_t>(pixels, pixels + w * h), final});
+    }
+};
+
+
+TEST_CASE( "progressive render streams tiles and matches tiled render", "[ray_marcher]" )
+{
+    const std::vector<float> weights = load_floats("data/weights/sdf1_gt_weights.bin");
+    const Camera cam = load_cam("conf/camera_1.txt");
+    const Light light = load_light("conf/light.txt");
+    auto model = std::make_shared<const SirenModel>(2, 64, weights, 1024);
+
+    // neither the tile size nor the coarse step divides the frame
+    const uint32_t width = 100, height = 90;
+    const auto tiled = RayMarcher(cam, light, model, RenderMode::Tiled, 24).render(width, height);
+
+    RayMarcher marcher(cam, light, model, RenderMode::Progressive, 24);
+    marcher.setProgressiveCfg({8, 0});
+    auto sink = std::make_shared<MemorySink>();
+    marcher.setRenderSink(sink);
+    std::vector<uint> progressive;
+    {
+        const ScopedNNThreads threads(3);
+        progressive = marcher.render(width, height);
+    }
+
+    const ProgressiveStats &stats = marcher.getProgressiveStats();
+    REQUIRE( stats.marched.size() == 4 );
+    REQUIRE( stats.marched[0] == 13 * 12 );
+    uint32_t n_marched = 0;
+    for (uint32_t n: stats.marched)
+        n_marched += n;
+    REQUIRE( n_marched + stats.n_interpolated == width * height );
+    REQUIRE( n_marched < width * height / 2 );
+    REQUIRE( marcher.getMarchStats().n_rays == n_marched );
+
+    // previews of the whole frame after the first three passes, then every tile once
+    std::vector<int> covered(width * height, 0);
+    uint32_t n_previews = 0;
+    for (const auto &tile: sink->tiles) {
+        if (!tile.final) {
+            REQUIRE( tile.w == width );
+            REQUIRE( tile.h == height );
+            n_previews += 1;
+            continue;
+        }
+        for (uint32_t y = 0; y < tile.h; ++y) {
+            for (uint32_t x = 0; x < tile.w; ++x) {
+                const uint32_t i = (tile.y0 + y) * width + tile.x0 + x;
+                covered[i] += 1;
+                REQUIRE( tile.pixels[y * tile.w + x] == progressive[i] );
+            }
+        }
+    }
+    REQUIRE( n_previews == 3 );
+    REQUIRE( sink->tiles.size() == 3 + 5 * 4 );
+    for (int c: covered)
+        REQUIRE( c == 1 );
+
+    int n_different = 0;
+    for (uint32_t i = 0; i < width * height; ++i)
+        n_different += progressive[i] != tiled[i];
+    REQUIRE( n_different <= 4 );
+
+    REQUIRE_THROWS_AS( marcher.setProgressiveCfg({6, 0}), std::runtime_error );
+}
+
+
+// fails on its n-th tile, like a BMP sink whose disk is full
+struct ThrowingSink: public RenderSink
+{
+    explicit ThrowingSink(int n): n_left(n) {}
+    std::atomic<int> n_left;
+
+    void writeTile(uint32_t, uint32_t, uint32_t, uint32_t, const uint32_t *, bool) override
+    {
+        if (--n_left == 0)
+            throw std::runtime_error("can't write the tile");
+    }
+};
+
+
+TEST_CASE( "sink errors leave render as exceptions", "[ray_marcher]" )
+{
+    const std::vector<float> weights = load_floats("data/weights/sdf1_gt_weights.bin");
+    const Camera cam = load_cam("conf/camera_1.txt");
+    const Light light = load_light("conf/light.txt");
+    auto model = std::make_shared<const SirenModel>(2, 64, weights, 1024);
+
+    const uint32_t width = 64, height = 48;
+    for (RenderMode mode: {RenderMode::Tiled, RenderMode::Progressive}) {
+        RayMarcher marcher(cam, light, model, mode, 16);
+        const auto expected = marcher.render(width, height);
+        const ScopedNNThreads threads(3);
+        // the first thing sent (a preview in progressive mode), the second and a later tile
+        for (int n: {1, 2, 7}) {
+            marcher.setRenderSink(std::make_shared<ThrowingSink>(n));
+            REQUIRE_THROWS_AS( marcher.render(width, height), std::runtime_error );
+        }
+        marcher.setRenderSink(nullptr);
+        REQUIRE( marcher.render(width, height) == expected );
+    }
+}
+
+
+TEST_CASE( "views rendered together match separate renders", "[ray_marcher]" )
+{
+    const std::vector<float> weights = load_floats("data/weights/sdf1_gt_weights.bin");
+    const Camera cam = load_cam("conf/camera_1.txt");
+    const Light light = load_light("conf/light.txt");
+    auto model = std::make_shared<const SirenModel>(2, 64, weights, 1024);
+
+    const std::vector<Camera> cams = orbit_cameras(cam, 5);
+    REQUIRE( cams.size() == 5 );
+    for (const Camera &c: cams) {
+        REQUIRE( std::fabs(length(c.pos - c.look_at) - length(cam.pos - cam.look_at)) < 1e-5f );
+        REQUIRE( std::fabs(dot(c.pos - cam.pos, normalize(cam.up))) < 1e-5f );
+    }
+    REQUIRE( length(cams[0].pos - cam.pos) < 1e-6f );
+
+    // chunks of 700 rays take pixels of two views at a time
+    const uint32_t width = 30, height = 40;
+    RayMarcher marcher(cam, light, model, RenderMode::Wavefront);
+    std::vector<std::vector<uint>> images;
+    {
+        const ScopedNNThreads threads(3);
+        images = marcher.renderViews(cams, width, height, 700);
+    }
+    REQUIRE( marcher.getMarchStats().n_rays == cams.size() * width * height );
+
+    REQUIRE( images.size() == cams.size() );
+    for (size_t v = 0; v < cams.size(); ++v) {
+        marcher.setCamera(cams[v]);
+        REQUIRE( images[v] == marcher.render(width, height) );
+    }
+}
@@ -0,0 +1,46 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#include "render_sink.h"
+
+
+TEST_CASE( "bmp sink writes tiles in place", "[render_sink]" )
+{
+    // rows of 3 * 5 bytes are padded to 16
+    const uint32_t width = 5, height = 3;
+    const std::string path = "render_sink_test.bmp";
+    {
+        auto sink = make_bmp_sink(path, width, height);
+        const std::vector<uint32_t> preview(width * height, 0x00010203);
+        sink->writeTile(0, 0, width, height, preview.data(), false);
+        const uint32_t tile[] = {0x00AABBCC, 0x00DDEEFF};
+        sink->writeTile(3, 2, 2, 1, tile, true);
+        REQUIRE_THROWS_AS( sink->writeTile(4, 2, 2, 1, tile, true), std::runtime_error );
+    }
+
+    std::ifstream in(path, std::ios::binary);
+    const std::vector<unsigned char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    REQUIRE( data.size() == 54 + 16 * height );
+    REQUIRE( data[0] == 'B' );
+    REQUIRE( data[18] == width );
+    REQUIRE( data[22] == height );
+    REQUIRE( data[28] == 24 );
+
+    auto pixel = [&](uint32_t x, uint32_t y) {
+        const unsigned char *p = &data[54 + 16 * y + 3 * x];
+        return uint32_t(p[0]) << 16 | uint32_t(p[1]) << 8 | p[2];
+    };
+    REQUIRE( pixel(0, 0) == 0x010203 );
+    REQUIRE( pixel(4, 1) == 0x010203 );
+    REQUIRE( pixel(2, 2) == 0x010203 );
+    REQUIRE( pixel(3, 2) == 0xAABBCC );
+    REQUIRE( pixel(4, 2) == 0xDDEEFF );
+    std::remove(path.c_str());
+
+    REQUIRE_THROWS_AS( make_bmp_sink("no_such_dir/out.bmp", 4, 4), std::runtime_error );
+}
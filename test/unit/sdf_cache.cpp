@@ -0,0 +1,93 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+
+#include "sdf_cache.h"
+#include "ray_marcher.h"
+
+
+TEST_CASE( "sdf cache bounds the network and survives a round trip", "[sdf_cache]" )
+{
+    const std::vector<float> weights = load_floats("data/weights/sdf1_gt_weights.bin");
+    const SirenModel model(2, 64, weights);
+    const SdfCache cache(model, 8, 4);
+    const SdfCacheHeader &h = cache.getHeader();
+    REQUIRE( h.n_fine > 0 );
+    REQUIRE( h.n_fine < 8 * 8 * 8 );
+    REQUIRE( cache.getLipschitz() >= 1.0f );
+    REQUIRE( cache.matches(model) );
+
+    const uint32_t n = 20000;
+    std::mt19937 gen(11);
+    std::uniform_real_distribution<float> dis(-1.0f, 1.0f);
+    std::vector<float> points(INPUT_DIM * n), sdf(n);
+    for (auto &v: points)
+        v = dis(gen);
+    model.forward(sdf.data(), points.data(), n);
+
+    uint32_t n_above = 0;
+    float max_near_err = 0.0f;
+    for (uint32_t i = 0; i < n; ++i) {
+        const float3 p(points[i], points[n + i], points[2 * n + i]);
+        n_above += cache.lowerBound(p) > sdf[i];
+        // fine bricks cover the surface
+        if (std::fabs(sdf[i]) < 0.05f)
+            max_near_err = std::max(max_near_err, std::fabs(cache.value(p) - sdf[i]));
+    }
+    REQUIRE( n_above == 0 );
+    REQUIRE( max_near_err < 0.02f );
+    REQUIRE( std::isinf(cache.lowerBound(float3(1.5f, 0.0f, 0.0f))) );
+
+    const std::string path = "sdf_cache_test.nsdf";
+    cache.save(path);
+    {
+        const SdfCache loaded(path);
+        REQUIRE( loaded.getMemoryBytes() == cache.getMemoryBytes() );
+        REQUIRE( loaded.getHeader().n_fine == h.n_fine );
+        REQUIRE( loaded.matches(model) );
+        for (uint32_t i = 0; i < n; ++i) {
+            const float3 p(points[i], points[n + i], points[2 * n + i]);
+            REQUIRE( loaded.lowerBound(p) == cache.lowerBound(p) );
+        }
+        REQUIRE_THROWS_AS( NsdfFile(path, NsdfKind::Weights), std::runtime_error );
+    }
+    std::remove(path.c_str());
+
+    // another model gets refused
+    std::vector<float> other = weights;
+    other.back() += 0.1f;
+    const SirenModel other_model(2, 64, other);
+    REQUIRE_FALSE( cache.matches(other_model) );
+}
+
+
+TEST_CASE( "render with sdf cache matches the network render", "[sdf_cache]" )
+{
+    const std::vector<float> weights = load_floats("data/weights/sdf1_gt_weights.bin");
+    const Camera cam = load_cam("conf/camera_1.txt");
+    const Light light = load_light("conf/light.txt");
+    auto model = std::make_shared<const SirenModel>(2, 64, weights, 1024);
+    auto cache = std::make_shared<const SdfCache>(*model, 16, 4);
+
+    const uint32_t width = 64, height = 64;
+    for (RenderMode mode: {RenderMode::PerPixel, RenderMode::Wavefront}) {
+        RayMarcher marcher(cam, light, model, mode);
+        const auto reference = marcher.render(width, height);
+        marcher.setSdfCache(cache);
+        const auto cached = marcher.render(width, height);
+
+        // steps are shorter away from the surface, so hits may land a bit differently
+        int n_different = 0;
+        for (uint32_t i = 0; i < width * height; ++i)
+            n_different += cached[i] != reference[i];
+        REQUIRE( n_different <= 4 );
+    }
+
+    std::vector<float> other = weights;
+    other[0] += 0.1f;
+    RayMarcher other_marcher(cam, light, std::make_shared<const SirenModel>(2, 64, other), RenderMode::Wavefront);
+    REQUIRE_THROWS_AS( other_marcher.setSdfCache(cache), std::runtime_error );
+}
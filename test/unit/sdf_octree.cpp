@@ -0,0 +1,117 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cmath>
+#include <random>
+
+#include "sdf_octree.h"
+#include "ray_marcher.h"
+
+
+TEST_CASE( "siren bounds hold the network over the box", "[sdf_octree]" )
+{
+    const std::vector<float> weights = load_floats("data/weights/sdf1_gt_weights.bin");
+    const SirenModel model(2, 64, weights);
+
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    const uint32_t n = 256;
+    std::vector<float> points(INPUT_DIM * n), sdf(n);
+    for (float half: {0.25f, 0.03125f, 0.0078125f}) {
+        for (int box = 0; box < 8; ++box) {
+            const float3 center(uniform(gen), uniform(gen), uniform(gen));
+            float lower, upper;
+            siren_bounds(model, center, float3(half, half, half), lower, upper);
+            REQUIRE( lower <= upper );
+
+            for (uint32_t i = 0; i < n; ++i) {
+                for (int dim = 0; dim < INPUT_DIM; ++dim)
+                    points[dim * n + i] = center[dim] + half * uniform(gen);
+            }
+            model.forward(sdf.data(), points.data(), n);
+            for (float d: sdf) {
+                REQUIRE( d >= lower - 1e-4f );
+                REQUIRE( d <= upper + 1e-4f );
+            }
+            // the Taylor model is tight for small boxes
+            if (half < 0.01f)
+                REQUIRE( upper - lower < 0.5f );
+        }
+    }
+}
+
+
+TEST_CASE( "weight norm lipschitz bound is above the gradient norms", "[sdf_octree]" )
+{
+    const std::vector<float> weights = load_floats("data/weights/sdf1_gt_weights.bin");
+    const SirenModel model(2, 64, weights);
+    const float bound = siren_lipschitz_bound(model);
+
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    const uint32_t n = 4096;
+    std::vector<float> points(INPUT_DIM * n), sdf(n), grad(INPUT_DIM * n);
+    for (float &x: points)
+        x = uniform(gen);
+    SirenWorkspace workspace;
+    model.forwardWithGradient(sdf.data(), grad.data(), points.data(), n, workspace);
+    for (uint32_t i = 0; i < n; ++i)
+        REQUIRE( length(float3(grad[i], grad[n + i], grad[2 * n + i])) <= bound );
+}
+
+
+TEST_CASE( "ray box intersection", "[sdf_octree]" )
+{
+    const float3 corner(1.0f, 1.0f, 1.0f);
+    float t_near, t_far;
+    REQUIRE( ray_box_intersection(float3(-3.0f, 0.5f, 0.0f), float3(1.0f, 0.0f, 0.0f), -corner, corner,
+        t_near, t_far) );
+    REQUIRE( std::fabs(t_near - 2.0f) < 1e-6f );
+    REQUIRE( std::fabs(t_far - 4.0f) < 1e-6f );
+    REQUIRE_FALSE( ray_box_intersection(float3(-3.0f, 1.5f, 0.0f), float3(1.0f, 0.0f, 0.0f), -corner, corner,
+        t_near, t_far) );
+}
+
+
+TEST_CASE( "octree skips empty space without changing the render", "[sdf_octree]" )
+{
+    const std::vector<float> weights = load_floats("data/weights/sdf1_gt_weights.bin");
+    const Camera cam = load_cam("conf/camera_1.txt");
+    const Light light = load_light("conf/light.txt");
+    auto model = std::make_shared<const SirenModel>(2, 64, weights, 1024);
+    auto octree = std::make_shared<const SdfOctree>(*model, 5);
+    REQUIRE( octree->getEmptyLeaves() > 0 );
+    REQUIRE( octree->getEmptyVolume() > 0.3f );
+
+    // empty leaves have no surface: the network is positive in them
+    const float3 ray_dir = normalize(float3(1.0f, 0.3f, 0.2f));
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    for (int i = 0; i < 1000; ++i) {
+        const float3 p(uniform(gen), uniform(gen), uniform(gen));
+        if (octree->emptyDistance(p, ray_dir) > 0.0f) {
+            float point[INPUT_DIM] = { p.x, p.y, p.z }, d;
+            model->forward(&d, point, 1);
+            REQUIRE( d > 0.0f );
+        }
+    }
+
+    const uint32_t width = 64, height = 64;
+    for (RenderMode mode: {RenderMode::PerPixel, RenderMode::Wavefront}) {
+        RayMarcher marcher(cam, light, model, mode);
+        const auto reference = marcher.render(width, height);
+        const MarchStats reference_stats = marcher.getMarchStats();
+        marcher.setOctree(octree);
+        const auto skipped = marcher.render(width, height);
+        const MarchStats &stats = marcher.getMarchStats();
+
+        REQUIRE( reference_stats.n_rays == width * height );
+        REQUIRE( stats.n_rays == width * height );
+        REQUIRE( stats.n_node_skips > 0 );
+        REQUIRE( stats.n_steps * 4 < reference_stats.n_steps );
+
+        int n_different = 0;
+        for (uint32_t i = 0; i < width * height; ++i)
+            n_different += skipped[i] != reference[i];
+        REQUIRE( n_different <= 4 );
+    }
+}
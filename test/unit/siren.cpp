@@ -1,6 +1,8 @@
 #include <catch2/catch_test_macros.hpp>
 
 #include <iostream>
+#include <cmath>
+#include <algorithm>
 
 #include "siren.h"
 #include "utils.h"
@@ -104,6 +106,34 @@ TEST_CASE( "forward on test points", "[siren]" )
 }
 
 
+TEST_CASE( "inference matches forward", "[siren]" )
+{
+    const std::vector<float> weights = load_floats("data/weights/sdf1_gt_weights.bin");
+    const auto [points, gt_sdf] = load_points("data/points/sdf1_test.bin");
+
+    const int batch_size = gt_sdf.size();
+
+    auto net = getSirenNetwork(2, 64, batch_size);
+    net->setWeights(weights);
+    net->CommitDeviceData();
+
+    std::vector<float> points_batch = transpose(points, batch_size, 3);
+    std::vector<float> forward_sdf(batch_size), inference_sdf(batch_size);
+
+    net->UpdateMembersPlainData();
+    net->forward(forward_sdf.data(), points_batch.data(), batch_size);
+    net->inference(inference_sdf.data(), points_batch.data(), batch_size);
+
+    REQUIRE( forward_sdf == inference_sdf );
+
+    // a smaller batch reuses the same buffers
+    net->inference(inference_sdf.data(), points_batch.data(), 1);
+    std::vector<float> single(1);
+    net->forward(single.data(), points_batch.data(), 1);
+    REQUIRE( single[0] == inference_sdf[0] );
+}
+
+
 TEST_CASE( "backward on sampled batch", "[siren]" )
 {
     const std::vector<float> weights = {
@@ -304,3 +334,51 @@ TEST_CASE( "Adam step on sampled batch", "[siren]" )
     std::cout << "[Adam step] Updated weights after Adam step MSE: " << mse << std::endl;
     REQUIRE( mse < 1e-9 );
 }
+
+
+TEST_CASE( "backward overwrites gradients, backwardAccumulate adds them", "[siren]" )
+{
+    const auto [points, sdfs] = load_points("data/points/sdf1_test.bin");
+    const int n = sdfs.size(), batch_size = 512, micro_batch_size = 128;
+    const auto init = load_floats("data/weights/sdf1_gt_weights.bin");
+    const auto input = transpose(points, n, INPUT_DIM);
+    std::vector<float> preds(batch_size);
+
+    SirenNetwork net(2, 64, batch_size);
+    net.setWeights(init);
+    net.forward(preds.data(), input.data(), batch_size, n);
+    net.backward(sdfs.data());
+    const auto grads = net.getWeightsGradients();
+
+    // bias gradients used to keep growing with every backward
+    net.forward(preds.data(), input.data(), batch_size, n);
+    net.backward(sdfs.data());
+    REQUIRE( net.getWeightsGradients() == grads );
+
+    net.backwardAccumulate(sdfs.data(), 0.5f);
+    auto accumulated = net.getWeightsGradients();
+    float max_err = 0.0f;
+    for (size_t i = 0; i < grads.size(); ++i)
+        max_err = std::max(max_err, std::fabs(accumulated[i] - 1.5f * grads[i]));
+    REQUIRE( max_err < 1e-6f );
+
+    net.scaleGradients(2.0f);
+    REQUIRE( net.getWeightsGradients()[0] == 2.0f * accumulated[0] );
+    net.zeroGradients();
+    for (float g: net.getWeightsGradients())
+        REQUIRE( g == 0.0f );
+
+    // micro-batches weighted by their share give the gradient of the whole batch
+    SirenNetwork micro(2, 64, micro_batch_size);
+    micro.setWeights(init);
+    micro.zeroGradients();
+    for (int start = 0; start < batch_size; start += micro_batch_size) {
+        micro.forward(preds.data(), input.data() + start, micro_batch_size, n);
+        micro.backwardAccumulate(sdfs.data() + start, float(micro_batch_size) / batch_size);
+    }
+    accumulated = micro.getWeightsGradients();
+    max_err = 0.0f;
+    for (size_t i = 0; i < grads.size(); ++i)
+        max_err = std::max(max_err, std::fabs(accumulated[i] - grads[i]));
+    REQUIRE( max_err < 1e-6f );
+}
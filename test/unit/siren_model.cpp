@@ -0,0 +1,208 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <thread>
+#include <stdexcept>
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+#include "siren_model.h"
+#include "utils.h"
+
+
+TEST_CASE( "model matches network forward for any batch size", "[siren_model]" )
+{
+    const std::vector<float> weights = load_floats("data/weights/sdf1_gt_weights.bin");
+    const auto [points, gt_sdf] = load_points("data/points/sdf1_test.bin");
+
+    const int batch_size = gt_sdf.size();
+    std::vector<float> points_batch = transpose(points, batch_size, 3);
+
+    auto net = getSirenNetwork(2, 64, batch_size);
+    net->setWeights(weights);
+    net->CommitDeviceData();
+    net->UpdateMembersPlainData();
+    std::vector<float> net_sdf(batch_size);
+    net->inference(net_sdf.data(), points_batch.data(), batch_size);
+
+    // chunks smaller than the batch and not dividing it
+    for (uint32_t max_chunk: {uint32_t(batch_size), 4096u, 37u}) {
+        const SirenModel model(2, 64, weights, max_chunk);
+        std::vector<float> model_sdf(batch_size);
+        model.forward(model_sdf.data(), points_batch.data(), batch_size);
+        REQUIRE( mse_loss(model_sdf, net_sdf) < 1e-12f );
+    }
+
+    // the network can't take a batch bigger than its buffers
+    std::vector<float> big_batch(INPUT_DIM * (batch_size + 1)), big_sdf(batch_size + 1);
+    REQUIRE_THROWS_AS( net->inference(big_sdf.data(), big_batch.data(), batch_size + 1),
+        std::runtime_error );
+}
+
+
+TEST_CASE( "model is evaluated from several threads at once", "[siren_model]" )
+{
+    const std::vector<float> weights = load_floats("data/weights/sdf1_gt_weights.bin");
+    const auto [points, gt_sdf] = load_points("data/points/sdf1_test.bin");
+
+    const int batch_size = gt_sdf.size();
+    std::vector<float> points_batch = transpose(points, batch_size, 3);
+
+    const SirenModel model(2, 64, weights, 64);
+    std::vector<float> ref_sdf(batch_size);
+    model.forward(ref_sdf.data(), points_batch.data(), batch_size);
+
+    const int n_threads = 4;
+    std::vector<std::vector<float>> thread_sdf(n_threads, std::vector<float>(batch_size));
+    std::vector<std::thread> threads;
+    for (int i = 0; i < n_threads; ++i) {
+        threads.emplace_back([&, i]() {
+            SirenWorkspace workspace;
+            for (int repeat = 0; repeat < 10; ++repeat)
+                model.forward(thread_sdf[i].data(), points_batch.data(), batch_size, workspace);
+        });
+    }
+    for (auto &thread: threads)
+        thread.join();
+
+    for (const auto &sdf: thread_sdf)
+        REQUIRE( sdf == ref_sdf );
+}
+
+
+TEST_CASE( "model checks the number of weights", "[siren_model]" )
+{
+    REQUIRE_THROWS_AS( SirenModel(2, 64, std::vector<float>(10)), std::runtime_error );
+}
+
+
+TEST_CASE( "input gradient matches network and finite differences", "[siren_model]" )
+{
+    const std::vector<float> weights = load_floats("data/weights/sdf1_gt_weights.bin");
+    const auto [points, gt_sdf] = load_points("data/points/sdf1_test.bin");
+
+    const int batch_size = gt_sdf.size();
+    std::vector<float> points_batch = transpose(points, batch_size, 3);
+
+    auto net = getSirenNetwork(2, 64, batch_size);
+    net->setWeights(weights);
+    net->CommitDeviceData();
+    net->UpdateMembersPlainData();
+    std::vector<float> net_sdf(batch_size), net_grad(INPUT_DIM * batch_size);
+    net->forwardWithGradient(net_sdf.data(), net_grad.data(), points_batch.data(), batch_size);
+
+    const SirenModel model(2, 64, weights, 100);
+    SirenWorkspace workspace;
+    std::vector<float> sdf(batch_size), grad(INPUT_DIM * batch_size);
+    model.forwardWithGradient(sdf.data(), grad.data(), points_batch.data(), batch_size, workspace);
+
+    REQUIRE( mse_loss(sdf, net_sdf) < 1e-12f );
+    REQUIRE( mse_loss(grad, net_grad) < 1e-9f );
+
+    // central differences, with a step big enough for float precision
+    const float eps = 1e-3f;
+    std::vector<float> shifted = points_batch, plus(batch_size), minus(batch_size);
+    float max_error = 0.0f;
+    for (int dim = 0; dim < INPUT_DIM; ++dim) {
+        for (int i = 0; i < batch_size; ++i)
+            shifted[dim * batch_size + i] = points_batch[dim * batch_size + i] + eps;
+        model.forward(plus.data(), shifted.data(), batch_size, workspace);
+        for (int i = 0; i < batch_size; ++i)
+            shifted[dim * batch_size + i] = points_batch[dim * batch_size + i] - eps;
+        model.forward(minus.data(), shifted.data(), batch_size, workspace);
+        shifted = points_batch;
+
+        for (int i = 0; i < batch_size; ++i) {
+            float numeric = (plus[i] - minus[i]) / (2 * eps);
+            max_error = std::max(max_error, std::abs(numeric - grad[dim * batch_size + i]));
+        }
+    }
+    std::cout << "[Input gradient] max abs error vs finite differences = " << max_error << std::endl;
+    REQUIRE( max_error < 1e-2f );
+}
+
+
+TEST_CASE( "specialized kernels match the network on small batches", "[siren_model]" )
+{
+    const auto [points, gt_sdf] = load_points("data/points/sdf1_test.bin");
+    const uint32_t n = 13;
+    std::vector<float> points_batch = transpose(
+        std::vector<float>(points.begin(), points.begin() + INPUT_DIM * n), n, INPUT_DIM);
+
+    REQUIRE_FALSE( SirenModel(2, 10, SirenNetwork(2, 10, 1).getWeights()).isSpecialized() );
+
+    for (auto [n_hidden, hidden_size]: {std::pair{2, 64}, std::pair{3, 128}, std::pair{4, 256}}) {
+        SirenNetwork net(n_hidden, hidden_size, n);
+        const SirenModel model(n_hidden, hidden_size, net.getWeights());
+        REQUIRE( model.isSpecialized() );
+
+        std::vector<float> net_sdf(n), net_grad(INPUT_DIM * n);
+        net.forwardWithGradient(net_sdf.data(), net_grad.data(), points_batch.data(), n);
+
+        std::vector<float> sdf(n), grad(INPUT_DIM * n);
+        SirenWorkspace workspace;
+        model.forwardWithGradient(sdf.data(), grad.data(), points_batch.data(), n, workspace);
+        float max_err = 0.0f, max_grad_err = 0.0f;
+        for (uint32_t i = 0; i < n; ++i)
+            max_err = std::max(max_err, std::fabs(sdf[i] - net_sdf[i]));
+        float max_grad = 0.0f;
+        for (uint32_t i = 0; i < INPUT_DIM * n; ++i) {
+            max_grad_err = std::max(max_grad_err, std::fabs(grad[i] - net_grad[i]));
+            max_grad = std::max(max_grad, std::fabs(net_grad[i]));
+        }
+        REQUIRE( max_err < 1e-5f );
+        // relative to the largest gradient component, measured up to 2.4e-6
+        REQUIRE( max_grad_err < 1e-5f * max_grad );
+
+        model.forward(sdf.data(), points_batch.data(), n, workspace);
+        for (uint32_t i = 0; i < n; ++i)
+            REQUIRE( std::fabs(sdf[i] - net_sdf[i]) < 1e-5f );
+    }
+}
+
+
+TEST_CASE( "quantized model stays close to fp32", "[siren_model]" )
+{
+    const std::vector<float> weights = load_floats("data/weights/sdf1_gt_weights.bin");
+    const auto [points, gt_sdf] = load_points("data/points/sdf1_test.bin");
+
+    const uint32_t batch_size = gt_sdf.size();
+    std::vector<float> points_batch = transpose(points, batch_size, 3);
+
+    const SirenModel ref(2, 64, weights);
+    std::vector<float> ref_sdf(batch_size);
+    ref.forward(ref_sdf.data(), points_batch.data(), batch_size);
+
+    // max abs error of the sdf and bytes of weights, relative to fp32
+    const std::pair<Precision, float> limits[] = {
+        {Precision::FP16, 1e-3f}, {Precision::BF16, 1e-2f}, {Precision::INT8, 2e-2f}
+    };
+    for (auto [precision, max_allowed]: limits) {
+        SirenModel model(2, 64, weights, 100);
+        model.quantize(precision, points_batch.data(), batch_size);
+        REQUIRE( model.getPrecision() == precision );
+        // fp16/bf16 only emulate the rounding over fp32 weights
+        if (precision == Precision::INT8)
+            REQUIRE( model.getWeightsBytes() < ref.getWeightsBytes() );
+        else
+            REQUIRE( model.getWeightsBytes() == ref.getWeightsBytes() );
+        REQUIRE_THROWS_AS( model.quantize(Precision::FP16), std::runtime_error );
+
+        std::vector<float> sdf(batch_size);
+        model.forward(sdf.data(), points_batch.data(), batch_size);
+        float max_err = 0.0f;
+        for (uint32_t i = 0; i < batch_size; ++i)
+            max_err = std::max(max_err, std::fabs(sdf[i] - ref_sdf[i]));
+        std::cout << "[Quantized model] " << precision_name(precision) << ": max abs sdf error = " << \
+            max_err << ", weights " << model.getWeightsBytes() << " bytes" << std::endl;
+        REQUIRE( max_err < max_allowed );
+
+        // small batches don't take the fp32 specialized kernels
+        const uint32_t n = 3;
+        std::vector<float> small(n), small_batch = transpose(
+            std::vector<float>(points.begin(), points.begin() + INPUT_DIM * n), n, INPUT_DIM);
+        model.forward(small.data(), small_batch.data(), n);
+        for (uint32_t i = 0; i < n; ++i)
+            REQUIRE( std::fabs(small[i] - sdf[i]) < 1e-5f );
+    }
+}
@@ -0,0 +1,111 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <stdexcept>
+
+#include "streaming_loader.h"
+#include "nsdf_file.h"
+#include "utils.h"
+
+
+using Sample = std::array<float, 4>;
+
+
+static std::vector<Sample> read_epoch(StreamingLoader &loader, uint32_t batch_size)
+{
+    std::vector<Sample> samples;
+    BatchWorkspace batch;
+    bool short_batch = false;
+    while (loader.nextBatch(batch)) {
+        // only the last batch of an epoch may be short
+        REQUIRE_FALSE( short_batch );
+        short_batch = batch.size < batch_size;
+        REQUIRE( batch.size > 0 );
+        REQUIRE( batch.size <= batch_size );
+        const uint32_t n = batch.size;
+        for (uint32_t i = 0; i < n; ++i)
+            samples.push_back({batch.points[i], batch.points[n + i], batch.points[2 * n + i], batch.sdf[i]});
+    }
+    return samples;
+}
+
+
+static std::vector<Sample> sorted(std::vector<Sample> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    return samples;
+}
+
+
+TEST_CASE( "streaming loader yields every sample once per epoch", "[streaming_loader]" )
+{
+    const std::string bin_path = "data/points/sdf1_test.bin";
+    const std::string nsdf_path = "streaming_test_samples.nsdf";
+    const auto [points, sdfs] = load_points(bin_path);
+    const uint32_t n = sdfs.size();
+
+    std::vector<float> points_soa = transpose(points, n, 3);
+    save_nsdf_samples(nsdf_path, points_soa.data(), sdfs.data(), n);
+
+    std::vector<Sample> expected;
+    for (uint32_t i = 0; i < n; ++i)
+        expected.push_back({points[3 * i], points[3 * i + 1], points[3 * i + 2], sdfs[i]});
+    expected = sorted(expected);
+
+    StreamingLoaderConfig config;
+    config.batch_size = 100;
+    config.chunk_size = 333;
+    config.shuffle_buffer_size = 1000;
+    config.seed = 3;
+
+    for (const std::string &path: {bin_path, nsdf_path}) {
+        StreamingLoader loader(path, config);
+        REQUIRE( loader.size() == n );
+
+        std::vector<Sample> first = read_epoch(loader, config.batch_size);
+        std::vector<Sample> second = read_epoch(loader, config.batch_size);
+        REQUIRE( first.size() == n );
+        REQUIRE( second.size() == n );
+        // epochs come in different orders
+        REQUIRE( first != second );
+        REQUIRE( sorted(first) == expected );
+        REQUIRE( sorted(second) == expected );
+
+        LoaderStats stats = loader.stats();
+        REQUIRE( stats.n_chunks >= 2 * ((n + config.chunk_size - 1) / config.chunk_size) );
+        REQUIRE( stats.bytes_read >= 2 * 4 * n * sizeof(float) );
+    }
+
+    std::remove(nsdf_path.c_str());
+}
+
+
+TEST_CASE( "streaming loader is deterministic for a seed", "[streaming_loader]" )
+{
+    StreamingLoaderConfig config;
+    config.batch_size = 64;
+    config.chunk_size = 256;
+    config.shuffle_buffer_size = 512;
+    config.seed = 11;
+
+    StreamingLoader a("data/points/sdf1_test.bin", config);
+    StreamingLoader b("data/points/sdf1_test.bin", config);
+    REQUIRE( read_epoch(a, config.batch_size) == read_epoch(b, config.batch_size) );
+
+    // a buffer smaller than a batch is refilled within the batch
+    config.shuffle_buffer_size = 50;
+    StreamingLoader small("data/points/sdf1_test.bin", config);
+    REQUIRE( sorted(read_epoch(small, config.batch_size)) == sorted(read_epoch(a, config.batch_size)) );
+}
+
+
+TEST_CASE( "streaming loader rejects bad input", "[streaming_loader]" )
+{
+    StreamingLoaderConfig config;
+    REQUIRE_THROWS_AS( StreamingLoader("no_such_file.bin", config), std::runtime_error );
+
+    config.batch_size = 0;
+    REQUIRE_THROWS_AS( StreamingLoader("data/points/sdf1_test.bin", config), std::runtime_error );
+}
@@ -0,0 +1,170 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <random>
+#include <tuple>
+#include <set>
+#include <chrono>
+#include <stdexcept>
+
+#include "siren.h"
+#include "gemm.h"
+#include "thread_pool.h"
+
+
+static std::vector<float> random_vector(int n, std::mt19937 &gen)
+{
+    std::uniform_real_distribution<float> dis(-1.0f, 1.0f);
+    std::vector<float> v(n);
+    for (auto &x: v)
+        x = dis(gen);
+    return v;
+}
+
+
+TEST_CASE( "thread pool runs every task exactly once", "[thread_pool]" )
+{
+    ThreadPool pool(4);
+    REQUIRE( pool.size() == 4 );
+
+    for (uint32_t n_tasks: {0u, 1u, 3u, 1000u}) {
+        std::vector<int> counts(n_tasks);
+        pool.run(n_tasks, [&](uint32_t task) {
+            // nested jobs run on the calling thread
+            pool.run(2, [&](uint32_t) { counts[task] += 1; });
+        });
+        REQUIRE( counts == std::vector<int>(n_tasks, 2) );
+    }
+}
+
+
+TEST_CASE( "thread pool rethrows a task's exception and keeps working", "[thread_pool]" )
+{
+    ThreadPool pool(4);
+    auto throw_at = [](uint32_t bad) {
+        return [bad](uint32_t task) {
+            if (task == bad)
+                throw std::runtime_error("task " + std::to_string(task));
+        };
+    };
+
+    // serial (nested) and parallel jobs
+    REQUIRE_THROWS_AS( pool.run(8, [&](uint32_t) { pool.run(2, throw_at(1)); }), std::runtime_error );
+    for (int i = 0; i < 10; ++i)
+        REQUIRE_THROWS_AS( pool.run(1000, throw_at(i * 100)), std::runtime_error );
+
+    // the calling thread isn't left marked as inside a task, so jobs still use the workers
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    pool.run(64, [&](uint32_t) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.insert(std::this_thread::get_id());
+    });
+    REQUIRE( threads.size() > 1 );
+}
+
+
+TEST_CASE( "ScopedNNThreads restores the previous setting", "[thread_pool]" )
+{
+    set_nn_threads(5);
+    {
+        const ScopedNNThreads threads(2);
+        REQUIRE( nn_threads() == 2 );
+    }
+    REQUIRE( nn_threads() == 5 );
+    set_nn_threads(0);
+}
+
+
+TEST_CASE( "parallel_for covers the range with aligned chunks", "[thread_pool]" )
+{
+    set_nn_threads(8);
+
+    const uint32_t n = 1000, align = 64;
+    std::vector<int> hits(n), chunk_starts(n);
+    parallel_for(n, 1, align, [&](uint32_t begin, uint32_t end) {
+        chunk_starts[begin] = 1;
+        for (uint32_t i = begin; i < end; ++i)
+            hits[i] += 1;
+    });
+    REQUIRE( hits == std::vector<int>(n, 1) );
+
+    int n_chunks = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        if (chunk_starts[i]) {
+            REQUIRE( i % align == 0 );
+            ++n_chunks;
+        }
+    }
+    REQUIRE( n_chunks > 1 );
+
+    set_nn_threads(0);
+}
+
+
+TEST_CASE( "gemm result doesn't depend on the number of threads", "[thread_pool]" )
+{
+    std::mt19937 gen(7);
+
+    // wide shapes are split by columns, tall ones by rows
+    const std::vector<std::tuple<int,int,int>> shapes = {
+        {64, 4096, 64}, {64, 64, 4096}, {3000, 70, 64}, {1, 4096, 64}
+    };
+
+    for (auto [m, n, k]: shapes) {
+        auto a = random_vector(m * k, gen);
+        auto b = random_vector(k * n, gen);
+        auto bias = random_vector(m, gen);
+
+        GemmEpilogue epilogue;
+        epilogue.bias = bias.data();
+
+        std::vector<float> c_single(m * n), act_single(m * n), c(m * n), act(m * n);
+
+        set_nn_threads(1);
+        epilogue.activation = act_single.data();
+        epilogue.ld_activation = n;
+        gemm(c_single.data(), n, MatrixView{a.data(), uint32_t(k), 1},
+            MatrixView{b.data(), uint32_t(n), 1}, m, n, k, epilogue);
+
+        set_nn_threads(7);
+        epilogue.activation = act.data();
+        gemm(c.data(), n, MatrixView{a.data(), uint32_t(k), 1},
+            MatrixView{b.data(), uint32_t(n), 1}, m, n, k, epilogue);
+
+        REQUIRE( c == c_single );
+        REQUIRE( act == act_single );
+    }
+
+    set_nn_threads(0);
+}
+
+
+TEST_CASE( "training step doesn't depend on the number of threads", "[thread_pool]" )
+{
+    std::mt19937 gen(11);
+    const int batch_size = 4096;
+    auto points = random_vector(batch_size * INPUT_DIM, gen);
+    auto gt = random_vector(batch_size * OUTPUT_DIM, gen);
+
+    auto run_step = [&](int n_threads) {
+        set_nn_threads(n_threads);
+        SirenNetwork net(2, 64, batch_size);
+        net.setWeights(std::vector<float>(net.getWeights().size(), 0.01f));
+
+        std::vector<float> preds(batch_size);
+        net.forward(preds.data(), points.data(), batch_size);
+        net.backward(gt.data());
+        auto grads = net.getWeightsGradients();
+        net.step(1e-3f);
+        return std::make_tuple(preds, grads, net.getWeights());
+    };
+
+    auto single = run_step(1);
+    auto multi = run_step(6);
+    REQUIRE( std::get<0>(multi) == std::get<0>(single) );
+    REQUIRE( std::get<1>(multi) == std::get<1>(single) );
+    REQUIRE( std::get<2>(multi) == std::get<2>(single) );
+
+    set_nn_threads(0);
+}
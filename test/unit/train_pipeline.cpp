@@ -0,0 +1,157 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "train_pipeline.h"
+#include "siren.h"
+#include "utils.h"
+
+
+TEST_CASE( "pipelined training matches the serial loop", "[train_pipeline]" )
+{
+    const auto [points, sdfs] = load_points("data/points/sdf1_test.bin");
+    PointDataset dataset(points, sdfs);
+    const uint32_t batch_size = 256, seed = 7, n_epochs = 3;
+    const float lr = 1e-4f;
+    const auto init = load_floats("data/weights/sdf1_gt_weights.bin");
+
+    SirenNetwork serial(2, 64, batch_size), pipelined(2, 64, batch_size);
+    serial.setWeights(init);
+    pipelined.setWeights(init);
+
+    // same batch order for both, the serial loop computes the loss from forward's output
+    std::vector<float> serial_losses;
+    {
+        BatchSource source = shuffled_batches(dataset, batch_size, seed);
+        BatchWorkspace batch;
+        std::vector<float> preds(batch_size);
+        for (uint32_t epoch = 0; epoch < n_epochs; ++epoch) {
+            float loss_sum = 0.0f;
+            uint32_t n_steps = 0;
+            while (source(batch)) {
+                serial.forward(preds.data(), batch.points.data(), batch.size);
+                loss_sum += mse_loss(preds.data(), batch.sdf.data(), batch.size);
+                serial.backward(batch.sdf.data());
+                serial.step(lr);
+                ++n_steps;
+            }
+            serial_losses.push_back(loss_sum / n_steps);
+        }
+    }
+
+    TrainPipelineConfig config;
+    config.lr = lr;
+    config.queue_depth = 3;
+    TrainPipeline pipeline(pipelined, shuffled_batches(dataset, batch_size, seed), config);
+    for (uint32_t epoch = 0; epoch < n_epochs; ++epoch)
+        REQUIRE( pipeline.runEpoch() == serial_losses[epoch] );
+    REQUIRE( pipelined.getWeights() == serial.getWeights() );
+
+    PipelineStats stats = pipeline.stats();
+    REQUIRE( stats.n_steps == n_epochs * dataset.numBatches(batch_size) );
+    REQUIRE( stats.max_queue_depth <= config.queue_depth );
+    REQUIRE( stats.meanQueueDepth() <= config.queue_depth );
+}
+
+
+TEST_CASE( "pipeline trains on views of the dataset reshuffled every epoch", "[train_pipeline]" )
+{
+    const auto [points, sdfs] = load_points("data/points/sdf1_test.bin");
+    // both loops shuffle their dataset in place
+    PointDataset serial_dataset(points, sdfs), dataset(points, sdfs);
+    const uint32_t batch_size = 300, seed = 11, n_epochs = 3;
+    const float lr = 1e-4f;
+    const auto init = load_floats("data/weights/sdf1_gt_weights.bin");
+
+    SirenNetwork serial(2, 64, batch_size), pipelined(2, 64, batch_size);
+    serial.setWeights(init);
+    pipelined.setWeights(init);
+
+    std::vector<float> serial_losses;
+    std::mt19937 gen(seed);
+    std::vector<float> preds(batch_size);
+    for (uint32_t epoch = 0; epoch < n_epochs; ++epoch) {
+        serial_dataset.shuffle(gen);
+        float loss_sum = 0.0f;
+        const uint32_t n_batches = serial_dataset.numBatches(batch_size);
+        for (uint32_t b = 0; b < n_batches; ++b) {
+            const PointBatch batch = serial_dataset.batch(b, batch_size);
+            serial.forward(preds.data(), batch.points, batch.size, batch.stride);
+            loss_sum += mse_loss(preds.data(), batch.sdf, batch.size);
+            serial.backward(batch.sdf);
+            serial.step(lr);
+        }
+        serial_losses.push_back(loss_sum / n_batches);
+    }
+
+    // a deep queue would reach into the next epoch if the pipeline didn't wait for it
+    TrainPipelineConfig config;
+    config.lr = lr;
+    config.queue_depth = 4;
+    TrainPipeline pipeline(pipelined, dataset_batches(dataset, batch_size, seed), config);
+    for (uint32_t epoch = 0; epoch < n_epochs; ++epoch)
+        REQUIRE( pipeline.runEpoch() == serial_losses[epoch] );
+    REQUIRE( pipelined.getWeights() == serial.getWeights() );
+}
+
+
+TEST_CASE( "micro-batches train like whole batches", "[train_pipeline]" )
+{
+    const auto [points, sdfs] = load_points("data/points/sdf1_test.bin");
+    PointDataset dataset(points, sdfs);
+    const uint32_t batch_size = 500, micro_batch_size = 128, seed = 3;
+    const auto init = load_floats("data/weights/sdf1_gt_weights.bin");
+
+    SirenNetwork whole(2, 64, batch_size), micro(2, 64, micro_batch_size);
+    whole.setWeights(init);
+    micro.setWeights(init);
+
+    TrainPipelineConfig config;
+    TrainPipeline whole_pipeline(whole, shuffled_batches(dataset, batch_size, seed), config);
+    config.micro_batch_size = micro_batch_size;
+    TrainPipeline micro_pipeline(micro, shuffled_batches(dataset, batch_size, seed), config);
+    for (int epoch = 0; epoch < 2; ++epoch)
+        REQUIRE( std::fabs(micro_pipeline.runEpoch() - whole_pipeline.runEpoch()) < 1e-5f );
+
+    const auto whole_weights = whole.getWeights(), micro_weights = micro.getWeights();
+    float max_err = 0.0f;
+    for (size_t i = 0; i < whole_weights.size(); ++i)
+        max_err = std::max(max_err, std::fabs(micro_weights[i] - whole_weights[i]));
+    REQUIRE( max_err < 1e-5f );
+
+    config.micro_batch_size = 2 * micro_batch_size;
+    REQUIRE_THROWS_AS( TrainPipeline(micro, shuffled_batches(dataset, batch_size, seed), config),
+        std::runtime_error );
+}
+
+
+TEST_CASE( "shuffled batches cover the dataset every epoch", "[train_pipeline]" )
+{
+    const auto [points, sdfs] = load_points("data/points/sdf1_test.bin");
+    PointDataset dataset(points, sdfs);
+    BatchSource source = shuffled_batches(dataset, 100, 1);
+
+    std::vector<float> first, second;
+    BatchWorkspace batch;
+    while (source(batch))
+        first.insert(first.end(), batch.sdf.begin(), batch.sdf.begin() + batch.size);
+    while (source(batch))
+        second.insert(second.end(), batch.sdf.begin(), batch.sdf.begin() + batch.size);
+
+    REQUIRE( first.size() == dataset.size() );
+    REQUIRE( first != second );
+    std::sort(first.begin(), first.end());
+    std::sort(second.begin(), second.end());
+    REQUIRE( first == second );
+}
+
+
+TEST_CASE( "batch source errors reach the training thread", "[train_pipeline]" )
+{
+    SirenNetwork net(2, 64, 16);
+    BatchSource failing = [](BatchWorkspace &) -> bool { throw std::runtime_error("read failed"); };
+    TrainPipeline pipeline(net, failing, TrainPipelineConfig{});
+    REQUIRE_THROWS_AS( pipeline.runEpoch(), std::runtime_error );
+}